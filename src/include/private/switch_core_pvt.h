@@ -103,6 +103,12 @@ typedef enum {
 	SSF_MEDIA_BUG_TAP_ONLY = (1 << 10)
 } switch_session_flag_t;
 
+/* immutable snapshot of session->bugs walked by the media path without bug_rwlock */
+typedef struct switch_media_bug_list {
+	uint32_t count;
+	switch_media_bug_t *bugs[1];
+} switch_media_bug_list_t;
+
 struct switch_core_session {
 	switch_memory_pool_t *pool;
 	switch_thread_t *thread;
@@ -153,6 +159,11 @@ struct switch_core_session {
 	switch_queue_t *private_event_queue_pri;
 	switch_thread_rwlock_t *bug_rwlock;
 	switch_media_bug_t *bugs;
+	switch_media_bug_list_t *bug_list;
+	/* readers of the snapshot are counted in the slot of the epoch they entered in */
+	switch_atomic_t bug_list_readers[2];
+	switch_atomic_t bug_list_epoch;
+	switch_mutex_t *bug_list_mutex;
 	switch_app_log_t *app_log;
 	uint32_t stack_count;
 
@@ -305,6 +316,8 @@ struct switch_runtime {
 	uint32_t port_alloc_flags;
 	char *event_channel_key_separator;
 	uint32_t max_audio_channels;
+	uint32_t record_writer_threads;
+	uint32_t record_writer_buffer_size;
 };
 
 extern struct switch_runtime runtime;
@@ -336,3 +349,13 @@ void switch_core_session_uninit(void);
 void switch_core_state_machine_init(switch_memory_pool_t *pool);
 switch_memory_pool_t *switch_core_memory_init(void);
 void switch_core_memory_stop(void);
+void switch_dns_cache_init(switch_memory_pool_t *pool);
+void switch_dns_cache_shutdown(void);
+switch_media_bug_list_t *switch_core_media_bug_list_enter(switch_core_session_t *session, uint32_t *slot);
+void switch_core_media_bug_list_leave(switch_core_session_t *session, uint32_t slot);
+void switch_ivr_record_writer_init(switch_memory_pool_t *pool);
+void switch_ivr_record_writer_shutdown(void);
+void switch_resample_bank_init(switch_memory_pool_t *pool);
+void switch_resample_bank_shutdown(void);
+void switch_frame_pool_init(switch_memory_pool_t *pool);
+void switch_frame_pool_shutdown(void);
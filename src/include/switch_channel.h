@@ -334,6 +334,25 @@ static inline int switch_channel_var_true(switch_channel_t *channel, const char
 	return switch_true(switch_channel_get_variable_dup(channel, variable, SWITCH_FALSE, -1));
 }
 
+/*!
+ * \brief Defer the creation of a group of channel variables until they are needed.
+ * \param channel the channel to set the variables on
+ * \param prefix every variable the resolver creates starts with this prefix
+ * \param resolver called once to set the variables, the first time one of them is read, written or listed
+ * \param release called once after the resolver ran or when the channel is destroyed, to free user_data
+ * \param user_data data passed to both callbacks
+ * \return SWITCH_STATUS_FALSE if the channel already has a pending resolver
+ */
+SWITCH_DECLARE(switch_status_t) switch_channel_set_variable_resolver(switch_channel_t *channel, const char *prefix,
+																	 switch_channel_variable_resolver_t resolver,
+																	 switch_channel_variable_release_t release, void *user_data);
+
+/*!
+ * \brief Run the pending variable resolver of a channel, if any.
+ * \param channel the channel to resolve the variables of
+ */
+SWITCH_DECLARE(void) switch_channel_resolve_variables(switch_channel_t *channel);
+
 /*!
  * \brief Start iterating over the entries in the channel variable list.
  * \param channel the channel to iterate the variables for
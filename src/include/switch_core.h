@@ -627,6 +627,14 @@ SWITCH_DECLARE(void) switch_core_memory_pool_tag(switch_memory_pool_t *pool, con
 
 SWITCH_DECLARE(void) switch_core_pool_stats(switch_stream_handle_t *stream);
 
+/*!
+  \brief Configure the cache of destroyed memory pools, normally set from <memory-pool-cache> in switch.conf
+  \param max the number of pools to keep, 0 disables the cache and frees what it holds
+  \param trim_kb the free blocks each cached pool keeps, in kilobytes
+  \param trim_interval how often, in seconds, the pools that were not needed are destroyed
+*/
+SWITCH_DECLARE(void) switch_core_memory_pool_cache_set(uint32_t max, uint32_t trim_kb, uint32_t trim_interval);
+
 SWITCH_DECLARE(switch_status_t) switch_core_perform_new_memory_pool(_Out_ switch_memory_pool_t **pool,
 																	_In_z_ const char *file, _In_z_ const char *func, _In_ int line);
 
@@ -53,6 +53,71 @@ SWITCH_DECLARE(void) switch_curl_destroy(void);
 SWITCH_DECLARE(switch_status_t) switch_curl_process_form_post_params(switch_event_t *event, switch_CURL *curl_handle, struct curl_httppost **formpostp);
 #define switch_curl_easy_setopt curl_easy_setopt
 
+/*
+ * Background HTTP poster: queued documents are POSTed from one thread over a curl multi
+ * handle, so connections are kept alive between posts and up to max_connections run at once.
+ * Failed posts are retried after delay seconds and handed to the spool callback once the
+ * retries run out.  On destroy the queue keeps being posted for up to drain_timeout seconds
+ * before the rest is spooled.  With synchronous set, push posts from the calling thread
+ * instead, so nothing is held only in memory.  Files named <id><spool_suffix> in the replay dir are posted again every
+ * replay_interval seconds and removed once they are accepted, so the suffix must be one only
+ * the spool callback writes, the replay dir may well be shared with other files.
+ */
+typedef struct switch_curl_poster_s switch_curl_poster_t;
+
+typedef enum {
+	SWITCH_CURL_POST_RAW,			/* the document is the body */
+	SWITCH_CURL_POST_FORM,			/* <form_field>=<document> */
+	SWITCH_CURL_POST_FORM_URLENCODE,	/* <form_field>=<url encoded document> */
+	SWITCH_CURL_POST_FORM_BASE64	/* <form_field>=<base64 document> */
+} switch_curl_post_encoding_t;
+
+/* called for each new transfer to apply credentials, tls options and the like */
+typedef void (*switch_curl_poster_setup_callback_t) (switch_CURL *curl_handle, void *user_data);
+/* called with a document that could not be delivered, name is what it was pushed as */
+typedef void (*switch_curl_poster_spool_callback_t) (const char *id, const char *name, const char *text, void *user_data);
+
+typedef struct {
+	const char *name;
+	char **urls;
+	int url_count;
+	/* query parameter that carries the document id, NULL to leave the url alone */
+	const char *id_param;
+	const char *user_agent;
+	const char *content_type;
+	const char *form_field;
+	switch_curl_post_encoding_t encoding;
+	/* with SWITCH_CURL_POST_FORM_URLENCODE also escape the % of sequences that look encoded already */
+	switch_bool_t double_encode;
+	uint32_t max_connections;
+	uint32_t queue_size;
+	/* documents per request, only used with SWITCH_CURL_POST_RAW */
+	uint32_t batch_max;
+	const char *batch_open;
+	const char *batch_separator;
+	const char *batch_close;
+	/* attempts per document and seconds between them */
+	uint32_t retries;
+	uint32_t delay;
+	long timeout;
+	long connect_timeout;
+	switch_bool_t disable_100_continue;
+	const char *spool_suffix;
+	uint32_t replay_interval;
+	/* seconds to keep posting the queue on destroy, 0 for the default */
+	uint32_t drain_timeout;
+	switch_bool_t synchronous;
+	switch_curl_poster_setup_callback_t setup;
+	switch_curl_poster_spool_callback_t spool;
+	void *user_data;
+} switch_curl_poster_settings_t;
+
+SWITCH_DECLARE(switch_status_t) switch_curl_poster_create(switch_curl_poster_t **posterP, const switch_curl_poster_settings_t *settings);
+SWITCH_DECLARE(switch_status_t) switch_curl_poster_push(switch_curl_poster_t *poster, const char *id, const char *name, const char *text);
+SWITCH_DECLARE(void) switch_curl_poster_set_replay_dir(switch_curl_poster_t *poster, const char *dir);
+SWITCH_DECLARE(void) switch_curl_poster_stats(switch_curl_poster_t *poster, switch_stream_handle_t *stream);
+SWITCH_DECLARE(void) switch_curl_poster_destroy(switch_curl_poster_t **posterP);
+
 SWITCH_END_EXTERN_C
 
 #endif
@@ -94,6 +94,16 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_activate_unicast(switch_core_session_
 */
 SWITCH_DECLARE(switch_status_t) switch_ivr_generate_json_cdr(switch_core_session_t *session, cJSON **json_cdr, switch_bool_t urlencode);
 
+/*!
+  \brief Generate a JSON CDR report as text without building the json object.
+  \param session the session to get the data from.
+  \param json_text pointer to the text, the same as cJSON_PrintUnformatted() of the object from switch_ivr_generate_json_cdr()
+  \param urlencode url encode the variable values
+  \return SWITCH_STATUS_SUCCESS if successful
+  \note on success the text must be freed
+*/
+SWITCH_DECLARE(switch_status_t) switch_ivr_generate_json_cdr_text(switch_core_session_t *session, char **json_text, switch_bool_t urlencode);
+
 /*!
   \brief Generate an XML CDR report.
   \param session the session to get the data from.
@@ -102,6 +112,16 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_generate_json_cdr(switch_core_session
   \note on success the xml object must be freed
 */
 SWITCH_DECLARE(switch_status_t) switch_ivr_generate_xml_cdr(switch_core_session_t *session, switch_xml_t *xml_cdr);
+
+/*!
+  \brief Generate an XML CDR report as text without building the xml tree.
+  \param session the session to get the data from.
+  \param xml_text pointer to the text, the same as switch_xml_toxml() of the tree from switch_ivr_generate_xml_cdr()
+  \param prn_header add <?xml version..> header too
+  \return SWITCH_STATUS_SUCCESS if successful
+  \note on success the text must be freed
+*/
+SWITCH_DECLARE(switch_status_t) switch_ivr_generate_xml_cdr_text(switch_core_session_t *session, char **xml_text, switch_bool_t prn_header);
 SWITCH_DECLARE(int) switch_ivr_set_xml_profile_data(switch_xml_t xml, switch_caller_profile_t *caller_profile, int off);
 SWITCH_DECLARE(int) switch_ivr_set_xml_chan_vars(switch_xml_t xml, switch_channel_t *channel, int off);
 
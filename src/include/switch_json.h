@@ -46,6 +46,33 @@ extern "C"
 SWITCH_DECLARE(cJSON *) cJSON_CreateStringPrintf(const char *fmt, ...);
 SWITCH_DECLARE(const char *)cJSON_GetObjectCstr(const cJSON *object, const char *string);
 
+/* Writes compact json straight into a growing buffer, the text is the same as
+   cJSON_PrintUnformatted() of the equivalent object. */
+typedef struct {
+	char *buf;
+	switch_size_t len;
+	switch_size_t max;
+	cJSON_bool need_comma;
+} switch_json_writer_t;
+
+SWITCH_DECLARE(void) switch_json_writer_init(switch_json_writer_t *writer, switch_size_t size);
+/* opens an object ('{') or array ('['), key is NULL for array items and the top level */
+SWITCH_DECLARE(void) switch_json_writer_begin(switch_json_writer_t *writer, const char *key, char c);
+SWITCH_DECLARE(void) switch_json_writer_end(switch_json_writer_t *writer, char c);
+/* a NULL value is left out, as cJSON_CreateString(NULL) would be */
+SWITCH_DECLARE(void) switch_json_writer_string(switch_json_writer_t *writer, const char *key, const char *value);
+SWITCH_DECLARE(void) switch_json_writer_number(switch_json_writer_t *writer, const char *key, double d);
+SWITCH_DECLARE(char *) switch_json_writer_finish(switch_json_writer_t *writer);
+SWITCH_DECLARE(void) switch_json_writer_destroy(switch_json_writer_t *writer);
+
+/* Called for each string member of a top level object, and for each string item of
+   an array member with array_item set. Other values are validated and skipped. */
+typedef void (*switch_json_member_callback_t)(const char *name, const char *value, cJSON_bool array_item, void *user_data);
+
+/* Parses json in one pass without building a tree, accepting what cJSON_Parse() does.
+   Returns false on invalid json, callbacks may have been made by then. */
+SWITCH_DECLARE(cJSON_bool) switch_json_parse_members(const char *json, switch_json_member_callback_t callback, void *user_data);
+
 static inline cJSON *json_add_child_obj(cJSON *json, const char *name, cJSON *obj)
 {
 	cJSON *new_json = NULL;
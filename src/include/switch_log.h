@@ -184,6 +184,12 @@ SWITCH_DECLARE(uint32_t) switch_log_str2mask(_In_z_ const char *str);
 SWITCH_DECLARE(switch_log_node_t *) switch_log_node_dup(const switch_log_node_t *node);
 SWITCH_DECLARE(void) switch_log_node_free(switch_log_node_t **pnode);
 
+/*!
+  \brief Count of log lines thrown away because the logger thread fell behind
+  \return the number of lines dropped since startup
+*/
+SWITCH_DECLARE(uint32_t) switch_log_get_dropped(void);
+
 ///\}
 SWITCH_END_EXTERN_C
 #endif
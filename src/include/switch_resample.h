@@ -70,9 +70,38 @@ SWITCH_BEGIN_EXTERN_C
 	uint32_t to_size;
 	/*! the number of channels */
 	int channels;
+	/*! the core polyphase state when a shared filter bank is used instead of speex */
+	void *polyphase;
 
 } switch_audio_resampler_t;
 
+/*! \brief Resampler quality tiers, each tier shares one set of filter banks between all of its resamplers */
+typedef enum {
+	/*! the speex resampler at SWITCH_RESAMPLE_QUALITY */
+	SWITCH_RESAMPLE_TIER_SPEEX = 0,
+	/*! short filters for mixing many legs, lowest cpu */
+	SWITCH_RESAMPLE_TIER_CONFERENCE,
+	/*! flat passband up to the edge for speech recognition */
+	SWITCH_RESAMPLE_TIER_ASR,
+	/*! long filters with deep stopband for files and recordings */
+	SWITCH_RESAMPLE_TIER_RECORDING
+} switch_resample_tier_t;
+
+typedef enum {
+	/*! speex for every resampler, the default */
+	SWITCH_RESAMPLE_ENGINE_SPEEX = 0,
+	/*! shared polyphase banks for the callers that ask for a tier, speex for the rest */
+	SWITCH_RESAMPLE_ENGINE_TIERED,
+	/*! shared polyphase banks for every resampler */
+	SWITCH_RESAMPLE_ENGINE_POLYPHASE
+} switch_resample_engine_t;
+
+/*!
+  \brief Choose the engine new resamplers are built with, existing handles keep theirs
+  \param engine the engine
+ */
+SWITCH_DECLARE(void) switch_resample_set_engine(switch_resample_engine_t engine);
+
 /*!
   \brief Prepare a new resampler handle
   \param new_resampler NULL pointer to aim at the new handle
@@ -80,6 +109,7 @@ SWITCH_BEGIN_EXTERN_C
   \param to_rate the rate to transfer to in hz
   \param quality the quality desired
   \return SWITCH_STATUS_SUCCESS if the handle was created
+  \note this is a speex resampler unless the engine is SWITCH_RESAMPLE_ENGINE_POLYPHASE
  */
 SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
 															   uint32_t from_rate, uint32_t to_rate, uint32_t to_size,
@@ -88,6 +118,30 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 
 #define switch_resample_create(_n, _fr, _tr, _ts, _q, _c) switch_resample_perform_create(_n, _fr, _tr, _ts, _q, _c, __FILE__, __SWITCH_FUNC__, __LINE__)
 
+/*!
+  \brief Prepare a new resampler handle for a quality tier
+  \param new_resampler NULL pointer to aim at the new handle
+  \param from_rate the rate to transfer from in hz
+  \param to_rate the rate to transfer to in hz
+  \param to_size the expected number of input samples per call
+  \param tier the quality tier, ratios without a shared filter bank fall back to speex
+  \note the tier is only honoured once switch_resample_set_engine() has moved off SWITCH_RESAMPLE_ENGINE_SPEEX
+  \param channels the number of interleaved channels
+  \return SWITCH_STATUS_SUCCESS if the handle was created
+ */
+SWITCH_DECLARE(switch_status_t) switch_resample_perform_create_tier(switch_audio_resampler_t **new_resampler,
+																	uint32_t from_rate, uint32_t to_rate, uint32_t to_size,
+																	switch_resample_tier_t tier, uint32_t channels, const char *file, const char *func, int line);
+
+#define switch_resample_create_tier(_n, _fr, _tr, _ts, _t, _c) switch_resample_perform_create_tier(_n, _fr, _tr, _ts, _t, _c, __FILE__, __SWITCH_FUNC__, __LINE__)
+
+/*!
+  \brief Get the printable name of the engine behind a resampler handle
+  \param resampler the resampler handle
+  \return the name
+ */
+SWITCH_DECLARE(const char *) switch_resample_engine_name(switch_audio_resampler_t *resampler);
+
 /*!
   \brief Destroy an existing resampler handle
   \param resampler the resampler handle to destroy
@@ -147,6 +201,66 @@ SWITCH_DECLARE(int) switch_short_to_float(short *s, float *f, int len);
  */
 SWITCH_DECLARE(void) switch_swap_linear(int16_t *buf, int len);
 
+/*!
+  \brief Encode an array of signed linear samples to G.711 u-law
+  \param data the signed linear samples
+  \param out the u-law output buffer (samples bytes)
+  \param samples the number of samples
+ */
+SWITCH_DECLARE(void) switch_sln_to_ulaw(const int16_t *data, uint8_t *out, uint32_t samples);
+
+/*!
+  \brief Decode an array of G.711 u-law samples to signed linear
+  \param data the u-law samples
+  \param out the signed linear output buffer (samples 2 byte samples)
+  \param samples the number of samples
+ */
+SWITCH_DECLARE(void) switch_ulaw_to_sln(const uint8_t *data, int16_t *out, uint32_t samples);
+
+/*!
+  \brief Encode an array of signed linear samples to G.711 A-law
+  \param data the signed linear samples
+  \param out the A-law output buffer (samples bytes)
+  \param samples the number of samples
+ */
+SWITCH_DECLARE(void) switch_sln_to_alaw(const int16_t *data, uint8_t *out, uint32_t samples);
+
+/*!
+  \brief Decode an array of G.711 A-law samples to signed linear
+  \param data the A-law samples
+  \param out the signed linear output buffer (samples 2 byte samples)
+  \param samples the number of samples
+ */
+SWITCH_DECLARE(void) switch_alaw_to_sln(const uint8_t *data, int16_t *out, uint32_t samples);
+
+/*! \brief Instruction sets the PCM helpers can run on */
+typedef enum {
+	SWITCH_SIMD_NONE = 0,
+	SWITCH_SIMD_SSE2,
+	SWITCH_SIMD_AVX2,
+	SWITCH_SIMD_NEON
+} switch_simd_level_t;
+
+/*!
+  \brief Get the instruction set the PCM helpers are currently using
+  \return the active level, detected from the cpu on first use
+ */
+SWITCH_DECLARE(switch_simd_level_t) switch_pcm_simd_level(void);
+
+/*!
+  \brief Limit the PCM helpers to an instruction set
+  \param level the highest level to use, SWITCH_SIMD_NONE forces the scalar code
+  \return the level actually in use, never more than the cpu supports
+ */
+SWITCH_DECLARE(switch_simd_level_t) switch_pcm_simd_set_level(switch_simd_level_t level);
+
+/*!
+  \brief Get the printable name of an instruction set level
+  \param level the level
+  \return the name
+ */
+SWITCH_DECLARE(const char *) switch_pcm_simd_name(switch_simd_level_t level);
+
 /*!
   \brief Generate static noise
   \param data the audio data buffer
@@ -1666,6 +1666,7 @@ SFF_RFC2833    = (1 <<  4) - Frame has rfc2833 dtmf data
 SFF_DYNAMIC    = (1 <<  5) - Frame is dynamic and should be freed
 SFF_MARKER     = (1 << 11) - Frame flag has Marker set, only set by encoder
 SFF_WAIT_KEY_FRAME = (1 << 12) - Need a key from before could decode, or force generate a key frame on encode
+SFF_POOLED     = (1 << 21) - Frame came from the core frame pool (switch_frame_alloc/switch_frame_dup)
 </pre>
  */
 typedef enum {
@@ -1690,7 +1691,8 @@ typedef enum {
 	SFF_ENCODED = (1 << 17),
 	SFF_TEXT_LINE_BREAK = (1 << 18),
 	SFF_IS_KEYFRAME = (1 << 19),
-	SFF_EXTERNAL = (1 << 20)
+	SFF_EXTERNAL = (1 << 20),
+	SFF_POOLED = (1 << 21)
 } switch_frame_flag_enum_t;
 typedef uint32_t switch_frame_flag_t;
 
@@ -2380,6 +2382,8 @@ typedef void (*switch_media_bug_exec_cb_t)(switch_media_bug_t *bug, void *user_d
 typedef switch_status_t (*switch_core_video_thread_callback_func_t) (switch_core_session_t *session, switch_frame_t *frame, void *user_data);
 typedef switch_status_t (*switch_core_text_thread_callback_func_t) (switch_core_session_t *session, switch_frame_t *frame, void *user_data);
 typedef void (*switch_cap_callback_t) (const char *var, const char *val, void *user_data);
+typedef void (*switch_channel_variable_resolver_t) (switch_channel_t *channel, void *user_data);
+typedef void (*switch_channel_variable_release_t) (void *user_data);
 typedef switch_status_t (*switch_console_complete_callback_t) (const char *, const char *, switch_console_callback_match_t **matches);
 typedef switch_bool_t (*switch_media_bug_callback_t) (switch_media_bug_t *, void *, switch_abc_type_t);
 typedef switch_bool_t (*switch_tone_detect_callback_t) (switch_core_session_t *, const char *, const char *);
@@ -498,6 +498,28 @@ SWITCH_DECLARE(switch_size_t) switch_fp_read_dline(FILE *fd, char **buf, switch_
 SWITCH_DECLARE(switch_status_t) switch_frame_alloc(switch_frame_t **frame, switch_size_t size);
 SWITCH_DECLARE(switch_status_t) switch_frame_dup(switch_frame_t *orig, switch_frame_t **clone);
 SWITCH_DECLARE(switch_status_t) switch_frame_free(switch_frame_t **frame);
+
+/*! \brief Usage of one size class of the shared frame cache */
+typedef struct switch_frame_pool_stats_s {
+	/*! block size in bytes, the first class holds the frame headers */
+	switch_size_t size;
+	/*! blocks currently obtained from malloc, in use or cached */
+	uint32_t allocated;
+	/*! blocks currently handed out */
+	uint32_t in_use;
+	/*! largest in_use seen since startup */
+	uint32_t high_water;
+	/*! blocks parked in the shared depot */
+	uint32_t cached;
+} switch_frame_pool_stats_t;
+
+/*!
+  \brief Fetch the usage of the frame cache behind switch_frame_alloc, switch_frame_dup and the frame buffers
+  \param stats array to fill
+  \param max number of entries in stats
+  \return the number of size classes filled in
+*/
+SWITCH_DECLARE(int) switch_frame_pool_stats(switch_frame_pool_stats_t *stats, int max);
 SWITCH_DECLARE(switch_bool_t) switch_is_number(const char *str);
 SWITCH_DECLARE(switch_bool_t) switch_is_leading_number(const char *str);
 SWITCH_DECLARE(char *) switch_find_parameter(const char *str, const char *param, switch_memory_pool_t *pool);
@@ -553,6 +575,52 @@ static inline int switch_false(const char *expr)
 
 
 SWITCH_DECLARE(switch_status_t) switch_resolve_host(const char *host, char *buf, size_t buflen);
+/*!
+  \brief resolve a host name to an address string through the core lookup cache
+  \param host the name to resolve
+  \param family AF_INET, AF_INET6 or AF_UNSPEC for any
+  \param buf buffer for the address
+  \param buflen size of buf
+  \return SWITCH_STATUS_SUCCESS when the name resolved
+*/
+SWITCH_DECLARE(switch_status_t) switch_resolve_host_family(const char *host, int family, char *buf, size_t buflen);
+/*!
+  \brief configure the host lookup cache used by switch_resolve_host()
+  \param ttl seconds to keep an answer, 0 disables the cache
+  \param negative_ttl seconds to remember a name that did not resolve
+  \param stale_ttl seconds an expired answer is still served while it is looked up again in the background
+  \param max_entries names to keep, 0 for no limit
+*/
+SWITCH_DECLARE(void) switch_dns_cache_set(uint32_t ttl, uint32_t negative_ttl, uint32_t stale_ttl, uint32_t max_entries);
+/*!
+  \brief drop cached lookups
+  \param host only drop this name, NULL for all
+  \return the number of entries removed
+*/
+SWITCH_DECLARE(uint32_t) switch_dns_cache_flush(const char *host);
+SWITCH_DECLARE(void) switch_dns_cache_stats(switch_stream_handle_t *stream);
+/*!
+  \brief look up a DNS record a module resolved itself (NAPTR, SRV, ...) in the core lookup cache
+  \param type record type, used as part of the key
+  \param name the name that was queried
+  \param answer set to a malloc'd copy of the cached answer, free it with free()
+  \return SWITCH_STATUS_SUCCESS on a hit, SWITCH_STATUS_NOTFOUND for a name known to have no records, otherwise SWITCH_STATUS_FALSE
+*/
+SWITCH_DECLARE(switch_status_t) switch_dns_cache_get_record(const char *type, const char *name, char **answer);
+/*!
+  \brief keep a DNS answer a module resolved itself in the core lookup cache
+  \param type record type, used as part of the key
+  \param name the name that was queried
+  \param answer the answer as text, NULL when the name has no records
+  \param ttl the record TTL, never kept longer than the cache ttl
+  \param usec how long the lookup took
+*/
+SWITCH_DECLARE(void) switch_dns_cache_put_record(const char *type, const char *name, const char *answer, uint32_t ttl, switch_time_t usec);
+typedef switch_status_t (*switch_dns_resolver_func_t) (const char *host, int family, char *buf, size_t buflen);
+/*!
+  \brief replace getaddrinfo() behind switch_resolve_host(), NULL puts it back
+*/
+SWITCH_DECLARE(void) switch_dns_cache_set_resolver(switch_dns_resolver_func_t resolver);
 
 
 /*!
@@ -237,6 +237,39 @@ SWITCH_DECLARE(char *) switch_xml_tohtml_ex(_In_ switch_xml_t xml, _In_ switch_b
 SWITCH_DECLARE(char *) switch_xml_toxml_buf_ex(_In_ switch_xml_t xml, _In_z_ char *buf, _In_ switch_size_t buflen, _In_ switch_size_t offset,
 											_In_ switch_bool_t prn_header, switch_bool_t use_utf8_encoding);
 
+///\brief Writes xml text directly into a growing buffer without building a tree.
+///\ The output is the same as switch_xml_toxml_ex() would give for the equivalent
+///\ tree where every tag has character content or children.
+typedef struct {
+	char *buf;
+	switch_size_t len;
+	switch_size_t max;
+	uint32_t depth;
+	switch_bool_t tag_open;
+	switch_bool_t use_utf8_encoding;
+} switch_xml_writer_t;
+
+///\brief Starts a new document
+///\param writer the writer
+///\param size initial buffer size hint
+///\param prn_header add <?xml version..> header too
+///\param use_utf8_encoding encoding into ampersand entities for UTF-8 chars
+SWITCH_DECLARE(void) switch_xml_writer_init(switch_xml_writer_t *writer, switch_size_t size, switch_bool_t prn_header, switch_bool_t use_utf8_encoding);
+///\brief Opens a tag, attributes may follow until the next text, tag or close
+SWITCH_DECLARE(void) switch_xml_writer_open(switch_xml_writer_t *writer, const char *name);
+///\brief Adds an attribute to the tag just opened, a NULL value is written empty
+SWITCH_DECLARE(void) switch_xml_writer_attr(switch_xml_writer_t *writer, const char *name, const char *value);
+///\brief Adds character content to the current tag
+SWITCH_DECLARE(void) switch_xml_writer_text(switch_xml_writer_t *writer, const char *txt);
+///\brief Closes the current tag, name must match the one passed to switch_xml_writer_open()
+SWITCH_DECLARE(void) switch_xml_writer_close(switch_xml_writer_t *writer, const char *name);
+///\brief Writes a <name>txt</name> element
+SWITCH_DECLARE(void) switch_xml_writer_element(switch_xml_writer_t *writer, const char *name, const char *txt);
+///\brief Returns the xml text, which must be freed, and resets the writer
+SWITCH_DECLARE(char *) switch_xml_writer_finish(switch_xml_writer_t *writer);
+///\brief Releases the buffer of an unfinished writer
+SWITCH_DECLARE(void) switch_xml_writer_destroy(switch_xml_writer_t *writer);
+
 
 ///\brief returns a NULL terminated array of processing instructions for the given
 ///\ target
@@ -399,6 +432,20 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user_in_domain(_In_z_ const ch
 SWITCH_DECLARE(switch_status_t) switch_xml_locate_user_merged(const char *key, const char *user_name, const char *domain_name,
 															  const char *ip, switch_xml_t *user, switch_event_t *params);
 SWITCH_DECLARE(uint32_t) switch_xml_clear_user_cache(const char *key, const char *user_name, const char *domain_name);
+
+///\brief cache the answers of the search bindings for a section
+///\param section the section name e.g. directory
+///\param ttl seconds to keep an answer, 0 to not cache answers
+///\param negative_ttl seconds to remember that every binding said "not found", 0 to not cache those
+///\param key_template optional string expanded against the request params and added to the cache key
+///\return SWITCH_STATUS_SUCCESS on success
+SWITCH_DECLARE(switch_status_t) switch_xml_binding_cache_set(const char *section, uint32_t ttl, uint32_t negative_ttl, const char *key_template);
+SWITCH_DECLARE(void) switch_xml_binding_cache_set_max(uint32_t max_entries);
+///\brief drop cached binding answers
+///\param section only flush this section, NULL for all
+///\param key only flush entries with this tag, key, value or expanded template, NULL for all
+///\return the number of entries removed
+SWITCH_DECLARE(uint32_t) switch_xml_binding_cache_flush(const char *section, const char *key);
 SWITCH_DECLARE(void) switch_xml_merge_user(switch_xml_t user, switch_xml_t domain, switch_xml_t group);
 
 SWITCH_DECLARE(switch_xml_t) switch_xml_dup(switch_xml_t xml);
@@ -739,6 +739,30 @@ SWITCH_STANDARD_API(host_lookup_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define DNS_CACHE_SYNTAX "[flush [<hostname>]]"
+SWITCH_STANDARD_API(dns_cache_function)
+{
+	char *mycmd = NULL, *argv[2] = { 0 };
+	int argc = 0;
+
+	if (!zstr(cmd) && (mycmd = strdup(cmd))) {
+		argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if (argc == 0) {
+		switch_dns_cache_stats(stream);
+	} else if (!strcasecmp(argv[0], "flush")) {
+		uint32_t r = switch_dns_cache_flush(argv[1]);
+
+		stream->write_function(stream, "+OK cleared %u entr%s\n", r, r == 1 ? "y" : "ies");
+	} else {
+		stream->write_function(stream, "-USAGE: %s\n", DNS_CACHE_SYNTAX);
+	}
+
+	switch_safe_free(mycmd);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(nat_map_function)
 {
 	int argc;
@@ -6680,6 +6704,24 @@ SWITCH_STANDARD_API(xml_flush_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_STANDARD_API(xml_binding_cache_flush_function)
+{
+	char *mycmd = NULL, *argv[2] = { 0 };
+	int argc = 0;
+	uint32_t r;
+
+	if (!zstr(cmd) && (mycmd = strdup(cmd))) {
+		argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	r = switch_xml_binding_cache_flush(argc > 0 ? argv[0] : NULL, argc > 1 ? argv[1] : NULL);
+
+	stream->write_function(stream, "+OK cleared %u entr%s\n", r, r == 1 ? "y" : "ies");
+
+	switch_safe_free(mycmd);
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(escape_function)
 {
 	int len;
@@ -7536,6 +7578,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "group_call", "Generate a dial string to call a group", group_call_function, "<group>[@<domain>]");
 	SWITCH_ADD_API(commands_api_interface, "help", "Show help for all the api commands", help_function, "");
 	SWITCH_ADD_API(commands_api_interface, "host_lookup", "Lookup host", host_lookup_function, "<hostname>");
+	SWITCH_ADD_API(commands_api_interface, "dns_cache", "Show or flush the host lookup cache", dns_cache_function, DNS_CACHE_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "hostname", "Return the system hostname", hostname_api_function, "");
 	SWITCH_ADD_API(commands_api_interface, "interface_ip", "Return the primary IP of an interface", interface_ip_function, INTERFACE_IP_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "switchname", "Return the switch name", switchname_api_function, "");
@@ -7647,6 +7690,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "uuid_zombie_exec", "Set zombie_exec flag on the specified uuid", uuid_zombie_exec_function, "<uuid>");
 	SWITCH_ADD_API(commands_api_interface, "uuid_xfer_zombie", "Allow A leg to hangup and continue originating", uuid_xfer_zombie, XFER_ZOMBIE_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "xml_flush_cache", "Clear xml cache", xml_flush_function, "<id> <key> <val>");
+	SWITCH_ADD_API(commands_api_interface, "xml_binding_cache_flush", "Clear cached xml binding answers", xml_binding_cache_flush_function, "[<section> [<value>]]");
 	SWITCH_ADD_API(commands_api_interface, "xml_locate", "Find some xml", xml_locate_function, "[root | <section> <tag> <tag_attr_name> <tag_attr_val>]");
 	SWITCH_ADD_API(commands_api_interface, "xml_wrap", "Wrap another api command in xml", xml_wrap_api_function, "<command> <args>");
 	SWITCH_ADD_API(commands_api_interface, "file_exists", "Check if a file exists on server", file_exists_function, "<file>");
@@ -1779,9 +1779,9 @@ int conference_member_setup_media(conference_member_t *member, conference_obj_t
 	}
 
 	if (read_impl.actual_samples_per_second != conference->rate) {
-		if (switch_resample_create(&member->read_resampler,
-								   read_impl.actual_samples_per_second,
-								   conference->rate, member->frame_size, SWITCH_RESAMPLE_QUALITY, read_impl.number_of_channels) != SWITCH_STATUS_SUCCESS) {
+		if (switch_resample_create_tier(&member->read_resampler,
+										read_impl.actual_samples_per_second,
+										conference->rate, member->frame_size, SWITCH_RESAMPLE_TIER_CONFERENCE, read_impl.number_of_channels) != SWITCH_STATUS_SUCCESS) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Unable to create resampler!\n");
 			goto done;
 		}
@@ -297,9 +297,9 @@ static ldns_rdf *ldns_rdf_new_addr_frm_str(const char *str)
 
 #define strip_quotes(_s) if (*_s == '"') _s++; if (end_of(_s) == '"') end_of(_s) = '\0'
 
-static void parse_naptr(const ldns_rr *naptr, const char *number, enum_record_t **results)
+/* parses one NAPTR record in ldns_rr2str() form, takes ownership of the malloc'd str */
+static void parse_naptr_str(char *str, const char *number, enum_record_t **results)
 {
-	char *str = ldns_rr2str(naptr);
 	char *argv[11] = { 0 };
 	int i, argc;
 	char *pack[4] = { 0 };
@@ -455,6 +455,35 @@ static void parse_naptr(const ldns_rr *naptr, const char *number, enum_record_t
 	return;
 }
 
+static void parse_naptr(const ldns_rr *naptr, const char *number, enum_record_t **results)
+{
+	parse_naptr_str(ldns_rr2str(naptr), number, results);
+}
+
+/* the records in a cached answer are the ldns_rr2str() lines of the original one */
+static void parse_naptr_cached(const char *answer, const char *number, enum_record_t **results)
+{
+	const char *p = answer, *e;
+
+	while (p && *p) {
+		size_t len;
+		char *str;
+
+		if (!(e = strchr(p, '\n'))) {
+			e = p + strlen(p);
+		}
+
+		if ((len = e - p)) {
+			switch_malloc(str, len + 1);
+			memcpy(str, p, len);
+			str[len] = '\0';
+			parse_naptr_str(str, number, results);
+		}
+
+		p = *e ? e + 1 : e;
+	}
+}
+
 switch_status_t ldns_lookup(const char *number, const char *root, char *server_name[ENUM_MAXNAMESERVERS] , enum_record_t **results)
 {
 	ldns_resolver *res = NULL;
@@ -468,12 +497,26 @@ switch_status_t ldns_lookup(const char *number, const char *root, char *server_n
 	struct timeval to = { 0, 0};
 	int inameserver = 0;
 	int added_server = 0;
+	char *cached = NULL;
+	switch_time_t started;
 
 	if (!(name = reverse_number(number, root))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Parse Error!\n");
 		goto end;
 	}
 
+	switch (switch_dns_cache_get_record("naptr", name, &cached)) {
+	case SWITCH_STATUS_SUCCESS:
+		parse_naptr_cached(cached, number, results);
+		switch_safe_free(cached);
+		status = SWITCH_STATUS_SUCCESS;
+		goto end;
+	case SWITCH_STATUS_NOTFOUND:
+		goto end;
+	default:
+		break;
+	}
+
 	if (!(domain = ldns_dname_new_frm_str(name))) {
 		goto end;
 	}
@@ -513,6 +556,8 @@ switch_status_t ldns_lookup(const char *number, const char *root, char *server_n
 	ldns_resolver_set_retry(res, (uint8_t)globals.retries);
 	ldns_resolver_set_random(res, globals.random);
 
+	started = switch_time_now();
+
 	if ((p = ldns_resolver_query(res,
 								 domain,
 								 LDNS_RR_TYPE_NAPTR,
@@ -523,17 +568,38 @@ switch_status_t ldns_lookup(const char *number, const char *root, char *server_n
 		 */
 
 		if ((naptr = ldns_pkt_rr_list_by_type(p, LDNS_RR_TYPE_NAPTR, LDNS_SECTION_ANSWER))) {
+			switch_stream_handle_t stream = { 0 };
+			uint32_t ttl = 0;
 			size_t i;
 
+			SWITCH_STANDARD_STREAM(stream);
 			ldns_rr_list_sort(naptr);
 
 			for (i = 0; i < ldns_rr_list_rr_count(naptr); i++) {
-				parse_naptr(ldns_rr_list_rr(naptr, i), number, results);
+				ldns_rr *rr = ldns_rr_list_rr(naptr, i);
+				char *str;
+
+				if ((str = ldns_rr2str(rr))) {
+					stream.write_function(&stream, "%s%s", str, end_of(str) == '\n' ? "" : "\n");
+					free(str);
+				}
+
+				if (!i || ldns_rr_ttl(rr) < ttl) {
+					ttl = ldns_rr_ttl(rr);
+				}
+
+				parse_naptr(rr, number, results);
 			}
 
+			/* kept for the shortest TTL in the answer */
+			switch_dns_cache_put_record("naptr", name, (char *) stream.data, ttl, switch_time_now() - started);
+			switch_safe_free(stream.data);
+
 			//ldns_rr_list_print(stdout, naptr);
 			ldns_rr_list_deep_free(naptr);
 			status = SWITCH_STATUS_SUCCESS;
+		} else if (ldns_pkt_get_rcode(p) == LDNS_RCODE_NOERROR || ldns_pkt_get_rcode(p) == LDNS_RCODE_NXDOMAIN) {
+			switch_dns_cache_put_record("naptr", name, NULL, 0, switch_time_now() - started);
 		}
 	}
 
@@ -40,6 +40,7 @@
 /*************************************************************************************************************************************************************/
 #include "mod_sofia.h"
 #include "sofia-sip/sip_extra.h"
+#include "sofia-resolv/sres_cache.h"
 
 #if HAVE_STIRSHAKEN
 #include <stir_shaken.h>
@@ -2732,7 +2733,7 @@ static switch_status_t sofia_receive_event(switch_core_session_t *session, switc
 
 	if (tech_pvt->hash_key) {
 		switch_mutex_lock(tech_pvt->sofia_mutex);
-		msg_nh = nua_handle(tech_pvt->profile->nua, NULL,
+		msg_nh = nua_handle(sofia_glue_stack_nua(tech_pvt->profile, tech_pvt->stack), NULL,
 							SIPTAG_FROM_STR(tech_pvt->chat_from),
 							NUTAG_URL(tech_pvt->chat_to), SIPTAG_TO_STR(tech_pvt->chat_to), TAG_END());
 		nua_handle_bind(msg_nh, &mod_sofia_globals.destroy_private);
@@ -2900,6 +2901,29 @@ static switch_status_t cmd_status(char **argv, int argc, switch_stream_handle_t
 	int ac = 0;
 	const char *line = "=================================================================================================";
 
+	if (argc > 0 && !strcasecmp(argv[0], "queues")) {
+		int i;
+
+		stream->write_function(stream, "%5s\t%8s\t%12s\t%12s\t%12s\t%12s\t%12s\n", "Queue", "Depth", "Events",
+							   "Avg Wait(us)", "Max Wait(us)", "Avg Proc(us)", "Max Proc(us)");
+		stream->write_function(stream, "%s\n", line);
+
+		for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
+			sofia_msg_queue_t *mq = &mod_sofia_globals.msg_queues[i];
+			uint64_t events = mq->events;
+
+			stream->write_function(stream, "%5d\t%8u\t%12llu\t%12lld\t%12lld\t%12lld\t%12lld\n",
+								   i, switch_queue_size(mq->queue), (unsigned long long) events,
+								   events ? (long long) (mq->wait_time / (switch_time_t) events) : 0LL, (long long) mq->max_wait,
+								   events ? (long long) (mq->proc_time / (switch_time_t) events) : 0LL, (long long) mq->max_proc);
+		}
+
+		stream->write_function(stream, "%s\n", line);
+		stream->write_function(stream, "%d queue%s\n", mod_sofia_globals.msg_queue_len, mod_sofia_globals.msg_queue_len == 1 ? "" : "s");
+
+		return SWITCH_STATUS_SUCCESS;
+	}
+
 	if (argc > 0) {
 		if (argc == 1) {
 			/* show summary of all gateways */
@@ -3076,6 +3100,10 @@ static switch_status_t cmd_status(char **argv, int argc, switch_stream_handle_t
 					stream->write_function(stream, "CALLS-OUT        \t%u\n", profile->ob_calls);
 					stream->write_function(stream, "FAILED-CALLS-OUT \t%u\n", profile->ob_failed_calls);
 					stream->write_function(stream, "REGISTRATIONS    \t%lu\n", sofia_profile_reg_count(profile));
+					if (profile->pres_notify_window || profile->pres_notify_rate) {
+						stream->write_function(stream, "NOTIFY-COALESCED \t%u\n", profile->pres_notify_coalesced);
+						stream->write_function(stream, "NOTIFY-SHAPED    \t%u\n", profile->pres_notify_shaped);
+					}
 				}
 
 				cb.profile = profile;
@@ -4455,7 +4483,8 @@ SWITCH_STANDARD_API(sofia_function)
 		"                     capture  <on|off>\n"
 		"                     watchdog <on|off>\n\n"
 		"sofia <status|xmlstatus> profile <name> [reg [<contact str>]] | [pres <pres str>] | [user <user@domain>]\n"
-		"sofia <status|xmlstatus> gateway <name>\n\n"
+		"sofia <status|xmlstatus> gateway <name>\n"
+		"sofia status queues\n\n"
 		"sofia loglevel <all|default|tport|iptsec|nea|nta|nth_client|nth_server|nua|soa|sresolv|stun> [0-9]\n"
 		"sofia tracelevel <console|alert|crit|err|warning|notice|info|debug>\n\n"
 		"sofia help\n"
@@ -4967,14 +4996,9 @@ static switch_call_cause_t sofia_outgoing_channel(switch_core_session_t *session
 			host++;
 
 			if (!strchr(host, '.') || switch_true(switch_event_get_header(var_event, "sip_gethostbyname"))) {
-				struct sockaddr_in sa;
-				struct hostent *he = gethostbyname(host);
-				char buf[50] = "", *tmp;
-				const char *ip;
-
-				if (he) {
-					memcpy(&sa.sin_addr, he->h_addr, sizeof(struct in_addr));
-					ip = switch_inet_ntop(AF_INET, &sa.sin_addr, buf, sizeof(buf));
+				char ip[50] = "", *tmp;
+
+				if (switch_resolve_host_family(host, AF_INET, ip, sizeof(ip)) == SWITCH_STATUS_SUCCESS) {
 					tmp = switch_string_replace(dest, host, ip);
 					//host = switch_core_session_strdup(nsession, ip);
 					//dest = switch_core_session_strdup(nsession, tmp);
@@ -5253,6 +5277,7 @@ static int notify_csta_callback(void *pArg, int argc, char **argv, char **column
 	uint32_t callsequence;
 	sofia_destination_t *dst = NULL;
 	char *route_uri = NULL;
+	int stack;
 
 	time_t epoch_now = switch_epoch_time_now(NULL);
 	time_t expires_in = (expires - epoch_now);
@@ -5278,7 +5303,9 @@ static int notify_csta_callback(void *pArg, int argc, char **argv, char **column
 	callsequence = sofia_presence_get_cseq(profile);
 
 	//nh = nua_handle(profile->nua, NULL, NUTAG_URL(dst->contact), SIPTAG_FROM_STR(id), SIPTAG_TO_STR(id), SIPTAG_CONTACT_STR(profile->url), TAG_END());
-	nh = nua_handle(profile->nua, NULL, NUTAG_URL(dst->contact), SIPTAG_FROM_STR(full_to), SIPTAG_TO_STR(full_from), SIPTAG_CONTACT_STR(profile->url), TAG_END());
+	stack = sofia_glue_contact_stack(profile, contact);
+	nh = nua_handle(sofia_glue_stack_nua(profile, stack), NULL, NUTAG_URL(dst->contact), SIPTAG_FROM_STR(full_to), SIPTAG_TO_STR(full_from),
+					SIPTAG_CONTACT_STR(sofia_glue_get_stack_url(profile, stack, NULL, SOFIA_TRANSPORT_UDP)), TAG_END());
 	cseq = sip_cseq_create(nua_handle_get_home(nh), callsequence, SIP_METHOD_NOTIFY);
 
 	nua_handle_bind(nh, &mod_sofia_globals.destroy_private);
@@ -5320,6 +5347,7 @@ static int notify_callback(void *pArg, int argc, char **argv, char **columnNames
 	char *contact;
 	sofia_destination_t *dst = NULL;
 	char *route_uri = NULL;
+	int stack;
 
 	if (profile_name && strcasecmp(profile_name, profile->name)) {
 		if ((ext_profile = sofia_glue_find_profile(profile_name))) {
@@ -5338,7 +5366,9 @@ static int notify_callback(void *pArg, int argc, char **argv, char **columnNames
 		route_uri = sofia_glue_strip_uri(dst->route_uri);
 	}
 
-	nh = nua_handle(profile->nua, NULL, NUTAG_URL(dst->contact), SIPTAG_FROM_STR(id), SIPTAG_TO_STR(id), SIPTAG_CONTACT_STR(profile->url), TAG_END());
+	stack = sofia_glue_contact_stack(profile, contact);
+	nh = nua_handle(sofia_glue_stack_nua(profile, stack), NULL, NUTAG_URL(dst->contact), SIPTAG_FROM_STR(id), SIPTAG_TO_STR(id),
+					SIPTAG_CONTACT_STR(sofia_glue_get_stack_url(profile, stack, NULL, SOFIA_TRANSPORT_UDP)), TAG_END());
 
 	nua_handle_bind(nh, &mod_sofia_globals.destroy_private);
 
@@ -5404,6 +5434,7 @@ void general_event_handler(switch_event_t *event)
 					nua_handle_t *nh;
 					char *route_uri = NULL;
 					char *sip_sub_st = NULL;
+					int stack;
 
 					dst = sofia_glue_get_destination((char *) contact_uri);
 
@@ -5419,12 +5450,13 @@ void general_event_handler(switch_event_t *event)
 						return;
 					}
 
-					nh = nua_handle(profile->nua,
+					stack = sofia_glue_contact_stack(profile, contact_uri);
+					nh = nua_handle(sofia_glue_stack_nua(profile, stack),
 									NULL,
 									NUTAG_URL(dst->contact),
 									SIPTAG_FROM_STR(from_uri),
 									SIPTAG_TO_STR(to_uri),
-									SIPTAG_CONTACT_STR(profile->url),
+									SIPTAG_CONTACT_STR(sofia_glue_get_stack_url(profile, stack, NULL, SOFIA_TRANSPORT_UDP)),
 									TAG_END());
 
 					nua_handle_bind(nh, &mod_sofia_globals.destroy_private);
@@ -5765,7 +5797,7 @@ void general_event_handler(switch_event_t *event)
 			}
 
 			if (call_id) {
-				nh = nua_handle_by_call_id(profile->nua, call_id);
+				nh = sofia_glue_nh_by_call_id(profile, NULL, call_id);
 
 				if (!nh) {
 					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid Call-ID %s\n", call_id);
@@ -6536,6 +6568,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 	switch_application_interface_t *app_interface;
 	struct in_addr in;
 	switch_status_t status;
+	int i;
 
 	memset(&mod_sofia_globals, 0, sizeof(mod_sofia_globals));
 	mod_sofia_globals.destroy_private.destroy_nh = 1;
@@ -6545,6 +6578,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 	switch_mutex_init(&mod_sofia_globals.mutex, SWITCH_MUTEX_NESTED, mod_sofia_globals.pool);
 	switch_core_hash_init(&mod_sofia_globals.profile_hash);
 	switch_core_hash_init(&mod_sofia_globals.gateway_hash);
+	switch_core_hash_init_nocase(&mod_sofia_globals.gateway_realm_hash);
 	switch_mutex_init(&mod_sofia_globals.hash_mutex, SWITCH_MUTEX_NESTED, mod_sofia_globals.pool);
 
 	if (switch_event_reserve_subclass(MY_EVENT_NOTIFY_REFER) != SWITCH_STATUS_SUCCESS) {
@@ -6672,10 +6706,14 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 		mod_sofia_globals.max_msg_queues = SOFIA_MAX_MSG_QUEUE;
 	}
 
-	switch_queue_create(&mod_sofia_globals.msg_queue, SOFIA_MSG_QUEUE_SIZE * mod_sofia_globals.max_msg_queues, mod_sofia_globals.pool);
+	for (i = 0; i < mod_sofia_globals.max_msg_queues; i++) {
+		switch_queue_create(&mod_sofia_globals.msg_queues[i].queue, SOFIA_MSG_QUEUE_SIZE, mod_sofia_globals.pool);
+	}
+	mod_sofia_globals.msg_queue_len = mod_sofia_globals.max_msg_queues;
 
-	/* start one message thread */
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Starting initial message thread.\n");
+	sofia_reg_nonce_store_init();
+	sofia_presence_notify_init();
+	mod_sofia_globals.sres_cache = sres_cache_new(0);
 
 
 	if (sofia_init() != SWITCH_STATUS_SUCCESS) {
@@ -6689,7 +6727,11 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 		return SWITCH_STATUS_GENERR;
 	}
 
-	sofia_msg_thread_start(0);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Starting %d message threads.\n", mod_sofia_globals.msg_queue_len);
+
+	for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
+		sofia_msg_thread_start(i);
+	}
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Waiting for profiles to start\n");
 	switch_yield(1500000);
@@ -6793,6 +6835,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 	switch_console_set_complete("add sofia ::[help:status");
 	switch_console_set_complete("add sofia status profile ::sofia::list_profiles reg");
 	switch_console_set_complete("add sofia status gateway ::sofia::list_gateways");
+	switch_console_set_complete("add sofia status queues");
 
 	switch_console_set_complete("add sofia loglevel ::[all:default:tport:iptsec:nea:nta:nth_client:nth_server:nua:soa:sresolv:stun ::[0:1:2:3:4:5:6:7:8:9");
 	switch_console_set_complete("add sofia tracelevel ::[console:alert:crit:err:warning:notice:info:debug");
@@ -6893,13 +6936,17 @@ void mod_sofia_shutdown_cleanup() {
 		}
 	}
 
-	for (i = 0; mod_sofia_globals.msg_queue_thread[i]; i++) {
-		switch_queue_push(mod_sofia_globals.msg_queue, NULL);
-		switch_queue_interrupt_all(mod_sofia_globals.msg_queue);
+	for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
+		if (mod_sofia_globals.msg_queues[i].thread) {
+			switch_queue_push(mod_sofia_globals.msg_queues[i].queue, NULL);
+			switch_queue_interrupt_all(mod_sofia_globals.msg_queues[i].queue);
+		}
 	}
 
-	for (i = 0; mod_sofia_globals.msg_queue_thread[i]; i++) {
-		switch_thread_join(&st, mod_sofia_globals.msg_queue_thread[i]);
+	for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
+		if (mod_sofia_globals.msg_queues[i].thread) {
+			switch_thread_join(&st, mod_sofia_globals.msg_queues[i].thread);
+		}
 	}
 
 	if (mod_sofia_globals.presence_thread) {
@@ -6908,6 +6955,14 @@ void mod_sofia_shutdown_cleanup() {
 
 	su_deinit();
 
+	sofia_reg_nonce_store_destroy();
+	sofia_presence_notify_destroy();
+
+	if (mod_sofia_globals.sres_cache) {
+		sres_cache_unref(mod_sofia_globals.sres_cache);
+		mod_sofia_globals.sres_cache = NULL;
+	}
+
 	/* 
 		Release the clone of the default SIP parser 
 		created by `sip_update_default_mclass(sip_extend_mclass(NULL))` call with NULL argument
@@ -6917,6 +6972,7 @@ void mod_sofia_shutdown_cleanup() {
 	switch_mutex_lock(mod_sofia_globals.hash_mutex);
 	switch_core_hash_destroy(&mod_sofia_globals.profile_hash);
 	switch_core_hash_destroy(&mod_sofia_globals.gateway_hash);
+	switch_core_hash_destroy(&mod_sofia_globals.gateway_realm_hash);
 	switch_mutex_unlock(mod_sofia_globals.hash_mutex);
 
 	sofia_stir_shaken_destroy_services();
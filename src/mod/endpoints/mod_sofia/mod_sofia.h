@@ -46,11 +46,13 @@
 #define IPING_SECONDS 30
 #define IPING_FREQUENCY 1
 #define GATEWAY_SECONDS 1
+#define GATEWAY_IDLE_SECONDS 60
 #define SOFIA_QUEUE_SIZE 50000
 #define HAVE_APR
 #include <switch.h>
 #define SOFIA_NAT_SESSION_TIMEOUT 90
 #define SOFIA_MAX_ACL 100
+#define SOFIA_MAX_STACKS 32
 #ifdef _MSC_VER
 #define HAVE_FUNCTION 1
 #else
@@ -167,6 +169,7 @@ typedef struct sofia_dispatch_event_s {
 	switch_core_session_t *session;
 	switch_core_session_t *init_session;
 	switch_memory_pool_t *pool;
+	switch_time_t queued;
 	struct sofia_dispatch_event_s *next;
 } sofia_dispatch_event_t;
 
@@ -204,6 +207,28 @@ struct sip_alias_node {
 
 typedef struct sip_alias_node sip_alias_node_t;
 
+/* An extra nua event loop of a profile (sip-stacks), stack 0 is profile->nua on the profile thread.
+   Stack n listens on sip-stack-base-port + n - 1 and is advertised on the same port. */
+struct sofia_stack {
+	int index;
+	sofia_profile_t *profile;
+	switch_port_t port;
+	switch_port_t extport;
+	char *bindurl;
+	char *url;
+	char *public_url;
+	char *tcp_contact;
+	char *tcp_public_contact;
+	const char *supported;
+	nua_t *nua;
+	su_root_t *s_root;
+	switch_thread_t *thread;
+	int ready;
+	int shutdown;
+};
+
+typedef struct sofia_stack sofia_stack_t;
+
 typedef enum {
 	MFLAG_REFER = (1 << 0),
 	MFLAG_REGISTER = (1 << 1)
@@ -372,10 +397,29 @@ typedef enum {
 
 #define SOFIA_MAX_REG_ALGS 7 /* rfc8760 */
 
+/* one worker per queue, the stats are only written by that worker */
+typedef struct sofia_msg_queue_s {
+	switch_queue_t *queue;
+	switch_thread_t *thread;
+	uint64_t events;
+	switch_time_t wait_time;
+	switch_time_t max_wait;
+	switch_time_t proc_time;
+	switch_time_t max_proc;
+} sofia_msg_queue_t;
+
+#define SOFIA_NONCE_SHARDS 16
+
+typedef struct sofia_nonce_shard_s {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+} sofia_nonce_shard_t;
+
 struct mod_sofia_globals {
 	switch_memory_pool_t *pool;
 	switch_hash_t *profile_hash;
 	switch_hash_t *gateway_hash;
+	switch_hash_t *gateway_realm_hash;
 	switch_mutex_t *hash_mutex;
 	uint32_t callid;
 	int32_t running;
@@ -386,10 +430,10 @@ struct mod_sofia_globals {
 	char guess_ip[80];
 	char hostname[512];
 	switch_queue_t *presence_queue;
-	switch_queue_t *msg_queue;
 	switch_queue_t *general_event_queue;
-	switch_thread_t *msg_queue_thread[SOFIA_MAX_MSG_QUEUE];
+	sofia_msg_queue_t msg_queues[SOFIA_MAX_MSG_QUEUE];
 	int msg_queue_len;
+	sofia_nonce_shard_t nonce_shards[SOFIA_NONCE_SHARDS];
 	struct sofia_private destroy_private;
 	struct sofia_private keep_private;
 	int guess_mask;
@@ -413,6 +457,8 @@ struct mod_sofia_globals {
 	const char *stir_shaken_vs_ca_dir;
 	int stir_shaken_vs_cert_path_check;
 	int stir_shaken_vs_require_date;
+	/* sres answers shared by sip_dig and resolve_compare, expired per record TTL */
+	struct sres_cache *sres_cache;
 };
 extern struct mod_sofia_globals mod_sofia_globals;
 
@@ -541,6 +587,10 @@ struct sofia_gateway {
 	time_t retry;
 	time_t ping;
 	time_t reg_timeout;
+	time_t reg_start;
+	time_t next_check;
+	reg_state_t check_state;
+	int reg_inflight;
 	int pinging;
 	sofia_gateway_status_t status;
 	switch_time_t uptime;
@@ -698,9 +748,19 @@ struct sofia_profile {
 	uint32_t max_calls;
 	uint32_t nonce_ttl;
 	uint32_t max_auth_validity;
+	int auth_nonce_db;
+	uint32_t gateway_reg_spread;
+	uint32_t gateway_max_inflight;
+	uint32_t gateway_reg_inflight;
 	nua_t *nua;
 	switch_memory_pool_t *pool;
 	su_root_t *s_root;
+	int sip_stacks;
+	switch_port_t stack_base_port;
+	sofia_stack_t *stacks[SOFIA_MAX_STACKS];
+	/* registered contact (user@host:port) -> stack it registered on, only kept for stacks > 0 */
+	switch_hash_t *contact_stacks;
+	switch_mutex_t *contact_stacks_mutex;
 	sip_alias_node_t *aliases;
 	switch_payload_t cng_pt;
 	uint32_t codec_flags;
@@ -712,6 +772,10 @@ struct sofia_profile {
 	switch_hash_t *chat_hash;
 	switch_hash_t *reg_nh_hash;
 	switch_hash_t *mwi_debounce_hash;
+	switch_hash_t *pres_subs;
+	switch_hash_t *pres_index;
+	switch_mutex_t *pres_index_mutex;
+	time_t pres_index_loaded;
 	//switch_core_db_t *master_db;
 	switch_thread_rwlock_t *rwlock;
 	switch_mutex_t *flag_mutex;
@@ -744,6 +808,11 @@ struct sofia_profile {
 	int client_rport_level;
 	sofia_presence_type_t pres_type;
 	sofia_presence_held_calls_type_t pres_held_type;
+	uint32_t pres_notify_window;
+	uint32_t pres_notify_rate;
+	uint32_t pres_notify_burst;
+	uint32_t pres_notify_coalesced;
+	uint32_t pres_notify_shaped;
 	sofia_media_options_t media_options;
 	uint32_t force_subscription_expires;
 	uint32_t force_publish_expires;
@@ -863,6 +932,7 @@ struct private_object {
 	switch_payload_t cng_pt;
 	switch_payload_t bcng_pt;
 	sofia_transport_t transport;
+	int stack;
 	nua_handle_t *nh;
 	nua_handle_t *nh2;
 	sip_contact_t *contact;
@@ -1087,10 +1157,26 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 #define sofia_reg_handle_register(_nua_, _profile_, _nh_, _sip_, _de_, _regtype_, _key_, _keylen_, _v_event_, _is_nat_, _sofia_private_p_, _user_xml_) sofia_reg_handle_register_token(_nua_, _profile_, _nh_, _sip_, _de_, _regtype_, _key_, _keylen_, _v_event_, _is_nat_, _sofia_private_p_, _user_xml_, NULL)
 extern switch_endpoint_interface_t *sofia_endpoint_interface;
 void sofia_presence_set_chat_hash(private_object_t *tech_pvt, sip_t const *sip);
+void sofia_presence_sub_load(sofia_profile_t *profile, const char *call_id);
+void sofia_presence_sub_del(sofia_profile_t *profile, const char *call_id);
+void sofia_presence_sub_reset(sofia_profile_t *profile);
+void sofia_presence_sub_destroy(sofia_profile_t *profile);
+void sofia_presence_notify_init(void);
+void sofia_presence_notify_destroy(void);
 switch_status_t sofia_on_hangup(switch_core_session_t *session);
 char *sofia_glue_get_url_from_contact(char *buf, uint8_t to_dup);
 char *sofia_glue_get_path_from_contact(char *buf);
 char *sofia_glue_get_profile_url(sofia_profile_t *profile, char *remote_ip, const sofia_transport_t transport);
+char *sofia_glue_get_stack_url(sofia_profile_t *profile, int stack, char *remote_ip, const sofia_transport_t transport);
+int sofia_glue_stack_index(sofia_profile_t *profile, nua_t *nua);
+nua_t *sofia_glue_stack_nua(sofia_profile_t *profile, int stack);
+char *sofia_glue_get_stack_contact(sofia_profile_t *profile, int stack, const char *remote_ip, sofia_transport_t transport);
+char *sofia_glue_create_stack_via(sofia_profile_t *profile, int stack, sofia_transport_t transport);
+nua_handle_t *sofia_glue_nh_by_call_id(sofia_profile_t *profile, nua_t *nua, const char *call_id);
+nua_handle_t *sofia_glue_nh_by_replaces(sofia_profile_t *profile, nua_t *nua, sip_replaces_t *replaces);
+void sofia_glue_contact_stack_expire(sofia_profile_t *profile, time_t now);
+int sofia_glue_contact_stack(sofia_profile_t *profile, const char *contact);
+void sofia_glue_set_contact_stack(sofia_profile_t *profile, const char *contact, int stack, time_t expires);
 void sofia_presence_set_hash_key(char *hash_key, int32_t len, sip_t const *sip);
 void sofia_glue_sql_close(sofia_profile_t *profile, time_t prune);
 int sofia_glue_init_sql(sofia_profile_t *profile);
@@ -1117,6 +1203,8 @@ sofia_gateway_t *sofia_reg_find_gateway__(const char *file, const char *func, in
 
 sofia_gateway_t *sofia_reg_find_gateway_by_realm__(const char *file, const char *func, int line, const char *key);
 #define sofia_reg_find_gateway_by_realm(x) sofia_reg_find_gateway_by_realm__(__FILE__, __SWITCH_FUNC__, __LINE__,  x)
+void sofia_reg_index_gateway_realm(sofia_gateway_t *gateway);
+void sofia_reg_unindex_gateway_realm(sofia_gateway_t *gateway);
 
 sofia_gateway_subscription_t *sofia_find_gateway_subscription(sofia_gateway_t *gateway_ptr, const char *event);
 
@@ -1264,6 +1352,8 @@ char *sofia_glue_get_host(const char *str, switch_memory_pool_t *pool);
 char *sofia_glue_get_host_from_cfg(const char *str, switch_memory_pool_t *pool);
 void sofia_presence_check_subscriptions(sofia_profile_t *profile, time_t now);
 void sofia_msg_thread_start(int idx);
+void sofia_reg_nonce_store_init(void);
+void sofia_reg_nonce_store_destroy(void);
 void crtp_init(switch_loadable_module_interface_t *module_interface);
 int sofia_recover_callback(switch_core_session_t *session);
 void sofia_glue_set_name(private_object_t *tech_pvt, const char *channame);
@@ -329,7 +329,7 @@ switch_status_t sip_dig_function(_In_opt_z_ const char *cmd, _In_opt_ switch_cor
 			prepare_transport(dig, "tls-sctp");
 	}
 
-	dig->sres = sres_resolver_new(getenv("SRESOLV_CONF"));
+	dig->sres = sres_resolver_new_with_cache(getenv("SRESOLV_CONF"), mod_sofia_globals.sres_cache, NULL);
 
 	if (!dig->sres) {
 		usage(1);
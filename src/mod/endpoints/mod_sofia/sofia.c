@@ -144,6 +144,7 @@ void sofia_handle_sip_r_notify(switch_core_session_t *session, int status,
 		sql = switch_mprintf("delete from sip_subscriptions where call_id='%q'", sip->sip_call_id->i_id);
 		switch_assert(sql != NULL);
 		sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+		sofia_presence_sub_del(profile, sip->sip_call_id->i_id);
 		nua_handle_destroy(nh);
 	}
 
@@ -389,20 +390,43 @@ static void extract_vars(sofia_profile_t *profile, sip_t const *sip,
 
 /**
  * Add a specific SIP INVITE header to the channel variables, prefixed with "sip_i_"
+ * Repeated headers are pushed onto an array variable with SWITCH_STACK_PUSH.
+ * The header is encoded on the stack, only oversized ones need a heap buffer.
  */
-static void sofia_add_invite_header_to_chanvars(switch_channel_t *channel, nua_handle_t *nh, void *sip_header, const char *var)
+static void sofia_add_invite_header_to_chanvars(switch_channel_t *channel, void *sip_header, const char *var, switch_stack_t stack)
 {
+	char buf[1024];
+	char *full = buf;
+	issize_t len;
+
 	switch_assert(channel);
-	switch_assert(nh);
 	switch_assert(var);
 
-	if (sip_header) {
-		char *full;
-		if ((full = sip_header_as_string(nua_handle_get_home(nh), sip_header))) {
-			switch_channel_set_variable(channel, var, full);
-			su_free(nua_handle_get_home(nh), full);
+	if (!sip_header) {
+		return;
+	}
+
+	if ((len = msg_header_field_e(buf, sizeof(buf), sip_header, 0)) < 0) {
+		return;
+	}
+
+	if ((size_t) len >= sizeof(buf)) {
+		switch_zmalloc(full, len + 1);
+		if (msg_header_field_e(full, len + 1, sip_header, 0) != len) {
+			free(full);
+			return;
 		}
 	}
+
+	if (stack == SWITCH_STACK_PUSH) {
+		switch_channel_add_variable_var_check(channel, var, full, SWITCH_FALSE, stack);
+	} else {
+		switch_channel_set_variable(channel, var, full);
+	}
+
+	if (full != buf) {
+		free(full);
+	}
 }
 
 /**
@@ -411,12 +435,10 @@ static void sofia_add_invite_header_to_chanvars(switch_channel_t *channel, nua_h
  * Multiple headers will have the original internal order, though.
  *
  * @param sip A sip_t struct containing the parsed message
- * @param session A call session
- * @param nh A NUA handle for string allocation
+ * @param channel The channel to set the variables on
  */
-static void sofia_parse_all_invite_headers(sip_t const *sip, switch_core_session_t *session, nua_handle_t *nh)
+static void sofia_parse_all_invite_headers(sip_t const *sip, switch_channel_t *channel)
 {
-	switch_channel_t *channel = switch_core_session_get_channel(session);
 	sip_unknown_t *un;
 	sip_p_asserted_identity_t *passerted;
 	sip_p_preferred_identity_t *ppreferred;
@@ -427,158 +449,148 @@ static void sofia_parse_all_invite_headers(sip_t const *sip, switch_core_session
 	if (!sip) return;
 
 	/* Add simple (unique) headers first */
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_from, "sip_i_from");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_to, "sip_i_to");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_call_id, "sip_i_call_id");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_cseq, "sip_i_cseq");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_identity, "sip_i_identity");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_route, "sip_i_route");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_max_forwards, "sip_i_max_forwards");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_proxy_require, "sip_i_proxy_require");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_contact, "sip_i_contact");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_user_agent, "sip_i_user_agent");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_subject, "sip_i_subject");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_priority, "sip_i_priority");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_organization, "sip_i_organization");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_in_reply_to, "sip_i_in_reply_to");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_accept_encoding, "sip_i_accept_encoding");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_accept_language, "sip_i_accept_language");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_allow, "sip_i_allow");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_require, "sip_i_require");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_supported, "sip_i_supported");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_date, "sip_i_date");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_timestamp, "sip_i_timestamp");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_expires, "sip_i_expires");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_min_expires, "sip_i_min_expires");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_session_expires, "sip_i_session_expires");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_min_se, "sip_i_min_se");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_privacy, "sip_i_privacy");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_mime_version, "sip_i_mime_version");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_content_type, "sip_i_content_type");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_content_encoding, "sip_i_content_encoding");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_content_language, "sip_i_content_language");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_content_disposition, "sip_i_content_disposition");
-	sofia_add_invite_header_to_chanvars(channel, nh, sip->sip_content_length, "sip_i_content_length");
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_from, "sip_i_from", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_to, "sip_i_to", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_call_id, "sip_i_call_id", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_cseq, "sip_i_cseq", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_identity, "sip_i_identity", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_route, "sip_i_route", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_max_forwards, "sip_i_max_forwards", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_proxy_require, "sip_i_proxy_require", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_contact, "sip_i_contact", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_user_agent, "sip_i_user_agent", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_subject, "sip_i_subject", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_priority, "sip_i_priority", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_organization, "sip_i_organization", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_in_reply_to, "sip_i_in_reply_to", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_accept_encoding, "sip_i_accept_encoding", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_accept_language, "sip_i_accept_language", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_allow, "sip_i_allow", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_require, "sip_i_require", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_supported, "sip_i_supported", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_date, "sip_i_date", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_timestamp, "sip_i_timestamp", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_expires, "sip_i_expires", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_min_expires, "sip_i_min_expires", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_session_expires, "sip_i_session_expires", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_min_se, "sip_i_min_se", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_privacy, "sip_i_privacy", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_mime_version, "sip_i_mime_version", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_content_type, "sip_i_content_type", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_content_encoding, "sip_i_content_encoding", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_content_language, "sip_i_content_language", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_content_disposition, "sip_i_content_disposition", SWITCH_STACK_BOTTOM);
+	sofia_add_invite_header_to_chanvars(channel, sip->sip_content_length, "sip_i_content_length", SWITCH_STACK_BOTTOM);
 
 	/* Add all other headers - which might exist more than once */
 
 	if (sip->sip_via) {
 		sip_via_t *vp;
 		for (vp = sip->sip_via; vp; vp = vp->v_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_via", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_via", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if (sip->sip_record_route) {
 		sip_record_route_t *rrp;
 		for (rrp = sip->sip_record_route; rrp; rrp = rrp->r_next) {
-			char *rr = sip_header_as_string(nua_handle_get_home(nh), (void *) rrp);
-			switch_channel_add_variable_var_check(channel, "sip_i_record_route", rr, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), rr);
+			sofia_add_invite_header_to_chanvars(channel, (void *) rrp, "sip_i_record_route", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if (sip->sip_proxy_authorization) {
 		sip_proxy_authorization_t *vp;
 		for (vp = sip->sip_proxy_authorization; vp; vp = vp->au_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_proxy_authorization", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_proxy_authorization", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if (sip->sip_call_info) {
 		sip_call_info_t *vp;
 		for (vp = sip->sip_call_info; vp; vp = vp->ci_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_call_info", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_call_info", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if (sip->sip_accept) {
 		sip_accept_t *vp;
 		for (vp = sip->sip_accept; vp; vp = vp->ac_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_accept", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_accept", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if (sip->sip_authorization) {
 		sip_authorization_t *vp;
 		for (vp = sip->sip_authorization; vp; vp = vp->au_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_authorization", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_authorization", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if ((alert_info = sip_alert_info(sip))) {
 		sip_alert_info_t *vp;
 		for (vp = alert_info; vp; vp = vp->ai_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_alert_info", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_alert_info", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if ((passerted = sip_p_asserted_identity(sip))) {
 		sip_p_asserted_identity_t *vp;
 		for (vp = passerted; vp; vp = vp->paid_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_p_asserted_identity", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_p_asserted_identity", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if ((ppreferred = sip_p_preferred_identity(sip))) {
 		sip_p_preferred_identity_t *vp;
 		for (vp = ppreferred; vp; vp = vp->ppid_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_p_preferred_identity", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_p_preferred_identity", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if ((rpid = sip_remote_party_id(sip))) {
 		sip_remote_party_id_t *vp;
 		for (vp = rpid; vp; vp = vp->rpid_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_remote_party_id", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_remote_party_id", SWITCH_STACK_PUSH);
 		}
 	}
 
 	if ((reply_to = sip_reply_to(sip))) {
 		sip_reply_to_t *vp;
 		for (vp = reply_to; vp; vp = vp->rplyto_next) {
-			char *v = sip_header_as_string(nua_handle_get_home(nh), (void *) vp);
-			switch_channel_add_variable_var_check(channel, "sip_i_reply_to", v, SWITCH_FALSE, SWITCH_STACK_PUSH);
-			su_free(nua_handle_get_home(nh), v);
+			sofia_add_invite_header_to_chanvars(channel, (void *) vp, "sip_i_reply_to", SWITCH_STACK_PUSH);
 		}
 	}
 
 	/* Loop through the unknown headers */
 	for (un = sip->sip_unknown; un; un = un->un_next) {
 		if (!zstr(un->un_name) && !zstr(un->un_value)) {
-			char *parsed_name;
-			if ((parsed_name = switch_mprintf("sip_i_%s", un->un_name))) {
-				char *p, *x = parsed_name;
-				switch_tolower_max(x);
-				while ((p = strchr(x, '-'))) {
-					*p = '_';
-					x = ++p;
-				}
-				switch_channel_add_variable_var_check(channel, parsed_name, un->un_value, SWITCH_FALSE, SWITCH_STACK_PUSH);
-				free(parsed_name);
+			char parsed_name[256];
+			char *p, *x = parsed_name;
+
+			switch_snprintf(parsed_name, sizeof(parsed_name), "sip_i_%s", un->un_name);
+			switch_tolower_max(x);
+			while ((p = strchr(x, '-'))) {
+				*p = '_';
+				x = ++p;
 			}
+			switch_channel_add_variable_var_check(channel, parsed_name, un->un_value, SWITCH_FALSE, SWITCH_STACK_PUSH);
 		}
 	}
 }
 
+/**
+ * Channel variable resolver, the "sip_i_" variables are only built from the retained INVITE once something asks for them.
+ */
+static void sofia_resolve_invite_headers(switch_channel_t *channel, void *user_data)
+{
+	sofia_parse_all_invite_headers(sip_object((msg_t *) user_data), channel);
+}
+
+static void sofia_release_invite_headers(void *user_data)
+{
+	msg_ref_destroy((msg_t *) user_data);
+}
+
 static switch_status_t sofia_pass_notify(switch_core_session_t *session, const char *uuid, const char *payload)
 {
 	switch_core_session_t *other_session;
@@ -1780,8 +1792,15 @@ static void our_sofia_event_callback(nua_event_t event,
 		break;
 	case nua_r_shutdown:
 		if (status >= 200) {
-			sofia_set_pflag(profile, PFLAG_SHUTDOWN);
-			su_root_break(profile->s_root);
+			int stack = sofia_glue_stack_index(profile, nua);
+
+			if (stack) {
+				profile->stacks[stack]->shutdown = 1;
+				su_root_break(profile->stacks[stack]->s_root);
+			} else {
+				sofia_set_pflag(profile, PFLAG_SHUTDOWN);
+				su_root_break(profile->s_root);
+			}
 		}
 		break;
 	case nua_r_message:
@@ -2052,6 +2071,7 @@ static void our_sofia_event_callback(nua_event_t event,
 
 
 				sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+				sofia_presence_sub_load(profile, call_id);
 
 				sip_to_tag(nua_handle_get_home(nh), sip->sip_to, to_tag);
 			}
@@ -2289,92 +2309,97 @@ void sofia_process_dispatch_event(sofia_dispatch_event_t **dep)
 
 
 
-static int msg_queue_threads = 0;
-//static int count = 0;
-
-void *SWITCH_THREAD_FUNC sofia_msg_thread_run(switch_thread_t *thread, void *obj)
+/* Every event of a nua handle lands on the same queue so a dialog is handled in order by a single thread.
+   Events without a handle fall back to the Call-ID. */
+static int sofia_msg_queue_index(nua_handle_t *nh, sip_t const *sip)
 {
-	void *pop;
-	switch_queue_t *q = (switch_queue_t *) obj;
-	int my_id;
+	uint32_t hash;
 
+	if (mod_sofia_globals.msg_queue_len < 2) {
+		return 0;
+	}
 
-	for (my_id = 0; my_id < mod_sofia_globals.msg_queue_len; my_id++) {
-		if (mod_sofia_globals.msg_queue_thread[my_id] == thread) {
-			break;
-		}
+	if (nh) {
+		hash = (uint32_t) (((uintptr_t) nh) >> 4) * 2654435761U;
+		hash ^= hash >> 16;
+	} else if (sip && sip->sip_call_id && sip->sip_call_id->i_id) {
+		hash = switch_hashfunc_default(sip->sip_call_id->i_id, NULL);
+	} else {
+		return 0;
 	}
 
-	switch_mutex_lock(mod_sofia_globals.mutex);
-	msg_queue_threads++;
-	switch_mutex_unlock(mod_sofia_globals.mutex);
+	return (int) (hash % (uint32_t) mod_sofia_globals.msg_queue_len);
+}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MSG Thread %d Started\n", my_id);
+void *SWITCH_THREAD_FUNC sofia_msg_thread_run(switch_thread_t *thread, void *obj)
+{
+	void *pop;
+	sofia_msg_queue_t *mq = (sofia_msg_queue_t *) obj;
+	int my_id = (int) (mq - mod_sofia_globals.msg_queues);
 
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "MSG Thread %d Started\n", my_id);
 
 	for(;;) {
 
-		if (switch_queue_pop(q, &pop) != SWITCH_STATUS_SUCCESS) {
+		if (switch_queue_pop(mq->queue, &pop) != SWITCH_STATUS_SUCCESS) {
 			switch_cond_next();
 			continue;
 		}
 
 		if (pop) {
 			sofia_dispatch_event_t *de = (sofia_dispatch_event_t *) pop;
+			switch_time_t start = switch_micro_time_now(), wait, proc;
+
+			wait = start - de->queued;
 			sofia_process_dispatch_event(&de);
+			proc = switch_micro_time_now() - start;
+
+			mq->events++;
+			mq->wait_time += wait;
+			mq->proc_time += proc;
+
+			if (wait > mq->max_wait) {
+				mq->max_wait = wait;
+			}
+
+			if (proc > mq->max_proc) {
+				mq->max_proc = proc;
+			}
 		} else {
 			break;
 		}
 	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MSG Thread Ended\n");
-
-	switch_mutex_lock(mod_sofia_globals.mutex);
-	msg_queue_threads--;
-	switch_mutex_unlock(mod_sofia_globals.mutex);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "MSG Thread %d Ended\n", my_id);
 
 	return NULL;
 }
 
 void sofia_msg_thread_start(int idx)
 {
+	sofia_msg_queue_t *mq;
+	switch_threadattr_t *thd_attr = NULL;
 
-	if (idx >= mod_sofia_globals.max_msg_queues ||
-		idx >= SOFIA_MAX_MSG_QUEUE || (idx < mod_sofia_globals.msg_queue_len && mod_sofia_globals.msg_queue_thread[idx])) {
+	if (idx < 0 || idx >= mod_sofia_globals.msg_queue_len) {
 		return;
 	}
 
-	switch_mutex_lock(mod_sofia_globals.mutex);
-
-	if (idx >= mod_sofia_globals.msg_queue_len) {
-		int i;
-		mod_sofia_globals.msg_queue_len = idx + 1;
+	mq = &mod_sofia_globals.msg_queues[idx];
 
-		for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
-			if (!mod_sofia_globals.msg_queue_thread[i]) {
-				switch_threadattr_t *thd_attr = NULL;
+	switch_mutex_lock(mod_sofia_globals.mutex);
 
-				switch_threadattr_create(&thd_attr, mod_sofia_globals.pool);
-				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-				//switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
-				switch_thread_create(&mod_sofia_globals.msg_queue_thread[i],
-									 thd_attr,
-									 sofia_msg_thread_run,
-									 mod_sofia_globals.msg_queue,
-									 mod_sofia_globals.pool);
-			}
-		}
+	if (mq->queue && !mq->thread) {
+		switch_threadattr_create(&thd_attr, mod_sofia_globals.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&mq->thread, thd_attr, sofia_msg_thread_run, mq, mod_sofia_globals.pool);
 	}
 
 	switch_mutex_unlock(mod_sofia_globals.mutex);
 }
 
-//static int foo = 0;
 void sofia_queue_message(sofia_dispatch_event_t *de)
 {
-	int launch = 0;
-
-	if (mod_sofia_globals.running == 0 || !mod_sofia_globals.msg_queue) {
+	if (mod_sofia_globals.running == 0 || !mod_sofia_globals.msg_queue_len) {
 		/* Calling with SWITCH_TRUE as we are sure this is the stack's thread */
 		sofia_process_dispatch_event(&de);
 		return;
@@ -2387,19 +2412,8 @@ void sofia_queue_message(sofia_dispatch_event_t *de)
 		return;
 	}
 
-
-	if ((switch_queue_size(mod_sofia_globals.msg_queue) > (SOFIA_MSG_QUEUE_SIZE * (unsigned int)msg_queue_threads))) {
-		launch++;
-	}
-
-
-	if (launch) {
-		if (mod_sofia_globals.msg_queue_len < mod_sofia_globals.max_msg_queues) {
-			sofia_msg_thread_start(mod_sofia_globals.msg_queue_len + 1);
-		}
-	}
-
-	switch_queue_push(mod_sofia_globals.msg_queue, de);
+	de->queued = switch_micro_time_now();
+	switch_queue_push(mod_sofia_globals.msg_queues[sofia_msg_queue_index(de->nh, de->sip)].queue, de);
 }
 
 static void set_call_id(private_object_t *tech_pvt, sip_t const *sip)
@@ -2418,7 +2432,7 @@ void sofia_event_callback(nua_event_t event,
 						  tagi_t tags[])
 {
 	sofia_dispatch_event_t *de;
-	int critical = (((SOFIA_MSG_QUEUE_SIZE * mod_sofia_globals.max_msg_queues) * 900) / 1000);
+	int critical = ((SOFIA_MSG_QUEUE_SIZE * 900) / 1000);
 	uint32_t sess_count = switch_core_session_count();
 	uint32_t sess_max = switch_core_session_limit(0);
 
@@ -2493,7 +2507,8 @@ void sofia_event_callback(nua_event_t event,
 			}
 
 
-			if (switch_queue_size(mod_sofia_globals.msg_queue) > (unsigned int)critical) {
+			if (mod_sofia_globals.msg_queue_len &&
+				switch_queue_size(mod_sofia_globals.msg_queues[sofia_msg_queue_index(nh, sip)].queue) > (unsigned int)critical) {
 				nua_respond(nh, 503, "System Busy", SIPTAG_RETRY_AFTER_STR("300"), NUTAG_WITH_THIS(nua), TAG_END());
 				goto end;
 			}
@@ -3145,6 +3160,291 @@ switch_thread_t *launch_sofia_worker_thread(sofia_profile_t *profile)
 	return thread;
 }
 
+static nua_t *sofia_profile_create_nua(sofia_profile_t *profile, su_root_t *root, const char *bindurl, switch_bool_t primary)
+{
+	return nua_create(root,	/* Event loop */
+			  sofia_event_callback,	/* Callback for processing events */
+			  profile,	/* Additional data to pass to callback */
+			  TAG_IF( ! sofia_test_pflag(profile, PFLAG_TLS) || ! profile->tls_only, NUTAG_URL(bindurl)),
+			  NTATAG_USER_VIA(1),
+			  TPTAG_PONG2PING(1),
+			  NTATAG_TCP_RPORT(0),
+			  NTATAG_TLS_RPORT(0),
+			  NUTAG_RETRY_AFTER_ENABLE(0),
+			  NUTAG_AUTO_INVITE_100(0),
+			  TAG_IF(!strchr(profile->sipip, ':'),
+					 SOATAG_AF(SOA_AF_IP4_ONLY)),
+			  TAG_IF(strchr(profile->sipip, ':'),
+					 SOATAG_AF(SOA_AF_IP6_ONLY)),
+			  TAG_IF(primary && sofia_test_pflag(profile, PFLAG_TLS),
+					 NUTAG_SIPS_URL(profile->tls_bindurl)),
+			  TAG_IF(primary && profile->ws_bindurl,
+					 NUTAG_WS_URL(profile->ws_bindurl)),
+			  TAG_IF(primary && profile->wss_bindurl,
+					 NUTAG_WSS_URL(profile->wss_bindurl)),
+			  TAG_IF(profile->tls_cert_dir,
+					 NUTAG_CERTIFICATE_DIR(profile->tls_cert_dir)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS) && profile->tls_passphrase,
+					 TPTAG_TLS_PASSPHRASE(profile->tls_passphrase)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
+					 TPTAG_TLS_VERIFY_POLICY(profile->tls_verify_policy)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
+					 TPTAG_TLS_VERIFY_DEPTH(profile->tls_verify_depth)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
+					 TPTAG_TLS_VERIFY_DATE(profile->tls_verify_date)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS) && profile->tls_verify_in_subjects,
+					 TPTAG_TLS_VERIFY_SUBJECTS(profile->tls_verify_in_subjects)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
+					 TPTAG_TLS_CIPHERS(profile->tls_ciphers)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
+					 TPTAG_TLS_VERSION(profile->tls_version)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS) && profile->tls_timeout,
+					 TPTAG_TLS_TIMEOUT(profile->tls_timeout)),
+			  TAG_IF(!strchr(profile->sipip, ':'),
+					 NTATAG_UDP_MTU(65535)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_DISABLE_SRV),
+					 NTATAG_USE_SRV(0)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_DISABLE_NAPTR),
+					 NTATAG_USE_NAPTR(0)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TCP_PINGPONG),
+					 TPTAG_PINGPONG(profile->tcp_pingpong)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TCP_PING2PONG),
+					 TPTAG_PINGPONG(profile->tcp_ping2pong)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_DISABLE_SRV503),
+					 NTATAG_SRV_503(0)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_SOCKET_TCP_KEEPALIVE),
+					 TPTAG_SOCKET_KEEPALIVE(profile->socket_tcp_keepalive)),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_TCP_KEEPALIVE),
+					 TPTAG_KEEPALIVE(profile->tcp_keepalive)),
+			  NTATAG_DEFAULT_PROXY(profile->outbound_proxy),
+			  NTATAG_SERVER_RPORT(profile->server_rport_level),
+			  NTATAG_CLIENT_RPORT(profile->client_rport_level),
+			  TPTAG_LOG(sofia_test_flag(profile, TFLAG_TPORT_LOG)),
+			  TPTAG_CAPT(sofia_test_flag(profile, TFLAG_CAPTURE) ? mod_sofia_globals.capture_server : NULL),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_SIPCOMPACT),
+					 NTATAG_SIPFLAGS(MSG_DO_COMPACT)),
+			  TAG_IF(profile->timer_t1, NTATAG_SIP_T1(profile->timer_t1)),
+			  TAG_IF(profile->timer_t1x64, NTATAG_SIP_T1X64(profile->timer_t1x64)),
+			  TAG_IF(profile->timer_t2, NTATAG_SIP_T2(profile->timer_t2)),
+			  TAG_IF(profile->timer_t4, NTATAG_SIP_T4(profile->timer_t4)),
+			  SIPTAG_ACCEPT_STR("application/sdp, multipart/mixed"),
+			  TAG_IF(sofia_test_pflag(profile, PFLAG_NO_CONNECTION_REUSE),
+					 TPTAG_REUSE(0)),
+			  TAG_END());	/* Last tag should always finish the sequence */
+}
+
+static void sofia_profile_set_nua_params(sofia_profile_t *profile, nua_t *nua, const char *supported)
+{
+	nua_set_params(nua,
+				   SIPTAG_ALLOW_STR("INVITE, ACK, BYE, CANCEL, OPTIONS, MESSAGE, INFO"),
+				   SIPTAG_USER_AGENT(SIP_NONE),
+				   NUTAG_AUTOANSWER(0),
+				   NUTAG_AUTOACK(0),
+				   NUTAG_AUTOALERT(0),
+				   NUTAG_ENABLEMESSENGER(1),
+				   NTATAG_EXTRA_100(0),
+				   TAG_IF(sofia_test_pflag(profile, PFLAG_ALLOW_UPDATE), NUTAG_ALLOW("UPDATE")),
+				   TAG_IF((profile->mflags & MFLAG_REGISTER), NUTAG_ALLOW("REGISTER")),
+				   TAG_IF((profile->mflags & MFLAG_REFER), NUTAG_ALLOW("REFER")),
+				   TAG_IF(!sofia_test_pflag(profile, PFLAG_DISABLE_100REL), NUTAG_ALLOW("PRACK")),
+				   NUTAG_ALLOW("INFO"),
+				   NUTAG_ALLOW("NOTIFY"),
+				   NUTAG_ALLOW_EVENTS("talk"),
+				   NUTAG_ALLOW_EVENTS("hold"),
+				   NUTAG_ALLOW_EVENTS("conference"),
+				   NUTAG_APPL_METHOD("OPTIONS"),
+				   NUTAG_APPL_METHOD("INVITE"),
+				   NUTAG_APPL_METHOD("REFER"),
+				   NUTAG_APPL_METHOD("REGISTER"),
+				   NUTAG_APPL_METHOD("NOTIFY"), NUTAG_APPL_METHOD("INFO"), NUTAG_APPL_METHOD("ACK"), NUTAG_APPL_METHOD("SUBSCRIBE"),
+#ifdef MANUAL_BYE
+				   NUTAG_APPL_METHOD("BYE"),
+#endif
+				   NUTAG_APPL_METHOD("MESSAGE"),
+
+				   TAG_IF(profile->session_timeout && profile->minimum_session_expires, NUTAG_MIN_SE(profile->minimum_session_expires)),
+				   NUTAG_SESSION_TIMER(profile->session_timeout),
+				   NTATAG_MAX_PROCEEDING(profile->max_proceeding),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW("PUBLISH")),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW("SUBSCRIBE")),
+				   TAG_IF(profile->pres_type, NUTAG_ENABLEMESSAGE(1)),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("presence")),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("as-feature-event")),
+				   TAG_IF((profile->pres_type || sofia_test_pflag(profile, PFLAG_MANAGE_SHARED_APPEARANCE)), NUTAG_ALLOW_EVENTS("dialog")),
+				   TAG_IF((profile->pres_type || sofia_test_pflag(profile, PFLAG_MANAGE_SHARED_APPEARANCE)), NUTAG_ALLOW_EVENTS("line-seize")),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("call-info")),
+				   TAG_IF((profile->pres_type || sofia_test_pflag(profile, PFLAG_MANAGE_SHARED_APPEARANCE)), NUTAG_ALLOW_EVENTS("sla")),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("include-session-description")),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("presence.winfo")),
+				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("message-summary")),
+				   TAG_IF(profile->pres_type == PRES_TYPE_PNP, NUTAG_ALLOW_EVENTS("ua-profile")),
+				   NUTAG_ALLOW_EVENTS("refer"), SIPTAG_SUPPORTED_STR(supported),
+				   TAG_IF(strcasecmp(profile->user_agent, "_undef_"), SIPTAG_USER_AGENT_STR(profile->user_agent)),
+				   TAG_END());
+}
+
+/* Runs one extra stack of a profile until the profile stops. The su_root and nua belong to this thread,
+   everything else (registrations, gateways, sql, sessions) is the shared profile state. */
+static void *SWITCH_THREAD_FUNC sofia_stack_thread_run(switch_thread_t *thread, void *obj)
+{
+	sofia_stack_t *stack = (sofia_stack_t *) obj;
+	sofia_profile_t *profile = stack->profile;
+	int sanity;
+
+	if (!(stack->s_root = su_root_create(NULL))) {
+		stack->ready = -1;
+		return NULL;
+	}
+
+	if (!(stack->nua = sofia_profile_create_nua(profile, stack->s_root, stack->bindurl, SWITCH_FALSE))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Creating SIP UA for profile: %s stack %d (%s)\n",
+						  profile->name, stack->index, stack->bindurl);
+		su_root_destroy(stack->s_root);
+		stack->s_root = NULL;
+		stack->ready = -1;
+		return NULL;
+	}
+
+	sofia_profile_set_nua_params(profile, stack->nua, stack->supported);
+	stack->ready = 1;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Started stack %d for %s on %s\n", stack->index, profile->name, stack->bindurl);
+
+	while (mod_sofia_globals.running == 1 && sofia_test_pflag(profile, PFLAG_RUNNING)) {
+		su_root_step(stack->s_root, 1000);
+	}
+
+	nua_shutdown(stack->nua);
+
+	sanity = 100;
+	while (!stack->shutdown && --sanity) {
+		su_root_step(stack->s_root, 1000);
+	}
+
+	stack->ready = 0;
+	nua_destroy(stack->nua);
+	su_root_destroy(stack->s_root);
+	stack->nua = NULL;
+	stack->s_root = NULL;
+
+	return NULL;
+}
+
+static void sofia_profile_start_stacks(sofia_profile_t *profile, const char *supported)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	int i;
+
+	if (profile->sip_stacks < 2) {
+		return;
+	}
+
+	if (sofia_test_pflag(profile, PFLAG_TLS) && profile->tls_only) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "sip-stacks has no effect on tls-only profile %s\n", profile->name);
+		profile->sip_stacks = 1;
+		return;
+	}
+
+	if (!profile->stack_base_port) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "sip-stacks on profile %s needs sip-stack-base-port, running one stack\n", profile->name);
+		profile->sip_stacks = 1;
+		return;
+	}
+
+	/* the extra ports must not land on a port the profile binds already */
+	for (i = 1; i < profile->sip_stacks; i++) {
+		int port = profile->stack_base_port + i - 1;
+
+		if (port > 65535 || port == profile->sip_port || (sofia_test_pflag(profile, PFLAG_TLS) && port == profile->tls_sip_port)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
+							  "sip-stack-base-port %d with %d stacks on profile %s overlaps sip-port %d or tls-sip-port %d, running one stack\n",
+							  profile->stack_base_port, profile->sip_stacks, profile->name, profile->sip_port, profile->tls_sip_port);
+			profile->sip_stacks = 1;
+			return;
+		}
+	}
+
+	switch_mutex_lock(profile->contact_stacks_mutex);
+	switch_core_hash_init(&profile->contact_stacks);
+	switch_mutex_unlock(profile->contact_stacks_mutex);
+
+	for (i = 1; i < profile->sip_stacks; i++) {
+		sofia_stack_t *stack;
+		char *ipv6 = strchr(profile->sipip, ':');
+
+		stack = switch_core_alloc(profile->pool, sizeof(*stack));
+		stack->index = i;
+		stack->profile = profile;
+		stack->port = (switch_port_t) (profile->stack_base_port + i - 1);
+		stack->extport = stack->port;
+		stack->supported = supported;
+
+		if (profile->extsipip) {
+			char *extipv6 = strchr(profile->extsipip, ':');
+			stack->public_url = switch_core_sprintf(profile->pool, "sip:%s@%s%s%s:%d", profile->contact_user,
+													extipv6 ? "[" : "", profile->extsipip, extipv6 ? "]" : "", stack->extport);
+		}
+
+		/* same shape as config_sofia_profile_urls(), bind-params already carries a transport */
+		if (profile->extsipip && !sofia_test_pflag(profile, PFLAG_AUTO_NAT)) {
+			stack->url = stack->public_url;
+			stack->bindurl = switch_core_sprintf(profile->pool, "%s;maddr=%s;%s", stack->url, profile->sipip,
+												 profile->bind_params ? profile->bind_params : "transport=udp,tcp");
+		} else {
+			stack->url = switch_core_sprintf(profile->pool, "sip:%s@%s%s%s:%d",
+											 profile->contact_user, ipv6 ? "[" : "", profile->sipip, ipv6 ? "]" : "", stack->port);
+			stack->bindurl = switch_core_sprintf(profile->pool, "%s;%s", stack->url,
+												 profile->bind_params ? profile->bind_params : "transport=udp,tcp");
+		}
+
+		stack->tcp_contact = switch_core_sprintf(profile->pool, "<%s;transport=tcp>", stack->url);
+
+		if (stack->public_url) {
+			stack->tcp_public_contact = switch_core_sprintf(profile->pool, "<%s;transport=tcp>", stack->public_url);
+		}
+
+		profile->stacks[i] = stack;
+
+		switch_threadattr_create(&thd_attr, profile->pool);
+		switch_threadattr_detach_set(thd_attr, 0);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
+		switch_thread_create(&stack->thread, thd_attr, sofia_stack_thread_run, stack, profile->pool);
+	}
+
+	for (i = 1; i < profile->sip_stacks; i++) {
+		int sanity = 500;
+
+		while (!profile->stacks[i]->ready && --sanity) {
+			switch_yield(10000);
+		}
+
+		if (profile->stacks[i]->ready < 1) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Stack %d of profile %s failed to start, its traffic stays on stack 0\n",
+							  i, profile->name);
+		}
+	}
+}
+
+static void sofia_profile_stop_stacks(sofia_profile_t *profile)
+{
+	switch_status_t st;
+	int i;
+
+	for (i = 1; i < profile->sip_stacks; i++) {
+		if (profile->stacks[i] && profile->stacks[i]->thread) {
+			switch_thread_join(&st, profile->stacks[i]->thread);
+			profile->stacks[i]->thread = NULL;
+		}
+	}
+
+	switch_mutex_lock(profile->contact_stacks_mutex);
+	if (profile->contact_stacks) {
+		switch_core_hash_destroy(&profile->contact_stacks);
+	}
+	switch_mutex_unlock(profile->contact_stacks_mutex);
+}
+
 void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void *obj)
 {
 	sofia_profile_t *profile = (sofia_profile_t *) obj;
@@ -3242,75 +3542,7 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 #endif
 
 	do {
-		profile->nua = nua_create(profile->s_root,	/* Event loop */
-								  sofia_event_callback,	/* Callback for processing events */
-								  profile,	/* Additional data to pass to callback */
-								  TAG_IF( ! sofia_test_pflag(profile, PFLAG_TLS) || ! profile->tls_only, NUTAG_URL(profile->bindurl)),
-								  NTATAG_USER_VIA(1),
-								  TPTAG_PONG2PING(1),
-								  NTATAG_TCP_RPORT(0),
-								  NTATAG_TLS_RPORT(0),
-								  NUTAG_RETRY_AFTER_ENABLE(0),
-								  NUTAG_AUTO_INVITE_100(0),
-								  TAG_IF(!strchr(profile->sipip, ':'),
-										 SOATAG_AF(SOA_AF_IP4_ONLY)),
-								  TAG_IF(strchr(profile->sipip, ':'),
-										 SOATAG_AF(SOA_AF_IP6_ONLY)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
-										 NUTAG_SIPS_URL(profile->tls_bindurl)),
-								  TAG_IF(profile->ws_bindurl,
-										 NUTAG_WS_URL(profile->ws_bindurl)),
-								  TAG_IF(profile->wss_bindurl,
-										 NUTAG_WSS_URL(profile->wss_bindurl)),
-								  TAG_IF(profile->tls_cert_dir,
-										 NUTAG_CERTIFICATE_DIR(profile->tls_cert_dir)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS) && profile->tls_passphrase,
-										 TPTAG_TLS_PASSPHRASE(profile->tls_passphrase)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
-										 TPTAG_TLS_VERIFY_POLICY(profile->tls_verify_policy)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
-										 TPTAG_TLS_VERIFY_DEPTH(profile->tls_verify_depth)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
-										 TPTAG_TLS_VERIFY_DATE(profile->tls_verify_date)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS) && profile->tls_verify_in_subjects,
-										 TPTAG_TLS_VERIFY_SUBJECTS(profile->tls_verify_in_subjects)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
-										 TPTAG_TLS_CIPHERS(profile->tls_ciphers)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS),
-										 TPTAG_TLS_VERSION(profile->tls_version)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TLS) && profile->tls_timeout,
-										 TPTAG_TLS_TIMEOUT(profile->tls_timeout)),
-								  TAG_IF(!strchr(profile->sipip, ':'),
-										 NTATAG_UDP_MTU(65535)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_DISABLE_SRV),
-										 NTATAG_USE_SRV(0)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_DISABLE_NAPTR),
-										 NTATAG_USE_NAPTR(0)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TCP_PINGPONG),
-										 TPTAG_PINGPONG(profile->tcp_pingpong)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TCP_PING2PONG),
-										 TPTAG_PINGPONG(profile->tcp_ping2pong)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_DISABLE_SRV503),
-										 NTATAG_SRV_503(0)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_SOCKET_TCP_KEEPALIVE),
-										 TPTAG_SOCKET_KEEPALIVE(profile->socket_tcp_keepalive)),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_TCP_KEEPALIVE),
-										 TPTAG_KEEPALIVE(profile->tcp_keepalive)),
-								  NTATAG_DEFAULT_PROXY(profile->outbound_proxy),
-								  NTATAG_SERVER_RPORT(profile->server_rport_level),
-								  NTATAG_CLIENT_RPORT(profile->client_rport_level),
-								  TPTAG_LOG(sofia_test_flag(profile, TFLAG_TPORT_LOG)),
-								  TPTAG_CAPT(sofia_test_flag(profile, TFLAG_CAPTURE) ? mod_sofia_globals.capture_server : NULL),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_SIPCOMPACT),
-										 NTATAG_SIPFLAGS(MSG_DO_COMPACT)),
-								  TAG_IF(profile->timer_t1, NTATAG_SIP_T1(profile->timer_t1)),
-								  TAG_IF(profile->timer_t1x64, NTATAG_SIP_T1X64(profile->timer_t1x64)),
-								  TAG_IF(profile->timer_t2, NTATAG_SIP_T2(profile->timer_t2)),
-								  TAG_IF(profile->timer_t4, NTATAG_SIP_T4(profile->timer_t4)),
-								  SIPTAG_ACCEPT_STR("application/sdp, multipart/mixed"),
-								  TAG_IF(sofia_test_pflag(profile, PFLAG_NO_CONNECTION_REUSE),
-										 TPTAG_REUSE(0)),
-								  TAG_END());	/* Last tag should always finish the sequence */
+		profile->nua = sofia_profile_create_nua(profile, profile->s_root, profile->bindurl, SWITCH_TRUE);
 
 		if (!ssl_error && !profile->nua) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Creating SIP UA for profile: %s (%s) ATTEMPT %d (RETRY IN %d SEC)\n",
@@ -3338,52 +3570,7 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Created agent for %s\n", profile->name);
 
-	nua_set_params(profile->nua,
-				   SIPTAG_ALLOW_STR("INVITE, ACK, BYE, CANCEL, OPTIONS, MESSAGE, INFO"),
-				   SIPTAG_USER_AGENT(SIP_NONE),
-				   NUTAG_AUTOANSWER(0),
-				   NUTAG_AUTOACK(0),
-				   NUTAG_AUTOALERT(0),
-				   NUTAG_ENABLEMESSENGER(1),
-				   NTATAG_EXTRA_100(0),
-				   TAG_IF(sofia_test_pflag(profile, PFLAG_ALLOW_UPDATE), NUTAG_ALLOW("UPDATE")),
-				   TAG_IF((profile->mflags & MFLAG_REGISTER), NUTAG_ALLOW("REGISTER")),
-				   TAG_IF((profile->mflags & MFLAG_REFER), NUTAG_ALLOW("REFER")),
-				   TAG_IF(!sofia_test_pflag(profile, PFLAG_DISABLE_100REL), NUTAG_ALLOW("PRACK")),
-				   NUTAG_ALLOW("INFO"),
-				   NUTAG_ALLOW("NOTIFY"),
-				   NUTAG_ALLOW_EVENTS("talk"),
-				   NUTAG_ALLOW_EVENTS("hold"),
-				   NUTAG_ALLOW_EVENTS("conference"),
-				   NUTAG_APPL_METHOD("OPTIONS"),
-				   NUTAG_APPL_METHOD("INVITE"),
-				   NUTAG_APPL_METHOD("REFER"),
-				   NUTAG_APPL_METHOD("REGISTER"),
-				   NUTAG_APPL_METHOD("NOTIFY"), NUTAG_APPL_METHOD("INFO"), NUTAG_APPL_METHOD("ACK"), NUTAG_APPL_METHOD("SUBSCRIBE"),
-#ifdef MANUAL_BYE
-				   NUTAG_APPL_METHOD("BYE"),
-#endif
-				   NUTAG_APPL_METHOD("MESSAGE"),
-
-				   TAG_IF(profile->session_timeout && profile->minimum_session_expires, NUTAG_MIN_SE(profile->minimum_session_expires)),
-				   NUTAG_SESSION_TIMER(profile->session_timeout),
-				   NTATAG_MAX_PROCEEDING(profile->max_proceeding),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW("PUBLISH")),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW("SUBSCRIBE")),
-				   TAG_IF(profile->pres_type, NUTAG_ENABLEMESSAGE(1)),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("presence")),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("as-feature-event")),
-				   TAG_IF((profile->pres_type || sofia_test_pflag(profile, PFLAG_MANAGE_SHARED_APPEARANCE)), NUTAG_ALLOW_EVENTS("dialog")),
-				   TAG_IF((profile->pres_type || sofia_test_pflag(profile, PFLAG_MANAGE_SHARED_APPEARANCE)), NUTAG_ALLOW_EVENTS("line-seize")),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("call-info")),
-				   TAG_IF((profile->pres_type || sofia_test_pflag(profile, PFLAG_MANAGE_SHARED_APPEARANCE)), NUTAG_ALLOW_EVENTS("sla")),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("include-session-description")),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("presence.winfo")),
-				   TAG_IF(profile->pres_type, NUTAG_ALLOW_EVENTS("message-summary")),
-				   TAG_IF(profile->pres_type == PRES_TYPE_PNP, NUTAG_ALLOW_EVENTS("ua-profile")),
-				   NUTAG_ALLOW_EVENTS("refer"), SIPTAG_SUPPORTED_STR(supported),
-				   TAG_IF(strcasecmp(profile->user_agent, "_undef_"), SIPTAG_USER_AGENT_STR(profile->user_agent)),
-				   TAG_END());
+	sofia_profile_set_nua_params(profile, profile->nua, supported);
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Set params for %s\n", profile->name);
 
@@ -3476,6 +3663,7 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 
 	sofia_set_pflag_locked(profile, PFLAG_RUNNING);
 	worker_thread = launch_sofia_worker_thread(profile);
+	sofia_profile_start_stacks(profile, supported);
 
 	switch_yield(1000000);
 
@@ -3529,6 +3717,8 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "ERROR: Sofia worker thead failed to start\n");
 	}
 
+	sofia_profile_stop_stacks(profile);
+
 	sofia_reg_unregister(profile);
 	nua_shutdown(profile->nua);
 
@@ -3603,6 +3793,7 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 	switch_core_hash_destroy(&profile->chat_hash);
 	switch_core_hash_destroy(&profile->reg_nh_hash);
 	switch_core_hash_destroy(&profile->mwi_debounce_hash);
+	sofia_presence_sub_destroy(profile);
 
 	switch_thread_rwlock_unlock(profile->rwlock);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Write unlock %s\n", profile->name);
@@ -4047,6 +4238,9 @@ static void parse_gateways(sofia_profile_t *profile, switch_xml_t gateways_tag,
 				gateway->state = REG_STATE_NOREG;
 				gateway->status = SOFIA_GATEWAY_UP;
 				gateway->uptime = switch_time_now();
+			} else if (profile->gateway_reg_spread) {
+				/* don't send every first REGISTER of a big gateway list on the same tick */
+				gateway->reg_start = switch_epoch_time_now(NULL) + (rand() % profile->gateway_reg_spread);
 			}
 
 			if (zstr(auth_username)) {
@@ -4650,8 +4844,12 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 					switch_core_hash_init(&profile->chat_hash);
 					switch_core_hash_init(&profile->reg_nh_hash);
 					switch_core_hash_init(&profile->mwi_debounce_hash);
+					switch_core_hash_init(&profile->pres_subs);
+					switch_core_hash_init(&profile->pres_index);
+					switch_mutex_init(&profile->pres_index_mutex, SWITCH_MUTEX_NESTED, profile->pool);
 					switch_thread_rwlock_create(&profile->rwlock, profile->pool);
 					switch_mutex_init(&profile->flag_mutex, SWITCH_MUTEX_NESTED, profile->pool);
+					switch_mutex_init(&profile->contact_stacks_mutex, SWITCH_MUTEX_NESTED, profile->pool);
 					profile->dtmf_duration = 100;
 					profile->rtp_digit_delay = 40;
 					profile->sip_force_expires = 0;
@@ -4701,6 +4899,8 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 					profile->paid_type = PAID_DEFAULT;
 					profile->bind_attempts = 2;
 					profile->bind_attempt_interval = 5;
+					profile->sip_stacks = 1;
+					profile->auth_nonce_db = -1;
 					profile->dtmf_type = DTMF_2833;
 					profile->tls_verify_policy = TPTLS_VERIFY_NONE;
 					/* lib default */
@@ -4833,6 +5033,10 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 						if (profile->iping_seconds < 0) {
 							profile->iping_seconds = IPING_SECONDS;
 						}
+					} else if (!strcasecmp(var, "gateway-register-spread") && !zstr(val)) {
+						profile->gateway_reg_spread = atoi(val);
+					} else if (!strcasecmp(var, "gateway-max-inflight-registers") && !zstr(val)) {
+						profile->gateway_max_inflight = atoi(val);
 					} else if (!strcasecmp(var, "ping-thread-frequency") && !zstr(val)) {
 						profile->iping_freq = atoi(val);
 						if (profile->iping_freq < 0) {
@@ -5029,6 +5233,15 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 						profile->dbname = switch_core_strdup(profile->pool, val);
 					} else if (!strcasecmp(var, "presence-hosts")) {
 						profile->presence_hosts = switch_core_strdup(profile->pool, val);
+					} else if (!strcasecmp(var, "presence-notify-coalesce-ms")) {
+						int tmp = atoi(val);
+						profile->pres_notify_window = tmp > 0 ? tmp : 0;
+					} else if (!strcasecmp(var, "presence-notify-rate")) {
+						int tmp = atoi(val);
+						profile->pres_notify_rate = tmp > 0 ? tmp : 0;
+					} else if (!strcasecmp(var, "presence-notify-burst")) {
+						int tmp = atoi(val);
+						profile->pres_notify_burst = tmp > 0 ? tmp : 0;
 					} else if (!strcasecmp(var, "caller-id-type")) {
 						profile->cid_type = sofia_cid_name2type(val);
 					} else if (!strcasecmp(var, "record-template")) {
@@ -5152,6 +5365,16 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 							profile->sip_port = (switch_port_t) atoi(val);
 							if (!profile->extsipport) profile->extsipport = profile->sip_port;
 						}
+					} else if (!strcasecmp(var, "sip-stacks") && !zstr(val)) {
+						int stacks = atoi(val);
+
+						if (stacks >= 1 && stacks <= SOFIA_MAX_STACKS) {
+							profile->sip_stacks = stacks;
+						} else {
+							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "sip-stacks must be between 1 and %d\n", SOFIA_MAX_STACKS);
+						}
+					} else if (!strcasecmp(var, "sip-stack-base-port") && !zstr(val)) {
+						profile->stack_base_port = (switch_port_t) atoi(val);
 					} else if (!strcasecmp(var, "vad") && !zstr(val)) {
 						if (!strcasecmp(val, "in")) {
 							profile->vflags |= VAD_IN;
@@ -5610,6 +5833,14 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 						profile->nonce_ttl = atoi(val);
 					} else if (!strcasecmp(var, "max-auth-validity") && !zstr(val)) {
 						profile->max_auth_validity = atoi(val);
+					} else if (!strcasecmp(var, "auth-nonce-store") && !zstr(val)) {
+						if (!strcasecmp(val, "db")) {
+							profile->auth_nonce_db = 1;
+						} else if (!strcasecmp(val, "memory")) {
+							profile->auth_nonce_db = 0;
+						} else {
+							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid auth-nonce-store [%s], use memory or db\n", val);
+						}
 					} else if (!strcasecmp(var, "auth-require-user")) {
 						if (switch_true(val)) {
 							sofia_set_pflag(profile, PFLAG_AUTH_REQUIRE_USER);
@@ -7916,7 +8147,7 @@ static void sofia_handle_sip_i_state(switch_core_session_t *session, int status,
 							home = su_home_new(sizeof(*home));
 							switch_assert(home != NULL);
 							if ((replaces = sip_replaces_make(home, replaces_str))
-								&& (bnh = nua_handle_by_replaces(nua, replaces))) {
+								&& (bnh = sofia_glue_nh_by_replaces(profile, nua, replaces))) {
 								sofia_private_t *b_private;
 
 								switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Processing Replaces Attended Transfer\n");
@@ -8871,11 +9102,9 @@ nua_handle_t *sofia_global_nua_handle_by_replaces(sip_replaces_t *replaces)
 		for (hi = switch_core_hash_first(mod_sofia_globals.profile_hash); hi; hi = switch_core_hash_next(&hi)) {
 			switch_core_hash_this(hi, &var, NULL, &val);
 			if ((profile = (sofia_profile_t *) val)) {
-				if (!(nh = nua_handle_by_replaces(profile->nua, replaces))) {
-					nh = nua_handle_by_call_id(profile->nua, replaces->rp_call_id);
-				}
-				if (nh)
+				if ((nh = sofia_glue_nh_by_replaces(profile, NULL, replaces))) {
 					break;
+				}
 			}
 		}
 		switch_safe_free(hi);
@@ -9016,10 +9245,8 @@ void sofia_handle_sip_i_refer(nua_t *nua, sofia_profile_t *profile, nua_handle_t
 			}
 
 			if ((replaces = sip_replaces_make(home, rep))) {
-				if (!(bnh = nua_handle_by_replaces(nua, replaces))) {
-					if (!(bnh = nua_handle_by_call_id(nua, replaces->rp_call_id))) {
-						bnh = sofia_global_nua_handle_by_replaces(replaces);
-					}
+				if (!(bnh = sofia_glue_nh_by_replaces(profile, nua, replaces))) {
+					bnh = sofia_global_nua_handle_by_replaces(replaces);
 				}
 			}
 
@@ -10985,6 +11212,8 @@ void sofia_handle_sip_i_invite(switch_core_session_t *session, nua_t *nua, sofia
 
 		transport = sofia_glue_url2transport(transport_url);
 		tech_pvt->transport = transport;
+		/* in-dialog requests must come back to the stack holding the dialog */
+		tech_pvt->stack = sofia_glue_stack_index(profile, nua);
 
 		url_set_chanvars(session, sip->sip_to->a_url, sip_to);
 		if (switch_channel_get_variable(channel, "sip_to_uri")) {
@@ -11016,7 +11245,7 @@ void sofia_handle_sip_i_invite(switch_core_session_t *session, nua_t *nua, sofia
 			if (sofia_glue_check_nat(profile, tech_pvt->mparams.remote_ip)) {
 				check_nat = 1;
 			}
-			url = sofia_glue_get_profile_url(profile, tech_pvt->mparams.remote_ip, transport);
+			url = sofia_glue_get_stack_url(profile, tech_pvt->stack, tech_pvt->mparams.remote_ip, transport);
 
 			if (!url) {
 				if (check_nat) {
@@ -11051,7 +11280,7 @@ void sofia_handle_sip_i_invite(switch_core_session_t *session, nua_t *nua, sofia
 
 		} else {
 			const char *url = NULL;
-			url = sofia_glue_get_profile_url(profile, tech_pvt->mparams.remote_ip, transport);
+			url = sofia_glue_get_stack_url(profile, tech_pvt->stack, tech_pvt->mparams.remote_ip, transport);
 
 			if (url) {
 				const char *brackets = NULL;
@@ -11360,7 +11589,7 @@ void sofia_handle_sip_i_invite(switch_core_session_t *session, nua_t *nua, sofia
 				 switch_str_nil(p), switch_str_nil(p), user, host, user, host);
 
 			if ((str = sofia_glue_execute_sql2str(profile, profile->dbh_mutex, sql, cid, sizeof(cid)))) {
-				bnh = nua_handle_by_call_id(nua, str);
+				bnh = sofia_glue_nh_by_call_id(profile, nua, str);
 			}
 
 			if (mod_sofia_globals.debug_sla > 1) {
@@ -11387,10 +11616,8 @@ void sofia_handle_sip_i_invite(switch_core_session_t *session, nua_t *nua, sofia
 	profile_dup_clean(destination_number, tech_pvt->caller_profile->destination_number, tech_pvt->caller_profile->pool);
 
 	if (!bnh && sip->sip_replaces) {
-		if (!(bnh = nua_handle_by_replaces(nua, sip->sip_replaces))) {
-			if (!(bnh = nua_handle_by_call_id(nua, sip->sip_replaces->rp_call_id))) {
-				bnh = sofia_global_nua_handle_by_replaces(sip->sip_replaces);
-			}
+		if (!(bnh = sofia_glue_nh_by_replaces(profile, nua, sip->sip_replaces))) {
+			bnh = sofia_global_nua_handle_by_replaces(sip->sip_replaces);
 		}
 	}
 
@@ -11562,7 +11789,12 @@ void sofia_handle_sip_i_invite(switch_core_session_t *session, nua_t *nua, sofia
 	}
 
 	if (sofia_test_pflag(profile, PFLAG_PARSE_ALL_INVITE_HEADERS)) {
-		sofia_parse_all_invite_headers(sip, session, nh);
+		msg_t *invite_msg = msg_ref_create(de->data->e_msg);
+
+		if (switch_channel_set_variable_resolver(channel, "sip_i_", sofia_resolve_invite_headers, sofia_release_invite_headers, invite_msg) != SWITCH_STATUS_SUCCESS) {
+			msg_ref_destroy(invite_msg);
+			sofia_parse_all_invite_headers(sip, channel);
+		}
 	}
 
 	if (sip->sip_to) {
@@ -766,8 +766,19 @@ const char *sofia_glue_transport2str(const sofia_transport_t tp)
 
 char *sofia_glue_create_external_via(switch_core_session_t *session, sofia_profile_t *profile, sofia_transport_t transport)
 {
+	switch_port_t port = profile->extsipport;
+
+	if (session && !sofia_glue_transport_has_tls(transport)) {
+		private_object_t *tech_pvt = switch_core_session_get_private(session);
+		int stack = tech_pvt ? tech_pvt->stack : 0;
+
+		if (stack > 0 && stack < profile->sip_stacks && profile->stacks[stack]) {
+			port = profile->stacks[stack]->extport;
+		}
+	}
+
 	return sofia_glue_create_via(session, profile->extsipip, (sofia_glue_transport_has_tls(transport))
-								 ? profile->tls_sip_port : profile->extsipport, transport);
+								 ? profile->tls_sip_port : port, transport);
 }
 
 char *sofia_glue_create_via(switch_core_session_t *session, const char *ip, switch_port_t port, sofia_transport_t transport)
@@ -1254,6 +1265,11 @@ switch_status_t sofia_glue_do_invite(switch_core_session_t *session)
 			dst = sofia_glue_get_destination(tech_pvt->dest);
 		}
 
+		/* calls to a registration leave through the stack it registered on, gateways stay on stack 0 */
+		if (zstr(tech_pvt->gateway_name)) {
+			tech_pvt->stack = sofia_glue_contact_stack(tech_pvt->profile, tech_pvt->dest);
+		}
+
 		/*
 		 * Ignore transport chanvar and uri parameter for gateway connections
 		 * since all of them have been already taken care of in mod_sofia.c:sofia_outgoing_channel()
@@ -1304,10 +1320,11 @@ switch_status_t sofia_glue_do_invite(switch_core_session_t *session)
 																		   ipv6 ? "[" : "", ip_addr, ipv6 ? "]" : "", tech_pvt->profile->tls_sip_port);
 				} else {
 					tech_pvt->invite_contact = switch_core_session_sprintf(session, "sip:%s@%s%s%s:%d", contact,
-																		   ipv6 ? "[" : "", ip_addr, ipv6 ? "]" : "", tech_pvt->profile->extsipport);
+																		   ipv6 ? "[" : "", ip_addr, ipv6 ? "]" : "",
+																		   tech_pvt->stack ? tech_pvt->profile->stacks[tech_pvt->stack]->extport : tech_pvt->profile->extsipport);
 				}
 			} else {
-				tech_pvt->invite_contact = sofia_glue_get_profile_url(tech_pvt->profile, tech_pvt->mparams.remote_ip, tech_pvt->transport);
+				tech_pvt->invite_contact = sofia_glue_get_stack_url(tech_pvt->profile, tech_pvt->stack, tech_pvt->mparams.remote_ip, tech_pvt->transport);
 			}
 		}
 
@@ -1390,7 +1407,7 @@ switch_status_t sofia_glue_do_invite(switch_core_session_t *session)
 		switch_channel_set_variable(channel, "sip_to_host", sofia_glue_get_host(to_str, switch_core_session_get_pool(session)));
 		switch_channel_set_variable(channel, "sip_from_host", sofia_glue_get_host(from_str, switch_core_session_get_pool(session)));
 
-		if (!(tech_pvt->nh = nua_handle(tech_pvt->profile->nua, NULL,
+		if (!(tech_pvt->nh = nua_handle(sofia_glue_stack_nua(tech_pvt->profile, tech_pvt->stack), NULL,
 										NUTAG_URL(url_str),
 										TAG_IF(call_id, SIPTAG_CALL_ID_STR(call_id)),
 										TAG_IF(!zstr(record_route), SIPTAG_HEADER_STR(record_route)),
@@ -1772,7 +1789,7 @@ void sofia_glue_do_xfer_invite(switch_core_session_t *session)
 
 		const char *rep = switch_channel_get_variable(channel, SOFIA_REPLACES_HEADER);
 
-		tech_pvt->nh2 = nua_handle(tech_pvt->profile->nua, NULL,
+		tech_pvt->nh2 = nua_handle(sofia_glue_stack_nua(tech_pvt->profile, tech_pvt->stack), NULL,
 								   SIPTAG_TO_STR(tech_pvt->dest), SIPTAG_FROM_STR(tech_pvt->from_str), SIPTAG_CONTACT_STR(contact_url), TAG_END());
 
 		nua_handle_bind(tech_pvt->nh2, tech_pvt->sofia_private);
@@ -2244,6 +2261,7 @@ void sofia_glue_del_profile(sofia_profile_t *profile)
 
 			switch_core_hash_delete(mod_sofia_globals.gateway_hash, gp->name);
 			switch_core_hash_delete(mod_sofia_globals.gateway_hash, pkey);
+			sofia_reg_unindex_gateway_realm(gp);
 			switch_safe_free(pkey);
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "deleted gateway %s from profile %s\n", gp->name, profile->name);
 		}
@@ -3087,6 +3105,7 @@ switch_status_t sofia_glue_send_notify(sofia_profile_t *profile, const char *use
 	char *contact_str, *contact, *user_via = NULL;
 	char *route_uri = NULL, *p;
 	char *ptr;
+	int stack;
 
 	contact = sofia_glue_get_url_from_contact((char *) o_contact, 1);
 
@@ -3142,6 +3161,25 @@ switch_status_t sofia_glue_send_notify(sofia_profile_t *profile, const char *use
 		}
 	}
 
+	/* a registration taken on another sip-stacks stack is notified from that stack */
+	if ((stack = sofia_glue_contact_stack(profile, o_contact))) {
+		sofia_transport_t transport = SOFIA_TRANSPORT_UDP;
+		char *stack_contact;
+
+		if ((ptr = sofia_glue_find_parameter(o_contact, "transport="))) {
+			transport = sofia_glue_str2transport(ptr + 10);
+		}
+
+		if ((stack_contact = sofia_glue_get_stack_contact(profile, stack, network_ip, transport))) {
+			contact_str = stack_contact;
+
+			if (user_via) {
+				free(user_via);
+				user_via = sofia_glue_create_stack_via(profile, stack, transport);
+			}
+		}
+	}
+
 	dst = sofia_glue_get_destination((char *) o_contact);
 	switch_assert(dst);
 
@@ -3149,7 +3187,7 @@ switch_status_t sofia_glue_send_notify(sofia_profile_t *profile, const char *use
 		route_uri = sofia_glue_strip_uri(dst->route_uri);
 	}
 
-	nh = nua_handle(profile->nua, NULL, NUTAG_URL(contact), SIPTAG_FROM_STR(id), SIPTAG_TO_STR(id), SIPTAG_CONTACT_STR(contact_str), TAG_END());
+	nh = nua_handle(sofia_glue_stack_nua(profile, stack), NULL, NUTAG_URL(contact), SIPTAG_FROM_STR(id), SIPTAG_TO_STR(id), SIPTAG_CONTACT_STR(contact_str), TAG_END());
 	nua_handle_bind(nh, &mod_sofia_globals.destroy_private);
 
 	nua_notify(nh,
@@ -3539,6 +3577,237 @@ char *sofia_glue_get_profile_url(sofia_profile_t *profile, char *remote_ip, cons
 	return url;
 }
 
+/* the contact for a dialog or registration owned by a sip-stacks stack, tls and stack 0 use the profile urls */
+char *sofia_glue_get_stack_url(sofia_profile_t *profile, int stack, char *remote_ip, const sofia_transport_t transport)
+{
+	sofia_stack_t *sp;
+
+	if (stack <= 0 || stack >= profile->sip_stacks || !(sp = profile->stacks[stack]) || !sp->ready || sofia_glue_transport_has_tls(transport)) {
+		return sofia_glue_get_profile_url(profile, remote_ip, transport);
+	}
+
+	if (sp->public_url && !zstr(remote_ip) && sofia_glue_check_nat(profile, remote_ip)) {
+		return sp->public_url;
+	}
+
+	return sp->url;
+}
+
+int sofia_glue_stack_index(sofia_profile_t *profile, nua_t *nua)
+{
+	int i;
+
+	for (i = 1; nua && i < profile->sip_stacks; i++) {
+		if (profile->stacks[i] && profile->stacks[i]->nua == nua) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+nua_t *sofia_glue_stack_nua(sofia_profile_t *profile, int stack)
+{
+	if (stack > 0 && stack < profile->sip_stacks && profile->stacks[stack] && profile->stacks[stack]->ready) {
+		return profile->stacks[stack]->nua;
+	}
+
+	return profile->nua;
+}
+
+/* the contact for a request to a contact registered on stack n, NULL when the profile contact applies (stack 0, tls) */
+char *sofia_glue_get_stack_contact(sofia_profile_t *profile, int stack, const char *remote_ip, sofia_transport_t transport)
+{
+	sofia_stack_t *sp;
+	int nat;
+
+	if (stack <= 0 || stack >= profile->sip_stacks || !(sp = profile->stacks[stack]) || sp->ready < 1 || sofia_glue_transport_has_tls(transport)) {
+		return NULL;
+	}
+
+	nat = sp->public_url && !zstr(remote_ip) && sofia_glue_check_nat(profile, remote_ip);
+
+	if (transport == SOFIA_TRANSPORT_TCP) {
+		return nat ? sp->tcp_public_contact : sp->tcp_contact;
+	}
+
+	return nat ? sp->public_url : sp->url;
+}
+
+/* the external via for a request leaving through stack n */
+char *sofia_glue_create_stack_via(sofia_profile_t *profile, int stack, sofia_transport_t transport)
+{
+	if (stack > 0 && stack < profile->sip_stacks && profile->stacks[stack] && !sofia_glue_transport_has_tls(transport)) {
+		return sofia_glue_create_via(NULL, profile->extsipip, profile->stacks[stack]->extport, transport);
+	}
+
+	return sofia_glue_create_external_via(NULL, profile, transport);
+}
+
+static nua_t *sofia_glue_stack_nua_at(sofia_profile_t *profile, int i)
+{
+	if (!i) {
+		return profile->nua;
+	}
+
+	if (i < profile->sip_stacks && profile->stacks[i] && profile->stacks[i]->ready > 0) {
+		return profile->stacks[i]->nua;
+	}
+
+	return NULL;
+}
+
+/* a dialog lives on the stack it was set up on, nua (when set) is tried first and then every other stack of the profile */
+nua_handle_t *sofia_glue_nh_by_call_id(sofia_profile_t *profile, nua_t *nua, const char *call_id)
+{
+	nua_handle_t *nh = NULL;
+	nua_t *snua;
+	int i;
+
+	if (zstr(call_id)) {
+		return NULL;
+	}
+
+	if (nua && (nh = nua_handle_by_call_id(nua, call_id))) {
+		return nh;
+	}
+
+	for (i = 0; !i || i < profile->sip_stacks; i++) {
+		if ((snua = sofia_glue_stack_nua_at(profile, i)) && snua != nua && (nh = nua_handle_by_call_id(snua, call_id))) {
+			break;
+		}
+	}
+
+	return nh;
+}
+
+nua_handle_t *sofia_glue_nh_by_replaces(sofia_profile_t *profile, nua_t *nua, sip_replaces_t *replaces)
+{
+	nua_handle_t *nh = NULL;
+	nua_t *snua;
+	int i;
+
+	if (!replaces) {
+		return NULL;
+	}
+
+	if (nua && (nh = nua_handle_by_replaces(nua, replaces))) {
+		return nh;
+	}
+
+	for (i = 0; !i || i < profile->sip_stacks; i++) {
+		if ((snua = sofia_glue_stack_nua_at(profile, i)) && snua != nua && (nh = nua_handle_by_replaces(snua, replaces))) {
+			break;
+		}
+	}
+
+	return nh ? nh : sofia_glue_nh_by_call_id(profile, nua, replaces->rp_call_id);
+}
+
+typedef struct {
+	int stack;
+	time_t expires;
+} contact_stack_t;
+
+/* user@host:port of a contact or uri, the part that stays the same between the stored registration and what is dialed */
+static switch_bool_t contact_stack_key(const char *contact, char *buf, switch_size_t len)
+{
+	const char *p, *e;
+
+	if ((p = switch_stristr("sips:", contact))) {
+		p += 5;
+	} else if ((p = switch_stristr("sip:", contact))) {
+		p += 4;
+	} else {
+		p = contact;
+	}
+
+	for (e = p; *e && *e != ';' && *e != '>' && *e != '?' && *e != ' '; e++);
+
+	if (e == p || (switch_size_t) (e - p) >= len) {
+		return SWITCH_FALSE;
+	}
+
+	memcpy(buf, p, e - p);
+	buf[e - p] = '\0';
+
+	return SWITCH_TRUE;
+}
+
+/* registrations taken on stack n are looked up by contact, the contact itself goes on the wire untouched */
+int sofia_glue_contact_stack(sofia_profile_t *profile, const char *contact)
+{
+	contact_stack_t *cs;
+	char key[512];
+	int stack = 0;
+
+	if (profile->sip_stacks < 2 || zstr(contact) || !contact_stack_key(contact, key, sizeof(key))) {
+		return 0;
+	}
+
+	switch_mutex_lock(profile->contact_stacks_mutex);
+	if (profile->contact_stacks && (cs = switch_core_hash_find(profile->contact_stacks, key))) {
+		if (cs->expires < switch_epoch_time_now(NULL)) {
+			switch_core_hash_delete(profile->contact_stacks, key);
+		} else {
+			stack = cs->stack;
+		}
+	}
+	switch_mutex_unlock(profile->contact_stacks_mutex);
+
+	/* a stack that failed to start leaves its registrations to stack 0 */
+	if (stack <= 0 || stack >= profile->sip_stacks || !profile->stacks[stack] || profile->stacks[stack]->ready < 1) {
+		return 0;
+	}
+
+	return stack;
+}
+
+/* stack 0 or an expires of 0 (unregister) forgets the contact */
+void sofia_glue_set_contact_stack(sofia_profile_t *profile, const char *contact, int stack, time_t expires)
+{
+	contact_stack_t *cs;
+	char key[512];
+
+	if (profile->sip_stacks < 2 || zstr(contact) || !contact_stack_key(contact, key, sizeof(key))) {
+		return;
+	}
+
+	switch_mutex_lock(profile->contact_stacks_mutex);
+	if (profile->contact_stacks) {
+		if (stack > 0 && expires) {
+			switch_zmalloc(cs, sizeof(*cs));
+			cs->stack = stack;
+			cs->expires = expires;
+			switch_core_hash_insert_auto_free(profile->contact_stacks, key, cs);
+		} else {
+			switch_core_hash_delete(profile->contact_stacks, key);
+		}
+	}
+	switch_mutex_unlock(profile->contact_stacks_mutex);
+}
+
+static switch_bool_t contact_stack_expire_callback(const void *key, const void *val, void *pData)
+{
+	const contact_stack_t *cs = (const contact_stack_t *) val;
+
+	return cs->expires < *(time_t *) pData;
+}
+
+/* drops the stacks of registrations that expired without an unregister */
+void sofia_glue_contact_stack_expire(sofia_profile_t *profile, time_t now)
+{
+	if (profile->sip_stacks < 2 || !profile->contact_stacks_mutex) {
+		return;
+	}
+
+	switch_mutex_lock(profile->contact_stacks_mutex);
+	if (profile->contact_stacks) {
+		switch_core_hash_delete_multi(profile->contact_stacks, contact_stack_expire_callback, &now);
+	}
+	switch_mutex_unlock(profile->contact_stacks_mutex);
+}
+
 /* gets the IP or HOST from a sip uri or from x.x.x.x:port format */
 char *sofia_glue_get_host_from_cfg(const char *uri, switch_memory_pool_t *pool)
 {
@@ -64,6 +64,7 @@ struct pres_sql_cb {
 };
 
 static int sofia_presence_send_sql(void *pArg, int argc, char **argv, char **columnNames);
+static switch_interval_time_t sofia_presence_notify_flush(switch_bool_t force);
 
 struct dialog_helper {
 	char state[128];
@@ -119,6 +120,7 @@ switch_status_t sofia_presence_chat_send(switch_event_t *message_event)
 	char *dup_dest = NULL;
 	char *p = NULL;
 	char *remote_host = NULL;
+	int stack;
 	const char *proto;
 	const char *from;
 	const char *to;
@@ -308,13 +310,16 @@ switch_status_t sofia_presence_chat_send(switch_event_t *message_event)
 			switch_split_user_domain(remote_host, NULL, &remote_ip);
 		}
 
+		/* a registration taken on another sip-stacks stack gets its messages from that stack */
+		stack = sofia_glue_contact_stack(profile, m->val);
+
 		if (!zstr(remote_ip) && sofia_glue_check_nat(profile, remote_ip)) {
 			char *ptr = NULL;
 			if ((ptr = sofia_glue_find_parameter(dst->contact, "transport="))) {
 				sofia_transport_t transport = sofia_glue_str2transport( ptr + 10 );
-				user_via = sofia_glue_create_external_via(NULL, profile, transport);
+				user_via = sofia_glue_create_stack_via(profile, stack, transport);
 			} else {
-				user_via = sofia_glue_create_external_via(NULL, profile, SOFIA_TRANSPORT_UDP);
+				user_via = sofia_glue_create_stack_via(profile, stack, SOFIA_TRANSPORT_UDP);
 			}
 		}
 
@@ -334,7 +339,7 @@ switch_status_t sofia_presence_chat_send(switch_event_t *message_event)
 			route_uri = switch_mprintf("sip:%s@%s:%s", user, network_ip, network_port);
 		}
 
-		msg_nh = nua_handle(profile->nua, NULL,
+		msg_nh = nua_handle(sofia_glue_stack_nua(profile, stack), NULL,
 							TAG_END());
 
 		nua_handle_bind(msg_nh, &mod_sofia_globals.destroy_private);
@@ -480,6 +485,424 @@ struct mwi_helper {
 	int total;
 };
 
+/*
+ * Per profile copy of this host's sip_subscriptions rows.  pres_subs maps call_id to the row and
+ * pres_index maps event/sub_to_user to the list of rows watching that user, so a presence event
+ * only visits its own subscribers.  The table stays the store of record: rows are loaded once
+ * from it per profile, refreshed by call_id whenever a SUBSCRIBE writes one and dropped alongside
+ * every delete.  The NOTIFY version is counted here and mirrored back to the table.
+ */
+#define PRES_SUB_PROTO 0
+#define PRES_SUB_TO_USER 3
+#define PRES_SUB_TO_HOST 4
+#define PRES_SUB_EVENT 5
+#define PRES_SUB_CALL_ID 7
+#define PRES_SUB_PRESENCE_HOSTS 14
+#define PRES_SUB_ORIG_PROTO 15
+#define PRES_SUB_FULL_TO 16
+#define PRES_SUB_NETWORK_IP 17
+#define PRES_SUB_NETWORK_PORT 18
+#define PRES_SUB_VERSION 19
+#define PRES_SUB_COLS 20
+
+/* the first 14 columns line up with the ones sofia_presence_sub_callback reads */
+#define PRES_SUB_SELECT "select proto,sip_user,sip_host,sub_to_user,sub_to_host,event,contact,call_id,full_from,full_via," \
+	"expires,user_agent,accept,profile_name,presence_hosts,orig_proto,full_to,network_ip,network_port,version from sip_subscriptions "
+
+#define PRES_FANOUT_COLS 28
+
+static char *pres_fanout_columns[PRES_FANOUT_COLS] = {
+	"proto", "sip_user", "sip_host", "sub_to_user", "sub_to_host", "event", "contact", "call_id", "full_from", "full_via",
+	"expires", "user_agent", "accept", "profile_name", "status", "rpid", "host", "presence_status", "presence_rpid",
+	"open_closed", "dialog_status", "dialog_rpid", "version", "presence_id", "orig_proto", "full_to", "network_ip", "network_port"
+};
+
+typedef struct sofia_pres_sub_s {
+	char *col[PRES_SUB_COLS];
+	char *key;
+	int version;
+	struct sofia_pres_sub_s *prev;
+	struct sofia_pres_sub_s *next;
+} sofia_pres_sub_t;
+
+static void pres_sub_free(sofia_pres_sub_t *sub)
+{
+	int i;
+
+	for (i = 0; i < PRES_SUB_COLS; i++) {
+		switch_safe_free(sub->col[i]);
+	}
+
+	switch_safe_free(sub->key);
+	free(sub);
+}
+
+/* callers hold pres_index_mutex */
+static void pres_sub_unlink(sofia_profile_t *profile, sofia_pres_sub_t *sub)
+{
+	if (sub->prev) {
+		sub->prev->next = sub->next;
+	} else if (sub->next) {
+		switch_core_hash_insert(profile->pres_index, sub->key, sub->next);
+	} else {
+		switch_core_hash_delete(profile->pres_index, sub->key);
+	}
+
+	if (sub->next) {
+		sub->next->prev = sub->prev;
+	}
+
+	switch_core_hash_delete(profile->pres_subs, sub->col[PRES_SUB_CALL_ID]);
+}
+
+static void pres_sub_link(sofia_profile_t *profile, sofia_pres_sub_t *sub)
+{
+	sofia_pres_sub_t *old;
+
+	if ((old = switch_core_hash_find(profile->pres_subs, sub->col[PRES_SUB_CALL_ID]))) {
+		if (old->version > sub->version) {
+			sub->version = old->version;
+		}
+		pres_sub_unlink(profile, old);
+		pres_sub_free(old);
+	}
+
+	sub->prev = NULL;
+	if ((sub->next = switch_core_hash_find(profile->pres_index, sub->key))) {
+		sub->next->prev = sub;
+	}
+
+	switch_core_hash_insert(profile->pres_index, sub->key, sub);
+	switch_core_hash_insert(profile->pres_subs, sub->col[PRES_SUB_CALL_ID], sub);
+}
+
+static int sofia_presence_sub_load_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	sofia_profile_t *profile = (sofia_profile_t *) pArg;
+	sofia_pres_sub_t *sub;
+	int i;
+
+	if (argc < PRES_SUB_COLS || zstr(argv[PRES_SUB_CALL_ID]) || zstr(argv[PRES_SUB_EVENT]) || zstr(argv[PRES_SUB_TO_USER])) {
+		return 0;
+	}
+
+	switch_zmalloc(sub, sizeof(*sub));
+
+	for (i = 0; i < PRES_SUB_COLS; i++) {
+		sub->col[i] = strdup(switch_str_nil(argv[i]));
+	}
+
+	sub->version = atoi(sub->col[PRES_SUB_VERSION]);
+	sub->key = switch_mprintf("%s/%s", sub->col[PRES_SUB_EVENT], sub->col[PRES_SUB_TO_USER]);
+
+	switch_mutex_lock(profile->pres_index_mutex);
+	pres_sub_link(profile, sub);
+	switch_mutex_unlock(profile->pres_index_mutex);
+
+	return 0;
+}
+
+void sofia_presence_sub_load(sofia_profile_t *profile, const char *call_id)
+{
+	char *sql;
+
+	if (zstr(call_id)) {
+		return;
+	}
+
+	sql = switch_mprintf(PRES_SUB_SELECT "where call_id='%q' and profile_name='%q' and hostname='%q'",
+						 call_id, profile->name, mod_sofia_globals.hostname);
+	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_presence_sub_load_callback, profile);
+	switch_safe_free(sql);
+}
+
+static void sofia_presence_sub_load_all(sofia_profile_t *profile, time_t now)
+{
+	char *sql;
+
+	sql = switch_mprintf(PRES_SUB_SELECT "where profile_name='%q' and hostname='%q'", profile->name, mod_sofia_globals.hostname);
+	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_presence_sub_load_callback, profile);
+	switch_safe_free(sql);
+
+	switch_mutex_lock(profile->pres_index_mutex);
+	profile->pres_index_loaded = now;
+	switch_mutex_unlock(profile->pres_index_mutex);
+}
+
+void sofia_presence_sub_del(sofia_profile_t *profile, const char *call_id)
+{
+	sofia_pres_sub_t *sub;
+
+	if (zstr(call_id)) {
+		return;
+	}
+
+	switch_mutex_lock(profile->pres_index_mutex);
+	if ((sub = switch_core_hash_find(profile->pres_subs, call_id))) {
+		pres_sub_unlink(profile, sub);
+		pres_sub_free(sub);
+	}
+	switch_mutex_unlock(profile->pres_index_mutex);
+}
+
+static int sofia_presence_sub_forget_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	sofia_presence_sub_del((sofia_profile_t *) pArg, argv[0]);
+	return 0;
+}
+
+/* drop the rows a multi row delete is about to remove, sql selects their call_id */
+static void sofia_presence_sub_forget(sofia_profile_t *profile, char **sqlp)
+{
+	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, *sqlp, sofia_presence_sub_forget_callback, profile);
+	switch_safe_free(*sqlp);
+}
+
+/* forget every row, they are loaded again from the table by the next sofia_presence_check_subscriptions */
+void sofia_presence_sub_reset(sofia_profile_t *profile)
+{
+	switch_hash_index_t *hi;
+	void *val;
+
+	switch_mutex_lock(profile->pres_index_mutex);
+
+	for (hi = switch_core_hash_first(profile->pres_subs); hi; hi = switch_core_hash_next(&hi)) {
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		pres_sub_free((sofia_pres_sub_t *) val);
+	}
+
+	switch_core_hash_destroy(&profile->pres_subs);
+	switch_core_hash_destroy(&profile->pres_index);
+	switch_core_hash_init(&profile->pres_subs);
+	switch_core_hash_init(&profile->pres_index);
+	profile->pres_index_loaded = 0;
+
+	switch_mutex_unlock(profile->pres_index_mutex);
+}
+
+void sofia_presence_sub_destroy(sofia_profile_t *profile)
+{
+	sofia_presence_sub_reset(profile);
+	switch_core_hash_destroy(&profile->pres_subs);
+	switch_core_hash_destroy(&profile->pres_index);
+}
+
+/*
+ * The dialog-info version of the next NOTIFY on a subscription.  A row held in memory counts it: one past the
+ * last version sent and never below what the table says, since the version=version+1 mirrors of earlier
+ * NOTIFYs may still be queued.  Without a row the table version is used as it is.
+ */
+static int pres_sub_next_version(sofia_profile_t *profile, const char *call_id, const char *table_version)
+{
+	sofia_pres_sub_t *sub;
+	int v = zstr(table_version) ? 0 : atoi(table_version);
+
+	if (zstr(call_id)) {
+		return v;
+	}
+
+	switch_mutex_lock(profile->pres_index_mutex);
+	if ((sub = switch_core_hash_find(profile->pres_subs, call_id))) {
+		if (v <= sub->version) {
+			v = sub->version + 1;
+		}
+		sub->version = v;
+	}
+	switch_mutex_unlock(profile->pres_index_mutex);
+
+	return v;
+}
+
+static switch_bool_t sofia_presence_index_has(sofia_profile_t *profile, const char *event, const char *user)
+{
+	char *key;
+	switch_bool_t r = SWITCH_TRUE;
+
+	if (zstr(event) || zstr(user)) {
+		return r;
+	}
+
+	key = switch_mprintf("%s/%s", event, user);
+
+	switch_mutex_lock(profile->pres_index_mutex);
+	/* until the first load it knows nothing about rows already in the db */
+	if (profile->pres_index_loaded) {
+		r = switch_core_hash_find(profile->pres_index, key) ? SWITCH_TRUE : SWITCH_FALSE;
+	}
+	switch_mutex_unlock(profile->pres_index_mutex);
+
+	free(key);
+
+	return r;
+}
+
+/* true when any profile holds a subscription to user for either event */
+static switch_bool_t sofia_presence_watched(const char *event, const char *alt_event, const char *user)
+{
+	switch_console_callback_match_t *matches = NULL;
+	switch_console_callback_match_node_t *m;
+	sofia_profile_t *profile;
+	switch_bool_t r = SWITCH_FALSE;
+
+	if (list_profiles_full(NULL, NULL, &matches, SWITCH_FALSE) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_TRUE;
+	}
+
+	for (m = matches->head; m && !r; m = m->next) {
+		if ((profile = sofia_glue_find_profile(m->val))) {
+			if (sofia_presence_index_has(profile, event, user) || (alt_event && sofia_presence_index_has(profile, alt_event, user))) {
+				r = SWITCH_TRUE;
+			}
+			sofia_glue_release_profile(profile);
+		}
+	}
+
+	switch_console_free_matches(&matches);
+
+	return r;
+}
+
+struct pres_fanout_row {
+	char *argv[PRES_FANOUT_COLS];
+	struct pres_fanout_row *next;
+};
+
+struct pres_state_helper {
+	switch_memory_pool_t *pool;
+	char *status;
+	char *rpid;
+	char *open_closed;
+};
+
+static int sofia_presence_state_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	struct pres_state_helper *ps = (struct pres_state_helper *) pArg;
+
+	ps->status = switch_core_strdup(ps->pool, switch_str_nil(argv[0]));
+	ps->rpid = switch_core_strdup(ps->pool, switch_str_nil(argv[1]));
+	ps->open_closed = switch_core_strdup(ps->pool, switch_str_nil(argv[2]));
+
+	return 0;
+}
+
+static switch_bool_t pres_sub_host_match(sofia_profile_t *profile, sofia_pres_sub_t *sub, const char *host)
+{
+	const char *to_host = sub->col[PRES_SUB_TO_HOST];
+
+	return (!strcmp(to_host, host) || !strcmp(to_host, profile->sipip) || (profile->extsipip && !strcmp(to_host, profile->extsipip)) ||
+			switch_stristr(host, sub->col[PRES_SUB_PRESENCE_HOSTS])) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static struct pres_fanout_row *pres_fanout_add(switch_memory_pool_t *pool, struct pres_fanout_row *rows, sofia_pres_sub_t *sub,
+											   const char *status, const char *rpid, const char *host, struct dialog_helper *dh)
+{
+	struct pres_fanout_row *row = switch_core_alloc(pool, sizeof(*row));
+	int i;
+
+	for (i = 0; i < 14; i++) {
+		row->argv[i] = switch_core_strdup(pool, sub->col[i]);
+	}
+
+	row->argv[14] = switch_core_strdup(pool, switch_str_nil(status));
+	row->argv[15] = switch_core_strdup(pool, switch_str_nil(rpid));
+	row->argv[16] = switch_core_strdup(pool, host);
+	row->argv[17] = row->argv[18] = row->argv[19] = "";
+	row->argv[20] = dh->status;
+	row->argv[21] = dh->rpid;
+	/* the version itself is taken by sofia_presence_sub_callback */
+	row->argv[22] = switch_core_sprintf(pool, "%d", sub->version);
+	row->argv[23] = dh->presence_id;
+	row->argv[24] = switch_core_strdup(pool, sub->col[PRES_SUB_ORIG_PROTO]);
+	row->argv[25] = switch_core_strdup(pool, sub->col[PRES_SUB_FULL_TO]);
+	row->argv[26] = switch_core_strdup(pool, sub->col[PRES_SUB_NETWORK_IP]);
+	row->argv[27] = switch_core_strdup(pool, sub->col[PRES_SUB_NETWORK_PORT]);
+	row->next = rows;
+
+	return row;
+}
+
+/*
+ * Send the presence event to the subscribers found in the in-memory rows, the same rows and columns the
+ * sip_subscriptions/sip_presence join would hand to sofia_presence_sub_callback.  Returns SWITCH_STATUS_FALSE
+ * before the rows are loaded so the caller can fall back to the query.
+ */
+static switch_status_t sofia_presence_sub_fanout(sofia_profile_t *profile, struct presence_helper *helper, const char *call_id,
+												 const char *proto, const char *event_type, const char *alt_event_type,
+												 const char *euser, const char *host, const char *status, const char *rpid,
+												 struct dialog_helper *dh)
+{
+	switch_memory_pool_t *pool;
+	struct pres_fanout_row *rows = NULL, *row;
+	struct pres_state_helper ps = { 0 };
+	sofia_pres_sub_t *sub;
+	const char *events[2];
+	char *key, *sql;
+	const char *last_user = NULL, *last_host = NULL;
+	int i;
+
+	events[0] = event_type;
+	events[1] = alt_event_type;
+
+	switch_core_new_memory_pool(&pool);
+	ps.pool = pool;
+
+	switch_mutex_lock(profile->pres_index_mutex);
+
+	if (!profile->pres_index_loaded) {
+		switch_mutex_unlock(profile->pres_index_mutex);
+		switch_core_destroy_memory_pool(&pool);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!zstr(call_id)) {
+		if ((sub = switch_core_hash_find(profile->pres_subs, call_id)) && strcmp(sub->col[PRES_SUB_EVENT], "line-seize")) {
+			rows = pres_fanout_add(pool, rows, sub, status, rpid, host, dh);
+		}
+	} else {
+		for (i = 0; i < 2; i++) {
+			if (zstr(events[i]) || (i && !zstr(events[0]) && !strcmp(events[0], events[1]))) {
+				continue;
+			}
+
+			key = switch_core_sprintf(pool, "%s/%s", events[i], euser);
+
+			for (sub = switch_core_hash_find(profile->pres_index, key); sub; sub = sub->next) {
+				if (!strcmp(sub->col[PRES_SUB_EVENT], "line-seize") || strcmp(sub->col[PRES_SUB_PROTO], proto) ||
+					!pres_sub_host_match(profile, sub, host)) {
+					continue;
+				}
+				rows = pres_fanout_add(pool, rows, sub, status, rpid, host, dh);
+			}
+		}
+	}
+
+	switch_mutex_unlock(profile->pres_index_mutex);
+
+	for (row = rows; row; row = row->next) {
+		/* stands in for the sip_presence join, the rows of one event nearly always share the watched user and host */
+		if (!last_user || strcmp(last_user, row->argv[PRES_SUB_TO_USER]) || strcmp(last_host, row->argv[PRES_SUB_TO_HOST])) {
+			last_user = row->argv[PRES_SUB_TO_USER];
+			last_host = row->argv[PRES_SUB_TO_HOST];
+			ps.status = ps.rpid = ps.open_closed = NULL;
+
+			sql = switch_mprintf("select status,rpid,open_closed from sip_presence where sip_user='%q' and sip_host='%q' and "
+								 "profile_name='%q' and hostname='%q'", last_user, last_host, profile->name, mod_sofia_globals.hostname);
+			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_presence_state_callback, &ps);
+			switch_safe_free(sql);
+		}
+
+		row->argv[17] = ps.status ? ps.status : "";
+		row->argv[18] = ps.rpid ? ps.rpid : "";
+		row->argv[19] = ps.open_closed ? ps.open_closed : "";
+
+		sofia_presence_sub_callback(helper, PRES_FANOUT_COLS, row->argv, pres_fanout_columns);
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static void actual_sofia_presence_mwi_event_handler(switch_event_t *event)
 {
 	char *account, *dup_account, *yn, *host, *user;
@@ -585,7 +1008,7 @@ static void actual_sofia_presence_mwi_event_handler(switch_event_t *event)
 
 	sql = NULL;
 
-	if (for_everyone) {
+	if (for_everyone && sofia_presence_watched("message-summary", NULL, user)) {
 		sql = switch_mprintf("select proto,sip_user,sip_host,sub_to_user,sub_to_host,event,contact,call_id,full_from,"
 							 "full_via,expires,user_agent,accept,profile_name,network_ip"
 							 ",'%q',full_to,network_ip,network_port from sip_subscriptions "
@@ -1031,6 +1454,7 @@ static void send_conference_data(sofia_profile_t *profile, switch_event_t *event
 
 	if (switch_true(final)) {
 		if (call_id) {
+			sofia_presence_sub_del(profile, call_id);
 			sql = switch_mprintf("delete from sip_subscriptions where "
 								 "hostname='%q' and profile_name='%q' and sub_to_user='%q' and sub_to_host='%q' and event='%q' "
 								 "and call_id = '%q' ",
@@ -1038,6 +1462,12 @@ static void send_conference_data(sofia_profile_t *profile, switch_event_t *event
 								 from_user, from_host, event_str, call_id);
 
 		} else {
+			sql = switch_mprintf("select call_id from sip_subscriptions where "
+								 "hostname='%q' and profile_name='%q' and sub_to_user='%q' and sub_to_host='%q' and event='%q'",
+								 mod_sofia_globals.hostname, profile->name,
+								 from_user, from_host, event_str);
+			sofia_presence_sub_forget(profile, &sql);
+
 			sql = switch_mprintf("delete from sip_subscriptions where "
 								 "hostname='%q' and profile_name='%q' and sub_to_user='%q' and sub_to_host='%q' and event='%q'",
 								 mod_sofia_globals.hostname, profile->name,
@@ -1301,9 +1731,12 @@ static switch_event_t *actual_sofia_presence_event_handler(switch_event_t *event
 
 	if (list_profiles_full(NULL, NULL, &matches, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS) {
 		switch_console_callback_match_node_t *m;
+		/* dialog state found on one profile can change what is sent on another, so only skip when no profile has a watcher */
+		int watched = !zstr(call_id) || sofia_presence_watched(event_type, alt_event_type, euser);
 
 		for (m = matches->head; m; m = m->next) {
 			struct dialog_helper dh = { { 0 } };
+			int in_memory;
 
 			if ((profile = sofia_glue_find_profile(m->val))) {
 				if (profile->pres_type != PRES_TYPE_FULL) {
@@ -1358,6 +1791,14 @@ static switch_event_t *actual_sofia_presence_event_handler(switch_event_t *event
 					proto = SOFIA_CHAT_PROTO;
 				}
 
+				if (!watched) {
+					if (mod_sofia_globals.debug_presence > 0) {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s: no subscriptions to %s@%s, skipping\n", profile->name, euser, host);
+					}
+					sofia_glue_release_profile(profile);
+					continue;
+				}
+
 				if (zstr(uuid)) {
 
 					sql = switch_mprintf("select state,status,rpid,presence_id,uuid from sip_dialogs "
@@ -1418,6 +1859,21 @@ static switch_event_t *actual_sofia_presence_event_handler(switch_event_t *event
 					goto done;
 				}
 
+				helper.hup = hup;
+				helper.calls_up = dh.hits;
+				helper.profile = profile;
+				helper.event = event;
+				SWITCH_STANDARD_STREAM(helper.stream);
+				switch_assert(helper.stream.data);
+
+				if (mod_sofia_globals.debug_presence > 0) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s START_PRESENCE_SQL (%s)\n",
+									  event->event_id == SWITCH_EVENT_PRESENCE_IN ? "IN" : "OUT", profile->name);
+				}
+
+				in_memory = sofia_presence_sub_fanout(profile, &helper, call_id, proto, event_type, alt_event_type,
+													  euser, host, status, rpid, &dh) == SWITCH_STATUS_SUCCESS;
+
 				if (zstr(call_id)) {
 
 					sql = switch_mprintf("update sip_subscriptions set version=version+1 where hostname='%q' and profile_name='%q' and "
@@ -1435,34 +1891,37 @@ static switch_event_t *actual_sofia_presence_event_handler(switch_event_t *event
 						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "PRES SQL %s\n", sql);
 					}
 
-					sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
-
-
-
-					sql = switch_mprintf("select distinct sip_subscriptions.proto,sip_subscriptions.sip_user,sip_subscriptions.sip_host,"
-										 "sip_subscriptions.sub_to_user,sip_subscriptions.sub_to_host,sip_subscriptions.event,"
-										 "sip_subscriptions.contact,sip_subscriptions.call_id,sip_subscriptions.full_from,"
-										 "sip_subscriptions.full_via,sip_subscriptions.expires,sip_subscriptions.user_agent,"
-										 "sip_subscriptions.accept,sip_subscriptions.profile_name"
-										 ",'%q','%q','%q',sip_presence.status,sip_presence.rpid,sip_presence.open_closed,'%q','%q',"
-										 "sip_subscriptions.version, '%q',sip_subscriptions.orig_proto,sip_subscriptions.full_to,"
-										 "sip_subscriptions.network_ip, sip_subscriptions.network_port "
-										 "from sip_subscriptions "
-										 "left join sip_presence on "
-										 "(sip_subscriptions.sub_to_user=sip_presence.sip_user and sip_subscriptions.sub_to_host=sip_presence.sip_host and "
-										 "sip_subscriptions.profile_name=sip_presence.profile_name and sip_subscriptions.hostname=sip_presence.hostname) "
-
-										 "where sip_subscriptions.hostname='%q' and sip_subscriptions.profile_name='%q' and "
-										 "sip_subscriptions.event != 'line-seize' and "
-										 "sip_subscriptions.proto='%q' and "
-										 "(event='%q' or event='%q') and sub_to_user='%q' "
-										 "and (sub_to_host='%q' or sub_to_host='%q' or sub_to_host='%q' or presence_hosts like '%%%q%%') ",
-
-
-										 switch_str_nil(status), switch_str_nil(rpid), host,
-										 dh.status,dh.rpid,dh.presence_id, mod_sofia_globals.hostname, profile->name, proto,
-										 event_type, alt_event_type, euser, host, profile->sipip,
-										 profile->extsipip ? profile->extsipip : "N/A", host);
+					if (in_memory) {
+						/* the in-memory rows already carry the bumped version, the table only mirrors it */
+						sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+					} else {
+						sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+
+						sql = switch_mprintf("select distinct sip_subscriptions.proto,sip_subscriptions.sip_user,sip_subscriptions.sip_host,"
+											 "sip_subscriptions.sub_to_user,sip_subscriptions.sub_to_host,sip_subscriptions.event,"
+											 "sip_subscriptions.contact,sip_subscriptions.call_id,sip_subscriptions.full_from,"
+											 "sip_subscriptions.full_via,sip_subscriptions.expires,sip_subscriptions.user_agent,"
+											 "sip_subscriptions.accept,sip_subscriptions.profile_name"
+											 ",'%q','%q','%q',sip_presence.status,sip_presence.rpid,sip_presence.open_closed,'%q','%q',"
+											 "sip_subscriptions.version, '%q',sip_subscriptions.orig_proto,sip_subscriptions.full_to,"
+											 "sip_subscriptions.network_ip, sip_subscriptions.network_port "
+											 "from sip_subscriptions "
+											 "left join sip_presence on "
+											 "(sip_subscriptions.sub_to_user=sip_presence.sip_user and sip_subscriptions.sub_to_host=sip_presence.sip_host and "
+											 "sip_subscriptions.profile_name=sip_presence.profile_name and sip_subscriptions.hostname=sip_presence.hostname) "
+
+											 "where sip_subscriptions.hostname='%q' and sip_subscriptions.profile_name='%q' and "
+											 "sip_subscriptions.event != 'line-seize' and "
+											 "sip_subscriptions.proto='%q' and "
+											 "(event='%q' or event='%q') and sub_to_user='%q' "
+											 "and (sub_to_host='%q' or sub_to_host='%q' or sub_to_host='%q' or presence_hosts like '%%%q%%') ",
+
+
+											 switch_str_nil(status), switch_str_nil(rpid), host,
+											 dh.status,dh.rpid,dh.presence_id, mod_sofia_globals.hostname, profile->name, proto,
+											 event_type, alt_event_type, euser, host, profile->sipip,
+											 profile->extsipip ? profile->extsipip : "N/A", host);
+					}
 				} else {
 
 					sql = switch_mprintf("update sip_subscriptions set version=version+1 where sip_subscriptions.event != 'line-seize' and "
@@ -1474,57 +1933,51 @@ static switch_event_t *actual_sofia_presence_event_handler(switch_event_t *event
 						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "PRES SQL %s\n", sql);
 					}
 
-					sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
-
-
-					sql = switch_mprintf("select distinct sip_subscriptions.proto,sip_subscriptions.sip_user,sip_subscriptions.sip_host,"
-										 "sip_subscriptions.sub_to_user,sip_subscriptions.sub_to_host,sip_subscriptions.event,"
-										 "sip_subscriptions.contact,sip_subscriptions.call_id,sip_subscriptions.full_from,"
-										 "sip_subscriptions.full_via,sip_subscriptions.expires,sip_subscriptions.user_agent,"
-										 "sip_subscriptions.accept,sip_subscriptions.profile_name"
-										 ",'%q','%q','%q',sip_presence.status,sip_presence.rpid,sip_presence.open_closed,'%q','%q',"
-										 "sip_subscriptions.version, '%q',sip_subscriptions.orig_proto,sip_subscriptions.full_to,"
-										 "sip_subscriptions.network_ip, sip_subscriptions.network_port "
-										 "from sip_subscriptions "
-										 "left join sip_presence on "
-										 "(sip_subscriptions.sub_to_user=sip_presence.sip_user and sip_subscriptions.sub_to_host=sip_presence.sip_host and "
-										 "sip_subscriptions.profile_name=sip_presence.profile_name and sip_subscriptions.hostname=sip_presence.hostname) "
-
-										 "where sip_subscriptions.hostname='%q' and sip_subscriptions.profile_name='%q' and "
-										 "sip_subscriptions.event != 'line-seize' and "
-										 "sip_subscriptions.call_id='%q'",
-
-										 switch_str_nil(status), switch_str_nil(rpid), host,
-										 dh.status,dh.rpid,dh.presence_id, mod_sofia_globals.hostname, profile->name, call_id);
-
-				}
-
-				helper.hup = hup;
-				helper.calls_up = dh.hits;
-				helper.profile = profile;
-				helper.event = event;
-				SWITCH_STANDARD_STREAM(helper.stream);
-				switch_assert(helper.stream.data);
+					if (in_memory) {
+						/* the in-memory rows already carry the bumped version, the table only mirrors it */
+						sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+					} else {
+						sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+
+						sql = switch_mprintf("select distinct sip_subscriptions.proto,sip_subscriptions.sip_user,sip_subscriptions.sip_host,"
+											 "sip_subscriptions.sub_to_user,sip_subscriptions.sub_to_host,sip_subscriptions.event,"
+											 "sip_subscriptions.contact,sip_subscriptions.call_id,sip_subscriptions.full_from,"
+											 "sip_subscriptions.full_via,sip_subscriptions.expires,sip_subscriptions.user_agent,"
+											 "sip_subscriptions.accept,sip_subscriptions.profile_name"
+											 ",'%q','%q','%q',sip_presence.status,sip_presence.rpid,sip_presence.open_closed,'%q','%q',"
+											 "sip_subscriptions.version, '%q',sip_subscriptions.orig_proto,sip_subscriptions.full_to,"
+											 "sip_subscriptions.network_ip, sip_subscriptions.network_port "
+											 "from sip_subscriptions "
+											 "left join sip_presence on "
+											 "(sip_subscriptions.sub_to_user=sip_presence.sip_user and sip_subscriptions.sub_to_host=sip_presence.sip_host and "
+											 "sip_subscriptions.profile_name=sip_presence.profile_name and sip_subscriptions.hostname=sip_presence.hostname) "
+
+											 "where sip_subscriptions.hostname='%q' and sip_subscriptions.profile_name='%q' and "
+											 "sip_subscriptions.event != 'line-seize' and "
+											 "sip_subscriptions.call_id='%q'",
+
+											 switch_str_nil(status), switch_str_nil(rpid), host,
+											 dh.status,dh.rpid,dh.presence_id, mod_sofia_globals.hostname, profile->name, call_id);
+					}
 
-				if (mod_sofia_globals.debug_presence > 0) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s START_PRESENCE_SQL (%s)\n",
-									  event->event_id == SWITCH_EVENT_PRESENCE_IN ? "IN" : "OUT", profile->name);
 				}
 
-				if (mod_sofia_globals.debug_presence) {
-					char *buf;
-					switch_event_serialize(event, &buf, SWITCH_FALSE);
-					switch_assert(buf);
-					if (mod_sofia_globals.debug_presence > 1) {
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "DUMP PRESENCE SQL:\n%s\nEVENT DUMP:\n%s\n", sql, buf);
-					} else {
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "EVENT DUMP:\n%s\n", buf);
+				if (sql) {
+					if (mod_sofia_globals.debug_presence) {
+						char *buf;
+						switch_event_serialize(event, &buf, SWITCH_FALSE);
+						switch_assert(buf);
+						if (mod_sofia_globals.debug_presence > 1) {
+							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "DUMP PRESENCE SQL:\n%s\nEVENT DUMP:\n%s\n", sql, buf);
+						} else {
+							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "EVENT DUMP:\n%s\n", buf);
+						}
+						free(buf);
 					}
-					free(buf);
-				}
 
-				sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_presence_sub_callback, &helper);
-				switch_safe_free(sql);
+					sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_presence_sub_callback, &helper);
+					switch_safe_free(sql);
+				}
 
 				if (mod_sofia_globals.debug_presence > 0) {
 					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s END_PRESENCE_SQL (%s)\n",
@@ -1620,8 +2073,9 @@ void *SWITCH_THREAD_FUNC sofia_presence_event_thread_run(switch_thread_t *thread
 
 	while (mod_sofia_globals.running == 1) {
 		int count = 0;
+		switch_interval_time_t next = sofia_presence_notify_flush(SWITCH_FALSE);
 
-		if (switch_queue_pop(mod_sofia_globals.presence_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		if (switch_queue_pop_timeout(mod_sofia_globals.presence_queue, &pop, next > 0 ? next : 1) == SWITCH_STATUS_SUCCESS) {
 			switch_event_t *event = (switch_event_t *) pop;
 
 			if (!pop) {
@@ -1659,6 +2113,7 @@ void *SWITCH_THREAD_FUNC sofia_presence_event_thread_run(switch_thread_t *thread
 	}
 
 	do_flush();
+	sofia_presence_notify_flush(SWITCH_TRUE);
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Event Thread Ended\n");
 
@@ -2191,6 +2646,7 @@ static void _send_presence_notify(sofia_profile_t *profile,
 	const char *tp;
 	char *cparams = NULL;
 	char *path = NULL;
+	int stack;
 
 	if (zstr(full_to) || zstr(full_from) || zstr(o_contact)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MISSING DATA TO SEND NOTIFY.\n");
@@ -2263,6 +2719,20 @@ static void _send_presence_notify(sofia_profile_t *profile,
 		}
 	}
 
+	/* a registration taken on another sip-stacks stack is notified from that stack */
+	if ((stack = sofia_glue_contact_stack(profile, o_contact))) {
+		sofia_transport_t transport = sofia_glue_str2transport(tp);
+		char *stack_contact;
+
+		if ((stack_contact = sofia_glue_get_stack_contact(profile, stack, remote_ip, transport))) {
+			contact_str = stack_contact;
+
+			if (user_via) {
+				free(user_via);
+				user_via = sofia_glue_create_stack_via(profile, stack, transport);
+			}
+		}
+	}
 
 	if ((to_uri = sofia_glue_get_url_from_contact((char *)full_to, 1))) {
 		char *p;
@@ -2333,7 +2803,7 @@ static void _send_presence_notify(sofia_profile_t *profile,
 		contact_str = send_contact;
 	}
 
-	nh = nua_handle(profile->nua, NULL, NUTAG_URL(contact), SIPTAG_CONTACT_STR(contact_str), TAG_END());
+	nh = nua_handle(sofia_glue_stack_nua(profile, stack), NULL, NUTAG_URL(contact), SIPTAG_CONTACT_STR(contact_str), TAG_END());
 	cseq = sip_cseq_create(nua_handle_get_home(nh), callsequence, SIP_METHOD_NOTIFY);
 	nua_handle_bind(nh, &mod_sofia_globals.destroy_private);
 
@@ -2372,6 +2842,526 @@ static void _send_presence_notify(sofia_profile_t *profile,
 }
 
 
+/*
+ * Output stage for the NOTIFYs that carry presence and dialog state to subscribers.
+ * presence-notify-coalesce-ms holds a subscription to one NOTIFY per window, the held one always
+ * carrying the latest state, and presence-notify-rate/-burst shape each watcher (network ip:port)
+ * with a token bucket. A NOTIFY that ends the subscription is never held.
+ */
+
+typedef struct pres_notify_s {
+	char *key;
+	char *profile_name;
+	char *watcher;
+	char *full_to;
+	char *full_from;
+	char *contact;
+	char *expires;
+	char *call_id;
+	char *event;
+	char *remote_ip;
+	char *remote_port;
+	char *ct;
+	char *pl;
+	int pending;
+	int held_pos;
+	switch_time_t due;
+	switch_time_t last_sent;
+	switch_time_t idle_expires;
+	switch_time_t window;
+	uint32_t rate;
+	uint32_t burst;
+	struct pres_notify_s *idle_prev;
+	struct pres_notify_s *idle_next;
+	struct pres_notify_s *next;
+} pres_notify_t;
+
+typedef struct pres_bucket_s {
+	char *watcher;
+	double tokens;
+	switch_time_t last;
+	struct pres_bucket_s *prev;
+	struct pres_bucket_s *next;
+} pres_bucket_t;
+
+/*
+ * Every entry in notifies is either held, in the held heap ordered on due, or idle, in the idle list
+ * ordered on when it may be forgotten. Buckets are kept least recently used first. A flush only looks at the heads.
+ */
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *notifies;
+	switch_hash_t *buckets;
+	pres_notify_t **held;
+	int pending;
+	int held_size;
+	pres_notify_t *idle_head;
+	pres_notify_t *idle_tail;
+	pres_bucket_t *bucket_head;
+	pres_bucket_t *bucket_tail;
+} pres_notify_globals;
+
+void sofia_presence_notify_init(void)
+{
+	switch_mutex_init(&pres_notify_globals.mutex, SWITCH_MUTEX_NESTED, mod_sofia_globals.pool);
+	switch_core_hash_init(&pres_notify_globals.notifies);
+	switch_core_hash_init(&pres_notify_globals.buckets);
+}
+
+void sofia_presence_notify_destroy(void)
+{
+	if (!pres_notify_globals.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(pres_notify_globals.mutex);
+	switch_core_hash_destroy(&pres_notify_globals.notifies);
+	switch_core_hash_destroy(&pres_notify_globals.buckets);
+	switch_safe_free(pres_notify_globals.held);
+	pres_notify_globals.pending = pres_notify_globals.held_size = 0;
+	pres_notify_globals.idle_head = pres_notify_globals.idle_tail = NULL;
+	pres_notify_globals.bucket_head = pres_notify_globals.bucket_tail = NULL;
+	switch_mutex_unlock(pres_notify_globals.mutex);
+}
+
+static void pres_notify_clear(pres_notify_t *n)
+{
+	switch_safe_free(n->full_to);
+	switch_safe_free(n->full_from);
+	switch_safe_free(n->contact);
+	switch_safe_free(n->expires);
+	switch_safe_free(n->call_id);
+	switch_safe_free(n->event);
+	switch_safe_free(n->remote_ip);
+	switch_safe_free(n->remote_port);
+	switch_safe_free(n->ct);
+	switch_safe_free(n->pl);
+}
+
+static void pres_notify_destroy(void *ptr)
+{
+	pres_notify_t *n = (pres_notify_t *) ptr;
+
+	pres_notify_clear(n);
+	switch_safe_free(n->key);
+	switch_safe_free(n->profile_name);
+	switch_safe_free(n->watcher);
+	free(n);
+}
+
+static void pres_bucket_destroy(void *ptr)
+{
+	pres_bucket_t *b = (pres_bucket_t *) ptr;
+
+	switch_safe_free(b->watcher);
+	free(b);
+}
+
+static char *pres_notify_dup(const char *s)
+{
+	return s ? strdup(s) : NULL;
+}
+
+static void pres_notify_store(pres_notify_t *n, const char *full_to, const char *full_from, const char *contact, const char *expires,
+							  const char *call_id, const char *event, const char *remote_ip, const char *remote_port,
+							  const char *ct, const char *pl)
+{
+	pres_notify_clear(n);
+	n->full_to = pres_notify_dup(full_to);
+	n->full_from = pres_notify_dup(full_from);
+	n->contact = pres_notify_dup(contact);
+	n->expires = pres_notify_dup(expires);
+	n->call_id = pres_notify_dup(call_id);
+	n->event = pres_notify_dup(event);
+	n->remote_ip = pres_notify_dup(remote_ip);
+	n->remote_port = pres_notify_dup(remote_port);
+	n->ct = pres_notify_dup(ct);
+	n->pl = pres_notify_dup(pl);
+}
+
+/* the held heap and the idle and bucket lists, all called with pres_notify_globals.mutex held */
+
+static void pres_held_swap(int a, int b)
+{
+	pres_notify_t *tmp = pres_notify_globals.held[a];
+
+	pres_notify_globals.held[a] = pres_notify_globals.held[b];
+	pres_notify_globals.held[b] = tmp;
+	pres_notify_globals.held[a]->held_pos = a;
+	pres_notify_globals.held[b]->held_pos = b;
+}
+
+static void pres_held_up(int i)
+{
+	while (i > 0 && pres_notify_globals.held[(i - 1) / 2]->due > pres_notify_globals.held[i]->due) {
+		pres_held_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void pres_held_down(int i)
+{
+	pres_notify_t **held = pres_notify_globals.held;
+
+	for (;;) {
+		int l = i * 2 + 1, r = l + 1, m = i;
+
+		if (l < pres_notify_globals.pending && held[l]->due < held[m]->due) {
+			m = l;
+		}
+		if (r < pres_notify_globals.pending && held[r]->due < held[m]->due) {
+			m = r;
+		}
+		if (m == i) {
+			break;
+		}
+		pres_held_swap(i, m);
+		i = m;
+	}
+}
+
+static void pres_held_push(pres_notify_t *n)
+{
+	if (pres_notify_globals.pending == pres_notify_globals.held_size) {
+		pres_notify_globals.held_size = pres_notify_globals.held_size ? pres_notify_globals.held_size * 2 : 64;
+		pres_notify_globals.held = realloc(pres_notify_globals.held, pres_notify_globals.held_size * sizeof(pres_notify_t *));
+		switch_assert(pres_notify_globals.held);
+	}
+
+	n->pending = 1;
+	n->held_pos = pres_notify_globals.pending++;
+	pres_notify_globals.held[n->held_pos] = n;
+	pres_held_up(n->held_pos);
+}
+
+static void pres_held_remove(pres_notify_t *n)
+{
+	int i = n->held_pos, last = --pres_notify_globals.pending;
+
+	if (i != last) {
+		pres_notify_globals.held[i] = pres_notify_globals.held[last];
+		pres_notify_globals.held[i]->held_pos = i;
+		pres_held_up(i);
+		pres_held_down(pres_notify_globals.held[i]->held_pos);
+	}
+
+	n->pending = 0;
+}
+
+static void pres_idle_unlink(pres_notify_t *n)
+{
+	if (n->idle_prev) {
+		n->idle_prev->idle_next = n->idle_next;
+	} else if (pres_notify_globals.idle_head == n) {
+		pres_notify_globals.idle_head = n->idle_next;
+	}
+
+	if (n->idle_next) {
+		n->idle_next->idle_prev = n->idle_prev;
+	} else if (pres_notify_globals.idle_tail == n) {
+		pres_notify_globals.idle_tail = n->idle_prev;
+	}
+
+	n->idle_prev = n->idle_next = NULL;
+}
+
+/* an idle entry is forgotten a second after its window closed, windows differ per profile so the list is
+   kept sorted on that time, searched from the tail where nearly every entry lands */
+static void pres_idle_append(pres_notify_t *n)
+{
+	pres_notify_t *p = pres_notify_globals.idle_tail;
+
+	n->idle_expires = n->last_sent + n->window + 1000000;
+
+	while (p && p->idle_expires > n->idle_expires) {
+		p = p->idle_prev;
+	}
+
+	n->idle_prev = p;
+	if (p) {
+		n->idle_next = p->idle_next;
+		p->idle_next = n;
+	} else {
+		n->idle_next = pres_notify_globals.idle_head;
+		pres_notify_globals.idle_head = n;
+	}
+
+	if (n->idle_next) {
+		n->idle_next->idle_prev = n;
+	} else {
+		pres_notify_globals.idle_tail = n;
+	}
+}
+
+static void pres_bucket_unlink(pres_bucket_t *b)
+{
+	if (b->prev) {
+		b->prev->next = b->next;
+	} else if (pres_notify_globals.bucket_head == b) {
+		pres_notify_globals.bucket_head = b->next;
+	}
+
+	if (b->next) {
+		b->next->prev = b->prev;
+	} else if (pres_notify_globals.bucket_tail == b) {
+		pres_notify_globals.bucket_tail = b->prev;
+	}
+
+	b->prev = b->next = NULL;
+}
+
+static void pres_bucket_append(pres_bucket_t *b)
+{
+	b->next = NULL;
+	if ((b->prev = pres_notify_globals.bucket_tail)) {
+		b->prev->next = b;
+	} else {
+		pres_notify_globals.bucket_head = b;
+	}
+	pres_notify_globals.bucket_tail = b;
+}
+
+/* same test _send_presence_notify() uses to pick "terminated" */
+static switch_bool_t pres_notify_active(const char *expires)
+{
+	long ltmp = expires ? atol(expires) : 0;
+
+	return (ltmp > 0 && ltmp - (long) switch_epoch_time_now(NULL) > 0) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/* Takes a token from the watcher's bucket, returns 0 on success or how long until one is available. */
+static switch_time_t pres_bucket_take(uint32_t rate, uint32_t burst, const char *watcher, switch_time_t now)
+{
+	pres_bucket_t *b;
+	double max = burst ? burst : rate;
+
+	if (!rate) {
+		return 0;
+	}
+
+	if (!(b = switch_core_hash_find(pres_notify_globals.buckets, watcher))) {
+		switch_zmalloc(b, sizeof(*b));
+		b->watcher = strdup(watcher);
+		b->tokens = max;
+		b->last = now;
+		if (switch_core_hash_insert_destructor(pres_notify_globals.buckets, watcher, b, pres_bucket_destroy) != SWITCH_STATUS_SUCCESS) {
+			pres_bucket_destroy(b);
+			return 0;
+		}
+	} else {
+		pres_bucket_unlink(b);
+	}
+
+	pres_bucket_append(b);
+
+	b->tokens += (double) (now - b->last) * rate / 1000000;
+	if (b->tokens > max) {
+		b->tokens = max;
+	}
+	b->last = now;
+
+	if (b->tokens >= 1) {
+		b->tokens -= 1;
+		return 0;
+	}
+
+	return (switch_time_t) ((1 - b->tokens) * 1000000 / rate) + 1;
+}
+
+static void queue_presence_notify(sofia_profile_t *profile, const char *full_to, const char *full_from, const char *contact,
+								  const char *expires, const char *call_id, const char *event, const char *remote_ip,
+								  const char *remote_port, const char *ct, const char *pl)
+{
+	pres_notify_t *n;
+	char *key;
+	switch_time_t now, wait = 0, window;
+	int send_now = 0;
+
+	if ((!profile->pres_notify_window && !profile->pres_notify_rate) || !pres_notify_globals.mutex || zstr(call_id) || zstr(event)) {
+		send_presence_notify(profile, full_to, full_from, contact, expires, call_id, event, remote_ip, remote_port, ct, pl, NULL);
+		return;
+	}
+
+	key = switch_mprintf("%s/%s/%s", profile->name, call_id, event);
+	now = switch_micro_time_now();
+	window = (switch_time_t) profile->pres_notify_window * 1000;
+
+	switch_mutex_lock(pres_notify_globals.mutex);
+
+	n = switch_core_hash_find(pres_notify_globals.notifies, key);
+
+	if (!pres_notify_active(expires)) {
+		/* the subscription is over, whatever was held for it is stale */
+		if (n) {
+			if (n->pending) {
+				pres_held_remove(n);
+			} else {
+				pres_idle_unlink(n);
+			}
+			switch_core_hash_delete(pres_notify_globals.notifies, key);
+		}
+		send_now = 1;
+	} else {
+		if (!n) {
+			switch_zmalloc(n, sizeof(*n));
+			n->key = strdup(key);
+			n->profile_name = strdup(profile->name);
+			if (zstr(remote_ip)) {
+				n->watcher = switch_mprintf("%s/%s", profile->name, contact);
+			} else {
+				n->watcher = switch_mprintf("%s/%s:%s", profile->name, remote_ip, switch_str_nil(remote_port));
+			}
+			switch_core_hash_insert_destructor(pres_notify_globals.notifies, key, n, pres_notify_destroy);
+			pres_idle_append(n);
+		}
+
+		n->window = window;
+		n->rate = profile->pres_notify_rate;
+		n->burst = profile->pres_notify_burst;
+
+		if (n->pending) {
+			/* the latest state replaces the one still waiting */
+			pres_notify_store(n, full_to, full_from, contact, expires, call_id, event, remote_ip, remote_port, ct, pl);
+			profile->pres_notify_coalesced++;
+		} else if (now - n->last_sent >= window && !(wait = pres_bucket_take(n->rate, n->burst, n->watcher, now))) {
+			n->last_sent = now;
+			pres_idle_unlink(n);
+			pres_idle_append(n);
+			send_now = 1;
+		} else {
+			pres_notify_store(n, full_to, full_from, contact, expires, call_id, event, remote_ip, remote_port, ct, pl);
+			n->due = n->last_sent + window;
+			if (now + wait > n->due) {
+				n->due = now + wait;
+			}
+			pres_idle_unlink(n);
+			pres_held_push(n);
+
+			if (wait) {
+				profile->pres_notify_shaped++;
+			}
+		}
+	}
+
+	switch_mutex_unlock(pres_notify_globals.mutex);
+
+	free(key);
+
+	if (send_now) {
+		send_presence_notify(profile, full_to, full_from, contact, expires, call_id, event, remote_ip, remote_port, ct, pl, NULL);
+	}
+}
+
+/* A NOTIFY sent around the stage carries newer state than anything still held for the same subscription and
+   event, which must not be flushed after it. */
+static void pres_notify_supersede(sofia_profile_t *profile, const char *call_id, const char *event)
+{
+	pres_notify_t *n;
+	char *key;
+
+	if (!pres_notify_globals.mutex || zstr(call_id) || zstr(event)) {
+		return;
+	}
+
+	key = switch_mprintf("%s/%s/%s", profile->name, call_id, event);
+
+	switch_mutex_lock(pres_notify_globals.mutex);
+	if (pres_notify_globals.notifies && (n = switch_core_hash_find(pres_notify_globals.notifies, key))) {
+		if (n->pending) {
+			pres_held_remove(n);
+			pres_notify_clear(n);
+		} else {
+			pres_idle_unlink(n);
+		}
+		n->last_sent = switch_micro_time_now();
+		pres_idle_append(n);
+	}
+	switch_mutex_unlock(pres_notify_globals.mutex);
+
+	free(key);
+}
+
+/*
+ * Sends the held NOTIFYs that are due, all of them when force is set. Runs on the presence event thread
+ * and returns how long it may sleep before the next one is due, at most 100ms.
+ */
+static switch_interval_time_t sofia_presence_notify_flush(switch_bool_t force)
+{
+	pres_notify_t *send_list = NULL, *n, *sn;
+	pres_bucket_t *b;
+	switch_time_t now = switch_micro_time_now(), wait;
+	switch_interval_time_t next = 100000;
+
+	if (!pres_notify_globals.mutex) {
+		return next;
+	}
+
+	switch_mutex_lock(pres_notify_globals.mutex);
+
+	if (!pres_notify_globals.notifies) {
+		switch_mutex_unlock(pres_notify_globals.mutex);
+		return next;
+	}
+
+	while (pres_notify_globals.pending && (force || pres_notify_globals.held[0]->due <= now)) {
+		n = pres_notify_globals.held[0];
+
+		if (!force && (wait = pres_bucket_take(n->rate, n->burst, n->watcher, now))) {
+			n->due = now + wait;
+			pres_held_down(0);
+			continue;
+		}
+
+		pres_held_remove(n);
+
+		/* hand the held state over to a copy so it can be sent without the lock */
+		switch_zmalloc(sn, sizeof(*sn));
+		*sn = *n;
+		sn->key = NULL;
+		sn->profile_name = strdup(n->profile_name);
+		sn->watcher = NULL;
+		sn->next = send_list;
+		send_list = sn;
+
+		n->full_to = n->full_from = n->contact = n->expires = n->call_id = n->event = NULL;
+		n->remote_ip = n->remote_port = n->ct = n->pl = NULL;
+		n->last_sent = now;
+		pres_idle_append(n);
+	}
+
+	while ((n = pres_notify_globals.idle_head) && n->idle_expires < now) {
+		pres_idle_unlink(n);
+		switch_core_hash_delete(pres_notify_globals.notifies, n->key);
+	}
+
+	while ((b = pres_notify_globals.bucket_head) && now - b->last > 60000000) {
+		pres_bucket_unlink(b);
+		switch_core_hash_delete(pres_notify_globals.buckets, b->watcher);
+	}
+
+	if (pres_notify_globals.pending && pres_notify_globals.held[0]->due - now < next) {
+		next = pres_notify_globals.held[0]->due - now;
+	}
+
+	switch_mutex_unlock(pres_notify_globals.mutex);
+
+	while ((sn = send_list)) {
+		sofia_profile_t *profile;
+
+		send_list = sn->next;
+
+		if ((profile = sofia_glue_find_profile(sn->profile_name))) {
+			send_presence_notify(profile, sn->full_to, sn->full_from, sn->contact, sn->expires, sn->call_id, sn->event,
+								 sn->remote_ip, sn->remote_port, sn->ct, sn->pl, NULL);
+			sofia_glue_release_profile(profile);
+		}
+
+		pres_notify_destroy(sn);
+	}
+
+	return next;
+}
+
 static int sofia_dialog_probe_notify_callback(void *pArg, int argc, char **argv, char **columnNames)
 {
 	struct rfc4235_helper *sh = (struct rfc4235_helper *) pArg;
@@ -2383,6 +3373,7 @@ static int sofia_dialog_probe_notify_callback(void *pArg, int argc, char **argv,
 	char *host = argv[3];
 	char *event = argv[4];
 	char *version = argv[5];
+	char version_buf[16] = "";
 	char *notify_state = argv[6];
 	char *full_to = argv[7];
 	char *full_from = argv[8];
@@ -2415,6 +3406,9 @@ static int sofia_dialog_probe_notify_callback(void *pArg, int argc, char **argv,
 
 	if (zstr(version)) {
 		version = "0";
+	} else {
+		switch_snprintf(version_buf, sizeof(version_buf), "%d", pres_sub_next_version(sh->profile, call_id, version));
+		version = version_buf;
 	}
 
 	stream.write_function(&stream,
@@ -2441,6 +3435,7 @@ static int sofia_dialog_probe_notify_callback(void *pArg, int argc, char **argv,
 	}
 
 
+	pres_notify_supersede(sh->profile, call_id, event);
 	send_presence_notify(sh->profile,
 						 full_to,
 						 full_from,
@@ -2634,6 +3629,7 @@ static int sofia_presence_sub_callback(void *pArg, int argc, char **argv, char *
 
 	char status_line[256] = "";
 	char *version = "0";
+	char version_buf[16] = "";
 	char *presence_id = NULL;
 	char *free_me = NULL;
 	int holding = 0;
@@ -2670,6 +3666,10 @@ static int sofia_presence_sub_callback(void *pArg, int argc, char **argv, char *
 		dialog_status = argv[20];
 		dialog_rpid = argv[21];
 		version = argv[22];
+		if (!zstr(version)) {
+			switch_snprintf(version_buf, sizeof(version_buf), "%d", pres_sub_next_version(profile, call_id, version));
+			version = version_buf;
+		}
 		presence_id = argv[23];
 		orig_proto = argv[24];
 		full_to = argv[25];
@@ -3219,7 +4219,7 @@ static int sofia_presence_sub_callback(void *pArg, int argc, char **argv, char *
 		}
 	}
 
-	send_presence_notify(profile, full_to, full_from, contact, expires, call_id, event, ip, port, ct, pl, NULL);
+	queue_presence_notify(profile, full_to, full_from, contact, expires, call_id, event, ip, port, ct, pl);
 
 
  end:
@@ -3270,6 +4270,7 @@ static int sofia_presence_mwi_callback(void *pArg, int argc, char **argv, char *
 		}
 	}
 
+	pres_notify_supersede(profile, call_id, event);
 	send_presence_notify(profile,
 						 full_to,
 						 full_from,
@@ -3371,6 +4372,7 @@ static int broadsoft_sla_notify_callback(void *pArg, int argc, char **argv, char
 
 	}
 
+	pres_notify_supersede(sh->profile, call_id, event);
 	send_presence_notify(sh->profile, argv[5], argv[6], argv[7], argv[8], call_id, event, argv[9], argv[10], NULL, NULL, tmp);
 
 	sh->total++;
@@ -3924,6 +4926,7 @@ void sofia_presence_handle_sip_i_subscribe(int status,
 		}
 
 		sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+		sofia_presence_sub_load(profile, call_id);
 	} else {
 
 		if (sub_state == nua_substate_terminated) {
@@ -3937,6 +4940,7 @@ void sofia_presence_handle_sip_i_subscribe(int status,
 
 			switch_assert(sql != NULL);
 			sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+			sofia_presence_sub_del(profile, call_id);
 			sstr = switch_mprintf("terminated;reason=noresource");
 
 		} else {
@@ -3971,6 +4975,7 @@ void sofia_presence_handle_sip_i_subscribe(int status,
 
 
 			sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+			sofia_presence_sub_load(profile, call_id);
 			sstr = switch_mprintf("active;expires=%ld", exp_delta);
 		}
 
@@ -4529,12 +5534,23 @@ static int sofia_presence_send_sql(void *pArg, int argc, char **argv, char **col
 		}
 	}
 
+	pres_notify_supersede(cb->profile, argv[4], argv[5]);
 	send_presence_notify(cb->profile, argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7], argv[8], argv[9], NULL);
 	cb->ttl++;
 
 	return 0;
 }
 
+/* the final NOTIFY of an expired subscription takes its version from the in-memory row like every other one */
+static int sofia_presence_expire_sql(void *pArg, int argc, char **argv, char **columnNames)
+{
+	struct pres_sql_cb *cb = (struct pres_sql_cb *) pArg;
+
+	pres_sub_next_version(cb->profile, argv[4], NULL);
+
+	return sofia_presence_send_sql(pArg, argc, argv, columnNames);
+}
+
 
 uint32_t sofia_presence_contact_count(sofia_profile_t *profile, const char *contact_str)
 {
@@ -5075,6 +6091,10 @@ void sofia_presence_check_subscriptions(sofia_profile_t *profile, time_t now)
 			return;
 		}
 
+		if (!profile->pres_index_loaded) {
+			sofia_presence_sub_load_all(profile, now);
+		}
+
 		sql = switch_mprintf("update sip_subscriptions set version=version+1 where "
 							 "((expires > 0 and expires <= %ld)) and profile_name='%q' and hostname='%q'",
 							 (long) now, profile->name, mod_sofia_globals.hostname);
@@ -5087,10 +6107,15 @@ void sofia_presence_check_subscriptions(sofia_profile_t *profile, time_t now)
 							 " from sip_subscriptions where ((expires > 0 and expires <= %ld)) and profile_name='%q' and hostname='%q'",
 							 (long) now, profile->name, mod_sofia_globals.hostname);
 
-		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_presence_send_sql, &cb);
+		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_presence_expire_sql, &cb);
 		switch_safe_free(sql);
 
 		if (cb.ttl) {
+			sql = switch_mprintf("select call_id from sip_subscriptions where ((expires > 0 and expires <= %ld)) "
+								 "and profile_name='%q' and hostname='%q'",
+								 (long) now, profile->name, mod_sofia_globals.hostname);
+			sofia_presence_sub_forget(profile, &sql);
+
 			sql = switch_mprintf("delete from sip_subscriptions where ((expires > 0 and expires <= %ld)) "
 								 "and profile_name='%q' and hostname='%q'",
 								 (long) now, profile->name, mod_sofia_globals.hostname);
@@ -41,6 +41,188 @@
 #include "sofia-sip/hostdomain.h"
 #include "sip-dig.h"
 
+/*
+ * Digest nonces live in memory unless the profile keeps them in its database, which is what lets nodes
+ * sharing an odbc-dsn validate each other's challenges (auth-nonce-store, defaults to db when odbc-dsn is set).
+ */
+
+typedef struct {
+	time_t expires;
+	unsigned long last_nc;
+} sofia_nonce_t;
+
+static switch_bool_t sofia_reg_nonce_in_db(sofia_profile_t *profile)
+{
+	return (profile->auth_nonce_db > 0 || (profile->auth_nonce_db < 0 && profile->odbc_dsn)) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/* nonces are kept per profile, like the sip_authentication rows of each profile's own database */
+static switch_bool_t sofia_reg_nonce_key(sofia_profile_t *profile, const char *nonce, char *buf, switch_size_t len)
+{
+	if (zstr(nonce) || strlen(profile->name) + strlen(nonce) + 2 > len) {
+		return SWITCH_FALSE;
+	}
+
+	switch_snprintf(buf, len, "%s/%s", profile->name, nonce);
+
+	return SWITCH_TRUE;
+}
+
+static sofia_nonce_shard_t *sofia_reg_nonce_shard(const char *key)
+{
+	return &mod_sofia_globals.nonce_shards[switch_hashfunc_default(key, NULL) % SOFIA_NONCE_SHARDS];
+}
+
+void sofia_reg_nonce_store_init(void)
+{
+	int i;
+
+	for (i = 0; i < SOFIA_NONCE_SHARDS; i++) {
+		switch_mutex_init(&mod_sofia_globals.nonce_shards[i].mutex, SWITCH_MUTEX_NESTED, mod_sofia_globals.pool);
+		switch_core_hash_init(&mod_sofia_globals.nonce_shards[i].hash);
+	}
+}
+
+void sofia_reg_nonce_store_destroy(void)
+{
+	int i;
+
+	for (i = 0; i < SOFIA_NONCE_SHARDS; i++) {
+		if (mod_sofia_globals.nonce_shards[i].hash) {
+			switch_mutex_lock(mod_sofia_globals.nonce_shards[i].mutex);
+			switch_core_hash_destroy(&mod_sofia_globals.nonce_shards[i].hash);
+			switch_mutex_unlock(mod_sofia_globals.nonce_shards[i].mutex);
+		}
+	}
+}
+
+static void sofia_reg_nonce_add(sofia_profile_t *profile, const char *nonce, time_t expires)
+{
+	sofia_nonce_shard_t *shard;
+	sofia_nonce_t *n;
+	char key[256];
+
+	if (!sofia_reg_nonce_key(profile, nonce, key, sizeof(key))) {
+		return;
+	}
+
+	shard = sofia_reg_nonce_shard(key);
+
+	switch_zmalloc(n, sizeof(*n));
+	n->expires = expires;
+
+	switch_mutex_lock(shard->mutex);
+	if (switch_core_hash_insert_auto_free(shard->hash, key, n) != SWITCH_STATUS_SUCCESS) {
+		free(n);
+	}
+	switch_mutex_unlock(shard->mutex);
+}
+
+/* Looks the nonce up and checks that a nonce-count is past the last one accepted.  The count is only taken
+   by sofia_reg_nonce_commit() once the digest has been verified. */
+static switch_bool_t sofia_reg_nonce_check(sofia_profile_t *profile, const char *nonce, switch_bool_t has_nc, unsigned long nc, unsigned long *last_nc)
+{
+	sofia_nonce_shard_t *shard;
+	sofia_nonce_t *n;
+	switch_bool_t r = SWITCH_FALSE;
+	char key[256];
+
+	if (!sofia_reg_nonce_key(profile, nonce, key, sizeof(key))) {
+		return SWITCH_FALSE;
+	}
+
+	shard = sofia_reg_nonce_shard(key);
+
+	switch_mutex_lock(shard->mutex);
+	if ((n = switch_core_hash_find(shard->hash, key)) && (!has_nc || n->last_nc < nc)) {
+		*last_nc = n->last_nc;
+		r = SWITCH_TRUE;
+	}
+	switch_mutex_unlock(shard->mutex);
+
+	return r;
+}
+
+/* Takes the nonce-count of a verified request.  Returns SWITCH_FALSE when a racing request with the same
+   count got there first, so one count is only ever accepted once. */
+static switch_bool_t sofia_reg_nonce_commit(sofia_profile_t *profile, const char *nonce, time_t expires, unsigned long nc)
+{
+	sofia_nonce_shard_t *shard;
+	sofia_nonce_t *n;
+	switch_bool_t r = SWITCH_FALSE;
+	char key[256];
+
+	if (!sofia_reg_nonce_key(profile, nonce, key, sizeof(key))) {
+		return SWITCH_FALSE;
+	}
+
+	shard = sofia_reg_nonce_shard(key);
+
+	switch_mutex_lock(shard->mutex);
+	if ((n = switch_core_hash_find(shard->hash, key)) && nc > n->last_nc) {
+		n->expires = expires;
+		n->last_nc = nc;
+		r = SWITCH_TRUE;
+	}
+	switch_mutex_unlock(shard->mutex);
+
+	return r;
+}
+
+static void sofia_reg_nonce_del(sofia_profile_t *profile, const char *nonce)
+{
+	sofia_nonce_shard_t *shard;
+	char key[256];
+
+	if (!sofia_reg_nonce_key(profile, nonce, key, sizeof(key))) {
+		return;
+	}
+
+	shard = sofia_reg_nonce_shard(key);
+
+	switch_mutex_lock(shard->mutex);
+	switch_core_hash_delete(shard->hash, key);
+	switch_mutex_unlock(shard->mutex);
+}
+
+typedef struct {
+	time_t now;
+	const char *prefix;
+	switch_size_t prefix_len;
+} sofia_nonce_expire_t;
+
+static switch_bool_t sofia_reg_nonce_expired(const void *key, const void *val, void *pData)
+{
+	const sofia_nonce_t *n = (const sofia_nonce_t *) val;
+	const sofia_nonce_expire_t *ex = (const sofia_nonce_expire_t *) pData;
+
+	if (strncmp((const char *) key, ex->prefix, ex->prefix_len)) {
+		return SWITCH_FALSE;
+	}
+
+	return (n->expires > 0 && (!ex->now || n->expires <= ex->now)) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/* drops the profile's expired nonces, a zero now drops all of them like the "expires > 0" sql it stands in for */
+static void sofia_reg_nonce_expire(sofia_profile_t *profile, time_t now)
+{
+	sofia_nonce_expire_t ex = { 0 };
+	char *prefix = switch_mprintf("%s/", profile->name);
+	int i;
+
+	ex.now = now;
+	ex.prefix = prefix;
+	ex.prefix_len = strlen(prefix);
+
+	for (i = 0; i < SOFIA_NONCE_SHARDS; i++) {
+		switch_mutex_lock(mod_sofia_globals.nonce_shards[i].mutex);
+		switch_core_hash_delete_multi(mod_sofia_globals.nonce_shards[i].hash, sofia_reg_nonce_expired, &ex);
+		switch_mutex_unlock(mod_sofia_globals.nonce_shards[i].mutex);
+	}
+
+	switch_safe_free(prefix);
+}
+
 static void sofia_reg_new_handle(sofia_gateway_t *gateway_ptr, int attach)
 {
 	int ss_state = nua_callstate_authenticating;
@@ -307,12 +489,55 @@ void sofia_sub_check_gateway(sofia_profile_t *profile, time_t now)
 	switch_mutex_unlock(profile->gw_mutex);
 }
 
+/* the next time sofia_reg_check_gateway() has anything to do for this gateway, a state change made elsewhere is picked up on the next tick anyway */
+static time_t sofia_reg_gateway_next_check(sofia_gateway_t *gateway_ptr, time_t now)
+{
+	time_t next;
+
+	switch (gateway_ptr->state) {
+	case REG_STATE_DOWN:
+	case REG_STATE_NOREG:
+		next = now + GATEWAY_IDLE_SECONDS;
+		break;
+	case REG_STATE_UNREGED:
+		next = gateway_ptr->reg_start;
+		break;
+	case REG_STATE_TRYING:
+		next = gateway_ptr->reg_timeout;
+		break;
+	case REG_STATE_FAIL_WAIT:
+		next = gateway_ptr->retry;
+		break;
+	case REG_STATE_REGISTER:
+	case REG_STATE_UNREGISTER:
+	case REG_STATE_TIMEOUT:
+	case REG_STATE_FAILED:
+		next = now;
+		break;
+	default:
+		next = gateway_ptr->expires;
+		break;
+	}
+
+	if (gateway_ptr->ping && gateway_ptr->ping < next && (gateway_ptr->state == REG_STATE_NOREG || gateway_ptr->state == REG_STATE_REGED)) {
+		next = gateway_ptr->ping;
+	}
+
+	if (next > now + GATEWAY_IDLE_SECONDS) {
+		next = now + GATEWAY_IDLE_SECONDS;
+	}
+
+	return next;
+}
+
 void sofia_reg_check_gateway(sofia_profile_t *profile, time_t now)
 {
 	sofia_gateway_t *check, *gateway_ptr, *last = NULL;
 	switch_event_t *event;
 	int delta = 0;
 
+	/* hash_mutex before gw_mutex like the gateway console completion, it is only needed for the removal pass */
+	switch_mutex_lock(mod_sofia_globals.hash_mutex);
 	switch_mutex_lock(profile->gw_mutex);
 	for (gateway_ptr = profile->gateways; gateway_ptr; gateway_ptr = gateway_ptr->next) {
 		if (gateway_ptr->deleted) {
@@ -322,10 +547,15 @@ void sofia_reg_check_gateway(sofia_profile_t *profile, time_t now)
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Removing gateway %s from hash.\n", pkey);
 				switch_core_hash_delete(mod_sofia_globals.gateway_hash, pkey);
 				switch_core_hash_delete(mod_sofia_globals.gateway_hash, gateway_ptr->name);
+				sofia_reg_unindex_gateway_realm(gateway_ptr);
 				free(pkey);
 			}
 
 			if (gateway_ptr->state == REG_STATE_NOREG || gateway_ptr->state == REG_STATE_DOWN) {
+				if (gateway_ptr->reg_inflight) {
+					gateway_ptr->reg_inflight = 0;
+					profile->gateway_reg_inflight--;
+				}
 
 				if (last) {
 					last->next = gateway_ptr->next;
@@ -352,17 +582,27 @@ void sofia_reg_check_gateway(sofia_profile_t *profile, time_t now)
 			last = gateway_ptr;
 		}
 	}
+	switch_mutex_unlock(mod_sofia_globals.hash_mutex);
 
 	for (gateway_ptr = profile->gateways; gateway_ptr; gateway_ptr = gateway_ptr->next) {
 		reg_state_t ostate = gateway_ptr->state;
 		char *user_via = NULL;
 		char *register_host = NULL;
 
+		if (now && ostate == gateway_ptr->check_state && now < gateway_ptr->next_check) {
+			continue;
+		}
+
 		if (!now && ostate != REG_STATE_NOREG) {
 			gateway_ptr->state = ostate = REG_STATE_UNREGED;
 			gateway_ptr->expires_str = "0";
 		}
 
+		if (gateway_ptr->reg_inflight && ostate != REG_STATE_TRYING) {
+			gateway_ptr->reg_inflight = 0;
+			profile->gateway_reg_inflight--;
+		}
+
 		if (gateway_ptr->ping && !gateway_ptr->pinging && (now >= gateway_ptr->ping && (ostate == REG_STATE_NOREG || ostate == REG_STATE_REGED)) &&
 			!gateway_ptr->deleted) {
 			nua_handle_t *nh = nua_handle(profile->nua, NULL, NUTAG_URL(gateway_ptr->register_url), TAG_END());
@@ -439,6 +679,14 @@ void sofia_reg_check_gateway(sofia_profile_t *profile, time_t now)
 			gateway_ptr->status = SOFIA_GATEWAY_DOWN;
 			break;
 		case REG_STATE_UNREGED:
+			if (now && now < gateway_ptr->reg_start) {
+				break;
+			}
+
+			if (now && profile->gateway_max_inflight && profile->gateway_reg_inflight >= profile->gateway_max_inflight) {
+				break;
+			}
+
 			gateway_ptr->retry = 0;
 
 			if (!gateway_ptr->nh) {
@@ -468,6 +716,8 @@ void sofia_reg_check_gateway(sofia_profile_t *profile, time_t now)
 							 NUTAG_REGISTRAR(gateway_ptr->register_proxy),
 							 NUTAG_OUTBOUND("no-options-keepalive"), NUTAG_OUTBOUND("no-validate"), NUTAG_KEEPALIVE(0), TAG_NULL());
 				gateway_ptr->retry = now + gateway_ptr->retry_seconds;
+				gateway_ptr->reg_inflight = 1;
+				profile->gateway_reg_inflight++;
 			} else {
 				gateway_ptr->status = SOFIA_GATEWAY_DOWN;
 				nua_unregister(gateway_ptr->nh,
@@ -540,6 +790,9 @@ void sofia_reg_check_gateway(sofia_profile_t *profile, time_t now)
 		if (ostate != gateway_ptr->state) {
 			sofia_reg_fire_custom_gateway_state_event(gateway_ptr, 0, NULL);
 		}
+
+		gateway_ptr->check_state = gateway_ptr->state;
+		gateway_ptr->next_check = sofia_reg_gateway_next_check(gateway_ptr, now);
 	}
 	switch_mutex_unlock(profile->gw_mutex);
 }
@@ -609,6 +862,8 @@ int sofia_reg_nat_callback(void *pArg, int argc, char **argv, char **columnNames
 	sofia_destination_t *dst = NULL;
 	switch_uuid_t uuid;
 	sofia_private_t *pvt;
+	int stack = sofia_glue_contact_stack(profile, argv[3]);
+	char *url = sofia_glue_get_stack_url(profile, stack, NULL, SOFIA_TRANSPORT_UDP);
 
 	switch_snprintf(to, sizeof(to), "sip:%s@%s", argv[1], argv[2]);
 
@@ -621,7 +876,8 @@ int sofia_reg_nat_callback(void *pArg, int argc, char **argv, char **columnNames
 	dst = sofia_glue_get_destination(argv[3]);
 	switch_assert(dst);
 
-	nh = nua_handle(profile->nua, NULL, SIPTAG_FROM_STR(profile->url), SIPTAG_TO_STR(to), NUTAG_URL(dst->contact), SIPTAG_CONTACT_STR(profile->url),
+	/* ping from the stack the registration came in on so the same nat binding is refreshed */
+	nh = nua_handle(sofia_glue_stack_nua(profile, stack), NULL, SIPTAG_FROM_STR(url), SIPTAG_TO_STR(to), NUTAG_URL(dst->contact), SIPTAG_CONTACT_STR(url),
 					SIPTAG_CALL_ID_STR(call_id), TAG_END());
 
 	pvt = malloc(sizeof(*pvt));
@@ -680,7 +936,7 @@ int sofia_sla_dialog_del_callback(void *pArg, int argc, char **argv, char **colu
 	sofia_profile_t *profile = (sofia_profile_t *) pArg;
 	nua_handle_t *nh = NULL;
 
-	if ((nh = nua_handle_by_call_id(profile->nua, argv[0]))) {
+	if ((nh = sofia_glue_nh_by_call_id(profile, NULL, argv[0]))) {
 		nua_handle_destroy(nh);
 	}
 
@@ -813,6 +1069,8 @@ void sofia_reg_check_expire(sofia_profile_t *profile, time_t now, int reboot)
 	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_del_callback, profile);
 	free(sql);
 
+	sofia_glue_contact_stack_expire(profile, now ? now : switch_epoch_time_now(NULL));
+
 	if (now) {
 		sql = switch_mprintf("delete from sip_registrations where expires > 0 and expires <= %ld and hostname='%q'",
 						(long) now, mod_sofia_globals.hostname);
@@ -848,14 +1106,18 @@ void sofia_reg_check_expire(sofia_profile_t *profile, time_t now, int reboot)
 
 	sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
 
-	if (now) {
-		sql = switch_mprintf("delete from sip_authentication where expires > 0 and expires <= %ld and hostname='%q'",
-						(long) now, mod_sofia_globals.hostname);
+	if (!sofia_reg_nonce_in_db(profile)) {
+		sofia_reg_nonce_expire(profile, now);
 	} else {
-		sql = switch_mprintf("delete from sip_authentication where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
-	}
+		if (now) {
+			sql = switch_mprintf("delete from sip_authentication where expires > 0 and expires <= %ld and hostname='%q'",
+							(long) now, mod_sofia_globals.hostname);
+		} else {
+			sql = switch_mprintf("delete from sip_authentication where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
+		}
 
-	sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+		sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+	}
 
 	sofia_presence_check_subscriptions(profile, now);
 
@@ -1024,11 +1286,16 @@ void sofia_reg_check_sync(sofia_profile_t *profile)
 	sql = switch_mprintf("delete from sip_presence where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
 	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
 
-	sql = switch_mprintf("delete from sip_authentication where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
-	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+	if (!sofia_reg_nonce_in_db(profile)) {
+		sofia_reg_nonce_expire(profile, 0);
+	} else {
+		sql = switch_mprintf("delete from sip_authentication where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
+		sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+	}
 
 	sql = switch_mprintf("delete from sip_subscriptions where expires >= -1 and hostname='%q'", mod_sofia_globals.hostname);
 	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+	sofia_presence_sub_reset(profile);
 
 	sql = switch_mprintf("delete from sip_dialogs where expires >= -1 and hostname='%q'", mod_sofia_globals.hostname);
 	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
@@ -1151,12 +1418,16 @@ void sofia_reg_auth_challenge(sofia_profile_t *profile, nua_handle_t *nh, sofia_
 	switch_uuid_get(&uuid);
 	switch_uuid_format(uuid_str, &uuid);
 
-	sql = switch_mprintf("insert into sip_authentication (nonce,expires,profile_name,hostname, last_nc) "
-						 "values('%q', %ld, '%q', '%q', 0)", uuid_str,
-						 (long) switch_epoch_time_now(NULL) + (profile->nonce_ttl ? profile->nonce_ttl : DEFAULT_NONCE_TTL) + exptime,
-						 profile->name, mod_sofia_globals.hostname);
-	switch_assert(sql != NULL);
-	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+	if (!sofia_reg_nonce_in_db(profile)) {
+		sofia_reg_nonce_add(profile, uuid_str, switch_epoch_time_now(NULL) + (profile->nonce_ttl ? profile->nonce_ttl : DEFAULT_NONCE_TTL) + exptime);
+	} else {
+		sql = switch_mprintf("insert into sip_authentication (nonce,expires,profile_name,hostname, last_nc) "
+							 "values('%q', %ld, '%q', '%q', 0)", uuid_str,
+							 (long) switch_epoch_time_now(NULL) + (profile->nonce_ttl ? profile->nonce_ttl : DEFAULT_NONCE_TTL) + exptime,
+							 profile->name, mod_sofia_globals.hostname);
+		switch_assert(sql != NULL);
+		sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+	}
 
 	if (!profile->rfc8760_algs_count) {
 		auth_str = switch_mprintf("Digest realm=\"%q\", nonce=\"%q\",%s algorithm=MD5, qop=\"auth\"", realm, uuid_str, stale ? " stale=true," : "");
@@ -1911,6 +2182,12 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		switch_goto_int(r, 0, end);
 	}
 
+	/* remember the sip-stacks stack the registration came in on, requests to it are sent from there */
+	if (profile->sip_stacks > 1 && *contact_str) {
+		sofia_glue_set_contact_stack(profile, contact_str, sofia_glue_stack_index(profile, nua),
+									 exptime ? reg_time + exptime + profile->sip_expires_late_margin : 0);
+	}
+
 
 	/* Does this profile supports multiple registrations ? */
 	multi_reg = (sofia_test_pflag(profile, PFLAG_MULTIREG)) ? 1 : 0;
@@ -2484,7 +2761,7 @@ switch_bool_t sip_resolve_compare(const char *domainname, const char *ip, sofia_
 
 	home = su_home_new(sizeof(*home));
 
-	dig->sres = sres_resolver_new(getenv("SRESOLV_CONF"));
+	dig->sres = sres_resolver_new_with_cache(getenv("SRESOLV_CONF"), mod_sofia_globals.sres_cache, NULL);
 
 	uri = url_hdup(home, (void *)domainname);
 
@@ -3081,7 +3358,24 @@ auth_res_t sofia_reg_parse_auth(sofia_profile_t *profile,
 
 	user_agent = (sip && sip->sip_user_agent) ? sip->sip_user_agent->g_string : "unknown";
 
-	if (zstr(np)) {
+	if (zstr(np) && !sofia_reg_nonce_in_db(profile)) {
+		unsigned long last_nc = 0;
+
+		first = 1;
+
+		if (!sofia_reg_nonce_check(profile, nonce, nc ? SWITCH_TRUE : SWITCH_FALSE, nc ? strtoul(nc, 0, 16) : 0, &last_nc) ||
+			(profile->max_auth_validity != 0 && last_nc >= profile->max_auth_validity)) {
+			sofia_reg_nonce_del(profile, nonce);
+			ret = AUTH_STALE;
+			goto end;
+		}
+
+		switch_copy_string(np, nonce, nplen);
+
+		if (reg_count) {
+			*reg_count = (long) last_nc + 1;
+		}
+	} else if (zstr(np)) {
 		nonce_cb_t cb = { 0 };
 		long nc_long = 0;
 
@@ -3536,14 +3830,22 @@ auth_res_t sofia_reg_parse_auth(sofia_profile_t *profile,
   end:
 
 
-	if (nc && cnonce && qop) {
+	/* the nonce-count only moves once the digest checked out, a bogus response must not use it up for the real client */
+	if (nc && cnonce && qop && ret == AUTH_OK) {
 		ncl = strtoul(nc, 0, 16);
 
-		sql = switch_mprintf("update sip_authentication set expires='%ld',last_nc=%lu where nonce='%q'",
-							 (long)switch_epoch_time_now(NULL) + (profile->nonce_ttl ? profile->nonce_ttl : DEFAULT_NONCE_TTL) + exptime, ncl, nonce);
+		if (!sofia_reg_nonce_in_db(profile)) {
+			if (!sofia_reg_nonce_commit(profile, nonce, switch_epoch_time_now(NULL) + (profile->nonce_ttl ? profile->nonce_ttl : DEFAULT_NONCE_TTL) + exptime, ncl)) {
+				/* a request with the same count was accepted in the meantime */
+				ret = AUTH_STALE;
+			}
+		} else {
+			sql = switch_mprintf("update sip_authentication set expires='%ld',last_nc=%lu where nonce='%q'",
+								 (long)switch_epoch_time_now(NULL) + (profile->nonce_ttl ? profile->nonce_ttl : DEFAULT_NONCE_TTL) + exptime, ncl, nonce);
 
-		switch_assert(sql != NULL);
-		sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+			switch_assert(sql != NULL);
+			sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+		}
 
 		if (ret == AUTH_OK)
 			ret = AUTH_RENEWED;
@@ -3611,23 +3913,56 @@ sofia_gateway_t *sofia_reg_find_gateway__(const char *file, const char *func, in
 }
 
 
-sofia_gateway_t *sofia_reg_find_gateway_by_realm__(const char *file, const char *func, int line, const char *key)
+void sofia_reg_index_gateway_realm(sofia_gateway_t *gateway)
+{
+	sofia_gateway_t *gp;
+
+	if (zstr(gateway->register_realm)) {
+		return;
+	}
+
+	switch_mutex_lock(mod_sofia_globals.hash_mutex);
+	if (!(gp = (sofia_gateway_t *) switch_core_hash_find(mod_sofia_globals.gateway_realm_hash, gateway->register_realm)) || gp->deleted) {
+		switch_core_hash_insert(mod_sofia_globals.gateway_realm_hash, gateway->register_realm, gateway);
+	}
+	switch_mutex_unlock(mod_sofia_globals.hash_mutex);
+}
+
+void sofia_reg_unindex_gateway_realm(sofia_gateway_t *gateway)
 {
-	sofia_gateway_t *gateway = NULL;
 	switch_hash_index_t *hi;
-	const void *var;
 	void *val;
+	sofia_gateway_t *gp;
+
+	if (zstr(gateway->register_realm)) {
+		return;
+	}
 
 	switch_mutex_lock(mod_sofia_globals.hash_mutex);
-	for (hi = switch_core_hash_first(mod_sofia_globals.gateway_hash); hi; hi = switch_core_hash_next(&hi)) {
-		switch_core_hash_this(hi, &var, NULL, &val);
-		if (key && (gateway = (sofia_gateway_t *) val) && !gateway->deleted && gateway->register_realm && !strcasecmp(gateway->register_realm, key)) {
-			break;
-		} else {
-			gateway = NULL;
+	if (switch_core_hash_find(mod_sofia_globals.gateway_realm_hash, gateway->register_realm) == gateway) {
+		switch_core_hash_delete(mod_sofia_globals.gateway_realm_hash, gateway->register_realm);
+
+		/* hand the realm over to another gateway registering to it, if there is one */
+		for (hi = switch_core_hash_first(mod_sofia_globals.gateway_hash); hi; hi = switch_core_hash_next(&hi)) {
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			if ((gp = (sofia_gateway_t *) val) && gp != gateway && !gp->deleted && gp->register_realm && !strcasecmp(gp->register_realm, gateway->register_realm)) {
+				switch_core_hash_insert(mod_sofia_globals.gateway_realm_hash, gp->register_realm, gp);
+				break;
+			}
 		}
+		switch_safe_free(hi);
+	}
+	switch_mutex_unlock(mod_sofia_globals.hash_mutex);
+}
+
+sofia_gateway_t *sofia_reg_find_gateway_by_realm__(const char *file, const char *func, int line, const char *key)
+{
+	sofia_gateway_t *gateway = NULL;
+
+	switch_mutex_lock(mod_sofia_globals.hash_mutex);
+	if (key && (gateway = (sofia_gateway_t *) switch_core_hash_find(mod_sofia_globals.gateway_realm_hash, key)) && gateway->deleted) {
+		gateway = NULL;
 	}
-	switch_safe_free(hi);
 
 	if (gateway) {
 		if (!sofia_test_pflag(gateway->profile, PFLAG_RUNNING) || gateway->deleted) {
@@ -3693,6 +4028,7 @@ switch_status_t sofia_reg_add_gateway(sofia_profile_t *profile, const char *key,
 			switch_core_hash_delete(mod_sofia_globals.gateway_hash, gp->name);
 			switch_core_hash_delete(mod_sofia_globals.gateway_hash, pkey);
 			switch_core_hash_delete(mod_sofia_globals.gateway_hash, key);
+			sofia_reg_unindex_gateway_realm(gp);
 		}
 	}
 
@@ -3701,6 +4037,8 @@ switch_status_t sofia_reg_add_gateway(sofia_profile_t *profile, const char *key,
 		status |= switch_core_hash_insert(mod_sofia_globals.gateway_hash, pkey, gateway);
 		if (status != SWITCH_STATUS_SUCCESS) {
 			status = SWITCH_STATUS_FALSE;
+		} else {
+			sofia_reg_index_gateway_realm(gateway);
 		}
 	} else {
 		status = SWITCH_STATUS_FALSE;
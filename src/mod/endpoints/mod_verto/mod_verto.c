@@ -173,6 +173,102 @@ static void close_socket(ws_socket_t *sock)
 
 void verto_broadcast(const char *event_channel, cJSON *json, const char *key, switch_event_channel_id_t id, void *user_data);
 
+static int verto_new_ticket_key(verto_ticket_key_t *key)
+{
+	if (RAND_bytes(key->name, sizeof(key->name)) != 1 || RAND_bytes(key->aes_key, sizeof(key->aes_key)) != 1 ||
+		RAND_bytes(key->hmac_key, sizeof(key->hmac_key)) != 1) {
+		return 0;
+	}
+
+	key->created = switch_epoch_time_now(NULL);
+
+	return 1;
+}
+
+/* session tickets are sealed with our own keys so they can be rotated, the previous key is still accepted for one period */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int verto_ticket_key_cb(SSL *ssl, unsigned char key_name[16], unsigned char *iv, EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+#else
+static int verto_ticket_key_cb(SSL *ssl, unsigned char key_name[16], unsigned char *iv, EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc)
+#endif
+{
+	verto_profile_t *profile = (verto_profile_t *) SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	verto_ticket_key_t key = { { 0 } };
+	int r = 1;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM params[3];
+#endif
+
+	switch_mutex_lock(profile->ticket_mutex);
+	if (enc) {
+		if (profile->tls_ticket_rotate && switch_epoch_time_now(NULL) - profile->ticket_keys[0].created >= (time_t) profile->tls_ticket_rotate) {
+			verto_ticket_key_t fresh;
+
+			if (verto_new_ticket_key(&fresh)) {
+				profile->ticket_keys[1] = profile->ticket_keys[0];
+				profile->ticket_keys[0] = fresh;
+			}
+		}
+		key = profile->ticket_keys[0];
+	} else if (!memcmp(key_name, profile->ticket_keys[0].name, sizeof(key.name))) {
+		key = profile->ticket_keys[0];
+	} else if (profile->ticket_keys[1].created && !memcmp(key_name, profile->ticket_keys[1].name, sizeof(key.name))) {
+		key = profile->ticket_keys[1];
+		/* good, but have the client take a ticket sealed with the current key */
+		r = 2;
+	} else {
+		r = 0;
+	}
+	switch_mutex_unlock(profile->ticket_mutex);
+
+	if (!r) {
+		return 0;
+	}
+
+	if (enc) {
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+			return -1;
+		}
+
+		memcpy(key_name, key.name, sizeof(key.name));
+
+		if (!EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv)) {
+			return -1;
+		}
+	} else if (!EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv)) {
+		return -1;
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof(key.hmac_key));
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *) "sha256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+
+	if (!EVP_MAC_CTX_set_params(hctx, params)) {
+		return -1;
+	}
+#else
+	if (!HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL)) {
+		return -1;
+	}
+#endif
+
+	return r;
+}
+
+static void verto_count_handshake(verto_profile_t *profile, wsh_t *wsh)
+{
+	switch_mutex_lock(profile->mutex);
+	if (SSL_session_reused(wsh->ssl)) {
+		profile->tls_resumed++;
+		profile->tls_resumed_usec += wsh->ssl_handshake_usec;
+	} else {
+		profile->tls_full++;
+		profile->tls_full_usec += wsh->ssl_handshake_usec;
+	}
+	switch_mutex_unlock(profile->mutex);
+}
+
 static int verto_init_ssl(verto_profile_t *profile)
 {
 	const char *err = "";
@@ -235,6 +331,30 @@ static int verto_init_ssl(verto_profile_t *profile)
 
 	SSL_CTX_set_cipher_list(profile->ssl_ctx, "HIGH:!DSS:!aNULL@STRENGTH");
 
+	/* one context serves every secure listener of the profile, so a client can resume on any of them */
+	SSL_CTX_set_app_data(profile->ssl_ctx, profile);
+	SSL_CTX_set_session_id_context(profile->ssl_ctx, (const unsigned char *) profile->name,
+								   (unsigned int) (strlen(profile->name) < SSL_MAX_SID_CTX_LENGTH ? strlen(profile->name) : SSL_MAX_SID_CTX_LENGTH));
+
+	if (profile->tls_session_cache) {
+		SSL_CTX_set_session_cache_mode(profile->ssl_ctx, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_sess_set_cache_size(profile->ssl_ctx, profile->tls_session_cache);
+		SSL_CTX_set_timeout(profile->ssl_ctx, profile->tls_session_timeout);
+	} else {
+		SSL_CTX_set_session_cache_mode(profile->ssl_ctx, SSL_SESS_CACHE_OFF);
+	}
+
+	if (!profile->tls_session_tickets) {
+		SSL_CTX_set_options(profile->ssl_ctx, SSL_OP_NO_TICKET);
+	} else if (verto_new_ticket_key(&profile->ticket_keys[0])) {
+		memset(&profile->ticket_keys[1], 0, sizeof(profile->ticket_keys[1]));
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(profile->ssl_ctx, verto_ticket_key_cb);
+#else
+		SSL_CTX_set_tlsext_ticket_key_cb(profile->ssl_ctx, verto_ticket_key_cb);
+#endif
+	}
+
 	return 1;
 
  fail:
@@ -1865,7 +1985,13 @@ error:
 
 static void client_run(jsock_t *jsock)
 {
-	if (ws_init(&jsock->ws, jsock->client_socket, (jsock->ptype & PTYPE_CLIENT_SSL) ? jsock->profile->ssl_ctx : NULL, 0, 1, !!jsock->profile->vhosts) < 0) {
+	int r = ws_init(&jsock->ws, jsock->client_socket, (jsock->ptype & PTYPE_CLIENT_SSL) ? jsock->profile->ssl_ctx : NULL, 0, 1, !!jsock->profile->vhosts);
+
+	if (jsock->ws.secure_established) {
+		verto_count_handshake(jsock->profile, &jsock->ws);
+	}
+
+	if (r < 0) {
 		if (jsock->profile->vhosts) {
 			http_run(jsock);
 			ws_close(&jsock->ws, WS_NONE);
@@ -4743,10 +4869,15 @@ static switch_status_t parse_config(const char *cf)
 			profile->pool = pool;
 			profile->name = switch_core_strdup(profile->pool, name);
 			switch_mutex_init(&profile->mutex, SWITCH_MUTEX_NESTED, profile->pool);
+			switch_mutex_init(&profile->ticket_mutex, SWITCH_MUTEX_NESTED, profile->pool);
 			switch_thread_rwlock_create(&profile->rwlock, profile->pool);
 			add_profile(profile);
 
 			profile->local_network = "localnet.auto";
+			profile->tls_session_cache = 20480;
+			profile->tls_session_timeout = 300;
+			profile->tls_session_tickets = 1;
+			profile->tls_ticket_rotate = 3600;
 
 			profile->mcast_sub.sock = ws_sock_invalid;
 			profile->mcast_pub.sock = ws_sock_invalid;
@@ -4782,6 +4913,14 @@ static switch_status_t parse_config(const char *cf)
 					set_string(profile->key, val);
 				} else if (!strcasecmp(var, "secure-chain")) {
 					set_string(profile->chain, val);
+				} else if (!strcasecmp(var, "tls-session-cache-size") && !zstr(val)) {
+					profile->tls_session_cache = switch_atoui(val);
+				} else if (!strcasecmp(var, "tls-session-timeout") && !zstr(val)) {
+					profile->tls_session_timeout = switch_atoui(val);
+				} else if (!strcasecmp(var, "tls-session-tickets")) {
+					profile->tls_session_tickets = switch_true(val);
+				} else if (!strcasecmp(var, "tls-ticket-key-rotate") && !zstr(val)) {
+					profile->tls_ticket_rotate = switch_atoui(val);
 				} else if (!strcasecmp(var, "inbound-codec-string") && !zstr(val)) {
 					profile->inbound_codec_string = switch_core_strdup(profile->pool, val);
 				} else if (!strcasecmp(var, "outbound-codec-string") && !zstr(val)) {
@@ -5068,6 +5207,16 @@ static switch_status_t cmd_status(char **argv, int argc, switch_stream_handle_t
 		cp++;
 
 		switch_mutex_lock(profile->mutex);
+		if (profile->ssl_ready) {
+			char *tmpdata = switch_mprintf("full %llu (%.1fms) resumed %llu (%.1fms)",
+										   (unsigned long long) profile->tls_full, profile->tls_full ? (double) profile->tls_full_usec / profile->tls_full / 1000 : 0.0,
+										   (unsigned long long) profile->tls_resumed,
+										   profile->tls_resumed ? (double) profile->tls_resumed_usec / profile->tls_resumed / 1000 : 0.0);
+			stream->write_function(stream, "%25s\t%s\t  %40s\t%s\n", profile->name, "tls", tmpdata,
+								   profile->tls_session_tickets ? "TICKETS" : profile->tls_session_cache ? "CACHE" : "NO_RESUME");
+			switch_safe_free(tmpdata);
+		}
+
 		for (vhost = profile->vhosts; vhost; vhost = vhost->next) {
 			char *tmpname = switch_mprintf("%s::%s", profile->name, vhost->domain);
 			stream->write_function(stream, "%25s\t%s\t  %40s\t%s (%s)\n", tmpname, "vhost", vhost->root, vhost->auth_user ? "AUTH" : "NOAUTH", vhost->auth_user ? vhost->auth_user : "");
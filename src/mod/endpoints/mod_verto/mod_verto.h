@@ -60,6 +60,11 @@
 #include <netdb.h>
 #endif
 #include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 #include "mcast.h"
 
 #define MAX_QUEUE_LEN 100000
@@ -213,6 +218,13 @@ typedef struct verto_vhost_s {
 	struct verto_vhost_s *next;
 } verto_vhost_t;
 
+typedef struct verto_ticket_key_s {
+	unsigned char name[16];
+	unsigned char aes_key[32];
+	unsigned char hmac_key[32];
+	time_t created;
+} verto_ticket_key_t;
+
 struct verto_profile_s {
 	char *name;
 	switch_mutex_t *mutex;
@@ -228,6 +240,17 @@ struct verto_profile_s {
 	char key[512];
 	char chain[512];
 
+	uint32_t tls_session_cache;
+	uint32_t tls_session_timeout;
+	int tls_session_tickets;
+	uint32_t tls_ticket_rotate;
+	verto_ticket_key_t ticket_keys[2];
+	switch_mutex_t *ticket_mutex;
+	uint64_t tls_full;
+	uint64_t tls_resumed;
+	switch_time_t tls_full_usec;
+	switch_time_t tls_resumed_usec;
+
 	jsock_t *jsock_head;
 	int jsock_count;
 	ws_socket_t server_socket[MAX_BIND];
@@ -588,6 +588,7 @@ int establish_logical_layer(wsh_t *wsh)
 			assert(wsh->ssl);
 
 			SSL_set_fd(wsh->ssl, wsh->sock);
+			wsh->ssl_handshake_start = switch_time_now();
 		}
 
 		do {
@@ -595,6 +596,7 @@ int establish_logical_layer(wsh_t *wsh)
 
 			if (code == 1) {
 				wsh->secure_established = 1;
+				wsh->ssl_handshake_usec = switch_time_now() - wsh->ssl_handshake_start;
 				break;
 			}
 
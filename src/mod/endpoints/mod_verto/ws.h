@@ -108,6 +108,8 @@ typedef struct wsh_s {
 	int sanity;
 	int secure_established;
 	int logical_established;
+	int64_t ssl_handshake_start;
+	int64_t ssl_handshake_usec;
 	int stay_open;
 	int x;
 	void *write_buffer;
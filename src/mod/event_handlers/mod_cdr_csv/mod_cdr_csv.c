@@ -34,14 +34,29 @@ typedef enum {
 	CDR_LEG_B = (1 << 1)
 } cdr_leg_t;
 
+#define CDR_BUFFER_SIZE (64 * 1024)
+#define CDR_BATCH_MAX 1000
+
 struct cdr_fd {
 	int fd;
 	char *path;
 	int64_t bytes;
 	switch_mutex_t *mutex;
+	/* only touched by the writer thread */
+	char *buf;
+	switch_size_t buf_used;
+	int dirty;
+	struct cdr_fd *dirty_next;
 };
 typedef struct cdr_fd cdr_fd_t;
 
+/* one malloc, path and line follow the struct */
+typedef struct cdr_record {
+	char *path;
+	char *line;
+	switch_size_t len;
+} cdr_record_t;
+
 const char *default_template =
 	"\"${caller_id_name}\",\"${caller_id_number}\",\"${destination_number}\",\"${context}\",\"${start_stamp}\","
 	"\"${answer_stamp}\",\"${end_stamp}\",\"${duration}\",\"${billsec}\",\"${hangup_cause}\",\"${uuid}\",\"${bleg_uuid}\", \"${accountcode}\"\n";
@@ -58,6 +73,17 @@ static struct {
 	int rotate;
 	int debug;
 	cdr_leg_t legs;
+	int async_write;
+	uint32_t queue_size;
+	uint32_t fsync_interval;
+	switch_queue_t *queue;
+	switch_thread_t *writer_thread;
+	int writer_running;
+	uint32_t queue_peak;
+	switch_atomic_t overflow;
+	uint64_t written;
+	uint64_t batches;
+	uint64_t fsyncs;
 } globals;
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_cdr_csv_load);
@@ -129,11 +155,9 @@ static void do_rotate(cdr_fd_t *fd)
 
 }
 
-static void write_cdr(const char *path, const char *log_line)
+static cdr_fd_t *get_cdr_fd(const char *path)
 {
 	cdr_fd_t *fd = NULL;
-	unsigned int bytes_in, bytes_out;
-	int loops = 0;
 
 	switch_mutex_lock(globals.mutex);
 	if (!(fd = switch_core_hash_find(globals.fd_hash, path))) {
@@ -147,13 +171,21 @@ static void write_cdr(const char *path, const char *log_line)
 	}
 	switch_mutex_unlock(globals.mutex);
 
+	return fd;
+}
+
+static void write_cdr_fd(cdr_fd_t *fd, const char *data, switch_size_t len)
+{
+	int bytes_in;
+	unsigned int bytes_out = (unsigned) len;
+	int loops = 0;
+
 	switch_mutex_lock(fd->mutex);
-	bytes_out = (unsigned) strlen(log_line);
 
 	if (fd->fd < 0) {
 		do_reopen(fd);
 		if (fd->fd < 0) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error opening %s\n", path);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error opening %s\n", fd->path);
 			goto end;
 		}
 	}
@@ -162,21 +194,168 @@ static void write_cdr(const char *path, const char *log_line)
 		do_rotate(fd);
 	}
 
-	while ((bytes_in = write(fd->fd, log_line, bytes_out)) != bytes_out && ++loops < 10) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Write error to file %s %d/%d\n", path, (int) bytes_in, (int) bytes_out);
+	/* batches can be written partially, carry on from where the last write stopped */
+	while (bytes_out > 0) {
+		if ((bytes_in = write(fd->fd, data, bytes_out)) > 0) {
+			fd->bytes += bytes_in;
+			data += bytes_in;
+			bytes_out -= bytes_in;
+			continue;
+		}
+
+		if (++loops >= 10) {
+			break;
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Write error to file %s %d/%d\n", fd->path, (int) bytes_in, (int) bytes_out);
 		do_rotate(fd);
 		switch_yield(250000);
 	}
 
-	if (bytes_in > 0) {
-		fd->bytes += bytes_in;
-	}
-
   end:
 
 	switch_mutex_unlock(fd->mutex);
 }
 
+static void cdr_flush(cdr_fd_t *fd)
+{
+	if (fd->buf_used) {
+		write_cdr_fd(fd, fd->buf, fd->buf_used);
+		fd->buf_used = 0;
+	}
+}
+
+static void cdr_buffer(cdr_fd_t *fd, const char *data, switch_size_t len, cdr_fd_t **dirty)
+{
+	if (!fd->buf) {
+		switch_malloc(fd->buf, CDR_BUFFER_SIZE);
+	}
+
+	if (fd->buf_used + len > CDR_BUFFER_SIZE) {
+		cdr_flush(fd);
+		if (len > CDR_BUFFER_SIZE) {
+			write_cdr_fd(fd, data, len);
+			return;
+		}
+	}
+
+	memcpy(fd->buf + fd->buf_used, data, len);
+	fd->buf_used += len;
+
+	if (!fd->dirty) {
+		fd->dirty = 1;
+		fd->dirty_next = *dirty;
+		*dirty = fd;
+	}
+}
+
+static void do_fsync_all(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+	cdr_fd_t *fd;
+
+	switch_mutex_lock(globals.mutex);
+	for (hi = switch_core_hash_first(globals.fd_hash); hi; hi = switch_core_hash_next(&hi)) {
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		fd = (cdr_fd_t *) val;
+		switch_mutex_lock(fd->mutex);
+		if (fd->fd > -1) {
+#ifdef _MSC_VER
+			_commit(fd->fd);
+#else
+			fsync(fd->fd);
+#endif
+		}
+		switch_mutex_unlock(fd->mutex);
+	}
+	switch_mutex_unlock(globals.mutex);
+}
+
+static uint32_t cdr_write_batch(void *pop)
+{
+	cdr_fd_t *dirty = NULL, *fd;
+	uint32_t count = 0;
+
+	do {
+		cdr_record_t *rec = (cdr_record_t *) pop;
+
+		cdr_buffer(get_cdr_fd(rec->path), rec->line, rec->len, &dirty);
+		free(rec);
+		count++;
+	} while (count < CDR_BATCH_MAX && switch_queue_trypop(globals.queue, &pop) == SWITCH_STATUS_SUCCESS && pop);
+
+	while ((fd = dirty)) {
+		dirty = fd->dirty_next;
+		fd->dirty_next = NULL;
+		fd->dirty = 0;
+		cdr_flush(fd);
+	}
+
+	globals.written += count;
+	globals.batches++;
+
+	return count;
+}
+
+static void *SWITCH_THREAD_FUNC cdr_writer_thread(switch_thread_t *thread, void *obj)
+{
+	switch_time_t next_fsync = switch_micro_time_now() + (switch_time_t) globals.fsync_interval * 1000000;
+	int pending = 0;
+	void *pop;
+
+	while (globals.writer_running || switch_queue_size(globals.queue)) {
+		if (switch_queue_pop_timeout(globals.queue, &pop, 100000) == SWITCH_STATUS_SUCCESS && pop) {
+			cdr_write_batch(pop);
+			pending = 1;
+		}
+
+		if (globals.fsync_interval && pending && switch_micro_time_now() >= next_fsync) {
+			do_fsync_all();
+			globals.fsyncs++;
+			pending = 0;
+			next_fsync = switch_micro_time_now() + (switch_time_t) globals.fsync_interval * 1000000;
+		}
+	}
+
+	if (globals.fsync_interval && pending) {
+		do_fsync_all();
+	}
+
+	return NULL;
+}
+
+static void write_cdr(const char *path, const char *log_line)
+{
+	switch_size_t len = strlen(log_line);
+
+	if (globals.writer_running) {
+		switch_size_t plen = strlen(path) + 1;
+		cdr_record_t *rec;
+		uint32_t depth;
+
+		switch_malloc(rec, sizeof(*rec) + plen + len + 1);
+		rec->path = (char *) (rec + 1);
+		rec->line = rec->path + plen;
+		rec->len = len;
+		memcpy(rec->path, path, plen);
+		memcpy(rec->line, log_line, len + 1);
+
+		if (switch_queue_trypush(globals.queue, rec) == SWITCH_STATUS_SUCCESS) {
+			if ((depth = switch_queue_size(globals.queue)) > globals.queue_peak) {
+				globals.queue_peak = depth;
+			}
+			return;
+		}
+
+		/* the writer is behind, this session pays for its own write */
+		free(rec);
+		switch_atomic_inc(&globals.overflow);
+	}
+
+	write_cdr_fd(get_cdr_fd(path), log_line, len);
+}
+
 static switch_status_t my_on_reporting(switch_core_session_t *session)
 {
 	switch_channel_t *channel = switch_core_session_get_channel(session);
@@ -308,6 +487,7 @@ static void do_teardown()
 			close(fd->fd);
 			fd->fd = -1;
 		}
+		switch_safe_free(fd->buf);
 		switch_mutex_unlock(fd->mutex);
 	}
 	switch_mutex_unlock(globals.mutex);
@@ -332,6 +512,19 @@ SWITCH_STANDARD_API(cdr_csv_function)
 		return SWITCH_STATUS_SUCCESS;
 	}
 
+	if (!strcmp(cmd, "status")) {
+		stream->write_function(stream, "async-write: %s\n", globals.writer_running ? "true" : "false");
+		if (globals.queue) {
+			stream->write_function(stream, "queue-depth: %u/%u\n", switch_queue_size(globals.queue), globals.queue_size);
+		}
+		stream->write_function(stream, "queue-peak: %u\n", globals.queue_peak);
+		stream->write_function(stream, "overflow: %u\n", switch_atomic_read(&globals.overflow));
+		stream->write_function(stream, "written: %" SWITCH_UINT64_T_FMT "\n", globals.written);
+		stream->write_function(stream, "batches: %" SWITCH_UINT64_T_FMT "\n", globals.batches);
+		stream->write_function(stream, "fsyncs: %" SWITCH_UINT64_T_FMT "\n", globals.fsyncs);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
 	return SWITCH_STATUS_FALSE;
 }
 
@@ -367,6 +560,8 @@ static switch_status_t load_config(switch_memory_pool_t *pool)
 	switch_core_hash_insert(globals.template_hash, "default", default_template);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding default template.\n");
 	globals.legs = CDR_LEG_A;
+	globals.async_write = 0;
+	globals.queue_size = 10000;
 
 	if ((xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
 
@@ -394,6 +589,18 @@ static switch_status_t load_config(switch_memory_pool_t *pool)
 					globals.default_template = switch_core_strdup(pool, val);
 				} else if (!strcasecmp(var, "master-file-only")) {
 					globals.masterfileonly = switch_true(val);
+				} else if (!strcasecmp(var, "async-write")) {
+					globals.async_write = switch_true(val);
+				} else if (!strcasecmp(var, "queue-size")) {
+					int tmp = atoi(val);
+					if (tmp > 0) {
+						globals.queue_size = tmp;
+					}
+				} else if (!strcasecmp(var, "fsync-interval")) {
+					int tmp = atoi(val);
+					if (tmp >= 0) {
+						globals.fsync_interval = tmp;
+					}
 				}
 			}
 		}
@@ -451,11 +658,22 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_cdr_csv_load)
 		return status;
 	}
 
+	if (globals.async_write) {
+		switch_threadattr_t *thd_attr = NULL;
+
+		switch_queue_create(&globals.queue, globals.queue_size, pool);
+		globals.writer_running = 1;
+		switch_threadattr_create(&thd_attr, pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&globals.writer_thread, thd_attr, cdr_writer_thread, NULL, pool);
+	}
+
 	switch_core_add_state_handler(&state_handlers);
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 
 	SWITCH_ADD_API(api_interface, "cdr_csv", "cdr_csv controls", cdr_csv_function, "parameters");
 	switch_console_set_complete("add cdr_csv rotate");
+	switch_console_set_complete("add cdr_csv status");
 
 	return status;
 }
@@ -469,6 +687,19 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_cdr_csv_shutdown)
 	switch_event_unbind_callback(event_handler);
 	switch_core_remove_state_handler(&state_handlers);
 
+	if (globals.writer_thread) {
+		switch_status_t st;
+		void *pop;
+
+		globals.writer_running = 0;
+		switch_thread_join(&st, globals.writer_thread);
+
+		/* anything pushed while the writer was on its way out */
+		while (switch_queue_trypop(globals.queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+			cdr_write_batch(pop);
+		}
+	}
+
 	do_teardown();
 	switch_core_hash_destroy(&globals.fd_hash);
 	switch_core_hash_destroy(&globals.template_hash);
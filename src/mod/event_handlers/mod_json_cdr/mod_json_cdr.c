@@ -40,12 +40,13 @@
 #define ENCODING_NONE 0
 #define ENCODING_DEFAULT 1
 #define ENCODING_BASE64 2
+/* only files with this suffix are replayed, the err dirs default to the log dir */
+#define SPOOL_SUFFIX ".spool.json"
 
 static struct {
 	char *cred;
 	char *urls[MAX_URLS];
 	int url_count;
-	int url_index;
 	switch_thread_rwlock_t *log_path_lock;
 	char *base_log_dir;
 	char *base_err_log_dir[MAX_ERR_DIRS];
@@ -75,11 +76,17 @@ static struct {
 	int encode_values;
 	switch_queue_t *queue;
 	switch_thread_t *thread;
+	uint32_t post_connections;
+	uint32_t post_batch;
+	uint32_t post_queue_size;
+	uint32_t replay_interval;
+	uint32_t post_drain_timeout;
+	int post_synchronous;
+	switch_curl_poster_t *poster;
 } globals;
 
 typedef struct {
 	char *json_text;
-	char *json_text_escaped;
 	char *logdir;
 	char *uuid;
 	char *filename;
@@ -89,15 +96,6 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_json_cdr_shutdown);
 SWITCH_MODULE_DEFINITION(mod_json_cdr, mod_json_cdr_load, mod_json_cdr_shutdown, NULL);
 
-/* this function would have access to the HTML returned by the webserver, we don't need it
- * and the default curl activity is to print to stdout, something not as desirable
- * so we have a dummy function here
- */
-static size_t httpCallBack(char *buffer, size_t size, size_t nitems, void *outstream)
-{
-	return size * nitems;
-}
-
 static switch_status_t set_json_cdr_log_dirs()
 {
 	switch_time_exp_t tm;
@@ -190,6 +188,12 @@ static switch_status_t set_json_cdr_log_dirs()
 		}
 	}
 
+	if (globals.poster && globals.err_dir_count) {
+		switch_thread_rwlock_rdlock(globals.log_path_lock);
+		switch_curl_poster_set_replay_dir(globals.poster, globals.err_log_dir[0]);
+		switch_thread_rwlock_unlock(globals.log_path_lock);
+	}
+
 	return status;
 }
 
@@ -198,7 +202,7 @@ static void backup_cdr(cdr_data_t *data)
 	if (globals.log_errors_to_disk) {
 		int fd = -1, err_dir_index;
 		char *path = NULL;
-		const char *json_text = data->json_text_escaped ? data->json_text_escaped : data->json_text;
+		const char *json_text = data->json_text;
 
 		for (err_dir_index = 0; err_dir_index < globals.err_dir_count; err_dir_index++) {
 			switch_thread_rwlock_rdlock(globals.log_path_lock);
@@ -245,22 +249,72 @@ static void backup_cdr(cdr_data_t *data)
 void destroy_cdr_data(cdr_data_t *data)
 {
 	switch_safe_free(data->json_text);
-	switch_safe_free(data->json_text_escaped);
 	switch_safe_free(data->uuid);
 	switch_safe_free(data->filename);
 	switch_safe_free(data->logdir);
 	switch_safe_free(data);
 }
 
+static void json_cdr_spool(const char *id, const char *name, const char *json_text, void *user_data)
+{
+	cdr_data_t data = { 0 };
+
+	data.uuid = (char *) id;
+	data.json_text = (char *) json_text;
+	if (globals.replay_interval) {
+		data.filename = switch_mprintf("%s%s", id, SPOOL_SUFFIX);
+	} else {
+		data.filename = switch_mprintf("%s.cdr.json", name);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_UUID_LOG(id), SWITCH_LOG_ERROR, "Unable to post to web server\n");
+	backup_cdr(&data);
+	switch_safe_free(data.filename);
+}
+
+static void json_cdr_curl_setup(switch_CURL *curl_handle, void *user_data)
+{
+	if (!zstr(globals.cred)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
+	}
+
+	if (!zstr(globals.ssl_cert_file)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
+	}
+
+	if (!zstr(globals.ssl_key_file)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
+	}
+
+	if (!zstr(globals.ssl_key_password)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
+	}
+
+	if (!zstr(globals.ssl_version)) {
+		if (!strcasecmp(globals.ssl_version, "SSLv3")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
+		} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
+		}
+	}
+
+	if (!zstr(globals.ssl_cacert_file)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
+	}
+
+	if (globals.enable_cacert_check) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
+	}
+
+	if (globals.enable_ssl_verifyhost) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
+	}
+}
+
 static void process_cdr(cdr_data_t *data)
 {
-	char *curl_json_text = NULL;
-	long httpRes;
-	CURL *curl_handle = NULL;
-	switch_curl_slist_t *headers = NULL;
-	switch_curl_slist_t *slist = NULL;
 	int fd = -1;
-	uint32_t cur_try;
 
 	switch_assert(data != NULL);
 
@@ -300,144 +354,24 @@ static void process_cdr(cdr_data_t *data)
 		}
 	}
 
-	/* try to post it to the web server */
-	if (globals.url_count) {
-		char *destUrl = NULL;
-		curl_handle = switch_curl_easy_init();
-
-		if (globals.encode) {
-			if (globals.encode == ENCODING_DEFAULT) {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
-			} else {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-base64-encoded");
-			}
-
-			curl_json_text = switch_mprintf("cdr=%s", data->json_text_escaped);
-			switch_assert(curl_json_text != NULL);
-
-		} else {
-			headers = switch_curl_slist_append(headers, "Content-Type: application/json");
-			curl_json_text = (char *)data->json_text;
-		}
-
-		if (!zstr(globals.cred)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
-		}
-
-		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, curl_json_text);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-json/1.0");
-		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, httpCallBack);
-
-		if (globals.disable100continue) {
-			slist = switch_curl_slist_append(slist, "Expect:");
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, slist);
-		}
-
-		if (!zstr(globals.ssl_cert_file)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
-		}
-
-		if (!zstr(globals.ssl_key_file)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
-		}
-
-		if (!zstr(globals.ssl_key_password)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
-		}
-
-		if (!zstr(globals.ssl_version)) {
-			if (!strcasecmp(globals.ssl_version, "SSLv3")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
-			} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
-			}
-		}
+	/* hand it to the poster (or post it here with post-synchronous), failures come back through json_cdr_spool */
+	if (globals.poster) {
+		char *name = strdup(data->filename), *p;
 
-		if (!zstr(globals.ssl_cacert_file)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
+		if ((p = strstr(name, ".cdr.json"))) {
+			*p = '\0';
 		}
-
-		/* these were used for testing, optionally they may be enabled if someone desires
-		   switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 120); // tcp timeout
-		   switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1); // 302 recursion level
-		 */
-
-		for (cur_try = 0; cur_try < globals.retries; cur_try++) {
-			if (cur_try > 0) {
-				switch_yield(globals.delay * 1000000);
-			}
-
-			destUrl = switch_mprintf("%s?uuid=%s", globals.urls[globals.url_index], data->uuid);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_URL, destUrl);
-
-			if (!strncasecmp(destUrl, "https", 5)) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
-			}
-
-			if (globals.enable_cacert_check) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
-			}
-
-			if (globals.enable_ssl_verifyhost) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
-			}
-
-			switch_curl_easy_perform(curl_handle);
-			switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-			switch_safe_free(destUrl);
-			if (httpRes >= 200 && httpRes < 300) {
-				goto end;
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Got error [%ld] posting to web server [%s]\n",
-								  httpRes, globals.urls[globals.url_index]);
-				globals.url_index++;
-				switch_assert(globals.url_count <= MAX_URLS);
-				if (globals.url_index >= globals.url_count) {
-					globals.url_index = 0;
-				} else {
-					switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Retry will be with url [%s]\n", globals.urls[globals.url_index]);
-					}
-			}
-		}
-		switch_curl_easy_cleanup(curl_handle);
-		switch_curl_slist_free_all(headers);
-		switch_curl_slist_free_all(slist);
-		slist = NULL;
-		headers = NULL;
-		curl_handle = NULL;
-
-		/* if we are here the web post failed for some reason */
-		switch_log_printf(SWITCH_CHANNEL_UUID_LOG(data->uuid), SWITCH_LOG_ERROR, "Unable to post to web server\n");
-		backup_cdr(data);
+		switch_curl_poster_push(globals.poster, data->uuid, name, data->json_text);
+		free(name);
 	}
 
 	end:
-	if (curl_handle) {
-		switch_curl_easy_cleanup(curl_handle);
-	}
-	if (headers) {
-		switch_curl_slist_free_all(headers);
-	}
-	if (slist) {
-		switch_curl_slist_free_all(slist);
-	}
-	if (curl_json_text != data->json_text) {
-		switch_safe_free(curl_json_text);
-	}
-
 	destroy_cdr_data(data);
 }
 
 static switch_status_t my_on_reporting(switch_core_session_t *session)
 {
-	cJSON *json_cdr = NULL;
 	char *json_text = NULL;
-	char *json_text_escaped = NULL;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	int is_b;
 	const char *a_prefix = "";
@@ -459,7 +393,7 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 		a_prefix = "a_";
 	}
 
-	if (switch_ivr_generate_json_cdr(session, &json_cdr, globals.encode_values == ENCODING_DEFAULT) != SWITCH_STATUS_SUCCESS) {
+	if (switch_ivr_generate_json_cdr_text(session, &json_text, globals.encode_values == ENCODING_DEFAULT) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error Generating Data!\n");
 		return SWITCH_STATUS_FALSE;
 	}
@@ -467,25 +401,9 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 	cdr_data = malloc(sizeof(cdr_data_t));
 	switch_assert(cdr_data);
 
-	json_text = cJSON_PrintUnformatted(json_cdr);
-
-	if (globals.url_count && globals.encode) {
-		switch_size_t need_bytes = strlen(json_text) * 3;
-
-		json_text_escaped = malloc(need_bytes);
-		switch_assert(json_text_escaped);
-		memset(json_text_escaped, 0, need_bytes);
-		if (globals.encode == ENCODING_DEFAULT) {
-			switch_url_encode(json_text, json_text_escaped, need_bytes);
-		} else {
-			switch_b64_encode((unsigned char *) json_text, need_bytes / 3, (unsigned char *) json_text_escaped, need_bytes);
-		}
-	}
-
 	cdr_data->uuid = strdup(switch_core_session_get_uuid(session));
 	cdr_data->filename = switch_mprintf("%s%s.cdr.json", a_prefix, cdr_data->uuid);
 	cdr_data->json_text = json_text;
-    cdr_data->json_text_escaped = json_text_escaped;
 
 	switch_thread_rwlock_rdlock(globals.log_path_lock);
 
@@ -506,8 +424,6 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 		process_cdr(cdr_data);
 	}
 
-	cJSON_Delete(json_cdr);
-
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -531,8 +447,11 @@ static void *SWITCH_THREAD_FUNC cdr_thread(switch_thread_t *t, void *obj)
 		process_cdr(data);
 	}
 
+	/* the poster is still up, so what was queued is posted or spooled rather than dropped */
 	while (switch_queue_trypop(globals.queue, &pop) == SWITCH_STATUS_SUCCESS) {
-		destroy_cdr_data((cdr_data_t *) pop);
+		if (pop) {
+			process_cdr((cdr_data_t *) pop);
+		}
 	}
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Cdr thread ended.\n");
@@ -566,11 +485,27 @@ static switch_state_handler_table_t state_handlers = {
 	/*.on_reporting */ my_on_reporting
 };
 
+SWITCH_STANDARD_API(json_cdr_function)
+{
+	if (!zstr(cmd) && !strcasecmp(cmd, "status")) {
+		if (globals.poster) {
+			switch_curl_poster_stats(globals.poster, stream);
+		} else {
+			stream->write_function(stream, "-ERR no url configured\n");
+		}
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	stream->write_function(stream, "-USAGE: status\n");
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 {
 	char *cf = "json_cdr.conf";
 	switch_xml_t cfg, xml, settings, param;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_api_interface_t *api_interface;
 
 	memset(&globals, 0, sizeof(globals));
 
@@ -581,6 +516,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 	globals.pool = pool;
 	globals.auth_scheme = CURLAUTH_BASIC;
 	globals.encode_values = ENCODING_DEFAULT;
+	globals.post_connections = 4;
+	globals.post_batch = 1;
+	globals.post_queue_size = 10000;
 
 	switch_thread_rwlock_create(&globals.log_path_lock, pool);
 
@@ -684,6 +622,18 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 				}
 			} else if (!strcasecmp(var, "encode-values") && !zstr(val)) {
 				globals.encode_values = switch_true(val) ? ENCODING_DEFAULT : ENCODING_NONE;
+			} else if (!strcasecmp(var, "post-connections") && !zstr(val)) {
+				globals.post_connections = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-batch") && !zstr(val)) {
+				globals.post_batch = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-queue-size") && !zstr(val)) {
+				globals.post_queue_size = switch_atoui(val);
+			} else if (!strcasecmp(var, "spool-replay-interval") && !zstr(val)) {
+				globals.replay_interval = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-drain-timeout") && !zstr(val)) {
+				globals.post_drain_timeout = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-synchronous")) {
+				globals.post_synchronous = switch_true(val);
 			} else if (!strcasecmp(var, "queue-capacity") && !zstr(val)) {
 				int capacity = atoi(val);
 				if (capacity > 0) {
@@ -714,6 +664,55 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 
 	globals.retries++;
 
+	if (globals.post_batch > 1 && globals.encode) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "post-batch needs encode=false, posting one cdr at a time\n");
+		globals.post_batch = 1;
+	}
+
+	if (globals.url_count) {
+		switch_curl_poster_settings_t settings = { 0 };
+
+		settings.name = "json_cdr";
+		settings.urls = globals.urls;
+		settings.url_count = globals.url_count;
+		settings.user_agent = "freeswitch-json/1.0";
+		settings.form_field = "cdr";
+		settings.max_connections = globals.post_connections;
+		settings.queue_size = globals.post_queue_size;
+		settings.retries = globals.retries;
+		settings.delay = globals.delay;
+		settings.disable_100_continue = globals.disable100continue ? SWITCH_TRUE : SWITCH_FALSE;
+		settings.spool_suffix = SPOOL_SUFFIX;
+		settings.replay_interval = globals.log_errors_to_disk ? globals.replay_interval : 0;
+		settings.drain_timeout = globals.post_drain_timeout;
+		settings.synchronous = globals.post_synchronous ? SWITCH_TRUE : SWITCH_FALSE;
+		settings.setup = json_cdr_curl_setup;
+		settings.spool = json_cdr_spool;
+
+		if (globals.encode == ENCODING_DEFAULT) {
+			settings.id_param = "uuid";
+			settings.encoding = SWITCH_CURL_POST_FORM_URLENCODE;
+			settings.content_type = "application/x-www-form-urlencoded";
+		} else if (globals.encode == ENCODING_BASE64) {
+			settings.id_param = "uuid";
+			settings.encoding = SWITCH_CURL_POST_FORM_BASE64;
+			settings.content_type = "application/x-www-form-base64-encoded";
+		} else {
+			settings.encoding = SWITCH_CURL_POST_RAW;
+			settings.content_type = "application/json";
+			if (globals.post_batch > 1) {
+				settings.batch_max = globals.post_batch;
+				settings.batch_open = "[";
+				settings.batch_separator = ",";
+				settings.batch_close = "]";
+			} else {
+				settings.id_param = "uuid";
+			}
+		}
+
+		switch_curl_poster_create(&globals.poster, &settings);
+	}
+
 	set_json_cdr_log_dirs();
 
 	if (switch_event_bind_removable(modname, SWITCH_EVENT_TRAP, SWITCH_EVENT_SUBCLASS_ANY, event_handler, NULL, &globals.node) != SWITCH_STATUS_SUCCESS) {
@@ -725,6 +724,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_json_cdr_load)
 	switch_core_add_state_handler(&state_handlers);
 
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
+	SWITCH_ADD_API(api_interface, "json_cdr", "json_cdr controls", json_cdr_function, "status");
+	switch_console_set_complete("add json_cdr status");
 
 	switch_xml_free(xml);
 	return status;
@@ -743,12 +744,16 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_json_cdr_shutdown)
 		switch_thread_join(&status, globals.thread);
 	}
 
+	/* posts what is queued for up to post-drain-timeout seconds and spools the rest to the err dir */
+	switch_curl_poster_destroy(&globals.poster);
+
 	switch_safe_free(globals.log_dir);
 
 	for (;err_dir_index < globals.err_dir_count; err_dir_index++) {
 		switch_safe_free(globals.err_log_dir[err_dir_index]);
 	}
 
+	switch_console_set_complete("del json_cdr");
 	switch_event_unbind(&globals.node);
 	switch_core_remove_state_handler(&state_handlers);
 
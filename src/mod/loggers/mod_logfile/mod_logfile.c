@@ -31,6 +31,12 @@
  */
 
 #include <switch.h>
+#ifdef LOGFILE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LOGFILE_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_logfile_shutdown);
@@ -39,14 +45,31 @@ SWITCH_MODULE_DEFINITION(mod_logfile, mod_logfile_load, mod_logfile_shutdown, NU
 #define DEFAULT_LIMIT	 0xA00000	/* About 10 MB */
 #define WARM_FUZZY_OFFSET 256
 #define MAX_ROT 4096			/* why not */
+#define DEFAULT_FLUSH_INTERVAL 100	/* ms */
+#define IDLE_TICK 1000			/* ms, how often the writer thread looks around when nothing is buffered */
 
 static switch_memory_pool_t *module_pool = NULL;
 static switch_hash_t *profile_hash = NULL;
 
+typedef enum {
+	LOGFILE_COMPRESS_NONE,
+	LOGFILE_COMPRESS_GZIP,
+	LOGFILE_COMPRESS_ZSTD
+} logfile_compress_t;
+
+static const char *COMPRESS_EXT[] = { "", ".gz", ".zst" };
+
 static struct {
 	int rotate;
 	switch_mutex_t *mutex;
 	switch_event_node_t *node;
+	switch_thread_cond_t *cond;
+	switch_thread_t *writer_thread;
+	switch_thread_t *compress_thread;
+	switch_queue_t *compress_queue;
+	uint32_t compress_pending;
+	uint32_t tick;
+	int running;
 } globals;
 
 struct logfile_profile {
@@ -60,6 +83,13 @@ struct logfile_profile {
 	uint32_t all_level;
 	uint32_t suffix;			/* suffix of the highest logfile name */
 	switch_bool_t log_uuid;
+	char *buf;					/* lines waiting to be written, flushed by size, age or a CRIT line */
+	switch_size_t buf_size;
+	switch_size_t buf_used;
+	switch_time_t buf_since;	/* when the oldest buffered line came in */
+	uint32_t flush_interval;	/* ms */
+	int rotate_pending;			/* the writer thread rotates so the logger thread never does */
+	logfile_compress_t compress;
 };
 
 typedef struct logfile_profile logfile_profile_t;
@@ -112,6 +142,55 @@ static switch_status_t mod_logfile_openlogfile(logfile_profile_t *profile, switc
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static switch_status_t mod_logfile_flush(logfile_profile_t *profile);
+
+typedef struct {
+	char *filename;
+	logfile_compress_t compress;
+} compress_job_t;
+
+/* hands a rotated file to the compress thread, rotation waits until it is done so names don't move under it */
+static void mod_logfile_queue_compress(logfile_profile_t *profile, const char *filename)
+{
+	compress_job_t *job;
+
+	if (profile->compress == LOGFILE_COMPRESS_NONE || !globals.compress_queue) {
+		return;
+	}
+
+	switch_zmalloc(job, sizeof(*job));
+	job->filename = strdup(filename);
+	job->compress = profile->compress;
+
+	globals.compress_pending++;
+	if (switch_queue_trypush(globals.compress_queue, job) != SWITCH_STATUS_SUCCESS) {
+		globals.compress_pending--;
+		free(job->filename);
+		free(job);
+	}
+}
+
+/* move one rotation slot, plain or compressed */
+static switch_status_t mod_logfile_shift(const char *from, const char *to, switch_memory_pool_t *pool)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (switch_file_exists(to, pool) == SWITCH_STATUS_SUCCESS) {
+		if ((status = switch_file_remove(to, pool)) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error removing log %s [%s]\n", to, strerror(errno));
+			return status;
+		}
+	}
+
+	if (from && switch_file_exists(from, pool) == SWITCH_STATUS_SUCCESS) {
+		if ((status = switch_file_rename(from, to, pool)) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error renaming log from %s to %s [%s]\n", from, to, strerror(errno));
+		}
+	}
+
+	return status;
+}
+
 /* rotate the log file */
 static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 {
@@ -127,6 +206,9 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 
 	switch_mutex_lock(globals.mutex);
 
+	/* whatever is buffered belongs to the file being rotated out */
+	mod_logfile_flush(profile);
+
 	switch_time_exp_lt(&tm, switch_micro_time_now());
 	switch_strftime_nocheck(date, &retsize, sizeof(date), "%Y-%m-%d-%H-%M-%S", &tm);
 
@@ -145,6 +227,7 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 	if (profile->max_rot) {
 		char *from_filename = NULL;
 		char *to_filename = NULL;
+		const char *ext = COMPRESS_EXT[profile->compress];
 
 		from_filename = switch_core_alloc(pool, strlen(profile->logfile) + WARM_FUZZY_OFFSET);
 		to_filename = switch_core_alloc(pool, strlen(profile->logfile) + WARM_FUZZY_OFFSET);
@@ -153,27 +236,32 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 			sprintf((char *) to_filename, "%s.%i", profile->logfile, i);
 			sprintf((char *) from_filename, "%s.%i", profile->logfile, i-1);
 
-			if (switch_file_exists(to_filename, pool) == SWITCH_STATUS_SUCCESS) {
-				if ((status = switch_file_remove(to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error removing log %s\n",to_filename);
+			if ((status = mod_logfile_shift(from_filename, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
+				goto end;
+			}
+
+			if (*ext) {
+				sprintf((char *) to_filename, "%s.%i%s", profile->logfile, i, ext);
+				sprintf((char *) from_filename, "%s.%i%s", profile->logfile, i-1, ext);
+
+				if ((status = mod_logfile_shift(from_filename, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
 					goto end;
 				}
 			}
+		}
 
-			if ((status = switch_file_rename(from_filename, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error renaming log from %s to %s [%s]\n",
-								  from_filename, to_filename, strerror(errno));
+		if (*ext) {
+			sprintf((char *) to_filename, "%s.%i%s", profile->logfile, i, ext);
+
+			if ((status = mod_logfile_shift(NULL, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
 				goto end;
 			}
 		}
 
 		sprintf((char *) to_filename, "%s.%i", profile->logfile, i);
 
-		if (switch_file_exists(to_filename, pool) == SWITCH_STATUS_SUCCESS) {
-			if ((status = switch_file_remove(to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error removing log %s [%s]\n", to_filename, strerror(errno));
-				goto end;
-			}
+		if ((status = mod_logfile_shift(NULL, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
+			goto end;
 		}
 
 		switch_file_close(profile->log_afd);
@@ -185,6 +273,7 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 		if ((status = mod_logfile_openlogfile(profile, SWITCH_FALSE)) != SWITCH_STATUS_SUCCESS) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error reopening log %s\n", profile->logfile);
 		}
+		mod_logfile_queue_compress(profile, to_filename);
 		if (profile->suffix < profile->max_rot) {
 			profile->suffix++;
 		}
@@ -196,6 +285,13 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 
 	/* XXX This have no real value EXCEPT making sure if we rotate within the same second, the end index will increase */
 	for (i = 1; i < MAX_ROT; i++) {
+		if (profile->compress != LOGFILE_COMPRESS_NONE) {
+			sprintf((char *) filename, "%s.%s.%i%s", profile->logfile, date, i, COMPRESS_EXT[profile->compress]);
+			if (switch_file_exists(filename, pool) == SWITCH_STATUS_SUCCESS) {
+				continue;
+			}
+		}
+
 		sprintf((char *) filename, "%s.%s.%i", profile->logfile, date, i);
 		if (switch_file_exists(filename, pool) == SWITCH_STATUS_SUCCESS) {
 			continue;
@@ -207,6 +303,7 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error Rotating Log!\n");
 			goto end;
 		}
+		mod_logfile_queue_compress(profile, filename);
 		break;
 	}
 
@@ -223,8 +320,41 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 	return status;
 }
 
-/* write to the actual logfile */
-static switch_status_t mod_logfile_raw_write(logfile_profile_t *profile, char *log_data)
+/* write to the actual logfile, called with globals.mutex held */
+static switch_status_t mod_logfile_write_out(logfile_profile_t *profile, const char *data, switch_size_t len)
+{
+	switch_size_t wlen = len;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (switch_file_write(profile->log_afd, data, &wlen) != SWITCH_STATUS_SUCCESS) {
+		switch_file_close(profile->log_afd);
+		if ((status = mod_logfile_openlogfile(profile, SWITCH_TRUE)) == SWITCH_STATUS_SUCCESS) {
+			wlen = len;
+			switch_file_write(profile->log_afd, data, &wlen);
+		}
+	}
+
+	return status;
+}
+
+static switch_status_t mod_logfile_flush(logfile_profile_t *profile)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	switch_mutex_lock(globals.mutex);
+	if (profile->buf_used && profile->log_afd) {
+		switch_size_t used = profile->buf_used;
+
+		/* cleared first, a reopen inside the write may rotate and flush again */
+		profile->buf_used = 0;
+		status = mod_logfile_write_out(profile, profile->buf, used);
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	return status;
+}
+
+static switch_status_t mod_logfile_raw_write(logfile_profile_t *profile, char *log_data, switch_log_level_t level)
 {
 	switch_size_t len;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
@@ -236,26 +366,219 @@ static switch_status_t mod_logfile_raw_write(logfile_profile_t *profile, char *l
 
 	switch_mutex_lock(globals.mutex);
 
-	if (switch_file_write(profile->log_afd, log_data, &len) != SWITCH_STATUS_SUCCESS) {
-		switch_file_close(profile->log_afd);
-		if ((status = mod_logfile_openlogfile(profile, SWITCH_TRUE)) == SWITCH_STATUS_SUCCESS) {
-			len = strlen(log_data);
-			switch_file_write(profile->log_afd, log_data, &len);
+	if (!profile->buf_size) {
+		status = mod_logfile_write_out(profile, log_data, len);
+	} else {
+		if (profile->buf_used + len > profile->buf_size) {
+			status = mod_logfile_flush(profile);
 		}
-	}
 
-	switch_mutex_unlock(globals.mutex);
+		if (len >= profile->buf_size) {
+			status = mod_logfile_write_out(profile, log_data, len);
+		} else {
+			if (!profile->buf_used) {
+				profile->buf_since = switch_micro_time_now();
+			}
+			memcpy(profile->buf + profile->buf_used, log_data, len);
+			profile->buf_used += len;
+		}
+
+		/* never sit on the lines that explain a crash */
+		if (level <= SWITCH_LOG_CRIT) {
+			status = mod_logfile_flush(profile);
+		}
+	}
 
 	if (status == SWITCH_STATUS_SUCCESS) {
 		profile->log_size += len;
 
-		if (profile->roll_size && profile->log_size >= profile->roll_size) {
-			mod_logfile_rotate(profile);
+		if (profile->roll_size && profile->log_size >= profile->roll_size && !profile->rotate_pending) {
+			profile->rotate_pending = 1;
+			switch_thread_cond_signal(globals.cond);
+		}
+	}
+
+	switch_mutex_unlock(globals.mutex);
+
+	return status;
+}
+
+static void *SWITCH_THREAD_FUNC mod_logfile_writer_thread(switch_thread_t *thread, void *obj)
+{
+	switch_hash_index_t *hi;
+	void *val;
+	logfile_profile_t *profile;
+
+	switch_mutex_lock(globals.mutex);
+
+	while (globals.running) {
+		switch_time_t now;
+
+		switch_thread_cond_timedwait(globals.cond, globals.mutex, (switch_interval_time_t) globals.tick * 1000);
+		now = switch_micro_time_now();
+
+		for (hi = switch_core_hash_first(profile_hash); hi; hi = switch_core_hash_next(&hi)) {
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			profile = (logfile_profile_t *) val;
+
+			if (profile->buf_used && now - profile->buf_since >= (switch_time_t) profile->flush_interval * 1000) {
+				mod_logfile_flush(profile);
+			}
+
+			/* renaming the slots while a rotated file is still being compressed would move it under the compressor */
+			if (profile->rotate_pending && !globals.compress_pending) {
+				profile->rotate_pending = 0;
+				mod_logfile_rotate(profile);
+			}
 		}
 	}
 
+	switch_mutex_unlock(globals.mutex);
+
+	return NULL;
+}
+
+#ifdef LOGFILE_HAVE_ZSTD
+static switch_status_t mod_logfile_zstd(FILE *in, FILE *out)
+{
+	ZSTD_CCtx *cctx = ZSTD_createCCtx();
+	size_t in_size = ZSTD_CStreamInSize(), out_size = ZSTD_CStreamOutSize();
+	void *ibuf = malloc(in_size), *obuf = malloc(out_size);
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	size_t r;
+	int last;
+
+	if (!cctx || !ibuf || !obuf) {
+		status = SWITCH_STATUS_MEMERR;
+		goto end;
+	}
+
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 3);
+
+	do {
+		ZSTD_inBuffer input;
+		int done = 0;
+
+		r = fread(ibuf, 1, in_size, in);
+		last = r < in_size;
+		input.src = ibuf;
+		input.size = r;
+		input.pos = 0;
+
+		while (!done) {
+			ZSTD_outBuffer output = { obuf, out_size, 0 };
+			size_t remaining = ZSTD_compressStream2(cctx, &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+
+			if (ZSTD_isError(remaining) || fwrite(obuf, 1, output.pos, out) != output.pos) {
+				status = SWITCH_STATUS_FALSE;
+				goto end;
+			}
+
+			done = last ? remaining == 0 : input.pos == input.size;
+		}
+	} while (!last);
+
+ end:
+	switch_safe_free(ibuf);
+	switch_safe_free(obuf);
+	if (cctx) {
+		ZSTD_freeCCtx(cctx);
+	}
 	return status;
 }
+#endif
+
+/* compress filename into filename.gz/.zst next to it, the original goes away only when that worked */
+static void mod_logfile_compress(compress_job_t *job)
+{
+	char *tmp = switch_mprintf("%s%s.tmp", job->filename, COMPRESS_EXT[job->compress]);
+	char *dst = switch_mprintf("%s%s", job->filename, COMPRESS_EXT[job->compress]);
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	FILE *in = NULL;
+
+	if (!(in = fopen(job->filename, "rb"))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't open %s for compression [%s]\n", job->filename, strerror(errno));
+		goto end;
+	}
+
+	switch (job->compress) {
+#ifdef LOGFILE_HAVE_ZLIB
+	case LOGFILE_COMPRESS_GZIP:
+		{
+			gzFile gz;
+			char buf[65536];
+			size_t r;
+
+			if (!(gz = gzopen(tmp, "wb6"))) {
+				break;
+			}
+
+			status = SWITCH_STATUS_SUCCESS;
+			while ((r = fread(buf, 1, sizeof(buf), in)) > 0) {
+				if (gzwrite(gz, buf, (unsigned) r) != (int) r) {
+					status = SWITCH_STATUS_FALSE;
+					break;
+				}
+			}
+
+			if (gzclose(gz) != Z_OK) {
+				status = SWITCH_STATUS_FALSE;
+			}
+		}
+		break;
+#endif
+#ifdef LOGFILE_HAVE_ZSTD
+	case LOGFILE_COMPRESS_ZSTD:
+		{
+			FILE *out;
+
+			if ((out = fopen(tmp, "wb"))) {
+				status = mod_logfile_zstd(in, out);
+				if (fclose(out)) {
+					status = SWITCH_STATUS_FALSE;
+				}
+			}
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (status == SWITCH_STATUS_SUCCESS && !rename(tmp, dst)) {
+		unlink(job->filename);
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error compressing %s, leaving it as is\n", job->filename);
+		unlink(tmp);
+	}
+
+ end:
+	if (in) {
+		fclose(in);
+	}
+	switch_safe_free(tmp);
+	switch_safe_free(dst);
+}
+
+static void *SWITCH_THREAD_FUNC mod_logfile_compress_thread(switch_thread_t *thread, void *obj)
+{
+	void *pop = NULL;
+
+	while (switch_queue_pop(globals.compress_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		compress_job_t *job = (compress_job_t *) pop;
+
+		mod_logfile_compress(job);
+
+		free(job->filename);
+		free(job);
+
+		switch_mutex_lock(globals.mutex);
+		globals.compress_pending--;
+		switch_mutex_unlock(globals.mutex);
+	}
+
+	return NULL;
+}
 
 static switch_status_t process_node(const switch_log_node_t *node, switch_log_level_t level)
 {
@@ -300,13 +623,13 @@ static switch_status_t process_node(const switch_log_node_t *node, switch_log_le
 				argc = switch_split(dup, '\n', lines);
 				for (i = 0; i < argc; i++) {
 					switch_snprintf(buf, sizeof(buf), "%s %s\n", node->userdata, lines[i]);
-					mod_logfile_raw_write(profile, buf);
+					mod_logfile_raw_write(profile, buf, level);
 				}
 
 				free(dup);
 
 			} else {
-				mod_logfile_raw_write(profile, node->data);
+				mod_logfile_raw_write(profile, node->data, level);
 			}
 		}
 
@@ -324,6 +647,7 @@ static void cleanup_profile(void *ptr)
 {
 	logfile_profile_t *profile = (logfile_profile_t *) ptr;
 
+	mod_logfile_flush(profile);
 	switch_core_hash_destroy(&profile->log_hash);
 	switch_file_close(profile->log_afd);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Closing %s\n", profile->logfile);
@@ -344,6 +668,7 @@ static switch_status_t load_profile(switch_xml_t xml)
 
 	new_profile->suffix = 1;
 	new_profile->log_uuid = SWITCH_TRUE;
+	new_profile->flush_interval = DEFAULT_FLUSH_INTERVAL;
 
 	if ((settings = switch_xml_child(xml, "settings"))) {
 		for (param = switch_xml_child(settings, "param"); param; param = param->next) {
@@ -360,6 +685,28 @@ static switch_status_t load_profile(switch_xml_t xml)
 				}
 			} else if (!strcmp(var, "uuid")) {
 				new_profile->log_uuid = switch_true(val);
+			} else if (!strcmp(var, "buffer-size")) {
+				new_profile->buf_size = switch_atoui(val);
+			} else if (!strcmp(var, "flush-interval")) {
+				if ((new_profile->flush_interval = switch_atoui(val)) < 10) {
+					new_profile->flush_interval = 10;
+				}
+			} else if (!strcmp(var, "compress")) {
+				if (!strcasecmp(val, "gzip")) {
+#ifdef LOGFILE_HAVE_ZLIB
+					new_profile->compress = LOGFILE_COMPRESS_GZIP;
+#else
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "gzip compression is not available in this build\n");
+#endif
+				} else if (!strcasecmp(val, "zstd")) {
+#ifdef LOGFILE_HAVE_ZSTD
+					new_profile->compress = LOGFILE_COMPRESS_ZSTD;
+#else
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "zstd compression is not available in this build\n");
+#endif
+				} else if (strcasecmp(val, "none")) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown compression %s, use gzip, zstd or none\n", val);
+				}
 			}
 		}
 	}
@@ -379,6 +726,13 @@ static switch_status_t load_profile(switch_xml_t xml)
 		new_profile->logfile = strdup(logfile);
 	}
 
+	if (new_profile->buf_size) {
+		new_profile->buf = switch_core_alloc(module_pool, new_profile->buf_size);
+		if (new_profile->flush_interval < globals.tick) {
+			globals.tick = new_profile->flush_interval;
+		}
+	}
+
 	if (mod_logfile_openlogfile(new_profile, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
 		return SWITCH_STATUS_GENERR;
 	}
@@ -398,16 +752,20 @@ static void event_handler(switch_event_t *event)
 
 	if (sig && !strcmp(sig, "HUP")) {
 		if (globals.rotate) {
+			switch_mutex_lock(globals.mutex);
 			for (hi = switch_core_hash_first(profile_hash); hi; hi = switch_core_hash_next(&hi)) {
 				switch_core_hash_this(hi, &var, NULL, &val);
 				profile = val;
-				mod_logfile_rotate(profile);
+				profile->rotate_pending = 1;
 			}
+			switch_thread_cond_signal(globals.cond);
+			switch_mutex_unlock(globals.mutex);
 		} else {
 			switch_mutex_lock(globals.mutex);
 			for (hi = switch_core_hash_first(profile_hash); hi; hi = switch_core_hash_next(&hi)) {
 				switch_core_hash_this(hi, &var, NULL, &val);
 				profile = val;
+				mod_logfile_flush(profile);
 				switch_file_close(profile->log_afd);
 				if (mod_logfile_openlogfile(profile, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
 					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error Re-opening Log!\n");
@@ -427,6 +785,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load)
 
 	memset(&globals, 0, sizeof(globals));
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, module_pool);
+	switch_thread_cond_create(&globals.cond, module_pool);
+	switch_queue_create(&globals.compress_queue, MAX_ROT, module_pool);
+	globals.tick = IDLE_TICK;
 
 	if (profile_hash) {
 		switch_core_hash_destroy(&profile_hash);
@@ -465,6 +826,16 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load)
 		switch_xml_free(xml);
 	}
 
+	{
+		switch_threadattr_t *thd_attr = NULL;
+
+		globals.running = 1;
+		switch_threadattr_create(&thd_attr, module_pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&globals.writer_thread, thd_attr, mod_logfile_writer_thread, NULL, module_pool);
+		switch_thread_create(&globals.compress_thread, thd_attr, mod_logfile_compress_thread, NULL, module_pool);
+	}
+
 	switch_log_bind_logger(mod_logfile_logger, SWITCH_LOG_DEBUG, SWITCH_FALSE);
 
 	return SWITCH_STATUS_SUCCESS;
@@ -472,8 +843,26 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load)
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_logfile_shutdown)
 {
+	switch_status_t st;
+
 	switch_log_unbind_logger(mod_logfile_logger);
 	switch_event_unbind(&globals.node);
+
+	switch_mutex_lock(globals.mutex);
+	globals.running = 0;
+	switch_thread_cond_signal(globals.cond);
+	switch_mutex_unlock(globals.mutex);
+
+	if (globals.writer_thread) {
+		switch_thread_join(&st, globals.writer_thread);
+	}
+
+	if (globals.compress_thread) {
+		/* finish what was already rotated */
+		switch_queue_push(globals.compress_queue, NULL);
+		switch_thread_join(&st, globals.compress_thread);
+	}
+
 	switch_core_hash_destroy(&profile_hash);
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -40,14 +40,14 @@
 #define ENCODING_DEFAULT 1
 #define ENCODING_BASE64 2
 #define ENCODING_TEXTXML 3
+/* only files with this suffix are replayed, the err dir defaults to the log dir */
+#define SPOOL_SUFFIX ".spool.xml"
 
 static struct {
 	char *cred;
 	char *urls[MAX_URLS + 1];
 	int url_count;
-	int url_index;
 	switch_thread_rwlock_t *log_path_lock;
-	switch_mutex_t *url_index_mutex;
 	char *base_log_dir;
 	char *base_err_log_dir;
 	char *log_dir;
@@ -73,21 +73,19 @@ static struct {
 	switch_memory_pool_t *pool;
 	switch_event_node_t *node;
 	char *cookie_file;
+	uint32_t post_connections;
+	uint32_t post_batch;
+	uint32_t post_queue_size;
+	uint32_t replay_interval;
+	uint32_t post_drain_timeout;
+	int post_synchronous;
+	switch_curl_poster_t *poster;
 } globals;
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_cdr_shutdown);
 SWITCH_MODULE_DEFINITION(mod_xml_cdr, mod_xml_cdr_load, mod_xml_cdr_shutdown, NULL);
 
-/* this function would have access to the HTML returned by the webserver, we don't need it
- * and the default curl activity is to print to stdout, something not as desirable
- * so we have a dummy function here
- */
-static size_t httpCallBack(char *buffer, size_t size, size_t nitems, void *outstream)
-{
-	return size * nitems;
-}
-
 static switch_status_t set_xml_cdr_log_dirs()
 {
 	switch_time_exp_t tm;
@@ -179,28 +177,108 @@ static switch_status_t set_xml_cdr_log_dirs()
 		}
 	}
 
+	if (globals.poster) {
+		switch_thread_rwlock_rdlock(globals.log_path_lock);
+		switch_curl_poster_set_replay_dir(globals.poster, globals.err_log_dir);
+		switch_thread_rwlock_unlock(globals.log_path_lock);
+	}
+
 	return status;
 }
 
+static void write_xml_cdr_file(const char *path, const char *xml_text)
+{
+	int fd = -1;
+
+#ifdef _MSC_VER
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
+#else
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
+#endif
+		int wrote;
+		wrote = write(fd, xml_text, (unsigned) strlen(xml_text));
+		wrote++;
+		close(fd);
+	} else {
+		char ebuf[512] = { 0 };
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error writing [%s][%s]\n",
+				path, switch_strerror_r(errno, ebuf, sizeof(ebuf)));
+	}
+}
+
+/* a cdr the web server never took goes to the err dir, under the spool suffix when the replay is to pick it up */
+static void xml_cdr_spool(const char *id, const char *name, const char *xml_text, void *user_data)
+{
+	char *path;
+
+	switch_thread_rwlock_rdlock(globals.log_path_lock);
+	if (globals.replay_interval) {
+		path = switch_mprintf("%s%s%s%s", globals.err_log_dir, SWITCH_PATH_SEPARATOR, id, SPOOL_SUFFIX);
+	} else {
+		path = switch_mprintf("%s%s%s.cdr.xml", globals.err_log_dir, SWITCH_PATH_SEPARATOR, name);
+	}
+	switch_thread_rwlock_unlock(globals.log_path_lock);
+
+	if (path) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to post to web server, writing to file %s\n", path);
+		write_xml_cdr_file(path, xml_text);
+		free(path);
+	}
+}
+
+static void xml_cdr_curl_setup(switch_CURL *curl_handle, void *user_data)
+{
+	if (!zstr(globals.cred)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
+	}
+
+	if (globals.ssl_cert_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
+	}
+
+	if (globals.ssl_key_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
+	}
+
+	if (globals.ssl_key_password) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
+	}
+
+	if (globals.ssl_version) {
+		if (!strcasecmp(globals.ssl_version, "SSLv3")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
+		} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
+		}
+	}
+
+	if (globals.ssl_cacert_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
+	}
+
+	if (globals.cookie_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, globals.cookie_file);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, globals.cookie_file);
+	}
+
+	if (globals.enable_cacert_check) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
+	}
+
+	if (globals.enable_ssl_verifyhost) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
+	}
+}
+
 static switch_status_t my_on_reporting(switch_core_session_t *session)
 {
-	switch_xml_t cdr = NULL;
 	char *xml_text = NULL;
 	char *path = NULL;
-	char *curl_xml_text = NULL;
 	const char *logdir = NULL;
-	char *xml_text_escaped = NULL;
-	int fd = -1;
-	uint32_t cur_try;
-	long httpRes;
-	switch_CURL *curl_handle = NULL;
-	switch_curl_slist_t *headers = NULL;
-	switch_curl_slist_t *slist = NULL;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
-	switch_status_t status = SWITCH_STATUS_FALSE;
 	int is_b;
 	const char *a_prefix = "";
-	char url_joiner = '?';
 	int prefix_a;
 	const char *prefix_a_var = NULL;
 
@@ -225,18 +303,12 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 	if (!is_b && prefix_a)
 		a_prefix = "a_";
 
-	if (switch_ivr_generate_xml_cdr(session, &cdr) != SWITCH_STATUS_SUCCESS) {
+	/* build the XML */
+	if (switch_ivr_generate_xml_cdr_text(session, &xml_text, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Generating Data!\n");
 		return SWITCH_STATUS_FALSE;
 	}
 
-	/* build the XML */
-	xml_text = switch_xml_toxml(cdr, SWITCH_TRUE);
-	if (!xml_text) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error!\n");
-		goto error;
-	}
-
 	switch_thread_rwlock_rdlock(globals.log_path_lock);
 
 	if (!(logdir = switch_channel_get_variable(channel, "xml_cdr_base"))) {
@@ -247,217 +319,30 @@ static switch_status_t my_on_reporting(switch_core_session_t *session)
 		path = switch_mprintf("%s%s%s%s.cdr.xml", logdir, SWITCH_PATH_SEPARATOR, a_prefix, switch_core_session_get_uuid(session));
 		switch_thread_rwlock_unlock(globals.log_path_lock);
 		if (path) {
-#ifdef _MSC_VER
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
-#else
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
-#endif
-				int wrote;
-				wrote = write(fd, xml_text, (unsigned) strlen(xml_text));
-				wrote++;
-				close(fd);
-			} else {
-				char ebuf[512] = { 0 };
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error writing [%s][%s]\n",
-						path, switch_strerror_r(errno, ebuf, sizeof(ebuf)));
-			}
+			write_xml_cdr_file(path, xml_text);
 			switch_safe_free(path);
 		}
 	} else {
 		switch_thread_rwlock_unlock(globals.log_path_lock);
 	}
 
-	/* try to post it to the web server */
-	if (globals.url_count) {
-		char *destUrl = NULL;
-		int g_url_index = -1;
+	/* hand it to the poster, the session only waits for the web server with post-synchronous */
+	if (globals.poster) {
+		char *id = switch_mprintf("%s%s", a_prefix, switch_core_session_get_uuid(session));
+		const char *doc = xml_text;
 
-		switch_mutex_lock(globals.url_index_mutex);
-		g_url_index = globals.url_index;
-		switch_mutex_unlock(globals.url_index_mutex);
-
-		curl_handle = switch_curl_easy_init();
-
-		if (globals.encode == ENCODING_TEXTXML) {
-			headers = switch_curl_slist_append(headers, "Content-Type: text/xml");
-		} else if (globals.encode) {
-			switch_size_t need_bytes = strlen(xml_text) * 3 + 1;
-
-			xml_text_escaped = malloc(need_bytes);
-			switch_assert(xml_text_escaped);
-			memset(xml_text_escaped, 0, need_bytes);
-			if (globals.encode == ENCODING_DEFAULT) {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
-				switch_url_encode_opt(xml_text, xml_text_escaped, need_bytes, SWITCH_TRUE);
-			} else {
-				headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-base64-encoded");
-				switch_b64_encode((unsigned char *) xml_text, need_bytes / 3, (unsigned char *) xml_text_escaped, need_bytes);
-			}
-			switch_safe_free(xml_text);
-			xml_text = xml_text_escaped;
-		} else {
-			headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-plaintext");
+		/* batches carry a single prolog of their own */
+		if (globals.post_batch > 1 && !strncmp(doc, "<?xml", 5) && (doc = strstr(doc, "?>"))) {
+			for (doc += 2; *doc == '\n' || *doc == '\r'; doc++);
 		}
 
-		if (globals.encode == ENCODING_TEXTXML) {
-			curl_xml_text = xml_text;
-		} else if (!(curl_xml_text = switch_mprintf("cdr=%s", xml_text))) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error!\n");
-			goto error;
-		}
-
-		if (!zstr(globals.cred)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, globals.auth_scheme);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, globals.cred);
-		}
-
-		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, curl_xml_text);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-xml/1.0");
-		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, httpCallBack);
-
-		if (globals.disable100continue) {
-			slist = switch_curl_slist_append(slist, "Expect:");
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, slist);
-		}
-
-		if (globals.ssl_cert_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, globals.ssl_cert_file);
-		}
-
-		if (globals.ssl_key_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, globals.ssl_key_file);
-		}
-
-		if (globals.ssl_key_password) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, globals.ssl_key_password);
-		}
-
-		if (globals.ssl_version) {
-			if (!strcasecmp(globals.ssl_version, "SSLv3")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
-			} else if (!strcasecmp(globals.ssl_version, "TLSv1")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
-			}
-		}
-
-		if (globals.ssl_cacert_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, globals.ssl_cacert_file);
-		}
-
-		if (globals.cookie_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, globals.cookie_file);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, globals.cookie_file);
-		}
-
-		switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, globals.timeout);
-
-		/* these were used for testing, optionally they may be enabled if someone desires
-		   switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1); // 302 recursion level
-		 */
-
-		for (cur_try = 0; cur_try < globals.retries; cur_try++) {
-			if (cur_try > 0) {
-				switch_yield(globals.delay * 1000000);
-			}
-
-			if( strchr(globals.urls[g_url_index], '?') != NULL ) {
-				url_joiner = '&';
-			}
-			destUrl = switch_mprintf("%s%cuuid=%s%s", globals.urls[g_url_index], url_joiner, a_prefix, switch_core_session_get_uuid(session));
-			switch_curl_easy_setopt(curl_handle, CURLOPT_URL, destUrl);
-
-			if (!strncasecmp(destUrl, "https", 5)) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0);
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
-			}
-
-			if (globals.enable_cacert_check) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
-			}
-
-			if (globals.enable_ssl_verifyhost) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
-			}
-
-			/* overrides default 300s timeout, could be usefull if the current web server is down to prevent long time waiting for nothing */
-			/* connection_timeout = retry_timeout  */
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, !globals.delay ? 5 : (long)globals.delay);
-			switch_curl_easy_perform(curl_handle);
-			switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-			switch_safe_free(destUrl);
-			if (httpRes >= 200 && httpRes <= 299) {
-				goto success;
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Got error [%ld] posting to web server [%s]\n",
-								  httpRes, globals.urls[g_url_index]);
-				g_url_index++;
-				switch_assert(globals.url_count <= MAX_URLS);
-				if (g_url_index >= globals.url_count) {
-					g_url_index = 0;
-				}
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Retry will be with url [%s]\n", globals.urls[g_url_index]);
-				switch_mutex_lock(globals.url_index_mutex);
-				if (globals.url_index != g_url_index) {
-					globals.url_index = g_url_index;
-				}
-				switch_mutex_unlock(globals.url_index_mutex);
-			}
-		}
-		switch_curl_easy_cleanup(curl_handle);
-		switch_curl_slist_free_all(headers);
-		switch_curl_slist_free_all(slist);
-		slist = NULL;
-		headers = NULL;
-		curl_handle = NULL;
-
-		/* if we are here the web post failed for some reason */
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to post to web server, writing to file\n");
-
-		switch_thread_rwlock_rdlock(globals.log_path_lock);
-		path = switch_mprintf("%s%s%s%s.cdr.xml", globals.err_log_dir, SWITCH_PATH_SEPARATOR, a_prefix, switch_core_session_get_uuid(session));
-		switch_thread_rwlock_unlock(globals.log_path_lock);
-		if (path) {
-#ifdef _MSC_VER
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
-#else
-			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) > -1) {
-#endif
-				int wrote;
-				wrote = write(fd, xml_text, (unsigned) strlen(xml_text));
-				wrote++;
-				close(fd);
-			} else {
-				char ebuf[512] = { 0 };
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error![%s]\n",
-						switch_strerror_r(errno, ebuf, sizeof(ebuf)));
-			}
-		}
+		switch_curl_poster_push(globals.poster, id, NULL, doc ? doc : xml_text);
+		free(id);
 	}
 
-  success:
-	status = SWITCH_STATUS_SUCCESS;
-
-  error:
-	if (curl_handle) {
-		switch_curl_easy_cleanup(curl_handle);
-	}
-	if (headers) {
-		switch_curl_slist_free_all(headers);
-	}
-	if (slist) {
-		switch_curl_slist_free_all(slist);
-	}
-	if (curl_xml_text != xml_text) {
-		switch_safe_free(curl_xml_text);
-	}
 	switch_safe_free(xml_text);
-	switch_safe_free(path);
-	switch_xml_free(cdr);
 
-	return status;
+	return SWITCH_STATUS_SUCCESS;
 }
 
 static void event_handler(switch_event_t *event)
@@ -471,6 +356,21 @@ static void event_handler(switch_event_t *event)
 	}
 }
 
+SWITCH_STANDARD_API(xml_cdr_function)
+{
+	if (!zstr(cmd) && !strcasecmp(cmd, "status")) {
+		if (globals.poster) {
+			switch_curl_poster_stats(globals.poster, stream);
+		} else {
+			stream->write_function(stream, "-ERR no url configured\n");
+		}
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	stream->write_function(stream, "-USAGE: status\n");
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_state_handler_table_t state_handlers = {
 	/*.on_init */ NULL,
 	/*.on_routing */ NULL,
@@ -490,11 +390,14 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 	char *cf = "xml_cdr.conf";
 	switch_xml_t cfg, xml, settings, param;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_api_interface_t *api_interface;
 
 	/* test global state handlers */
 	switch_core_add_state_handler(&state_handlers);
 
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
+	SWITCH_ADD_API(api_interface, "xml_cdr", "xml_cdr controls", xml_cdr_function, "status");
+	switch_console_set_complete("add xml_cdr status");
 
 	memset(&globals, 0, sizeof(globals));
 
@@ -510,8 +413,11 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 	globals.pool = pool;
 	globals.auth_scheme = CURLAUTH_BASIC;
 
+	globals.post_connections = 4;
+	globals.post_batch = 1;
+	globals.post_queue_size = 10000;
+
 	switch_thread_rwlock_create(&globals.log_path_lock, pool);
-	switch_mutex_init(&globals.url_index_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 
 	/* parse the config */
 	if (!(xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
@@ -618,6 +524,18 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 				}
 			} else if (!strcasecmp(var, "cookie-file")) {
 				globals.cookie_file = switch_core_strdup(globals.pool, val);
+			} else if (!strcasecmp(var, "post-connections") && !zstr(val)) {
+				globals.post_connections = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-batch") && !zstr(val)) {
+				globals.post_batch = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-queue-size") && !zstr(val)) {
+				globals.post_queue_size = switch_atoui(val);
+			} else if (!strcasecmp(var, "spool-replay-interval") && !zstr(val)) {
+				globals.replay_interval = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-drain-timeout") && !zstr(val)) {
+				globals.post_drain_timeout = switch_atoui(val);
+			} else if (!strcasecmp(var, "post-synchronous")) {
+				globals.post_synchronous = switch_true(val);
 			}
 		}
 
@@ -638,6 +556,62 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_cdr_load)
 
 	globals.retries++;
 
+	if (globals.post_batch > 1 && globals.encode != ENCODING_TEXTXML) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "post-batch needs encode=textxml, posting one cdr at a time\n");
+		globals.post_batch = 1;
+	}
+
+	if (globals.url_count) {
+		switch_curl_poster_settings_t settings = { 0 };
+
+		settings.name = "xml_cdr";
+		settings.urls = globals.urls;
+		settings.url_count = globals.url_count;
+		settings.user_agent = "freeswitch-xml/1.0";
+		settings.form_field = "cdr";
+		settings.max_connections = globals.post_connections;
+		settings.queue_size = globals.post_queue_size;
+		settings.retries = globals.retries;
+		settings.delay = globals.delay;
+		settings.timeout = globals.timeout;
+		/* connection_timeout = retry_timeout, don't wait for a web server that is down */
+		settings.connect_timeout = !globals.delay ? 5 : (long) globals.delay;
+		settings.disable_100_continue = globals.disable100continue ? SWITCH_TRUE : SWITCH_FALSE;
+		settings.spool_suffix = SPOOL_SUFFIX;
+		settings.replay_interval = globals.replay_interval;
+		settings.drain_timeout = globals.post_drain_timeout;
+		settings.synchronous = globals.post_synchronous ? SWITCH_TRUE : SWITCH_FALSE;
+		settings.setup = xml_cdr_curl_setup;
+		settings.spool = xml_cdr_spool;
+
+		if (globals.encode == ENCODING_TEXTXML) {
+			settings.encoding = SWITCH_CURL_POST_RAW;
+			settings.content_type = "text/xml";
+			if (globals.post_batch > 1) {
+				settings.batch_max = globals.post_batch;
+				settings.batch_open = "<?xml version=\"1.0\"?>\n<cdrs>\n";
+				settings.batch_close = "</cdrs>\n";
+			} else {
+				settings.id_param = "uuid";
+			}
+		} else {
+			settings.id_param = "uuid";
+			if (globals.encode == ENCODING_DEFAULT) {
+				settings.encoding = SWITCH_CURL_POST_FORM_URLENCODE;
+				settings.double_encode = SWITCH_TRUE;
+				settings.content_type = "application/x-www-form-urlencoded";
+			} else if (globals.encode == ENCODING_BASE64) {
+				settings.encoding = SWITCH_CURL_POST_FORM_BASE64;
+				settings.content_type = "application/x-www-form-base64-encoded";
+			} else {
+				settings.encoding = SWITCH_CURL_POST_FORM;
+				settings.content_type = "application/x-www-form-plaintext";
+			}
+		}
+
+		switch_curl_poster_create(&globals.poster, &settings);
+	}
+
 	set_xml_cdr_log_dirs();
 
 	switch_xml_free(xml);
@@ -650,12 +624,16 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_cdr_shutdown)
 
 	globals.shutdown = 1;
 
-	switch_safe_free(globals.log_dir);
-	switch_safe_free(globals.err_log_dir);
-
+	switch_console_set_complete("del xml_cdr");
 	switch_event_unbind(&globals.node);
 	switch_core_remove_state_handler(&state_handlers);
 
+	/* posts what is queued for up to post-drain-timeout seconds and spools the rest to the err dir */
+	switch_curl_poster_destroy(&globals.poster);
+
+	switch_safe_free(globals.log_dir);
+	switch_safe_free(globals.err_log_dir);
+
 	switch_thread_rwlock_destroy(globals.log_path_lock);
 
 	return SWITCH_STATUS_SUCCESS;
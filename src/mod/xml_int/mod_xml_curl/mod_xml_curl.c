@@ -60,6 +60,25 @@ struct xml_binding {
 	long auth_scheme;
 	int timeout;
 	switch_size_t curl_max_bytes;
+	int enable_http2;
+	/* idle handles kept for reuse so their connections stay open, 0 makes a new handle per request */
+	int connection_pool_size;
+	int handle_count;
+	switch_CURL **handles;
+	switch_mutex_t *handle_mutex;
+	/* response cache, disabled while cache_ttl is 0 */
+	uint32_t cache_ttl;
+	uint32_t cache_stale;
+	uint32_t cache_max_entries;
+	uint32_t cache_count;
+	int cache_var_count;
+	char **cache_vars;
+	switch_hash_t *cache;
+	switch_mutex_t *cache_mutex;
+	/* least recently used first */
+	struct xml_cache_entry *cache_head;
+	struct xml_cache_entry *cache_tail;
+	struct xml_binding *next;
 };
 
 static int keep_files_around = 0;
@@ -67,15 +86,41 @@ static int keep_files_around = 0;
 typedef struct xml_binding xml_binding_t;
 
 #define XML_CURL_MAX_BYTES 1024 * 1024
+#define XML_CURL_POOL_SIZE 8
+#define XML_CURL_CACHE_MAX_ENTRIES 10000
 
 struct config_data {
-	char *name;
-	int fd;
+	char *buf;
 	switch_size_t bytes;
+	switch_size_t size;
 	switch_size_t max_bytes;
 	int err;
+	/* Cache-Control of the final response, -1 when absent */
+	int no_store;
+	long max_age;
+	long stale;
 };
 
+typedef struct xml_cache_entry {
+	char *key;
+	char *body;
+	switch_time_t expires;
+	switch_time_t stale_until;
+	int refreshing;
+	struct xml_cache_entry *prev;
+	struct xml_cache_entry *next;
+} xml_cache_entry_t;
+
+typedef struct xml_refresh {
+	xml_binding_t *binding;
+	char *section;
+	char *tag_name;
+	char *key_name;
+	char *key_value;
+	char *cache_key;
+	switch_event_t *params;
+} xml_refresh_t;
+
 typedef struct hash_node {
 	switch_hash_t *hash;
 	struct hash_node *next;
@@ -85,9 +130,16 @@ static struct {
 	switch_memory_pool_t *pool;
 	hash_node_t *hash_root;
 	hash_node_t *hash_tail;
+	xml_binding_t *bindings;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *refresh_cond;
+	int refreshing;
+	int running;
 } globals;
 
-#define XML_CURL_SYNTAX "[debug_on|debug_off]"
+static void xml_cache_flush(xml_binding_t *binding, switch_bool_t expired_only);
+
+#define XML_CURL_SYNTAX "[debug_on|debug_off|cache_flush]"
 SWITCH_STANDARD_API(xml_curl_function)
 {
 	if (session) {
@@ -102,6 +154,12 @@ SWITCH_STANDARD_API(xml_curl_function)
 		keep_files_around = 1;
 	} else if (!strcasecmp(cmd, "debug_off")) {
 		keep_files_around = 0;
+	} else if (!strcasecmp(cmd, "cache_flush")) {
+		xml_binding_t *binding;
+
+		for (binding = globals.bindings; binding; binding = binding->next) {
+			xml_cache_flush(binding, SWITCH_FALSE);
+		}
 	} else {
 		goto usage;
 	}
@@ -114,43 +172,132 @@ SWITCH_STANDARD_API(xml_curl_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-static size_t file_callback(void *ptr, size_t size, size_t nmemb, void *data)
+static size_t body_callback(void *ptr, size_t size, size_t nmemb, void *data)
 {
 	register unsigned int realsize = (unsigned int) (size * nmemb);
 	struct config_data *config_data = data;
-	int x;
 
-	config_data->bytes += realsize;
-
-	if (config_data->bytes > config_data->max_bytes) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Oversized file detected [%d bytes]\n", (int) config_data->bytes);
+	if (config_data->bytes + realsize > config_data->max_bytes) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Oversized file detected [%d bytes]\n", (int) (config_data->bytes + realsize));
 		config_data->err = 1;
 		return 0;
 	}
 
-	x = write(config_data->fd, ptr, realsize);
-	if (x != (int) realsize) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Short write! %d out of %d\n", x, realsize);
+	if (config_data->bytes + realsize + 1 > config_data->size) {
+		switch_size_t new_size = config_data->size ? config_data->size : 4096;
+		char *new_buf;
+
+		while (new_size < config_data->bytes + realsize + 1) {
+			new_size *= 2;
+		}
+
+		if (!(new_buf = realloc(config_data->buf, new_size))) {
+			config_data->err = 1;
+			return 0;
+		}
+
+		config_data->buf = new_buf;
+		config_data->size = new_size;
 	}
-	return x;
+
+	memcpy(config_data->buf + config_data->bytes, ptr, realsize);
+	config_data->bytes += realsize;
+	config_data->buf[config_data->bytes] = '\0';
+
+	return realsize;
 }
 
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *data)
+{
+	size_t len = size * nitems;
+	struct config_data *config_data = data;
+	char line[512];
+	char *argv[32] = { 0 };
+	int argc, i;
+
+	/* a new status line means a redirect, only the last response counts */
+	if (len > 5 && !strncasecmp(buffer, "HTTP/", 5)) {
+		config_data->no_store = 0;
+		config_data->max_age = -1;
+		config_data->stale = -1;
+		return len;
+	}
 
+	if (len < 15 || len >= sizeof(line) || strncasecmp(buffer, "Cache-Control:", 14)) {
+		return len;
+	}
 
+	memcpy(line, buffer + 14, len - 14);
+	line[len - 14] = '\0';
 
-static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, const char *key_name, const char *key_value, switch_event_t *params,
-								  void *user_data)
+	argc = switch_separate_string(line, ',', argv, (sizeof(argv) / sizeof(argv[0])));
+
+	for (i = 0; i < argc; i++) {
+		char *directive = switch_strip_whitespace(argv[i]);
+
+		if (!directive) {
+			continue;
+		}
+
+		if (!strcasecmp(directive, "no-store") || !strcasecmp(directive, "no-cache")) {
+			config_data->no_store = 1;
+		} else if (!strncasecmp(directive, "max-age=", 8)) {
+			config_data->max_age = atol(directive + 8);
+		} else if (!strncasecmp(directive, "stale-while-revalidate=", 23)) {
+			config_data->stale = atol(directive + 23);
+		}
+
+		free(directive);
+	}
+
+	return len;
+}
+
+static switch_CURL *binding_get_handle(xml_binding_t *binding)
+{
+	switch_CURL *curl_handle = NULL;
+
+	if (binding->connection_pool_size) {
+		switch_mutex_lock(binding->handle_mutex);
+		if (binding->handle_count) {
+			curl_handle = binding->handles[--binding->handle_count];
+		}
+		switch_mutex_unlock(binding->handle_mutex);
+	}
+
+	if (curl_handle) {
+		/* drops the options but keeps the open connections, dns and tls session caches */
+		curl_easy_reset(curl_handle);
+	} else {
+		curl_handle = switch_curl_easy_init();
+	}
+
+	return curl_handle;
+}
+
+static void binding_put_handle(xml_binding_t *binding, switch_CURL *curl_handle, switch_bool_t reuse)
+{
+	if (reuse && binding->connection_pool_size) {
+		switch_mutex_lock(binding->handle_mutex);
+		if (binding->handle_count < binding->connection_pool_size) {
+			binding->handles[binding->handle_count++] = curl_handle;
+			curl_handle = NULL;
+		}
+		switch_mutex_unlock(binding->handle_mutex);
+	}
+
+	if (curl_handle) {
+		switch_curl_easy_cleanup(curl_handle);
+	}
+}
+
+/* performs the http request, returns the malloc'd body of a 200 response or NULL */
+static char *xml_curl_request(xml_binding_t *binding, const char *section, const char *tag_name, const char *key_name, const char *key_value,
+							  switch_event_t *params, struct config_data *config_data)
 {
-	char filename[512] = "";
 	switch_CURL *curl_handle = NULL;
 	switch_CURLcode cc;
-	struct config_data config_data;
-	switch_xml_t xml = NULL;
 	char *data = NULL;
-	switch_uuid_t uuid;
-	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
-	xml_binding_t *binding = (xml_binding_t *) user_data;
-	char *file_url;
 	switch_curl_slist_t *slist = NULL;
 	long httpRes = 0;
 	switch_curl_slist_t *headers = NULL;
@@ -158,22 +305,9 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 	char basic_data[512];
 	char *uri = NULL;
 	char *dynamic_url = NULL;
+	char *body = NULL;
 
-    strncpy(hostname, switch_core_get_switchname(), sizeof(hostname) - 1);
-
-	if (!binding) {
-		return NULL;
-	}
-
-	if ((file_url = strstr(binding->url, "file:"))) {
-		file_url += 5;
-
-		if (!(xml = switch_xml_parse_file(file_url))) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Parsing Result!\n");
-		}
-
-		return xml;
-	}
+	strncpy(hostname, switch_core_get_switchname(), sizeof(hostname) - 1);
 
 	switch_snprintf(basic_data, sizeof(basic_data), "hostname=%s&section=%s&tag_name=%s&key_name=%s&key_value=%s",
 					hostname, section, switch_str_nil(tag_name), switch_str_nil(key_name), switch_str_nil(key_value));
@@ -204,11 +338,7 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		sprintf(uri, "%s%c%s", dynamic_url, strchr(dynamic_url, '?') != NULL ? '&' : '?', data);
 	}
 
-	switch_uuid_get(&uuid);
-	switch_uuid_format(uuid_str, &uuid);
-
-	switch_snprintf(filename, sizeof(filename), "%s%s%s.tmp.xml", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, uuid_str);
-	curl_handle = switch_curl_easy_init();
+	curl_handle = binding_get_handle(binding);
 	headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
 
 	if (!strncasecmp(binding->url, "https", 5)) {
@@ -216,123 +346,556 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0);
 	}
 
-	memset(&config_data, 0, sizeof(config_data));
+	memset(config_data, 0, sizeof(*config_data));
 
-	config_data.name = filename;
-	config_data.max_bytes = binding->curl_max_bytes;
+	config_data->max_bytes = binding->curl_max_bytes;
+	config_data->max_age = -1;
+	config_data->stale = -1;
 
-	if ((config_data.fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
-		if (!zstr(binding->cred)) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, binding->auth_scheme);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, binding->cred);
+	if (!zstr(binding->cred)) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, binding->auth_scheme);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, binding->cred);
+	}
+	switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+	if (binding->method != NULL)
+		switch_curl_easy_setopt(curl_handle, CURLOPT_CUSTOMREQUEST, binding->method);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_POST, !binding->use_get_style);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_MAXREDIRS, 10);
+	if (!binding->use_get_style)
+		switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, data);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_URL, binding->use_get_style ? uri : dynamic_url);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, body_callback);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *) config_data);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, header_callback);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *) config_data);
+	switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-xml/1.0");
+	switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
+#if LIBCURL_VERSION_NUM >= 0x071900
+	switch_curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072f00
+	if (binding->enable_http2) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+	}
+#endif
+
+	if (binding->timeout) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, binding->timeout);
+	}
+
+	if (binding->disable100continue) {
+		slist = switch_curl_slist_append(slist, "Expect:");
+		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, slist);
+	}
+
+	if (binding->enable_cacert_check) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
+	}
+
+	if (binding->ssl_cert_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, binding->ssl_cert_file);
+	}
+
+	if (binding->ssl_key_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, binding->ssl_key_file);
+	}
+
+	if (binding->ssl_key_password) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, binding->ssl_key_password);
+	}
+
+	if (binding->ssl_version) {
+		if (!strcasecmp(binding->ssl_version, "SSLv3")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
+		} else if (!strcasecmp(binding->ssl_version, "TLSv1")) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
 		}
-		switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-		if (binding->method != NULL)
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CUSTOMREQUEST, binding->method);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_POST, !binding->use_get_style);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_MAXREDIRS, 10);
-		if (!binding->use_get_style)
-			switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, data);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_URL, binding->use_get_style ? uri : dynamic_url);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, file_callback);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *) &config_data);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-xml/1.0");
-		switch_curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1);
+	}
+
+	if (binding->ssl_cacert_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, binding->ssl_cacert_file);
+	}
+
+	if (binding->enable_ssl_verifyhost) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
+	}
+
+	if (binding->cookie_file) {
+		switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, binding->cookie_file);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, binding->cookie_file);
+	}
+
+	if (binding->bind_local) {
+		curl_easy_setopt(curl_handle, CURLOPT_INTERFACE, binding->bind_local);
+	}
 
-		if (binding->timeout) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, binding->timeout);
+	cc = switch_curl_easy_perform(curl_handle);
+	if (cc && cc != CURLE_WRITE_ERROR) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "CURL returned error:[%d] %s\n", cc, switch_curl_easy_strerror(cc));
+	}
+
+	switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
+
+	if (binding->cookie_file && binding->connection_pool_size) {
+		/* the jar is otherwise only written when the handle is cleaned up */
+		switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIELIST, "FLUSH");
+	}
+
+	binding_put_handle(binding, curl_handle, cc == CURLE_OK ? SWITCH_TRUE : SWITCH_FALSE);
+	switch_curl_slist_free_all(headers);
+	switch_curl_slist_free_all(slist);
+
+	if (config_data->err) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error encountered! [%s]\ndata: [%s]\n", binding->url, data);
+	} else if (httpRes == 200) {
+		body = config_data->buf;
+		config_data->buf = NULL;
+
+		if (!body) {
+			body = strdup("");
+			switch_assert(body);
 		}
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Received HTTP error %ld trying to fetch %s\ndata: [%s]\n", httpRes, binding->url,
+						  data);
+	}
 
-		if (binding->disable100continue) {
-			slist = switch_curl_slist_append(slist, "Expect:");
-			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, slist);
+	switch_safe_free(config_data->buf);
+	switch_safe_free(data);
+	if (binding->use_get_style == 1)
+		switch_safe_free(uri);
+	if (binding->use_dynamic_url && dynamic_url != binding->url)
+		switch_safe_free(dynamic_url);
+
+	return body;
+}
+
+/* parses a response body, takes ownership of body */
+static switch_xml_t xml_curl_parse(xml_binding_t *binding, char *body)
+{
+	char filename[512] = "";
+	switch_uuid_t uuid;
+	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
+	switch_xml_t xml = NULL;
+	int fd;
+
+	/* pre-processing and debug dumps need the body on disk, everything else parses in memory */
+	if (!keep_files_around && !switch_stristr("X-pre-process", body)) {
+		if (!(xml = switch_xml_parse_str_dynamic(body, SWITCH_FALSE))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Parsing Result! [%s]\n", binding->url);
+			free(body);
 		}
+		return xml;
+	}
+
+	switch_uuid_get(&uuid);
+	switch_uuid_format(uuid_str, &uuid);
+	switch_snprintf(filename, sizeof(filename), "%s%s%s.tmp.xml", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, uuid_str);
+
+	if ((fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
+		size_t len = strlen(body);
 
-		if (binding->enable_cacert_check) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, TRUE);
+		if (write(fd, body, len) != (int) len) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Short write to %s!\n", filename);
 		}
+		close(fd);
 
-		if (binding->ssl_cert_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLCERT, binding->ssl_cert_file);
+		if (!(xml = switch_xml_parse_file(filename))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Parsing Result! [%s]\n", binding->url);
 		}
 
-		if (binding->ssl_key_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEY, binding->ssl_key_file);
+		/* Debug by leaving the file behind for review */
+		if (keep_files_around) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "XML response is in %s\n", filename);
+		} else if (unlink(filename) != 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "XML response file [%s] delete failed\n", filename);
 		}
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening temp file!\n");
+	}
+
+	free(body);
+
+	return xml;
+}
 
-		if (binding->ssl_key_password) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSLKEYPASSWD, binding->ssl_key_password);
+static char *xml_cache_key(xml_binding_t *binding, const char *section, const char *tag_name, const char *key_name, const char *key_value,
+						   switch_event_t *params)
+{
+	switch_stream_handle_t stream = { 0 };
+	switch_event_header_t *hp;
+	int i;
+
+	SWITCH_STANDARD_STREAM(stream);
+	stream.write_function(&stream, "%s|%s|%s|%s", switch_str_nil(section), switch_str_nil(tag_name), switch_str_nil(key_name), switch_str_nil(key_value));
+
+	if (binding->cache_var_count) {
+		for (i = 0; i < binding->cache_var_count; i++) {
+			const char *val = params ? switch_event_get_header(params, binding->cache_vars[i]) : NULL;
+			stream.write_function(&stream, "|%s", switch_str_nil(val));
 		}
+	} else if (params) {
+		/* everything that is posted, except the event stamps that change on every request */
+		for (hp = params->headers; hp; hp = hp->next) {
+			if (!strncasecmp(hp->name, "Event-Date-", 11) || !strncasecmp(hp->name, "Event-Calling-", 14) ||
+				!strcasecmp(hp->name, "Event-Sequence")) {
+				continue;
+			}
 
-		if (binding->ssl_version) {
-			if (!strcasecmp(binding->ssl_version, "SSLv3")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);
-			} else if (!strcasecmp(binding->ssl_version, "TLSv1")) {
-				switch_curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1);
+			if (binding->vars_map && !switch_core_hash_find(binding->vars_map, hp->name)) {
+				continue;
 			}
-		}
 
-		if (binding->ssl_cacert_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_CAINFO, binding->ssl_cacert_file);
+			stream.write_function(&stream, "|%s=%s", hp->name, hp->value);
 		}
+	}
 
-		if (binding->enable_ssl_verifyhost) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 2);
-		}
+	return (char *) stream.data;
+}
+
+typedef struct xml_cache_sweep {
+	xml_binding_t *binding;
+	switch_time_t now;
+	switch_bool_t expired_only;
+	uint32_t deleted;
+} xml_cache_sweep_t;
+
+/* the list helpers are called with cache_mutex held */
+static void xml_cache_unlink(xml_binding_t *binding, xml_cache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		binding->cache_head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		binding->cache_tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+static void xml_cache_append(xml_binding_t *binding, xml_cache_entry_t *entry)
+{
+	entry->next = NULL;
+	if ((entry->prev = binding->cache_tail)) {
+		entry->prev->next = entry;
+	} else {
+		binding->cache_head = entry;
+	}
+	binding->cache_tail = entry;
+}
+
+static void xml_cache_touch(xml_binding_t *binding, xml_cache_entry_t *entry)
+{
+	if (binding->cache_tail != entry) {
+		xml_cache_unlink(binding, entry);
+		xml_cache_append(binding, entry);
+	}
+}
+
+static void xml_cache_entry_free(xml_cache_entry_t *entry)
+{
+	switch_safe_free(entry->body);
+	switch_safe_free(entry->key);
+	free(entry);
+}
+
+static void xml_cache_drop(xml_binding_t *binding, xml_cache_entry_t *entry)
+{
+	xml_cache_unlink(binding, entry);
+	switch_core_hash_delete(binding->cache, entry->key);
+	binding->cache_count--;
+	xml_cache_entry_free(entry);
+}
+
+static switch_bool_t xml_cache_sweep_callback(const void *key, const void *val, void *pData)
+{
+	xml_cache_entry_t *entry = (xml_cache_entry_t *) val;
+	xml_cache_sweep_t *sweep = (xml_cache_sweep_t *) pData;
+
+	if (!sweep->expired_only || (entry->stale_until < sweep->now && !entry->refreshing)) {
+		xml_cache_unlink(sweep->binding, entry);
+		xml_cache_entry_free(entry);
+		sweep->deleted++;
+		return SWITCH_TRUE;
+	}
+
+	return SWITCH_FALSE;
+}
+
+static void xml_cache_flush(xml_binding_t *binding, switch_bool_t expired_only)
+{
+	xml_cache_sweep_t sweep = { 0 };
+
+	if (!binding->cache) {
+		return;
+	}
+
+	sweep.binding = binding;
+	sweep.now = switch_micro_time_now();
+	sweep.expired_only = expired_only;
+
+	switch_mutex_lock(binding->cache_mutex);
+	switch_core_hash_delete_multi(binding->cache, xml_cache_sweep_callback, &sweep);
+	binding->cache_count -= sweep.deleted;
+	switch_mutex_unlock(binding->cache_mutex);
 
-		if (binding->cookie_file) {
-			switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEJAR, binding->cookie_file);
-			switch_curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, binding->cookie_file);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Flushed %u cached response%s for %s\n",
+					  sweep.deleted, sweep.deleted == 1 ? "" : "s", binding->url);
+}
+
+/* returns a copy of the cached body, *stale is set when the caller should refresh it */
+static char *xml_cache_lookup(xml_binding_t *binding, const char *key, switch_bool_t *stale)
+{
+	xml_cache_entry_t *entry;
+	switch_time_t now = switch_micro_time_now();
+	char *body = NULL;
+
+	*stale = SWITCH_FALSE;
+
+	switch_mutex_lock(binding->cache_mutex);
+	if ((entry = switch_core_hash_find(binding->cache, key))) {
+		if (now < entry->expires) {
+			body = strdup(entry->body);
+			xml_cache_touch(binding, entry);
+		} else if (now < entry->stale_until) {
+			body = strdup(entry->body);
+			xml_cache_touch(binding, entry);
+
+			if (!entry->refreshing) {
+				entry->refreshing = 1;
+				*stale = SWITCH_TRUE;
+			}
 		}
+	}
+	switch_mutex_unlock(binding->cache_mutex);
+
+	return body;
+}
+
+static void xml_cache_store(xml_binding_t *binding, const char *key, char *body, struct config_data *config_data)
+{
+	xml_cache_entry_t *entry;
+	switch_time_t now = switch_micro_time_now();
+	long ttl = binding->cache_ttl, stale = binding->cache_stale;
+
+	if (config_data->max_age >= 0) {
+		ttl = config_data->max_age;
+	}
+
+	if (config_data->stale >= 0) {
+		stale = config_data->stale;
+	}
+
+	if (config_data->no_store || ttl <= 0) {
+		free(body);
+		return;
+	}
 
-		if (binding->bind_local) {
-			curl_easy_setopt(curl_handle, CURLOPT_INTERFACE, binding->bind_local);
+	switch_mutex_lock(binding->cache_mutex);
+
+	if ((entry = switch_core_hash_find(binding->cache, key))) {
+		switch_safe_free(entry->body);
+		xml_cache_touch(binding, entry);
+	} else {
+		if (binding->cache_count >= binding->cache_max_entries) {
+			/* cache_mutex is nested */
+			xml_cache_flush(binding, SWITCH_TRUE);
 		}
 
-		cc = switch_curl_easy_perform(curl_handle);
-		if (cc && cc != CURLE_WRITE_ERROR) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "CURL returned error:[%d] %s\n", cc, switch_curl_easy_strerror(cc));
+		/* nothing expired, make room by dropping the least recently used entry */
+		while (binding->cache_count >= binding->cache_max_entries && binding->cache_head) {
+			xml_cache_drop(binding, binding->cache_head);
 		}
 
-		switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-		switch_curl_easy_cleanup(curl_handle);
-		switch_curl_slist_free_all(headers);
-		switch_curl_slist_free_all(slist);
-		close(config_data.fd);
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening temp file!\n");
+		switch_zmalloc(entry, sizeof(*entry));
+		entry->key = strdup(key);
+		switch_core_hash_insert(binding->cache, key, entry);
+		xml_cache_append(binding, entry);
+		binding->cache_count++;
 	}
 
-	if (config_data.err) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error encountered! [%s]\ndata: [%s]\n", binding->url, data);
-		xml = NULL;
-	} else {
-		if (httpRes == 200) {
-			if (!(xml = switch_xml_parse_file(filename))) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Parsing Result! [%s]\ndata: [%s]\n", binding->url, data);
-			}
+	entry->body = body;
+	entry->expires = now + (switch_time_t) ttl * 1000000;
+	entry->stale_until = entry->expires + (switch_time_t) stale * 1000000;
+	entry->refreshing = 0;
+
+	switch_mutex_unlock(binding->cache_mutex);
+}
+
+static void xml_cache_refresh_done(xml_binding_t *binding, const char *key)
+{
+	xml_cache_entry_t *entry;
+
+	switch_mutex_lock(binding->cache_mutex);
+	if ((entry = switch_core_hash_find(binding->cache, key))) {
+		entry->refreshing = 0;
+	}
+	switch_mutex_unlock(binding->cache_mutex);
+}
+
+/* fetches, validates and caches a body, returns the parsed xml */
+static switch_xml_t xml_curl_fetch_and_cache(xml_binding_t *binding, const char *section, const char *tag_name, const char *key_name,
+											 const char *key_value, switch_event_t *params, const char *cache_key)
+{
+	struct config_data config_data;
+	switch_xml_t xml = NULL;
+	char *body, *keep = NULL;
+
+	if (!(body = xml_curl_request(binding, section, tag_name, key_name, key_value, params, &config_data))) {
+		return NULL;
+	}
+
+	if (cache_key) {
+		keep = strdup(body);
+		switch_assert(keep);
+	}
+
+	xml = xml_curl_parse(binding, body);
+
+	if (keep) {
+		if (xml && zstr(switch_xml_error(xml))) {
+			xml_cache_store(binding, cache_key, keep, &config_data);
 		} else {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Received HTTP error %ld trying to fetch %s\ndata: [%s]\n", httpRes, binding->url,
-							  data);
-			xml = NULL;
+			free(keep);
 		}
 	}
 
-	/* Debug by leaving the file behind for review */
-	if (keep_files_around) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "XML response is in %s\n", filename);
-	} else {
-		if (unlink(filename) != 0) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "XML response file [%s] delete failed\n", filename);
+	return xml;
+}
+
+static void xml_cache_refresh_destroy(xml_refresh_t **refreshp)
+{
+	xml_refresh_t *refresh = *refreshp;
+
+	*refreshp = NULL;
+
+	if (refresh->params) {
+		switch_event_destroy(&refresh->params);
+	}
+
+	switch_safe_free(refresh->section);
+	switch_safe_free(refresh->tag_name);
+	switch_safe_free(refresh->key_name);
+	switch_safe_free(refresh->key_value);
+	switch_safe_free(refresh->cache_key);
+	free(refresh);
+
+	switch_mutex_lock(globals.mutex);
+	if (!--globals.refreshing) {
+		switch_thread_cond_broadcast(globals.refresh_cond);
+	}
+	switch_mutex_unlock(globals.mutex);
+}
+
+static void *SWITCH_THREAD_FUNC xml_cache_refresh_thread(switch_thread_t *thread, void *obj)
+{
+	xml_refresh_t *refresh = (xml_refresh_t *) obj;
+	switch_xml_t xml;
+
+	if ((xml = xml_curl_fetch_and_cache(refresh->binding, refresh->section, refresh->tag_name, refresh->key_name, refresh->key_value,
+										refresh->params, refresh->cache_key))) {
+		switch_xml_free(xml);
+	}
+
+	/* a successful store already cleared the flag, this covers failures */
+	xml_cache_refresh_done(refresh->binding, refresh->cache_key);
+	xml_cache_refresh_destroy(&refresh);
+
+	return NULL;
+}
+
+static void xml_cache_refresh(xml_binding_t *binding, const char *section, const char *tag_name, const char *key_name, const char *key_value,
+							  switch_event_t *params, const char *cache_key)
+{
+	xml_refresh_t *refresh;
+	switch_thread_data_t *td, *launch;
+
+	switch_mutex_lock(globals.mutex);
+	if (!globals.running) {
+		switch_mutex_unlock(globals.mutex);
+		xml_cache_refresh_done(binding, cache_key);
+		return;
+	}
+	globals.refreshing++;
+	switch_mutex_unlock(globals.mutex);
+
+	switch_zmalloc(refresh, sizeof(*refresh));
+	refresh->binding = binding;
+	refresh->section = section ? strdup(section) : NULL;
+	refresh->tag_name = tag_name ? strdup(tag_name) : NULL;
+	refresh->key_name = key_name ? strdup(key_name) : NULL;
+	refresh->key_value = key_value ? strdup(key_value) : NULL;
+	refresh->cache_key = strdup(cache_key);
+
+	if (params) {
+		switch_event_dup(&refresh->params, params);
+	}
+
+	switch_zmalloc(td, sizeof(*td));
+	td->alloc = 1;
+	td->func = xml_cache_refresh_thread;
+	td->obj = refresh;
+
+	/* the pool takes td only when the push succeeds */
+	launch = td;
+	if (switch_thread_pool_launch_thread(&launch) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot launch cache refresh for %s, it will be retried on the next hit\n",
+						  binding->url);
+		free(td);
+		xml_cache_refresh_done(binding, cache_key);
+		xml_cache_refresh_destroy(&refresh);
+	}
+}
+
+static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, const char *key_name, const char *key_value, switch_event_t *params,
+								  void *user_data)
+{
+	switch_xml_t xml = NULL;
+	xml_binding_t *binding = (xml_binding_t *) user_data;
+	char *file_url;
+	char *cache_key = NULL;
+
+	if (!binding) {
+		return NULL;
+	}
+
+	if ((file_url = strstr(binding->url, "file:"))) {
+		file_url += 5;
+
+		if (!(xml = switch_xml_parse_file(file_url))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Parsing Result!\n");
 		}
+
+		return xml;
 	}
 
-	switch_safe_free(data);
-	if (binding->use_get_style == 1)
-		switch_safe_free(uri);
-	if (binding->use_dynamic_url && dynamic_url != binding->url)
-		switch_safe_free(dynamic_url);
+	if (binding->cache) {
+		switch_bool_t stale = SWITCH_FALSE;
+		char *body;
+
+		cache_key = xml_cache_key(binding, section, tag_name, key_name, key_value, params);
+
+		if ((body = xml_cache_lookup(binding, cache_key, &stale))) {
+			if (stale) {
+				xml_cache_refresh(binding, section, tag_name, key_name, key_value, params, cache_key);
+			}
+
+			xml = xml_curl_parse(binding, body);
+			switch_safe_free(cache_key);
+
+			return xml;
+		}
+	}
+
+	xml = xml_curl_fetch_and_cache(binding, section, tag_name, key_name, key_value, params, cache_key);
+	switch_safe_free(cache_key);
+
 	return xml;
 }
 
@@ -376,6 +939,10 @@ static switch_status_t do_config(void)
 		char *cookie_file = NULL;
 		hash_node_t *hash_node;
 		long auth_scheme = CURLAUTH_BASIC;
+		int connection_pool_size = XML_CURL_POOL_SIZE;
+		int enable_http2 = 0;
+		uint32_t cache_ttl = 0, cache_stale = 0, cache_max_entries = XML_CURL_CACHE_MAX_ENTRIES;
+		const char *cache_vars = NULL;
 		need_vars_map = 0;
 		vars_map = NULL;
 
@@ -461,6 +1028,38 @@ static switch_status_t do_config(void)
 				} else {
 					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't set a negative maximum response bytes!\n");
 				}
+			} else if (!strcasecmp(var, "connection-pool-size")) {
+				int tmp = atoi(val);
+				if (tmp >= 0) {
+					connection_pool_size = tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't set a negative connection pool size!\n");
+				}
+			} else if (!strcasecmp(var, "enable-http2")) {
+				enable_http2 = switch_true(val);
+			} else if (!strcasecmp(var, "cache-ttl")) {
+				int tmp = atoi(val);
+				if (tmp >= 0) {
+					cache_ttl = tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't set a negative cache ttl!\n");
+				}
+			} else if (!strcasecmp(var, "cache-stale-while-revalidate")) {
+				int tmp = atoi(val);
+				if (tmp >= 0) {
+					cache_stale = tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't set a negative stale-while-revalidate window!\n");
+				}
+			} else if (!strcasecmp(var, "cache-max-entries")) {
+				int tmp = atoi(val);
+				if (tmp > 0) {
+					cache_max_entries = tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "cache-max-entries must be positive!\n");
+				}
+			} else if (!strcasecmp(var, "cache-key-vars")) {
+				cache_vars = val;
 			}
 		}
 
@@ -550,6 +1149,32 @@ static switch_status_t do_config(void)
 		}
 
 		binding->curl_max_bytes = curl_max_bytes;
+		binding->enable_http2 = enable_http2;
+		binding->connection_pool_size = connection_pool_size;
+
+		if (connection_pool_size) {
+			binding->handles = switch_core_alloc(globals.pool, sizeof(switch_CURL *) * connection_pool_size);
+			switch_mutex_init(&binding->handle_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+		}
+
+		if (cache_ttl) {
+			binding->cache_ttl = cache_ttl;
+			binding->cache_stale = cache_stale;
+			binding->cache_max_entries = cache_max_entries;
+
+			if (!zstr(cache_vars)) {
+				char *vars = switch_core_strdup(globals.pool, cache_vars);
+
+				binding->cache_vars = switch_core_alloc(globals.pool, sizeof(char *) * 32);
+				binding->cache_var_count = switch_separate_string(vars, ',', binding->cache_vars, 32);
+			}
+
+			switch_core_hash_init(&binding->cache);
+			switch_mutex_init(&binding->cache_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+		}
+
+		binding->next = globals.bindings;
+		globals.bindings = binding;
 
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Binding [%s] XML Fetch Function [%s] [%s]\n",
 						  zstr(bname) ? "N/A" : bname, binding->url, binding->bindings ? binding->bindings : "all");
@@ -575,6 +1200,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_curl_load)
 	globals.pool = pool;
 	globals.hash_root = NULL;
 	globals.hash_tail = NULL;
+	globals.running = 1;
+	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_cond_create(&globals.refresh_cond, pool);
 
 	if (do_config() != SWITCH_STATUS_SUCCESS) {
 		return SWITCH_STATUS_FALSE;
@@ -583,6 +1211,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_curl_load)
 	SWITCH_ADD_API(xml_curl_api_interface, "xml_curl", "XML Curl", xml_curl_function, XML_CURL_SYNTAX);
 	switch_console_set_complete("add xml_curl debug_on");
 	switch_console_set_complete("add xml_curl debug_off");
+	switch_console_set_complete("add xml_curl cache_flush");
 
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
@@ -591,6 +1220,17 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_curl_load)
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown)
 {
 	hash_node_t *ptr = NULL;
+	xml_binding_t *binding;
+
+	switch_xml_unbind_search_function_ptr(xml_url_fetch);
+
+	/* no refresh starts once running is cleared, wait for the ones in flight, they still use the bindings */
+	switch_mutex_lock(globals.mutex);
+	globals.running = 0;
+	while (globals.refreshing) {
+		switch_thread_cond_wait(globals.refresh_cond, globals.mutex);
+	}
+	switch_mutex_unlock(globals.mutex);
 
 	while (globals.hash_root) {
 		ptr = globals.hash_root;
@@ -599,7 +1239,16 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown)
 		switch_safe_free(ptr);
 	}
 
-	switch_xml_unbind_search_function_ptr(xml_url_fetch);
+	for (binding = globals.bindings; binding; binding = binding->next) {
+		while (binding->handle_count) {
+			switch_curl_easy_cleanup(binding->handles[--binding->handle_count]);
+		}
+
+		if (binding->cache) {
+			xml_cache_flush(binding, SWITCH_FALSE);
+			switch_core_hash_destroy(&binding->cache);
+		}
+	}
 
 	return SWITCH_STATUS_SUCCESS;
 }
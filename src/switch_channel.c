@@ -188,6 +188,11 @@ struct switch_channel {
 	switch_device_node_t *device_node;
 	char *device_id;
 	switch_event_t *log_tags;
+	char *resolver_prefix;
+	switch_size_t resolver_prefix_len;
+	switch_channel_variable_resolver_t resolver;
+	switch_channel_variable_release_t resolver_release;
+	void *resolver_data;
 };
 
 static void process_device_hup(switch_channel_t *channel);
@@ -753,6 +758,12 @@ SWITCH_DECLARE(void) switch_channel_uninit(switch_channel_t *channel)
 	}
 
 	switch_mutex_lock(channel->profile_mutex);
+	if (channel->resolver) {
+		channel->resolver = NULL;
+		if (channel->resolver_release) {
+			channel->resolver_release(channel->resolver_data);
+		}
+	}
 	switch_event_destroy(&channel->variables);
 	switch_event_destroy(&channel->api_list);
 	switch_event_destroy(&channel->var_list);
@@ -969,6 +980,55 @@ SWITCH_DECLARE(switch_status_t) switch_channel_get_scope_variables(switch_channe
 	return status;
 }
 
+SWITCH_DECLARE(switch_status_t) switch_channel_set_variable_resolver(switch_channel_t *channel, const char *prefix,
+																	 switch_channel_variable_resolver_t resolver,
+																	 switch_channel_variable_release_t release, void *user_data)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	switch_assert(channel != NULL);
+	switch_assert(resolver != NULL);
+
+	switch_mutex_lock(channel->profile_mutex);
+	if (!channel->resolver && !zstr(prefix)) {
+		channel->resolver_prefix = switch_core_session_strdup(channel->session, prefix);
+		channel->resolver_prefix_len = strlen(prefix);
+		channel->resolver = resolver;
+		channel->resolver_release = release;
+		channel->resolver_data = user_data;
+		status = SWITCH_STATUS_SUCCESS;
+	}
+	switch_mutex_unlock(channel->profile_mutex);
+
+	return status;
+}
+
+SWITCH_DECLARE(void) switch_channel_resolve_variables(switch_channel_t *channel)
+{
+	switch_channel_variable_resolver_t resolver;
+
+	switch_assert(channel != NULL);
+
+	switch_mutex_lock(channel->profile_mutex);
+	if ((resolver = channel->resolver)) {
+		/* cleared first, the resolver sets variables that match the prefix */
+		channel->resolver = NULL;
+		resolver(channel, channel->resolver_data);
+		if (channel->resolver_release) {
+			channel->resolver_release(channel->resolver_data);
+		}
+	}
+	switch_mutex_unlock(channel->profile_mutex);
+}
+
+/* must be called with the profile mutex held */
+static inline void resolve_variable(switch_channel_t *channel, const char *varname)
+{
+	if (channel->resolver && !strncasecmp(varname, channel->resolver_prefix, channel->resolver_prefix_len)) {
+		switch_channel_resolve_variables(channel);
+	}
+}
+
 SWITCH_DECLARE(const char *) switch_channel_get_variable_dup(switch_channel_t *channel, const char *varname, switch_bool_t dup, int idx)
 {
 	const char *v = NULL, *r = NULL, *vdup = NULL;
@@ -977,6 +1037,8 @@ SWITCH_DECLARE(const char *) switch_channel_get_variable_dup(switch_channel_t *c
 	switch_mutex_lock(channel->profile_mutex);
 
 	if (!zstr(varname)) {
+		resolve_variable(channel, varname);
+
 		if (channel->scope_variables) {
 			switch_event_t *ep;
 
@@ -1062,6 +1124,7 @@ SWITCH_DECLARE(switch_event_header_t *) switch_channel_variable_first(switch_cha
 
 	switch_assert(channel != NULL);
 	switch_mutex_lock(channel->profile_mutex);
+	switch_channel_resolve_variables(channel);
 	if (channel->variables && (hi = channel->variables->headers)) {
 		channel->vi = 1;
 	} else {
@@ -1475,6 +1538,8 @@ SWITCH_DECLARE(switch_status_t) switch_channel_set_variable_var_check(switch_cha
 
 	switch_mutex_lock(channel->profile_mutex);
 	if (channel->variables && !zstr(varname)) {
+		resolve_variable(channel, varname);
+
 		if (zstr(value)) {
 			switch_event_del_header(channel->variables, varname);
 		} else {
@@ -1506,6 +1571,8 @@ SWITCH_DECLARE(switch_status_t) switch_channel_add_variable_var_check(switch_cha
 
 	switch_mutex_lock(channel->profile_mutex);
 	if (channel->variables && !zstr(varname)) {
+		resolve_variable(channel, varname);
+
 		if (zstr(value)) {
 			switch_event_del_header(channel->variables, varname);
 		} else {
@@ -1541,6 +1608,7 @@ SWITCH_DECLARE(switch_status_t) switch_channel_set_variable_printf(switch_channe
 
 	switch_mutex_lock(channel->profile_mutex);
 	if (channel->variables && !zstr(varname)) {
+		resolve_variable(channel, varname);
 		switch_event_del_header(channel->variables, varname);
 
 		va_start(ap, fmt);
@@ -2735,6 +2803,8 @@ SWITCH_DECLARE(void) switch_channel_event_set_extended_data(switch_channel_t *ch
 		event->event_id == SWITCH_EVENT_TEXT || 
 		event->event_id == SWITCH_EVENT_CUSTOM) {
 
+		switch_channel_resolve_variables(channel);
+
 		/* Index Variables */
 
 		if (channel->scope_variables) {
@@ -3114,6 +3184,8 @@ SWITCH_DECLARE(switch_status_t) switch_channel_caller_extension_masquerade(switc
 		switch_channel_set_caller_profile(new_channel, caller_profile);
 		switch_channel_set_caller_extension(new_channel, extension);
 
+		switch_channel_resolve_variables(orig_channel);
+
 		for (hi = orig_channel->variables->headers; hi; hi = hi->next) {
 			int ok = 1;
 			for (i = 0; i < argc; i++) {
@@ -4405,6 +4477,7 @@ SWITCH_DECLARE(switch_status_t) switch_channel_get_variables(switch_channel_t *c
 {
 	switch_status_t status;
 	switch_mutex_lock(channel->profile_mutex);
+	switch_channel_resolve_variables(channel);
 	if (channel->variables) {
 		status = switch_event_dup(event, channel->variables);
 	} else {
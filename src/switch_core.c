@@ -1938,6 +1938,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	switch_thread_rwlock_create(&runtime.global_var_rwlock, runtime.memory_pool);
 	switch_core_set_globals();
 	switch_core_session_init(runtime.memory_pool);
+	switch_dns_cache_init(runtime.memory_pool);
 	switch_event_create_plain(&runtime.global_vars, SWITCH_EVENT_CHANNEL_DATA);
 	switch_core_hash_init_case(&runtime.mime_types, SWITCH_FALSE);
 	switch_core_hash_init_case(&runtime.mime_type_exts, SWITCH_FALSE);
@@ -2006,6 +2007,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	}
 
 	switch_log_init(runtime.memory_pool, runtime.colorize_console);
+	switch_resample_bank_init(runtime.memory_pool);
+	switch_frame_pool_init(runtime.memory_pool);
 
 	runtime.tipping_point = 0;
 	runtime.timer_affinity = -1;
@@ -2018,6 +2021,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	switch_core_state_machine_init(runtime.memory_pool);
 
 	switch_core_media_init();
+	switch_ivr_record_writer_init(runtime.memory_pool);
 	switch_scheduler_task_thread_start();
 
 	switch_nat_late_init();
@@ -2413,6 +2417,32 @@ static void switch_load_core_config(const char *file)
 					}
 				} else if (!strcasecmp(var, "max-audio-channels") && !zstr(val)) {
 					switch_core_max_audio_channels(atoi(val));
+				} else if (!strcasecmp(var, "record-writer-threads") && !zstr(val)) {
+					int tmp = atoi(val);
+
+					if (tmp >= 0 && tmp <= 128) {
+						runtime.record_writer_threads = (uint32_t) tmp;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "record-writer-threads must be between 0 and 128\n");
+					}
+				} else if (!strcasecmp(var, "record-writer-buffer-kb") && !zstr(val)) {
+					int tmp = atoi(val);
+
+					if (tmp >= 16 && tmp <= 65536) {
+						runtime.record_writer_buffer_size = (uint32_t) tmp * 1024;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "record-writer-buffer-kb must be between 16 and 65536\n");
+					}
+				} else if (!strcasecmp(var, "resampler") && !zstr(val)) {
+					if (!strcasecmp(val, "speex")) {
+						switch_resample_set_engine(SWITCH_RESAMPLE_ENGINE_SPEEX);
+					} else if (!strcasecmp(val, "tiered")) {
+						switch_resample_set_engine(SWITCH_RESAMPLE_ENGINE_TIERED);
+					} else if (!strcasecmp(val, "polyphase")) {
+						switch_resample_set_engine(SWITCH_RESAMPLE_ENGINE_POLYPHASE);
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "resampler must be speex, tiered or polyphase\n");
+					}
 				}
 			}
 		}
@@ -2421,6 +2451,47 @@ static void switch_load_core_config(const char *file)
 			runtime.event_channel_key_separator = switch_core_strdup(runtime.memory_pool, ".");
 		}
 
+		if ((settings = switch_xml_child(cfg, "xml-binding-cache"))) {
+			const char *max = switch_xml_attr(settings, "max-entries");
+
+			if (max) {
+				switch_xml_binding_cache_set_max(switch_atoui(max));
+			}
+
+			for (param = switch_xml_child(settings, "section"); param; param = param->next) {
+				const char *name = switch_xml_attr_soft(param, "name");
+				const char *ttl = switch_xml_attr_soft(param, "ttl");
+				const char *negative_ttl = switch_xml_attr_soft(param, "negative-ttl");
+
+				if (zstr(name)) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "xml-binding-cache section is missing a name\n");
+					continue;
+				}
+
+				switch_xml_binding_cache_set(name, zstr(ttl) ? 0 : switch_atoui(ttl), zstr(negative_ttl) ? 0 : switch_atoui(negative_ttl),
+											 switch_xml_attr(param, "key"));
+			}
+		}
+
+		if ((settings = switch_xml_child(cfg, "dns-cache"))) {
+			const char *ttl = switch_xml_attr_soft(settings, "ttl");
+			const char *negative_ttl = switch_xml_attr_soft(settings, "negative-ttl");
+			const char *stale_ttl = switch_xml_attr_soft(settings, "stale-ttl");
+			const char *max = switch_xml_attr_soft(settings, "max-entries");
+
+			switch_dns_cache_set(zstr(ttl) ? 0 : switch_atoui(ttl), zstr(negative_ttl) ? 0 : switch_atoui(negative_ttl),
+								 zstr(stale_ttl) ? 0 : switch_atoui(stale_ttl), zstr(max) ? 10000 : switch_atoui(max));
+		}
+
+		if ((settings = switch_xml_child(cfg, "memory-pool-cache"))) {
+			const char *max = switch_xml_attr_soft(settings, "max-pools");
+			const char *trim_kb = switch_xml_attr_soft(settings, "trim-kb");
+			const char *trim_interval = switch_xml_attr_soft(settings, "trim-interval");
+
+			switch_core_memory_pool_cache_set(zstr(max) ? 0 : switch_atoui(max), zstr(trim_kb) ? 64 : switch_atoui(trim_kb),
+											  zstr(trim_interval) ? 60 : switch_atoui(trim_interval));
+		}
+
 		if ((settings = switch_xml_child(cfg, "variables"))) {
 			for (param = switch_xml_child(settings, "variable"); param; param = param->next) {
 				const char *var = switch_xml_attr_soft(param, "name");
@@ -3055,6 +3126,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 
 	switch_loadable_module_shutdown();
 
+	switch_ivr_record_writer_shutdown();
+	switch_resample_bank_shutdown();
+	switch_frame_pool_shutdown();
+
 	switch_curl_destroy();
 
 	switch_ssl_destroy_ssl_locks();
@@ -3078,6 +3153,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Finalizing Shutdown.\n");
 	switch_log_shutdown();
 
+	switch_dns_cache_shutdown();
 	switch_core_session_uninit();
 	switch_core_unset_variables();
 	switch_core_memory_stop();
@@ -243,8 +243,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_asr_feed(switch_asr_handle_t *ah, vo
 
 	if (ah->native_rate && ah->samplerate && ah->native_rate != ah->samplerate) {
 		if (!ah->resampler) {
-			if (switch_resample_create(&ah->resampler,
-									   ah->samplerate, ah->native_rate, (uint32_t) orig_len, SWITCH_RESAMPLE_QUALITY, 1) != SWITCH_STATUS_SUCCESS) {
+			if (switch_resample_create_tier(&ah->resampler,
+											ah->samplerate, ah->native_rate, (uint32_t) orig_len, SWITCH_RESAMPLE_TIER_ASR, 1) != SWITCH_STATUS_SUCCESS) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Unable to create resampler!\n");
 				return SWITCH_STATUS_GENERR;
 			}
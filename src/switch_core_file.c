@@ -535,8 +535,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 
 	if (!switch_test_flag(fh, SWITCH_FILE_NATIVE) && fh->native_rate != fh->samplerate) {
 		if (!fh->resampler) {
-			if (switch_resample_create(&fh->resampler,
-									   fh->native_rate, fh->samplerate, (uint32_t) orig_len, SWITCH_RESAMPLE_QUALITY, fh->channels) != SWITCH_STATUS_SUCCESS) {
+			if (switch_resample_create_tier(&fh->resampler,
+											fh->native_rate, fh->samplerate, (uint32_t) orig_len, SWITCH_RESAMPLE_TIER_RECORDING, fh->channels) != SWITCH_STATUS_SUCCESS) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Unable to create resampler!\n");
 				return SWITCH_STATUS_GENERR;
 			}
@@ -622,10 +622,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh,
 
 	if (!switch_test_flag(fh, SWITCH_FILE_NATIVE) && fh->native_rate != fh->samplerate) {
 		if (!fh->resampler) {
-			if (switch_resample_create(&fh->resampler,
-									   fh->native_rate,
-									   fh->samplerate,
-									   (uint32_t) orig_len * 2 * fh->channels, SWITCH_RESAMPLE_QUALITY, fh->channels) != SWITCH_STATUS_SUCCESS) {
+			if (switch_resample_create_tier(&fh->resampler,
+											fh->native_rate,
+											fh->samplerate,
+											(uint32_t) orig_len * 2 * fh->channels, SWITCH_RESAMPLE_TIER_RECORDING, fh->channels) != SWITCH_STATUS_SUCCESS) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Unable to create resampler!\n");
 				return SWITCH_STATUS_GENERR;
 			}
@@ -234,12 +234,16 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 	if (session->bugs && !((*frame)->flags & SFF_CNG) && !((*frame)->flags & SFF_NOT_AUDIO)) {
 		switch_media_bug_t *bp;
+		switch_media_bug_list_t *bug_list;
+		uint32_t bug_slot;
+		uint32_t bug_idx;
 		switch_bool_t ok = SWITCH_TRUE;
 		int prune = 0;
 
-		switch_thread_rwlock_rdlock(session->bug_rwlock);
+		bug_list = switch_core_media_bug_list_enter(session, &bug_slot);
 
-		for (bp = session->bugs; bp; bp = bp->next) {
+		for (bug_idx = 0; bug_list && bug_idx < bug_list->count; bug_idx++) {
+			bp = bug_list->bugs[bug_idx];
 			ok = SWITCH_TRUE;
 
 			if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
@@ -275,7 +279,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 				prune++;
 			}
 		}
-		switch_thread_rwlock_unlock(session->bug_rwlock);
+		switch_core_media_bug_list_leave(session, bug_slot);
 
 		if (prune) {
 			switch_core_media_bug_prune(session);
@@ -295,12 +299,16 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 	if (tap_only) {
 		switch_media_bug_t *bp;
+		switch_media_bug_list_t *bug_list;
+		uint32_t bug_slot;
+		uint32_t bug_idx;
 		switch_bool_t ok = SWITCH_TRUE;
 		int prune = 0;
 
 		if (session->bugs && switch_test_flag((*frame), SFF_CNG)) {
-			switch_thread_rwlock_rdlock(session->bug_rwlock);
-			for (bp = session->bugs; bp; bp = bp->next) {
+			bug_list = switch_core_media_bug_list_enter(session, &bug_slot);
+			for (bug_idx = 0; bug_list && bug_idx < bug_list->count; bug_idx++) {
+				bp = bug_list->bugs[bug_idx];
 				ok = SWITCH_TRUE;
 
 				if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
@@ -342,7 +350,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					prune++;
 				}
 			}
-			switch_thread_rwlock_unlock(session->bug_rwlock);
+			switch_core_media_bug_list_leave(session, bug_slot);
 
 			if (prune) {
 				switch_core_media_bug_prune(session);
@@ -645,11 +653,15 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 		if (session->bugs) {
 			switch_media_bug_t *bp;
+			switch_media_bug_list_t *bug_list;
+			uint32_t bug_slot;
+			uint32_t bug_idx;
 			switch_bool_t ok = SWITCH_TRUE;
 			int prune = 0;
-			switch_thread_rwlock_rdlock(session->bug_rwlock);
+			bug_list = switch_core_media_bug_list_enter(session, &bug_slot);
 
-			for (bp = session->bugs; bp; bp = bp->next) {
+			for (bug_idx = 0; bug_list && bug_idx < bug_list->count; bug_idx++) {
+				bp = bug_list->bugs[bug_idx];
 				ok = SWITCH_TRUE;
 
 				if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
@@ -688,7 +700,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 
 			}
-			switch_thread_rwlock_unlock(session->bug_rwlock);
+			switch_core_media_bug_list_leave(session, bug_slot);
 			if (prune) {
 				switch_core_media_bug_prune(session);
 			}
@@ -696,11 +708,15 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 		if (session->bugs) {
 			switch_media_bug_t *bp;
+			switch_media_bug_list_t *bug_list;
+			uint32_t bug_slot;
+			uint32_t bug_idx;
 			switch_bool_t ok = SWITCH_TRUE;
 			int prune = 0;
-			switch_thread_rwlock_rdlock(session->bug_rwlock);
+			bug_list = switch_core_media_bug_list_enter(session, &bug_slot);
 
-			for (bp = session->bugs; bp; bp = bp->next) {
+			for (bug_idx = 0; bug_list && bug_idx < bug_list->count; bug_idx++) {
+				bp = bug_list->bugs[bug_idx];
 				ok = SWITCH_TRUE;
 
 				if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
@@ -749,7 +765,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					prune++;
 				}
 			}
-			switch_thread_rwlock_unlock(session->bug_rwlock);
+			switch_core_media_bug_list_leave(session, bug_slot);
 			if (prune) {
 				switch_core_media_bug_prune(session);
 			}
@@ -877,10 +893,14 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 		}
 		if (session->bugs) {
 			switch_media_bug_t *bp;
+			switch_media_bug_list_t *bug_list;
+			uint32_t bug_slot;
+			uint32_t bug_idx;
 			switch_bool_t ok = SWITCH_TRUE;
 			int prune = 0;
-			switch_thread_rwlock_rdlock(session->bug_rwlock);
-			for (bp = session->bugs; bp; bp = bp->next) {
+			bug_list = switch_core_media_bug_list_enter(session, &bug_slot);
+			for (bug_idx = 0; bug_list && bug_idx < bug_list->count; bug_idx++) {
+				bp = bug_list->bugs[bug_idx];
 				ok = SWITCH_TRUE;
 
 				if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
@@ -918,7 +938,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					prune++;
 				}
 			}
-			switch_thread_rwlock_unlock(session->bug_rwlock);
+			switch_core_media_bug_list_leave(session, bug_slot);
 			if (prune) {
 				switch_core_media_bug_prune(session);
 			}
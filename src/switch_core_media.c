@@ -7128,12 +7128,16 @@ static switch_status_t perform_write(switch_core_session_t *session, switch_fram
 
 	if (session->bugs && !(frame->flags & SFF_NOT_AUDIO)) {
 		switch_media_bug_t *bp;
+		switch_media_bug_list_t *bug_list;
+		uint32_t bug_slot;
+		uint32_t bug_idx;
 		switch_bool_t ok = SWITCH_TRUE;
 		int prune = 0;
 
-		switch_thread_rwlock_rdlock(session->bug_rwlock);
+		bug_list = switch_core_media_bug_list_enter(session, &bug_slot);
 
-		for (bp = session->bugs; bp; bp = bp->next) {
+		for (bug_idx = 0; bug_list && bug_idx < bug_list->count; bug_idx++) {
+			bp = bug_list->bugs[bug_idx];
 			ok = SWITCH_TRUE;
 
 			if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
@@ -7163,7 +7167,7 @@ static switch_status_t perform_write(switch_core_session_t *session, switch_fram
 				prune++;
 			}
 		}
-		switch_thread_rwlock_unlock(session->bug_rwlock);
+		switch_core_media_bug_list_leave(session, bug_slot);
 
 		if (prune) {
 			switch_core_media_bug_prune(session);
@@ -15952,12 +15956,17 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 
 	if (session->bugs) {
 		switch_media_bug_t *bp;
+		switch_media_bug_list_t *bug_list;
+		uint32_t bug_slot;
+		uint32_t bug_idx;
 		int prune = 0;
 
-		switch_thread_rwlock_rdlock(session->bug_rwlock);
-		for (bp = session->bugs; bp; bp = bp->next) {
+		bug_list = switch_core_media_bug_list_enter(session, &bug_slot);
+		for (bug_idx = 0; bug_list && bug_idx < bug_list->count; bug_idx++) {
 			switch_bool_t ok = SWITCH_TRUE;
 
+			bp = bug_list->bugs[bug_idx];
+
 			if (!bp->ready) {
 				continue;
 			}
@@ -16006,7 +16015,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 				prune++;
 			}
 		}
-		switch_thread_rwlock_unlock(session->bug_rwlock);
+		switch_core_media_bug_list_leave(session, bug_slot);
 		if (prune) {
 			switch_core_media_bug_prune(session);
 		}
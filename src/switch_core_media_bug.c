@@ -89,6 +89,86 @@ static void switch_core_media_bug_destroy(switch_media_bug_t **bug)
 	}
 }
 
+/*
+ * The read/write frame path walks an immutable array snapshot of session->bugs instead of
+ * taking bug_rwlock.  Writers still serialize on bug_rwlock, publish a new snapshot and then
+ * wait for the readers of the old one to leave before anything removed is closed or destroyed.
+ *
+ * Readers are counted in one of two slots picked by the parity of bug_list_epoch.  Reclaim
+ * flips the epoch so new readers, who can only see the new snapshot, land in the other slot,
+ * and waits for the slot of the old epoch alone to drain.
+ */
+switch_media_bug_list_t *switch_core_media_bug_list_enter(switch_core_session_t *session, uint32_t *slot)
+{
+	uint32_t idx;
+
+	for (;;) {
+		idx = switch_atomic_read(&session->bug_list_epoch) & 1;
+		switch_atomic_inc(&session->bug_list_readers[idx]);
+
+		if ((switch_atomic_read(&session->bug_list_epoch) & 1) == idx) {
+			break;
+		}
+
+		/* the epoch flipped under us, count ourselves in the new slot instead */
+		switch_atomic_dec(&session->bug_list_readers[idx]);
+	}
+
+	*slot = idx;
+
+	return session->bug_list;
+}
+
+void switch_core_media_bug_list_leave(switch_core_session_t *session, uint32_t slot)
+{
+	switch_atomic_dec(&session->bug_list_readers[slot]);
+}
+
+/* must be called with bug_rwlock write locked, returns the previous snapshot */
+static switch_media_bug_list_t *media_bug_list_publish(switch_core_session_t *session)
+{
+	switch_media_bug_list_t *old = session->bug_list, *list = NULL;
+	switch_media_bug_t *bp;
+	uint32_t count = 0;
+
+	for (bp = session->bugs; bp; bp = bp->next) {
+		count++;
+	}
+
+	if (count) {
+		switch_zmalloc(list, sizeof(*list) + sizeof(switch_media_bug_t *) * count);
+
+		for (bp = session->bugs; bp; bp = bp->next) {
+			list->bugs[list->count++] = bp;
+		}
+	}
+
+	session->bug_list = list;
+
+	return old;
+}
+
+/* must be called without bug_rwlock, waits until no media thread can still see the old snapshot */
+static void media_bug_list_reclaim(switch_core_session_t *session, switch_media_bug_list_t *old)
+{
+	uint32_t idx;
+
+	/* reclaimers take turns so every flip waits out the readers of the epoch before it */
+	switch_mutex_lock(session->bug_list_mutex);
+
+	/* the increment is a full barrier, it orders the snapshot store above against the reads below */
+	idx = switch_atomic_read(&session->bug_list_epoch) & 1;
+	switch_atomic_inc(&session->bug_list_epoch);
+
+	while (switch_atomic_read(&session->bug_list_readers[idx])) {
+		switch_cond_next();
+	}
+
+	switch_mutex_unlock(session->bug_list_mutex);
+
+	switch_safe_free(old);
+}
+
 SWITCH_DECLARE(void) switch_core_media_bug_pause(switch_core_session_t *session)
 {
 	switch_channel_set_flag(session->channel, CF_PAUSE_BUGS);
@@ -802,6 +882,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 														  switch_media_bug_t **new_bug)
 {
 	switch_media_bug_t *bug, *bp;
+	switch_media_bug_list_t *old_list;
 	switch_size_t bytes;
 	switch_event_t *event;
 	int tap_only = 1, punt = 0, added = 0;
@@ -992,7 +1073,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 		}
 	}
 
+	old_list = media_bug_list_publish(session);
 	switch_thread_rwlock_unlock(session->bug_rwlock);
+	media_bug_list_reclaim(session, old_list);
 	*new_bug = bug;
 
 	if (tap_only) {
@@ -1039,6 +1122,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_transfer_callback(switch_c
 																		switch_media_bug_callback_t callback, void * (*user_data_dup_func) (switch_core_session_t *, void *))
 {
 	switch_media_bug_t *new_bug = NULL, *cur = NULL, *bp = NULL, *last = NULL, *old_last_next = NULL, *old_bugs = NULL;
+	switch_media_bug_t *moved = NULL, *next = NULL;
+	switch_media_bug_list_t *old_list;
 	int total = 0;
 
 	if (!switch_channel_media_ready(new_session->channel)) {
@@ -1067,7 +1152,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_transfer_callback(switch_c
 			if ((switch_core_media_bug_add(new_session, cur->function, cur->target, cur->callback,
 										   user_data_dup_func(new_session, cur->user_data),
 										   cur->stop_time, cur->flags, &new_bug) == SWITCH_STATUS_SUCCESS)) {
-				switch_core_media_bug_destroy(&cur);
+				cur->next = moved;
+				moved = cur;
 				total++;
 			} else {
 				/* Call the dup function again to revert to original session */
@@ -1093,8 +1179,14 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_transfer_callback(switch_c
 		switch_core_codec_destroy(&orig_session->bug_codec);
 	}
 
+	old_list = media_bug_list_publish(orig_session);
 	switch_thread_rwlock_unlock(orig_session->bug_rwlock);
+	media_bug_list_reclaim(orig_session, old_list);
 
+	for (bp = moved; bp; bp = next) {
+		next = bp->next;
+		switch_core_media_bug_destroy(&bp);
+	}
 
 	return total ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
 }
@@ -1232,7 +1324,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_all_function(switch
 {
 	switch_media_bug_t *bp, *last = NULL, *next = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	switch_media_bug_t *closed = NULL;
+	switch_media_bug_t *closed = NULL, *closed_tail = NULL;
+	switch_media_bug_list_t *old_list;
 
 	switch_thread_rwlock_wrlock(session->bug_rwlock);
 	if (session->bugs) {
@@ -1257,21 +1350,26 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_all_function(switch
 				session->bugs = bp->next;
 			}
 
-			bp->next = closed;
-			closed = bp;
+			bp->next = NULL;
 
-			switch_core_media_bug_close(&bp, SWITCH_FALSE);
+			if (closed_tail) {
+				closed_tail->next = bp;
+			} else {
+				closed = bp;
+			}
+
+			closed_tail = bp;
 		}
 		status = SWITCH_STATUS_SUCCESS;
 	}
+	old_list = media_bug_list_publish(session);
 	switch_thread_rwlock_unlock(session->bug_rwlock);
+	media_bug_list_reclaim(session, old_list);
 
-		
-	if (closed) {
-		for (bp = closed; bp; bp = next) {
-			next = bp->next;
-			switch_core_media_bug_destroy(&bp);
-		}
+	for (bp = closed; bp; bp = next) {
+		next = bp->next;
+		switch_core_media_bug_close(&bp, SWITCH_FALSE);
+		switch_core_media_bug_destroy(&bp);
 	}
 
 	if (switch_core_codec_ready(&session->bug_codec)) {
@@ -1325,6 +1423,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_close(switch_media_bug_t *
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(switch_core_session_t *session, switch_media_bug_t **bug)
 {
 	switch_media_bug_t *bp = NULL, *bp2 = NULL, *last = NULL;
+	switch_media_bug_list_t *old_list;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	int tap_only = 0;
 
@@ -1366,7 +1465,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(switch_core_session
 		switch_clear_flag(session, SSF_MEDIA_BUG_TAP_ONLY);
 	}
 
+	old_list = media_bug_list_publish(session);
 	switch_thread_rwlock_unlock(session->bug_rwlock);
+	media_bug_list_reclaim(session, old_list);
 
 	if (bp) {
 		status = switch_core_media_bug_close(&bp, SWITCH_TRUE);
@@ -1379,6 +1480,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(switch_core_session
 SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *session)
 {
 	switch_media_bug_t *bp = NULL, *last = NULL;
+	switch_media_bug_list_t *old_list;
 	int ttl = 0;
 
 
@@ -1404,9 +1506,11 @@ SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *sess
 		switch_core_codec_destroy(&session->bug_codec);
 	}
 
+	old_list = bp ? media_bug_list_publish(session) : NULL;
 	switch_thread_rwlock_unlock(session->bug_rwlock);
 
 	if (bp) {
+		media_bug_list_reclaim(session, old_list);
 		switch_clear_flag(bp, SMBF_LOCK);
 		bp->thread_id = 0;
 		switch_core_media_bug_close(&bp, SWITCH_TRUE);
@@ -1420,7 +1524,8 @@ SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *sess
 
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_callback(switch_core_session_t *session, switch_media_bug_callback_t callback)
 {
-	switch_media_bug_t *cur = NULL, *bp = NULL, *last = NULL, *closed = NULL, *next = NULL;
+	switch_media_bug_t *cur = NULL, *bp = NULL, *last = NULL, *closed = NULL, *closed_tail = NULL, *next = NULL;
+	switch_media_bug_list_t *old_list;
 	int total = 0;
 
 	switch_thread_rwlock_wrlock(session->bug_rwlock);
@@ -1436,25 +1541,31 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_callback(switch_cor
 				} else {
 					session->bugs = cur->next;
 				}
-				if (switch_core_media_bug_close(&cur, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS) {
-					total++;
-				}
 
-				cur->next = closed;
-				closed = cur;
+				cur->next = NULL;
 
+				if (closed_tail) {
+					closed_tail->next = cur;
+				} else {
+					closed = cur;
+				}
+
+				closed_tail = cur;
 			} else {
 				last = cur;
 			}
 		}
 	}
+	old_list = media_bug_list_publish(session);
 	switch_thread_rwlock_unlock(session->bug_rwlock);
-	
-	if (closed) {
-		for (bp = closed; bp; bp = next) {
-			next = bp->next;
-			switch_core_media_bug_destroy(&bp);
+	media_bug_list_reclaim(session, old_list);
+
+	for (bp = closed; bp; bp = next) {
+		next = bp->next;
+		if (switch_core_media_bug_close(&bp, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS) {
+			total++;
 		}
+		switch_core_media_bug_destroy(&bp);
 	}
 
 	if (!session->bugs && switch_core_codec_ready(&session->bug_codec)) {
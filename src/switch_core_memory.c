@@ -34,6 +34,7 @@
 
 #include <switch.h>
 #include "private/switch_core_pvt.h"
+#include <apr_atomic.h>
 
 //#define DEBUG_ALLOC
 //#define DEBUG_ALLOC2
@@ -50,6 +51,49 @@
 #define DEBUG_ALLOC_CUTOFF 500
 #endif
 
+#if defined(PER_POOL_LOCK) && !defined(INSTANTLY_DESTROY_POOLS) && !APR_POOL_DEBUG
+#define POOL_CACHE 1
+#endif
+
+#ifdef POOL_CACHE
+/*
+ * Destroyed pools are pushed on a lock-free stack and, after the same one second grace the
+ * destroy queue gives them, cleared by the pool thread and parked in a depot with their
+ * allocator and a few free blocks.  New pools are served from a small per-thread stash
+ * refilled from the depot in batches.  Pools the depot did not need over a trim interval
+ * are destroyed, returning their memory to the OS.
+ */
+#define POOL_CACHE_KEY "switch_pool_cache"
+#define POOL_CACHE_BATCH 4
+#define POOL_SITE_MAX 512
+#define POOL_SITE_PROBE 16
+
+/* per creation site (file:line) accounting */
+typedef struct pool_site_s {
+	const char *file;
+	int line;
+	char name[128];
+	switch_atomic_t created;
+	switch_atomic_t live;
+	uint32_t peak;
+	uint32_t measured;
+	switch_size_t bytes;
+	switch_size_t max_bytes;
+} pool_site_t;
+
+typedef struct pool_cache_node_s {
+	struct pool_cache_node_s *next;
+	apr_pool_t *pool;
+	apr_allocator_t *allocator;
+	pool_site_t *site;
+	switch_atomic_t bytes;
+} pool_cache_node_t;
+
+typedef struct pool_cache_stash_s {
+	pool_cache_node_t *head;
+} pool_cache_stash_t;
+#endif
+
 static struct {
 #ifdef USE_MEM_LOCK
 	switch_mutex_t *mem_lock;
@@ -58,8 +102,31 @@ static struct {
 	switch_queue_t *pool_recycle_queue;
 	switch_memory_pool_t *memory_pool;
 	int pool_thread_running;
+#ifdef POOL_CACHE
+	switch_mutex_t *cache_mutex;
+	volatile void *dead;
+	pool_cache_node_t *aging;
+	pool_cache_node_t *depot;
+	uint32_t depot_count;
+	uint32_t depot_low;
+	uint32_t cache_max;
+	switch_atomic_t reused;
+	uint32_t trimmed;
+	uint32_t trim_kb;
+	uint32_t trim_interval;
+	time_t next_trim;
+	int stash_ready;
+#ifndef WIN32
+	pthread_key_t stash_key;
+#endif
+	pool_site_t sites[POOL_SITE_MAX];
+#endif
 } memory_manager;
 
+#ifdef POOL_CACHE
+static void pool_cache_account(apr_pool_t *pool, switch_size_t bytes);
+#endif
+
 SWITCH_DECLARE(switch_memory_pool_t *) switch_core_session_get_pool(switch_core_session_t *session)
 {
 	switch_assert(session != NULL);
@@ -94,6 +161,9 @@ SWITCH_DECLARE(void *) switch_core_perform_session_alloc(switch_core_session_t *
 	ptr = apr_palloc(session->pool, memory);
 #endif
 	switch_assert(ptr != NULL);
+#ifdef POOL_CACHE
+	pool_cache_account(session->pool, memory);
+#endif
 
 	memset(ptr, 0, memory);
 
@@ -207,6 +277,9 @@ SWITCH_DECLARE(char *) switch_core_vsprintf(switch_memory_pool_t *pool, const ch
 
 	result = apr_pvsprintf(pool, fmt, ap);
 	switch_assert(result != NULL);
+#ifdef POOL_CACHE
+	pool_cache_account(pool, strlen(result) + 1);
+#endif
 
 #ifdef LOCK_MORE
 #ifdef USE_MEM_LOCK
@@ -262,6 +335,9 @@ SWITCH_DECLARE(char *) switch_core_perform_session_strdup(switch_core_session_t
 
 	duped = apr_pstrdup(session->pool, todup);
 	switch_assert(duped != NULL);
+#ifdef POOL_CACHE
+	pool_cache_account(session->pool, strlen(duped) + 1);
+#endif
 
 #ifdef LOCK_MORE
 #ifdef USE_MEM_LOCK
@@ -303,6 +379,9 @@ SWITCH_DECLARE(char *) switch_core_perform_strndup(switch_memory_pool_t *pool, c
 
 	duped = apr_pstrmemdup(pool, todup, len);
 	switch_assert(duped != NULL);
+#ifdef POOL_CACHE
+	pool_cache_account(pool, len);
+#endif
 
 #ifdef LOCK_MORE
 #ifdef USE_MEM_LOCK
@@ -372,12 +451,426 @@ static int switch_core_pool_stats_callback(apr_pool_t *pool, void *data) {
 }
 #endif
 
+#ifdef POOL_CACHE
+static pool_site_t *pool_site_get(const char *file, int line)
+{
+	uint32_t hash;
+	pool_site_t *site;
+	int i;
+
+	if (!file) {
+		return NULL;
+	}
+
+	hash = (uint32_t) ((uintptr_t) file >> 3) ^ ((uint32_t) line * 2654435761U);
+
+	/* lookups don't lock, a slot's file is only set once the rest of it is filled in */
+	for (i = 0; i < POOL_SITE_PROBE; i++) {
+		site = &memory_manager.sites[(hash + i) % POOL_SITE_MAX];
+		if (site->file == file && site->line == line) {
+			return site;
+		}
+		if (!site->file) {
+			break;
+		}
+	}
+
+	switch_mutex_lock(memory_manager.cache_mutex);
+	for (i = 0; i < POOL_SITE_PROBE; i++) {
+		site = &memory_manager.sites[(hash + i) % POOL_SITE_MAX];
+		if (site->file == file && site->line == line) {
+			break;
+		}
+		if (!site->file) {
+			site->line = line;
+			switch_copy_string(site->name, switch_cut_path(file), sizeof(site->name));
+			site->file = file;
+			break;
+		}
+	}
+	if (i == POOL_SITE_PROBE) {
+		site = NULL;
+	}
+	switch_mutex_unlock(memory_manager.cache_mutex);
+
+	return site;
+}
+
+static void pool_site_created(pool_site_t *site)
+{
+	uint32_t live;
+
+	if (!site) {
+		return;
+	}
+
+	switch_atomic_inc(&site->created);
+	switch_atomic_inc(&site->live);
+
+	/* racy but only ever low by a pool or two */
+	if ((live = switch_atomic_read(&site->live)) > site->peak) {
+		site->peak = live;
+	}
+}
+
+/* called from the pool thread only, so the byte counters need no lock */
+static void pool_site_measure(pool_cache_node_t *node)
+{
+	switch_size_t bytes;
+
+	if (!node->site) {
+		return;
+	}
+
+	bytes = switch_atomic_read(&node->bytes);
+	node->site->bytes += bytes;
+	node->site->measured++;
+	if (bytes > node->site->max_bytes) {
+		node->site->max_bytes = bytes;
+	}
+}
+
+static pool_cache_node_t *pool_cache_attach(apr_pool_t *pool, apr_allocator_t *allocator, pool_site_t *site)
+{
+	pool_cache_node_t *node = apr_palloc(pool, sizeof(*node));
+
+	node->next = NULL;
+	node->pool = pool;
+	node->allocator = allocator;
+	node->site = site;
+	switch_atomic_set(&node->bytes, 0);
+	apr_pool_userdata_setn(node, POOL_CACHE_KEY, NULL, pool);
+
+	return node;
+}
+
+static pool_cache_node_t *pool_cache_node(apr_pool_t *pool)
+{
+	void *node = NULL;
+
+	apr_pool_userdata_get(&node, POOL_CACHE_KEY, pool);
+
+	return (pool_cache_node_t *) node;
+}
+
+/* the size a site reports is what was handed out through the core allocators below,
+   APR does not expose how many blocks a pool holds outside of APR_POOL_DEBUG */
+static void pool_cache_account(apr_pool_t *pool, switch_size_t bytes)
+{
+	pool_cache_node_t *node;
+
+	/* off by default, keep the allocators free of the userdata lookup */
+	if (!memory_manager.cache_max) {
+		return;
+	}
+
+	if ((node = pool_cache_node(pool)) && node->site) {
+		switch_atomic_add(&node->bytes, (uint32_t) bytes);
+	}
+}
+
+static void pool_cache_destroy_list(pool_cache_node_t *list)
+{
+	pool_cache_node_t *node;
+
+	while ((node = list)) {
+		list = node->next;
+		apr_pool_destroy(node->pool);
+	}
+}
+
+/* empty a pool for reuse, returns the node to park it with or NULL if it was destroyed instead */
+static pool_cache_node_t *pool_cache_reset(pool_cache_node_t *node)
+{
+	apr_pool_t *pool = node->pool;
+	apr_allocator_t *allocator = node->allocator;
+	apr_thread_mutex_t *my_mutex;
+
+	pool_site_measure(node);
+
+	/* the mutex lives in the pool, the clear below destroys it */
+	apr_pool_mutex_set(pool, NULL);
+	apr_allocator_mutex_set(allocator, NULL);
+	apr_allocator_max_free_set(allocator, (apr_size_t) memory_manager.trim_kb * 1024);
+	apr_pool_clear(pool);
+	apr_pool_tag(pool, "cached");
+
+	if ((apr_thread_mutex_create(&my_mutex, APR_THREAD_MUTEX_NESTED, pool)) != APR_SUCCESS) {
+		apr_pool_destroy(pool);
+		return NULL;
+	}
+
+	apr_allocator_mutex_set(allocator, my_mutex);
+	apr_pool_mutex_set(pool, my_mutex);
+
+	return pool_cache_attach(pool, allocator, NULL);
+}
+
+static void pool_cache_depot_put(pool_cache_node_t *list)
+{
+	pool_cache_node_t *tail, *excess = NULL;
+
+	switch_mutex_lock(memory_manager.cache_mutex);
+	while (list && memory_manager.depot_count < memory_manager.cache_max) {
+		tail = list;
+		list = list->next;
+		tail->next = memory_manager.depot;
+		memory_manager.depot = tail;
+		memory_manager.depot_count++;
+	}
+	excess = list;
+	switch_mutex_unlock(memory_manager.cache_mutex);
+
+	pool_cache_destroy_list(excess);
+}
+
+static void pool_cache_depot_take(pool_cache_node_t **list, uint32_t max)
+{
+	pool_cache_node_t *node;
+	uint32_t count = 0;
+
+	switch_mutex_lock(memory_manager.cache_mutex);
+	while (count < max && (node = memory_manager.depot)) {
+		memory_manager.depot = node->next;
+		node->next = *list;
+		*list = node;
+		count++;
+	}
+	memory_manager.depot_count -= count;
+	if (memory_manager.depot_count < memory_manager.depot_low) {
+		memory_manager.depot_low = memory_manager.depot_count;
+	}
+	switch_mutex_unlock(memory_manager.cache_mutex);
+}
+
+#ifndef WIN32
+static void pool_cache_stash_destroy(void *ptr)
+{
+	pool_cache_stash_t *stash = (pool_cache_stash_t *) ptr;
+
+	/* once the memory system is stopped whatever is left goes with the process */
+	if (stash->head && memory_manager.stash_ready) {
+		pool_cache_depot_put(stash->head);
+	}
+
+	free(stash);
+}
+#endif
+
+static pool_cache_node_t *pool_cache_get(void)
+{
+	pool_cache_node_t *node = NULL;
+#ifndef WIN32
+	pool_cache_stash_t *stash;
+#endif
+
+	if (!memory_manager.cache_max) {
+		return NULL;
+	}
+
+#ifndef WIN32
+	if (memory_manager.stash_ready) {
+		if (!(stash = pthread_getspecific(memory_manager.stash_key))) {
+			switch_zmalloc(stash, sizeof(*stash));
+			pthread_setspecific(memory_manager.stash_key, stash);
+		}
+
+		if (!stash->head) {
+			pool_cache_depot_take(&stash->head, POOL_CACHE_BATCH);
+		}
+
+		if ((node = stash->head)) {
+			stash->head = node->next;
+			node->next = NULL;
+		}
+
+		return node;
+	}
+#endif
+
+	pool_cache_depot_take(&node, 1);
+
+	return node;
+}
+
+/* hands a destroyed pool to the pool thread without taking any lock */
+static switch_bool_t pool_cache_put(apr_pool_t *pool)
+{
+	pool_cache_node_t *node;
+
+	if (!(node = pool_cache_node(pool))) {
+		return SWITCH_FALSE;
+	}
+
+	if (node->site) {
+		switch_atomic_dec(&node->site->live);
+	}
+
+	if (!memory_manager.cache_max || memory_manager.pool_thread_running != 1) {
+		return SWITCH_FALSE;
+	}
+
+	do {
+		node->next = (pool_cache_node_t *) memory_manager.dead;
+	} while (apr_atomic_casptr(&memory_manager.dead, node, node->next) != node->next);
+
+	return SWITCH_TRUE;
+}
+
+static pool_cache_node_t *pool_cache_take_dead(void)
+{
+	void *list;
+
+	do {
+		list = (void *) memory_manager.dead;
+	} while (apr_atomic_casptr(&memory_manager.dead, NULL, list) != list);
+
+	return (pool_cache_node_t *) list;
+}
+
+static void pool_cache_tick(void)
+{
+	pool_cache_node_t *node, *next, *ready = NULL, *trim = NULL;
+	uint32_t count;
+	time_t now;
+
+	/* pools pushed before the last tick have had their grace period */
+	for (node = memory_manager.aging; node; node = next) {
+		next = node->next;
+		if ((node = pool_cache_reset(node))) {
+			node->next = ready;
+			ready = node;
+		}
+	}
+	memory_manager.aging = pool_cache_take_dead();
+
+	if (ready) {
+		pool_cache_depot_put(ready);
+	}
+
+	now = switch_epoch_time_now(NULL);
+
+	if (memory_manager.trim_interval && now >= memory_manager.next_trim) {
+		/* whatever sat in the depot the whole interval wasn't needed */
+		switch_mutex_lock(memory_manager.cache_mutex);
+		for (count = memory_manager.depot_low; count && (node = memory_manager.depot); count--) {
+			memory_manager.depot = node->next;
+			memory_manager.depot_count--;
+			node->next = trim;
+			trim = node;
+			memory_manager.trimmed++;
+		}
+		memory_manager.depot_low = memory_manager.depot_count;
+		memory_manager.next_trim = now + memory_manager.trim_interval;
+		switch_mutex_unlock(memory_manager.cache_mutex);
+
+		pool_cache_destroy_list(trim);
+	}
+}
+
+static uint32_t pool_cache_drain(void)
+{
+	pool_cache_node_t *list;
+	uint32_t count;
+
+	switch_mutex_lock(memory_manager.cache_mutex);
+	list = memory_manager.depot;
+	count = memory_manager.depot_count;
+	memory_manager.depot = NULL;
+	memory_manager.depot_count = memory_manager.depot_low = 0;
+	switch_mutex_unlock(memory_manager.cache_mutex);
+
+	pool_cache_destroy_list(list);
+
+	return count;
+}
+
+static void pool_cache_shutdown(void)
+{
+	pool_cache_node_t *node, *next;
+
+	memory_manager.cache_max = 0;
+
+#ifndef WIN32
+	if (memory_manager.stash_ready) {
+		pool_cache_stash_t *stash = pthread_getspecific(memory_manager.stash_key);
+
+		if (stash) {
+			pthread_setspecific(memory_manager.stash_key, NULL);
+			pool_cache_stash_destroy(stash);
+		}
+		memory_manager.stash_ready = 0;
+	}
+#endif
+
+	for (node = memory_manager.aging; node; node = next) {
+		next = node->next;
+		apr_pool_destroy(node->pool);
+	}
+	memory_manager.aging = NULL;
+
+	pool_cache_destroy_list(pool_cache_take_dead());
+	pool_cache_drain();
+}
+#endif
+
+SWITCH_DECLARE(void) switch_core_memory_pool_cache_set(uint32_t max, uint32_t trim_kb, uint32_t trim_interval)
+{
+#ifdef POOL_CACHE
+	switch_mutex_lock(memory_manager.cache_mutex);
+	memory_manager.trim_kb = trim_kb;
+	memory_manager.trim_interval = trim_interval;
+	memory_manager.next_trim = switch_epoch_time_now(NULL) + trim_interval;
+	memory_manager.cache_max = max;
+	switch_mutex_unlock(memory_manager.cache_mutex);
+
+	if (!max) {
+		pool_cache_drain();
+	}
+#else
+	if (max) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "memory-pool-cache is not available in this build\n");
+	}
+#endif
+}
+
 SWITCH_DECLARE(void) switch_core_pool_stats(switch_stream_handle_t *stream)
 {
 #if APR_POOL_DEBUG
 	if (runtime.memory_pool) {
 		apr_pool_walk_tree_debug(runtime.memory_pool, switch_core_pool_stats_callback, (void *)stream);
 	}
+#elif defined(POOL_CACHE)
+	switch_stream_handle_t pstream = { 0 };
+	int i;
+
+	if (!stream) {
+		SWITCH_STANDARD_STREAM(pstream);
+		stream = &pstream;
+	}
+
+	switch_mutex_lock(memory_manager.cache_mutex);
+	stream->write_function(stream, "Pool cache: %s, depot:%u/%u, reused:%u, trimmed:%u, trim-kb:%u, trim-interval:%u\n",
+						   memory_manager.cache_max ? "enabled" : "disabled", memory_manager.depot_count, memory_manager.cache_max,
+						   switch_atomic_read(&memory_manager.reused), memory_manager.trimmed, memory_manager.trim_kb, memory_manager.trim_interval);
+	switch_mutex_unlock(memory_manager.cache_mutex);
+
+	for (i = 0; i < POOL_SITE_MAX; i++) {
+		pool_site_t *site = &memory_manager.sites[i];
+
+		if (!site->file) {
+			continue;
+		}
+
+		stream->write_function(stream, "Pool '%s:%d' live:%u, peak:%u, created:%u, avg_bytes:%" SWITCH_SIZE_T_FMT ", max_bytes:%" SWITCH_SIZE_T_FMT "\n",
+							   site->name, site->line, switch_atomic_read(&site->live), site->peak, switch_atomic_read(&site->created),
+							   site->measured ? site->bytes / site->measured : 0, site->max_bytes);
+	}
+
+	if (stream == &pstream) {
+		printf("%s", (char *) pstream.data);
+		switch_safe_free(pstream.data);
+	}
 #else
 	if (stream) {
 		stream->write_function(stream, "Unable to get core pool statictics. Please rebuild FreeSWITCH with --enable-pool-debug");
@@ -401,12 +894,28 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_new_memory_pool(switch_memor
 #else
 	void *pop = NULL;
 #endif
+#ifdef POOL_CACHE
+	pool_site_t *site = NULL;
+	pool_cache_node_t *node;
+#endif
 
 #ifdef USE_MEM_LOCK
 	switch_mutex_lock(memory_manager.mem_lock);
 #endif
 	switch_assert(pool != NULL);
 
+#ifdef POOL_CACHE
+	/* sites are only accounted while the cache is on, pools made before it was enabled are never cached */
+	if (memory_manager.cache_max) {
+		site = pool_site_get(file, line);
+	}
+
+	if ((node = pool_cache_get())) {
+		*pool = node->pool;
+		node->site = site;
+		switch_atomic_inc(&memory_manager.reused);
+	} else {
+#endif
 #ifndef PER_POOL_LOCK
 	if (switch_queue_trypop(memory_manager.pool_recycle_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
 		*pool = (switch_memory_pool_t *) pop;
@@ -435,6 +944,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_new_memory_pool(switch_memor
 
 		apr_pool_mutex_set(*pool, my_mutex);
 
+#ifdef POOL_CACHE
+		if (memory_manager.cache_max) {
+			apr_allocator_max_free_set(my_allocator, (apr_size_t) memory_manager.trim_kb * 1024);
+			pool_cache_attach(*pool, my_allocator, site);
+		}
+	}
+#endif
 #else
 		apr_pool_create(pool, NULL);
 		switch_assert(*pool != NULL);
@@ -442,6 +958,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_new_memory_pool(switch_memor
 #endif
 #endif
 
+#ifdef POOL_CACHE
+	pool_site_created(site);
+#endif
+
 	tmp = switch_core_sprintf(*pool, "%s:%d", file, line);
 	apr_pool_tag(*pool, tmp);
 
@@ -489,6 +1009,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_destroy_memory_pool(switch_m
 	switch_mutex_unlock(memory_manager.mem_lock);
 #endif
 #else
+#ifdef POOL_CACHE
+	if (pool_cache_put(*pool)) {
+		*pool = NULL;
+		return SWITCH_STATUS_SUCCESS;
+	}
+#endif
 	if ((memory_manager.pool_thread_running != 1) || (switch_queue_push(memory_manager.pool_queue, *pool) != SWITCH_STATUS_SUCCESS)) {
 #ifdef USE_MEM_LOCK
 		switch_mutex_lock(memory_manager.mem_lock);
@@ -535,6 +1061,9 @@ SWITCH_DECLARE(void *) switch_core_perform_alloc(switch_memory_pool_t *pool, swi
 #endif
 	switch_assert(ptr != NULL);
 	memset(ptr, 0, memory);
+#ifdef POOL_CACHE
+	pool_cache_account(pool, memory);
+#endif
 
 #ifdef LOCK_MORE
 #ifdef USE_MEM_LOCK
@@ -547,6 +1076,13 @@ SWITCH_DECLARE(void *) switch_core_perform_alloc(switch_memory_pool_t *pool, swi
 
 SWITCH_DECLARE(void) switch_core_memory_reclaim(void)
 {
+#ifdef POOL_CACHE
+	uint32_t count;
+
+	if ((count = pool_cache_drain())) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %u cached memory pool(s)\n", count);
+	}
+#endif
 #if !defined(PER_POOL_LOCK) && !defined(INSTANTLY_DESTROY_POOLS)
 	switch_memory_pool_t *pool;
 	void *pop = NULL;
@@ -597,6 +1133,15 @@ static void *SWITCH_THREAD_FUNC pool_thread(switch_thread_t *thread, void *obj)
 
 #ifdef DEBUG_ALLOC
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "%p DESTROY POOL\n", (void *) pop);
+#endif
+#ifdef POOL_CACHE
+				{
+					pool_cache_node_t *node = pool_cache_node(pop);
+
+					if (node) {
+						pool_site_measure(node);
+					}
+				}
 #endif
 				apr_pool_destroy(pop);
 #ifdef USE_MEM_LOCK
@@ -633,6 +1178,10 @@ static void *SWITCH_THREAD_FUNC pool_thread(switch_thread_t *thread, void *obj)
 		} else {
 			switch_yield(1000000);
 		}
+
+#ifdef POOL_CACHE
+		pool_cache_tick();
+#endif
 	}
 
   done:
@@ -673,6 +1222,9 @@ void switch_core_memory_stop(void)
 	memory_manager.pool_thread_running = 0;
 	switch_thread_join(&st, pool_thread_p);
 
+#ifdef POOL_CACHE
+	pool_cache_shutdown();
+#endif
 
 	while (switch_queue_trypop(memory_manager.pool_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
 		apr_pool_destroy(pop);
@@ -720,6 +1272,13 @@ switch_memory_pool_t *switch_core_memory_init(void)
 	switch_mutex_init(&memory_manager.mem_lock, SWITCH_MUTEX_NESTED, memory_manager.memory_pool);
 #endif
 
+#ifdef POOL_CACHE
+	switch_mutex_init(&memory_manager.cache_mutex, SWITCH_MUTEX_NESTED, memory_manager.memory_pool);
+#ifndef WIN32
+	memory_manager.stash_ready = !pthread_key_create(&memory_manager.stash_key, pool_cache_stash_destroy);
+#endif
+#endif
+
 #ifdef INSTANTLY_DESTROY_POOLS
 	{
 		void *foo;
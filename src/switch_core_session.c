@@ -1550,6 +1550,7 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 	switch_core_session_reset(*session, SWITCH_TRUE, SWITCH_TRUE);
 
 	switch_core_media_bug_remove_all(*session);
+	switch_safe_free((*session)->bug_list);
 	switch_ivr_deactivate_unicast(*session);
 
 	switch_scheduler_del_task_group((*session)->uuid_str);
@@ -2432,6 +2433,7 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_request_uuid(switch_
 	switch_mutex_init(&session->codec_write_mutex, SWITCH_MUTEX_NESTED, session->pool);
 	switch_mutex_init(&session->frame_read_mutex, SWITCH_MUTEX_NESTED, session->pool);
 	switch_thread_rwlock_create(&session->bug_rwlock, session->pool);
+	switch_mutex_init(&session->bug_list_mutex, SWITCH_MUTEX_NESTED, session->pool);
 	switch_thread_cond_create(&session->cond, session->pool);
 	switch_thread_rwlock_create(&session->rwlock, session->pool);
 	switch_thread_rwlock_create(&session->io_rwlock, session->pool);
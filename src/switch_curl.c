@@ -112,6 +112,718 @@ SWITCH_DECLARE(switch_status_t) switch_curl_process_form_post_params(switch_even
 
 }
 
+#define POSTER_LATENCY_SAMPLES 1024
+#define POSTER_REPLAY_MAX 100
+/* leave spool files alone while they may still be being written */
+#define POSTER_REPLAY_MIN_AGE 5
+#define POSTER_DRAIN_TIMEOUT 10
+
+typedef struct poster_item_s {
+	struct poster_item_s *next;
+	char *id;
+	char *name;
+	char *text;
+	char *replay_path;
+	switch_time_t queued;
+	switch_time_t not_before;
+	uint32_t tries;
+} poster_item_t;
+
+typedef struct poster_xfer_s {
+	CURL *curl;
+	struct curl_slist *headers;
+	char *url;
+	char *body;
+	int url_index;
+	poster_item_t *items;
+} poster_xfer_t;
+
+struct switch_curl_poster_s {
+	switch_memory_pool_t *pool;
+	switch_curl_poster_settings_t settings;
+	switch_queue_t *queue;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	CURLM *multi;
+	volatile int running;
+	uint32_t active;
+	int url_index;
+	poster_item_t *pending;
+	char *replay_dir;
+	switch_hash_t *replaying;
+	switch_time_t next_replay;
+	switch_time_t drain_until;
+	uint32_t latency[POSTER_LATENCY_SAMPLES];
+	uint32_t latency_count;
+	uint32_t latency_pos;
+	uint64_t requests;
+	uint64_t delivered;
+	uint64_t failed;
+	uint64_t replayed;
+	switch_atomic_t overflow;
+	uint32_t queue_peak;
+};
+
+static size_t poster_discard(char *buffer, size_t size, size_t nitems, void *outstream)
+{
+	return size * nitems;
+}
+
+static poster_item_t *poster_item_new(const char *id, const char *name, const char *text)
+{
+	switch_size_t id_len, name_len, text_len = strlen(text) + 1;
+	poster_item_t *item;
+
+	id = switch_str_nil(id);
+	name = name ? name : id;
+	id_len = strlen(id) + 1;
+	name_len = strlen(name) + 1;
+
+	switch_zmalloc(item, sizeof(*item) + id_len + name_len + text_len);
+	item->id = (char *) (item + 1);
+	item->name = item->id + id_len;
+	item->text = item->name + name_len;
+	memcpy(item->id, id, id_len);
+	memcpy(item->name, name, name_len);
+	memcpy(item->text, text, text_len);
+	item->queued = switch_micro_time_now();
+
+	return item;
+}
+
+static void poster_item_free(poster_item_t *item)
+{
+	switch_safe_free(item->replay_path);
+	free(item);
+}
+
+static char *poster_encode(switch_curl_poster_t *poster, const char *text)
+{
+	switch_size_t len = strlen(text), need;
+	char *buf, *r;
+
+	switch (poster->settings.encoding) {
+	case SWITCH_CURL_POST_FORM:
+		return switch_mprintf("%s=%s", poster->settings.form_field, text);
+	case SWITCH_CURL_POST_FORM_URLENCODE:
+		need = len * 3 + 1;
+		switch_zmalloc(buf, need);
+		switch_url_encode_opt(text, buf, need, poster->settings.double_encode);
+		break;
+	case SWITCH_CURL_POST_FORM_BASE64:
+		need = len * 4 / 3 + 5;
+		switch_zmalloc(buf, need);
+		switch_b64_encode((unsigned char *) text, len, (unsigned char *) buf, need);
+		break;
+	default:
+		return strdup(text);
+	}
+
+	r = switch_mprintf("%s=%s", poster->settings.form_field, buf);
+	free(buf);
+
+	return r;
+}
+
+static char *poster_batch_body(switch_curl_poster_t *poster, poster_item_t *items)
+{
+	const char *open = switch_str_nil(poster->settings.batch_open);
+	const char *sep = switch_str_nil(poster->settings.batch_separator);
+	const char *close = switch_str_nil(poster->settings.batch_close);
+	switch_size_t len = strlen(open) + strlen(close) + 1, sep_len = strlen(sep), n;
+	poster_item_t *item;
+	char *body, *p;
+
+	for (item = items; item; item = item->next) {
+		len += strlen(item->text) + sep_len;
+	}
+
+	switch_malloc(body, len);
+	p = body;
+	n = strlen(open);
+	memcpy(p, open, n);
+	p += n;
+
+	for (item = items; item; item = item->next) {
+		if (item != items) {
+			memcpy(p, sep, sep_len);
+			p += sep_len;
+		}
+		n = strlen(item->text);
+		memcpy(p, item->text, n);
+		p += n;
+	}
+
+	n = strlen(close);
+	memcpy(p, close, n);
+	p[n] = '\0';
+
+	return body;
+}
+
+static poster_xfer_t *poster_xfer_new(switch_curl_poster_t *poster, poster_item_t *items)
+{
+	poster_xfer_t *xfer;
+	const char *url;
+
+	switch_zmalloc(xfer, sizeof(*xfer));
+	xfer->items = items;
+	xfer->url_index = poster->url_index;
+	url = poster->settings.urls[xfer->url_index];
+
+	if (poster->settings.batch_max > 1) {
+		xfer->url = strdup(url);
+		xfer->body = poster_batch_body(poster, items);
+	} else {
+		if (poster->settings.id_param) {
+			xfer->url = switch_mprintf("%s%c%s=%s", url, strchr(url, '?') ? '&' : '?', poster->settings.id_param, items->id);
+		} else {
+			xfer->url = strdup(url);
+		}
+		xfer->body = poster_encode(poster, items->text);
+	}
+
+	if (poster->settings.content_type) {
+		char *header = switch_mprintf("Content-Type: %s", poster->settings.content_type);
+		xfer->headers = curl_slist_append(xfer->headers, header);
+		free(header);
+	}
+
+	if (poster->settings.disable_100_continue) {
+		xfer->headers = curl_slist_append(xfer->headers, "Expect:");
+	}
+
+	xfer->curl = curl_easy_init();
+	curl_easy_setopt(xfer->curl, CURLOPT_URL, xfer->url);
+	curl_easy_setopt(xfer->curl, CURLOPT_HTTPHEADER, xfer->headers);
+	curl_easy_setopt(xfer->curl, CURLOPT_POST, 1);
+	curl_easy_setopt(xfer->curl, CURLOPT_NOSIGNAL, 1);
+	curl_easy_setopt(xfer->curl, CURLOPT_POSTFIELDS, xfer->body);
+	curl_easy_setopt(xfer->curl, CURLOPT_POSTFIELDSIZE, (long) strlen(xfer->body));
+	curl_easy_setopt(xfer->curl, CURLOPT_WRITEFUNCTION, poster_discard);
+	curl_easy_setopt(xfer->curl, CURLOPT_PRIVATE, xfer);
+
+	if (poster->settings.user_agent) {
+		curl_easy_setopt(xfer->curl, CURLOPT_USERAGENT, poster->settings.user_agent);
+	}
+
+	if (poster->settings.timeout) {
+		curl_easy_setopt(xfer->curl, CURLOPT_TIMEOUT, poster->settings.timeout);
+	}
+
+	if (poster->settings.connect_timeout) {
+		curl_easy_setopt(xfer->curl, CURLOPT_CONNECTTIMEOUT, poster->settings.connect_timeout);
+	}
+
+	if (!strncasecmp(xfer->url, "https", 5)) {
+		curl_easy_setopt(xfer->curl, CURLOPT_SSL_VERIFYPEER, 0);
+		curl_easy_setopt(xfer->curl, CURLOPT_SSL_VERIFYHOST, 0);
+	}
+
+	if (poster->settings.setup) {
+		poster->settings.setup(xfer->curl, poster->settings.user_data);
+	}
+
+	return xfer;
+}
+
+static void poster_xfer_free(poster_xfer_t *xfer)
+{
+	curl_easy_cleanup(xfer->curl);
+	curl_slist_free_all(xfer->headers);
+	switch_safe_free(xfer->url);
+	switch_safe_free(xfer->body);
+	free(xfer);
+}
+
+static void poster_start(switch_curl_poster_t *poster, poster_item_t *items)
+{
+	poster_xfer_t *xfer = poster_xfer_new(poster, items);
+
+	curl_multi_add_handle(poster->multi, xfer->curl);
+	poster->active++;
+	poster->requests++;
+}
+
+static void poster_latency_add(switch_curl_poster_t *poster, switch_time_t queued, switch_time_t now)
+{
+	poster->latency[poster->latency_pos] = (uint32_t) ((now - queued) / 1000);
+	poster->latency_pos = (poster->latency_pos + 1) % POSTER_LATENCY_SAMPLES;
+	if (poster->latency_count < POSTER_LATENCY_SAMPLES) {
+		poster->latency_count++;
+	}
+}
+
+static void poster_finish(switch_curl_poster_t *poster, poster_xfer_t *xfer, CURLcode result)
+{
+	switch_time_t now = switch_micro_time_now();
+	poster_item_t *item, *next;
+	long code = 0;
+
+	curl_easy_getinfo(xfer->curl, CURLINFO_RESPONSE_CODE, &code);
+	curl_multi_remove_handle(poster->multi, xfer->curl);
+	poster->active--;
+
+	if (result == CURLE_OK && code >= 200 && code <= 299) {
+		switch_mutex_lock(poster->mutex);
+		for (item = xfer->items; item; item = next) {
+			next = item->next;
+			if (item->replay_path) {
+				unlink(item->replay_path);
+				switch_core_hash_delete(poster->replaying, item->replay_path);
+				poster->replayed++;
+			} else {
+				poster_latency_add(poster, item->queued, now);
+			}
+			poster->delivered++;
+			poster_item_free(item);
+		}
+		switch_mutex_unlock(poster->mutex);
+		goto end;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[%s] Got error [%ld] posting to web server [%s] %s\n", poster->settings.name,
+					  code, poster->settings.urls[xfer->url_index], result == CURLE_OK ? "" : curl_easy_strerror(result));
+
+	/* another failure may already have moved us on */
+	if (xfer->url_index == poster->url_index && poster->settings.url_count > 1) {
+		poster->url_index = (poster->url_index + 1) % poster->settings.url_count;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[%s] Retry will be with url [%s]\n", poster->settings.name,
+						  poster->settings.urls[poster->url_index]);
+	}
+
+	for (item = xfer->items; item; item = next) {
+		next = item->next;
+
+		if (item->replay_path) {
+			/* the file stays where it is for the next replay */
+			switch_mutex_lock(poster->mutex);
+			switch_core_hash_delete(poster->replaying, item->replay_path);
+			switch_mutex_unlock(poster->mutex);
+			poster_item_free(item);
+		} else if (++item->tries < poster->settings.retries && poster->running) {
+			item->not_before = now + (switch_time_t) poster->settings.delay * 1000000;
+			item->next = poster->pending;
+			poster->pending = item;
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[%s] Unable to post [%s] to web server\n", poster->settings.name, item->id);
+			poster->failed++;
+			if (poster->settings.spool) {
+				poster->settings.spool(item->id, item->name, item->text, poster->settings.user_data);
+			}
+			poster_item_free(item);
+		}
+	}
+
+  end:
+	poster_xfer_free(xfer);
+}
+
+/* posts one document from the calling thread, retrying and failing over like the background path */
+static switch_status_t poster_post_now(switch_curl_poster_t *poster, poster_item_t *item)
+{
+	poster_xfer_t *xfer;
+	CURLcode result;
+	long code;
+	uint32_t tries;
+
+	for (tries = 0; tries < poster->settings.retries; tries++) {
+		if (tries) {
+			switch_yield((switch_interval_time_t) poster->settings.delay * 1000000);
+		}
+
+		switch_mutex_lock(poster->mutex);
+		xfer = poster_xfer_new(poster, item);
+		poster->requests++;
+		switch_mutex_unlock(poster->mutex);
+
+		code = 0;
+		if ((result = curl_easy_perform(xfer->curl)) == CURLE_OK) {
+			curl_easy_getinfo(xfer->curl, CURLINFO_RESPONSE_CODE, &code);
+		}
+
+		switch_mutex_lock(poster->mutex);
+		if (result == CURLE_OK && code >= 200 && code <= 299) {
+			poster_latency_add(poster, item->queued, switch_micro_time_now());
+			poster->delivered++;
+			switch_mutex_unlock(poster->mutex);
+			poster_xfer_free(xfer);
+			return SWITCH_STATUS_SUCCESS;
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[%s] Got error [%ld] posting to web server [%s] %s\n", poster->settings.name,
+						  code, poster->settings.urls[xfer->url_index], result == CURLE_OK ? "" : curl_easy_strerror(result));
+
+		if (xfer->url_index == poster->url_index && poster->settings.url_count > 1) {
+			poster->url_index = (poster->url_index + 1) % poster->settings.url_count;
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[%s] Retry will be with url [%s]\n", poster->settings.name,
+							  poster->settings.urls[poster->url_index]);
+		}
+		switch_mutex_unlock(poster->mutex);
+
+		poster_xfer_free(xfer);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[%s] Unable to post [%s] to web server\n", poster->settings.name, item->id);
+
+	switch_mutex_lock(poster->mutex);
+	poster->failed++;
+	switch_mutex_unlock(poster->mutex);
+
+	if (poster->settings.spool) {
+		poster->settings.spool(item->id, item->name, item->text, poster->settings.user_data);
+	}
+
+	return SWITCH_STATUS_FALSE;
+}
+
+/* pending items that are due first, then fresh ones from the queue */
+static poster_item_t *poster_take(switch_curl_poster_t *poster, switch_time_t now)
+{
+	poster_item_t *list = NULL, **tail = &list, **pp, *item;
+	uint32_t max = poster->settings.batch_max > 1 ? poster->settings.batch_max : 1, count = 0;
+	void *pop;
+
+	for (pp = &poster->pending; *pp && count < max;) {
+		/* while draining there is no time left to wait for a retry slot */
+		if ((*pp)->not_before <= now || !poster->running) {
+			item = *pp;
+			*pp = item->next;
+			item->next = NULL;
+			*tail = item;
+			tail = &item->next;
+			count++;
+		} else {
+			pp = &(*pp)->next;
+		}
+	}
+
+	while (count < max && switch_queue_trypop(poster->queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		item = (poster_item_t *) pop;
+		*tail = item;
+		tail = &item->next;
+		count++;
+	}
+
+	return list;
+}
+
+static void poster_replay(switch_curl_poster_t *poster, switch_time_t now)
+{
+	switch_memory_pool_t *pool = NULL;
+	switch_dir_t *dir = NULL;
+	char *dir_name = NULL;
+	char buf[256];
+	const char *name;
+	switch_size_t suffix_len = strlen(switch_str_nil(poster->settings.spool_suffix));
+	int count = 0;
+
+	poster->next_replay = now + (switch_time_t) poster->settings.replay_interval * 1000000;
+
+	switch_mutex_lock(poster->mutex);
+	dir_name = switch_safe_strdup(poster->replay_dir);
+	switch_mutex_unlock(poster->mutex);
+
+	if (!dir_name || !suffix_len) {
+		goto end;
+	}
+
+	switch_core_new_memory_pool(&pool);
+
+	if (switch_dir_open(&dir, dir_name, pool) != SWITCH_STATUS_SUCCESS) {
+		goto end;
+	}
+
+	while (count < POSTER_REPLAY_MAX && (name = switch_dir_next_file(dir, buf, sizeof(buf)))) {
+		switch_size_t len = strlen(name);
+		struct stat st;
+		char *path, *text = NULL, *id;
+		poster_item_t *item;
+		FILE *f;
+
+		if (len <= suffix_len || strcmp(name + len - suffix_len, poster->settings.spool_suffix)) {
+			continue;
+		}
+
+		path = switch_mprintf("%s%s%s", dir_name, SWITCH_PATH_SEPARATOR, name);
+
+		switch_mutex_lock(poster->mutex);
+		if (switch_core_hash_find(poster->replaying, path) || stat(path, &st) || st.st_mtime > switch_epoch_time_now(NULL) - POSTER_REPLAY_MIN_AGE) {
+			switch_mutex_unlock(poster->mutex);
+			free(path);
+			continue;
+		}
+		switch_mutex_unlock(poster->mutex);
+
+		if ((f = fopen(path, "rb"))) {
+			switch_malloc(text, (switch_size_t) st.st_size + 1);
+			text[fread(text, 1, (size_t) st.st_size, f)] = '\0';
+			fclose(f);
+		}
+
+		if (zstr(text)) {
+			switch_safe_free(text);
+			free(path);
+			continue;
+		}
+
+		id = strdup(name);
+		id[len - suffix_len] = '\0';
+		item = poster_item_new(id, NULL, text);
+		item->replay_path = path;
+		free(id);
+		free(text);
+
+		switch_mutex_lock(poster->mutex);
+		switch_core_hash_insert(poster->replaying, path, item);
+		switch_mutex_unlock(poster->mutex);
+
+		item->next = poster->pending;
+		poster->pending = item;
+		count++;
+	}
+
+	if (count) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[%s] Replaying %d spooled document(s) from %s\n", poster->settings.name, count, dir_name);
+	}
+
+  end:
+	if (dir) {
+		switch_dir_close(dir);
+	}
+	if (pool) {
+		switch_core_destroy_memory_pool(&pool);
+	}
+	switch_safe_free(dir_name);
+}
+
+static void *SWITCH_THREAD_FUNC poster_thread(switch_thread_t *thread, void *obj)
+{
+	switch_curl_poster_t *poster = (switch_curl_poster_t *) obj;
+	poster_item_t *items, *item;
+	CURLMsg *msg;
+	int running, left;
+	void *pop;
+
+	for (;;) {
+		switch_time_t now = switch_micro_time_now();
+		/* once stopped, keep posting what was queued until the drain timeout runs out */
+		int draining = !poster->running && now < poster->drain_until;
+
+		if (poster->running || draining) {
+			while (poster->active < poster->settings.max_connections && (items = poster_take(poster, now))) {
+				poster_start(poster, items);
+			}
+
+			if (poster->running && poster->settings.replay_interval && now >= poster->next_replay) {
+				poster_replay(poster, now);
+			}
+		}
+
+		if (!poster->active) {
+			/* nothing in flight and poster_take found nothing left to start */
+			if (!poster->running) {
+				break;
+			}
+
+			if (switch_queue_pop_timeout(poster->queue, &pop, 100000) == SWITCH_STATUS_SUCCESS && pop) {
+				item = (poster_item_t *) pop;
+				item->next = poster->pending;
+				poster->pending = item;
+			}
+			continue;
+		}
+
+		curl_multi_perform(poster->multi, &running);
+
+		while ((msg = curl_multi_info_read(poster->multi, &left))) {
+			if (msg->msg == CURLMSG_DONE) {
+				poster_xfer_t *xfer = NULL;
+
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &xfer);
+				poster_finish(poster, xfer, msg->data.result);
+			}
+		}
+
+		if (poster->active) {
+			curl_multi_wait(poster->multi, NULL, 0, 100, NULL);
+		}
+	}
+
+	/* nothing left in flight, hand whatever the drain did not get to to the spool */
+	while (poster->pending || switch_queue_trypop(poster->queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		if (poster->pending) {
+			item = poster->pending;
+			poster->pending = item->next;
+		} else if (!(item = (poster_item_t *) pop)) {
+			continue;
+		}
+
+		if (!item->replay_path && poster->settings.spool) {
+			poster->settings.spool(item->id, item->name, item->text, poster->settings.user_data);
+		}
+		poster_item_free(item);
+	}
+
+	return NULL;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_curl_poster_create(switch_curl_poster_t **posterP, const switch_curl_poster_settings_t *settings)
+{
+	switch_memory_pool_t *pool = NULL;
+	switch_curl_poster_t *poster;
+	switch_threadattr_t *thd_attr = NULL;
+	int i;
+
+	if (!settings->url_count) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_core_new_memory_pool(&pool);
+	poster = switch_core_alloc(pool, sizeof(*poster));
+	poster->pool = pool;
+	poster->settings = *settings;
+
+	poster->settings.name = switch_core_strdup(pool, settings->name ? settings->name : "curl_poster");
+	poster->settings.urls = switch_core_alloc(pool, sizeof(char *) * settings->url_count);
+	for (i = 0; i < settings->url_count; i++) {
+		poster->settings.urls[i] = switch_core_strdup(pool, settings->urls[i]);
+	}
+	poster->settings.id_param = settings->id_param ? switch_core_strdup(pool, settings->id_param) : NULL;
+	poster->settings.user_agent = settings->user_agent ? switch_core_strdup(pool, settings->user_agent) : NULL;
+	poster->settings.content_type = settings->content_type ? switch_core_strdup(pool, settings->content_type) : NULL;
+	poster->settings.form_field = switch_core_strdup(pool, settings->form_field ? settings->form_field : "data");
+	poster->settings.batch_open = settings->batch_open ? switch_core_strdup(pool, settings->batch_open) : NULL;
+	poster->settings.batch_separator = settings->batch_separator ? switch_core_strdup(pool, settings->batch_separator) : NULL;
+	poster->settings.batch_close = settings->batch_close ? switch_core_strdup(pool, settings->batch_close) : NULL;
+	poster->settings.spool_suffix = settings->spool_suffix ? switch_core_strdup(pool, settings->spool_suffix) : NULL;
+
+	if (!poster->settings.max_connections) {
+		poster->settings.max_connections = 1;
+	}
+	if (!poster->settings.queue_size) {
+		poster->settings.queue_size = 10000;
+	}
+	if (!poster->settings.retries) {
+		poster->settings.retries = 1;
+	}
+	if (!poster->settings.drain_timeout) {
+		poster->settings.drain_timeout = POSTER_DRAIN_TIMEOUT;
+	}
+	/* the encodings are per document, so several can't share one body */
+	if (poster->settings.encoding != SWITCH_CURL_POST_RAW) {
+		poster->settings.batch_max = 1;
+	}
+
+	switch_mutex_init(&poster->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&poster->replaying);
+	switch_queue_create(&poster->queue, poster->settings.queue_size, pool);
+
+	poster->multi = curl_multi_init();
+	curl_multi_setopt(poster->multi, CURLMOPT_MAXCONNECTS, (long) poster->settings.max_connections);
+	poster->next_replay = switch_micro_time_now() + (switch_time_t) poster->settings.replay_interval * 1000000;
+	poster->running = 1;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&poster->thread, thd_attr, poster_thread, poster, pool);
+
+	*posterP = poster;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_curl_poster_push(switch_curl_poster_t *poster, const char *id, const char *name, const char *text)
+{
+	poster_item_t *item = poster_item_new(id, name, text);
+	switch_status_t status;
+	uint32_t depth;
+
+	if (poster->settings.synchronous) {
+		status = poster_post_now(poster, item);
+		poster_item_free(item);
+		return status;
+	}
+
+	if (!poster->running || switch_queue_trypush(poster->queue, item) != SWITCH_STATUS_SUCCESS) {
+		switch_atomic_inc(&poster->overflow);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[%s] Post queue is full, spooling [%s]\n", poster->settings.name, item->id);
+		if (poster->settings.spool) {
+			poster->settings.spool(item->id, item->name, item->text, poster->settings.user_data);
+		}
+		poster_item_free(item);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if ((depth = switch_queue_size(poster->queue)) > poster->queue_peak) {
+		poster->queue_peak = depth;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(void) switch_curl_poster_set_replay_dir(switch_curl_poster_t *poster, const char *dir)
+{
+	switch_mutex_lock(poster->mutex);
+	switch_safe_free(poster->replay_dir);
+	poster->replay_dir = switch_safe_strdup(dir);
+	switch_mutex_unlock(poster->mutex);
+}
+
+static int poster_cmp_uint32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+SWITCH_DECLARE(void) switch_curl_poster_stats(switch_curl_poster_t *poster, switch_stream_handle_t *stream)
+{
+	uint32_t samples[POSTER_LATENCY_SAMPLES], count;
+
+	switch_mutex_lock(poster->mutex);
+	count = poster->latency_count;
+	memcpy(samples, poster->latency, sizeof(uint32_t) * count);
+	stream->write_function(stream, "queue-depth: %u/%u\n", switch_queue_size(poster->queue), poster->settings.queue_size);
+	stream->write_function(stream, "queue-peak: %u\n", poster->queue_peak);
+	stream->write_function(stream, "active: %u/%u\n", poster->active, poster->settings.max_connections);
+	stream->write_function(stream, "requests: %" SWITCH_UINT64_T_FMT "\n", poster->requests);
+	stream->write_function(stream, "delivered: %" SWITCH_UINT64_T_FMT "\n", poster->delivered);
+	stream->write_function(stream, "failed: %" SWITCH_UINT64_T_FMT "\n", poster->failed);
+	stream->write_function(stream, "replayed: %" SWITCH_UINT64_T_FMT "\n", poster->replayed);
+	stream->write_function(stream, "overflow: %u\n", switch_atomic_read(&poster->overflow));
+	switch_mutex_unlock(poster->mutex);
+
+	if (count) {
+		qsort(samples, count, sizeof(uint32_t), poster_cmp_uint32);
+		stream->write_function(stream, "latency-p50-ms: %u\n", samples[count / 2]);
+		stream->write_function(stream, "latency-p99-ms: %u\n", samples[(count * 99) / 100]);
+	}
+}
+
+SWITCH_DECLARE(void) switch_curl_poster_destroy(switch_curl_poster_t **posterP)
+{
+	switch_curl_poster_t *poster;
+	switch_memory_pool_t *pool;
+	switch_status_t st;
+
+	if (!posterP || !(poster = *posterP)) {
+		return;
+	}
+
+	*posterP = NULL;
+	poster->drain_until = switch_micro_time_now() + (switch_time_t) poster->settings.drain_timeout * 1000000;
+	poster->running = 0;
+	switch_thread_join(&st, poster->thread);
+
+	curl_multi_cleanup(poster->multi);
+	switch_core_hash_destroy(&poster->replaying);
+	switch_safe_free(poster->replay_dir);
+
+	pool = poster->pool;
+	switch_core_destroy_memory_pool(&pool);
+}
+
 /* For Emacs:
  * Local Variables:
  * mode:c
@@ -1753,53 +1753,42 @@ SWITCH_DECLARE(switch_status_t) switch_event_create_brackets(char *data, char a,
 
 
 
+static void event_json_member(const char *name, const char *value, cJSON_bool array_item, void *user_data)
+{
+	switch_event_t *event = (switch_event_t *) user_data;
+
+	if (array_item) {
+		switch_event_add_header_string(event, SWITCH_STACK_PUSH, name, value);
+	} else if (!strcasecmp(name, "_body")) {
+		switch_event_add_body(event, value, SWITCH_VA_NONE);
+	} else {
+		if (!strcasecmp(name, "event-name")) {
+			switch_event_del_header(event, "event-name");
+			switch_name_event(value, &event->event_id);
+		}
+
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, name, value);
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_create_json(switch_event_t **event, const char *json)
 {
 	switch_event_t *new_event;
-	cJSON *cj, *cjp;
-
 
-	if (!(cj = cJSON_Parse(json))) {
+	if (!json) {
 		return SWITCH_STATUS_FALSE;
 	}
 
 	if (switch_event_create(&new_event, SWITCH_EVENT_CLONE) != SWITCH_STATUS_SUCCESS) {
-		cJSON_Delete(cj);
 		return SWITCH_STATUS_FALSE;
 	}
 
-	for (cjp = cj->child; cjp; cjp = cjp->next) {
-		char *name = cjp->string;
-		char *value = cjp->valuestring;
-
-		if (name && value) {
-			if (!strcasecmp(name, "_body")) {
-				switch_event_add_body(new_event, value, SWITCH_VA_NONE);
-			} else {
-				if (!strcasecmp(name, "event-name")) {
-					switch_event_del_header(new_event, "event-name");
-					switch_name_event(value, &new_event->event_id);
-				}
-
-				switch_event_add_header_string(new_event, SWITCH_STACK_BOTTOM, name, value);
-			}
-
-		} else if (name) {
-			if (cjp->type == cJSON_Array) {
-				int i, x = cJSON_GetArraySize(cjp);
-
-				for (i = 0; i < x; i++) {
-					cJSON *item = cJSON_GetArrayItem(cjp, i);
-
-					if (item && item->type == cJSON_String && item->valuestring) {
-						switch_event_add_header_string(new_event, SWITCH_STACK_PUSH, name, item->valuestring);
-					}
-				}
-			}
-		}
+	/* headers are added straight from the text, no cJSON tree is built */
+	if (!switch_json_parse_members(json, event_json_member, new_event)) {
+		switch_event_destroy(&new_event);
+		return SWITCH_STATUS_FALSE;
 	}
 
-	cJSON_Delete(cj);
 	*event = new_event;
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -1844,18 +1833,40 @@ SWITCH_DECLARE(switch_status_t) switch_event_serialize_json_obj(switch_event_t *
 
 SWITCH_DECLARE(switch_status_t) switch_event_serialize_json(switch_event_t *event, char **str)
 {
+	switch_event_header_t *hp;
+	switch_json_writer_t w;
 
-	cJSON *cj;
-	*str = NULL;
+	/* same text as switch_event_serialize_json_obj() and cJSON_PrintUnformatted() */
+	switch_json_writer_init(&w, 1024);
+	switch_json_writer_begin(&w, NULL, '{');
 
-	if (switch_event_serialize_json_obj(event, &cj) == SWITCH_STATUS_SUCCESS) {
-		*str = cJSON_PrintUnformatted(cj);
-		cJSON_Delete(cj);
+	for (hp = event->headers; hp; hp = hp->next) {
+		if (hp->idx) {
+			int i;
 
-		return SWITCH_STATUS_SUCCESS;
+			switch_json_writer_begin(&w, hp->name, '[');
+			for (i = 0; i < hp->idx; i++) {
+				switch_json_writer_string(&w, NULL, hp->array[i]);
+			}
+			switch_json_writer_end(&w, ']');
+		} else {
+			switch_json_writer_string(&w, hp->name, hp->value);
+		}
 	}
 
-	return SWITCH_STATUS_FALSE;
+	if (event->body) {
+		char tmp[25];
+
+		switch_snprintf(tmp, sizeof(tmp), "%d", (int) strlen(event->body));
+
+		switch_json_writer_string(&w, "Content-Length", tmp);
+		switch_json_writer_string(&w, "_body", event->body);
+	}
+
+	switch_json_writer_end(&w, '}');
+	*str = switch_json_writer_finish(&w);
+
+	return SWITCH_STATUS_SUCCESS;
 }
 
 static switch_xml_t add_xml_header(switch_xml_t xml, char *name, char *value, int offset)
@@ -3519,6 +3519,769 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_generate_json_cdr(switch_core_session
 }
 
 
+/* Streaming CDR serializers: these walk the same channel data as switch_ivr_generate_xml_cdr()
+   and switch_ivr_generate_json_cdr() but write the text straight into one growing buffer
+   instead of building a node per field and rendering the tree afterwards. */
+
+#define CDR_TEXT_BUFSIZE 16384
+
+#define write_stat(_w, _i, _s)											\
+	switch_snprintf(var_val, sizeof(var_val), "%" SWITCH_SIZE_T_FMT, _i); \
+	switch_xml_writer_element(_w, _s, var_val)
+
+#define write_stat_double(_w, _i, _s)									\
+	switch_snprintf(var_val, sizeof(var_val), "%0.2f", _i);				\
+	switch_xml_writer_element(_w, _s, var_val)
+
+static void switch_ivr_write_xml_profile_data(switch_xml_writer_t *w, switch_caller_profile_t *caller_profile)
+{
+	profile_node_t *pn;
+
+	switch_xml_writer_element(w, "username", caller_profile->username);
+	switch_xml_writer_element(w, "dialplan", caller_profile->dialplan);
+	switch_xml_writer_element(w, "caller_id_name", caller_profile->caller_id_name);
+	switch_xml_writer_element(w, "caller_id_number", caller_profile->caller_id_number);
+	switch_xml_writer_element(w, "callee_id_name", caller_profile->callee_id_name);
+	switch_xml_writer_element(w, "callee_id_number", caller_profile->callee_id_number);
+	switch_xml_writer_element(w, "ani", caller_profile->ani);
+	switch_xml_writer_element(w, "aniii", caller_profile->aniii);
+	switch_xml_writer_element(w, "network_addr", caller_profile->network_addr);
+	switch_xml_writer_element(w, "rdnis", caller_profile->rdnis);
+	switch_xml_writer_element(w, "destination_number", caller_profile->destination_number);
+	switch_xml_writer_element(w, "uuid", caller_profile->uuid);
+	switch_xml_writer_element(w, "source", caller_profile->source);
+
+	if (caller_profile->transfer_source) {
+		switch_xml_writer_element(w, "transfer_source", caller_profile->transfer_source);
+	}
+
+	switch_xml_writer_element(w, "context", caller_profile->context);
+	switch_xml_writer_element(w, "chan_name", caller_profile->chan_name);
+
+	for (pn = caller_profile->soft; pn; pn = pn->next) {
+		switch_xml_writer_element(w, pn->var, pn->val);
+	}
+}
+
+static void switch_ivr_write_xml_call_stats(switch_xml_writer_t *w, switch_core_session_t *session, switch_media_type_t type)
+{
+	const char *name = (type == SWITCH_MEDIA_TYPE_VIDEO) ? "video" : "audio";
+	switch_rtp_stats_t *stats = switch_core_media_get_stats(session, type, NULL);
+	char var_val[35] = "";
+
+	if (!stats) return;
+
+	switch_xml_writer_open(w, name);
+
+	stats->inbound.std_deviation = sqrt(stats->inbound.variance);
+
+	switch_xml_writer_open(w, "inbound");
+	write_stat(w, stats->inbound.raw_bytes, "raw_bytes");
+	write_stat(w, stats->inbound.media_bytes, "media_bytes");
+	write_stat(w, stats->inbound.packet_count, "packet_count");
+	write_stat(w, stats->inbound.media_packet_count, "media_packet_count");
+	write_stat(w, stats->inbound.skip_packet_count, "skip_packet_count");
+	write_stat(w, stats->inbound.jb_packet_count, "jitter_packet_count");
+	write_stat(w, stats->inbound.dtmf_packet_count, "dtmf_packet_count");
+	write_stat(w, stats->inbound.cng_packet_count, "cng_packet_count");
+	write_stat(w, stats->inbound.flush_packet_count, "flush_packet_count");
+	write_stat(w, stats->inbound.largest_jb_size, "largest_jb_size");
+	write_stat_double(w, stats->inbound.min_variance, "jitter_min_variance");
+	write_stat_double(w, stats->inbound.max_variance, "jitter_max_variance");
+	write_stat_double(w, stats->inbound.lossrate, "jitter_loss_rate");
+	write_stat_double(w, stats->inbound.burstrate, "jitter_burst_rate");
+	write_stat_double(w, stats->inbound.mean_interval, "mean_interval");
+	write_stat(w, stats->inbound.flaws, "flaw_total");
+	write_stat_double(w, stats->inbound.R, "quality_percentage");
+	write_stat_double(w, stats->inbound.mos, "mos");
+	switch_xml_writer_close(w, "inbound");
+
+	/* the tree version adds error-log after outbound so it is rendered last */
+	switch_xml_writer_open(w, "outbound");
+	write_stat(w, stats->outbound.raw_bytes, "raw_bytes");
+	write_stat(w, stats->outbound.media_bytes, "media_bytes");
+	write_stat(w, stats->outbound.packet_count, "packet_count");
+	write_stat(w, stats->outbound.media_packet_count, "media_packet_count");
+	write_stat(w, stats->outbound.skip_packet_count, "skip_packet_count");
+	write_stat(w, stats->outbound.dtmf_packet_count, "dtmf_packet_count");
+	write_stat(w, stats->outbound.cng_packet_count, "cng_packet_count");
+	write_stat(w, stats->rtcp.packet_count, "rtcp_packet_count");
+	write_stat(w, stats->rtcp.octet_count, "rtcp_octet_count");
+	switch_xml_writer_close(w, "outbound");
+
+	if (stats->inbound.error_log) {
+		switch_error_period_t *ep;
+
+		switch_xml_writer_open(w, "error-log");
+
+		for (ep = stats->inbound.error_log; ep; ep = ep->next) {
+
+			if (!(ep->start && ep->stop)) continue;
+
+			switch_xml_writer_open(w, "error-period");
+
+			switch_snprintf(var_val, sizeof(var_val), "%" SWITCH_TIME_T_FMT, ep->start);
+			switch_xml_writer_element(w, "start", var_val);
+
+			switch_snprintf(var_val, sizeof(var_val), "%" SWITCH_TIME_T_FMT, ep->stop);
+			switch_xml_writer_element(w, "stop", var_val);
+
+			switch_snprintf(var_val, sizeof(var_val), "%" SWITCH_TIME_T_FMT, ep->flaws);
+			switch_xml_writer_element(w, "flaws", var_val);
+
+			switch_snprintf(var_val, sizeof(var_val), "%" SWITCH_TIME_T_FMT, ep->consecutive_flaws);
+			switch_xml_writer_element(w, "consecutive-flaws", var_val);
+
+			switch_snprintf(var_val, sizeof(var_val), "%" SWITCH_TIME_T_FMT, (ep->stop - ep->start) / 1000);
+			switch_xml_writer_element(w, "duration-msec", var_val);
+
+			switch_xml_writer_close(w, "error-period");
+		}
+
+		switch_xml_writer_close(w, "error-log");
+	}
+
+	switch_xml_writer_close(w, name);
+}
+
+/* grows *buf to hold len bytes, reused across variables instead of a malloc per value */
+static char *switch_ivr_cdr_scratch(char **buf, switch_size_t *size, switch_size_t len)
+{
+	if (len > *size) {
+		*size = len > *size * 2 ? len : *size * 2;
+		*buf = (char *) switch_must_realloc(*buf, *size);
+	}
+
+	memset(*buf, 0, len);
+
+	return *buf;
+}
+
+static void switch_ivr_write_xml_chan_var(switch_xml_writer_t *w, const char *var, const char *val, char **buf, switch_size_t *size)
+{
+	switch_size_t dlen;
+
+	if (zstr(var)) {
+		return;
+	}
+
+	val = switch_str_nil(val);
+	dlen = strlen(val) * 3 + 1;
+
+	switch_url_encode(val, switch_ivr_cdr_scratch(buf, size, dlen), dlen);
+	switch_xml_writer_element(w, var, *buf);
+}
+
+static void switch_ivr_write_xml_chan_vars(switch_xml_writer_t *w, switch_channel_t *channel)
+{
+	switch_event_header_t *hi = switch_channel_variable_first(channel);
+	char *buf = NULL;
+	switch_size_t size = 0;
+
+	if (!hi)
+		return;
+
+	for (; hi; hi = hi->next) {
+		if (hi->idx) {
+			int i;
+
+			for (i = 0; i < hi->idx; i++) {
+				switch_ivr_write_xml_chan_var(w, hi->name, hi->array[i], &buf, &size);
+			}
+		} else {
+			switch_ivr_write_xml_chan_var(w, hi->name, hi->value, &buf, &size);
+		}
+	}
+	switch_channel_variable_last(channel);
+
+	switch_safe_free(buf);
+}
+
+static void switch_ivr_write_xml_extension(switch_xml_writer_t *w, switch_caller_profile_t *cp, switch_bool_t sub)
+{
+	switch_caller_extension_t *ext = cp->caller_extension;
+	switch_caller_application_t *ap;
+
+	switch_xml_writer_open(w, "extension");
+	switch_xml_writer_attr(w, "name", ext->extension_name);
+	switch_xml_writer_attr(w, "number", ext->extension_number);
+	if (sub) {
+		switch_xml_writer_attr(w, "dialplan", cp->dialplan);
+	}
+	if (ext->current_application) {
+		switch_xml_writer_attr(w, "current_app", ext->current_application->application_name);
+	}
+
+	for (ap = ext->applications; ap; ap = ap->next) {
+		switch_xml_writer_open(w, "application");
+		if (ap == ext->current_application) {
+			switch_xml_writer_attr(w, "last_executed", "true");
+		}
+		switch_xml_writer_attr(w, "app_name", ap->application_name);
+		switch_xml_writer_attr(w, "app_data", ap->application_data);
+		switch_xml_writer_close(w, "application");
+	}
+
+	if (!sub && ext->children) {
+		switch_caller_profile_t *child;
+
+		for (child = ext->children; child; child = child->next) {
+			if (!child->caller_extension) {
+				continue;
+			}
+
+			switch_xml_writer_open(w, "sub_extensions");
+			switch_ivr_write_xml_extension(w, child, SWITCH_TRUE);
+			switch_xml_writer_close(w, "sub_extensions");
+		}
+	}
+
+	switch_xml_writer_close(w, "extension");
+}
+
+/* switch_ivr_generate_xml_cdr() nests every sub extension after the first inside the previous
+   one, and orders it by offsets that are shared between siblings. Rather than reproduce that,
+   such channels are left to the tree so the text stays identical. */
+static switch_bool_t switch_ivr_xml_cdr_streamable(switch_channel_t *channel)
+{
+	switch_caller_profile_t *caller_profile, *cp;
+
+	for (caller_profile = switch_channel_get_caller_profile(channel); caller_profile; caller_profile = caller_profile->next) {
+		int n = 0;
+
+		if (!caller_profile->caller_extension) {
+			continue;
+		}
+
+		for (cp = caller_profile->caller_extension->children; cp; cp = cp->next) {
+			if (cp->caller_extension && ++n > 1) {
+				return SWITCH_FALSE;
+			}
+		}
+	}
+
+	return SWITCH_TRUE;
+}
+
+static void switch_ivr_write_xml_times(switch_xml_writer_t *w, switch_channel_timetable_t *times)
+{
+	char tmp[64];
+
+	switch_xml_writer_open(w, "times");
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->created);
+	switch_xml_writer_element(w, "created_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->profile_created);
+	switch_xml_writer_element(w, "profile_created_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->progress);
+	switch_xml_writer_element(w, "progress_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->progress_media);
+	switch_xml_writer_element(w, "progress_media_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->answered);
+	switch_xml_writer_element(w, "answered_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->bridged);
+	switch_xml_writer_element(w, "bridged_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->last_hold);
+	switch_xml_writer_element(w, "last_hold_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->hold_accum);
+	switch_xml_writer_element(w, "hold_accum_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->hungup);
+	switch_xml_writer_element(w, "hangup_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->resurrected);
+	switch_xml_writer_element(w, "resurrect_time", tmp);
+
+	switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->transferred);
+	switch_xml_writer_element(w, "transfer_time", tmp);
+
+	switch_xml_writer_close(w, "times");
+}
+
+static void switch_ivr_write_xml_profiles(switch_xml_writer_t *w, const char *name, const char *item, switch_caller_profile_t *cp)
+{
+	switch_xml_writer_open(w, name);
+
+	for (; cp; cp = cp->next) {
+		switch_xml_writer_open(w, item);
+		switch_ivr_write_xml_profile_data(w, cp);
+		switch_xml_writer_close(w, item);
+	}
+
+	switch_xml_writer_close(w, name);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_ivr_generate_xml_cdr_text(switch_core_session_t *session, char **xml_text, switch_bool_t prn_header)
+{
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	switch_caller_profile_t *caller_profile;
+	switch_hold_record_t *hold_record = switch_channel_get_hold_record(channel), *hr;
+	switch_app_log_t *app_log;
+	switch_xml_writer_t w;
+	const char *text_buffer = NULL;
+	char tmp[512], *f;
+
+	if (!switch_ivr_xml_cdr_streamable(channel)) {
+		switch_xml_t cdr = NULL;
+
+		if (switch_ivr_generate_xml_cdr(session, &cdr) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		*xml_text = switch_xml_toxml(cdr, prn_header);
+		switch_xml_free(cdr);
+
+		return *xml_text ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+	}
+
+	switch_xml_writer_init(&w, CDR_TEXT_BUFSIZE, prn_header, USE_UTF_8_ENCODING);
+
+	switch_xml_writer_open(&w, "cdr");
+	switch_xml_writer_attr(&w, "core-uuid", switch_core_get_uuid());
+	switch_xml_writer_attr(&w, "switchname", switch_core_get_switchname());
+
+	switch_xml_writer_open(&w, "channel_data");
+	switch_xml_writer_element(&w, "state", switch_channel_state_name(switch_channel_get_state(channel)));
+	switch_xml_writer_element(&w, "direction", switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND ? "outbound" : "inbound");
+
+	if ((text_buffer = switch_core_session_get_text_buffer(session))) {
+		switch_xml_writer_element(&w, "textlog", text_buffer);
+	}
+
+	switch_snprintf(tmp, sizeof(tmp), "%d", switch_channel_get_state(channel));
+	switch_xml_writer_element(&w, "state_number", tmp);
+
+	if ((f = switch_channel_get_flag_string(channel))) {
+		switch_xml_writer_element(&w, "flags", f);
+		free(f);
+	}
+
+	if ((f = switch_channel_get_cap_string(channel))) {
+		switch_xml_writer_element(&w, "caps", f);
+		free(f);
+	}
+	switch_xml_writer_close(&w, "channel_data");
+
+	switch_xml_writer_open(&w, "call-stats");
+	switch_ivr_write_xml_call_stats(&w, session, SWITCH_MEDIA_TYPE_AUDIO);
+	switch_ivr_write_xml_call_stats(&w, session, SWITCH_MEDIA_TYPE_VIDEO);
+	switch_xml_writer_close(&w, "call-stats");
+
+	switch_xml_writer_open(&w, "variables");
+	switch_ivr_write_xml_chan_vars(&w, channel);
+	switch_xml_writer_close(&w, "variables");
+
+	if ((app_log = switch_core_session_get_app_log(session))) {
+		switch_app_log_t *ap;
+
+		switch_xml_writer_open(&w, "app_log");
+		for (ap = app_log; ap; ap = ap->next) {
+			switch_xml_writer_open(&w, "application");
+			switch_xml_writer_attr(&w, "app_name", ap->app);
+			switch_xml_writer_attr(&w, "app_data", ap->arg);
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, ap->stamp);
+			switch_xml_writer_attr(&w, "app_stamp", tmp);
+			switch_xml_writer_close(&w, "application");
+		}
+		switch_xml_writer_close(&w, "app_log");
+	}
+
+	if (hold_record) {
+		switch_xml_writer_open(&w, "hold-record");
+		for (hr = hold_record; hr; hr = hr->next) {
+			switch_xml_writer_open(&w, "hold");
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, hr->on);
+			switch_xml_writer_attr(&w, "on", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, hr->off);
+			switch_xml_writer_attr(&w, "off", tmp);
+
+			if (hr->uuid) {
+				switch_xml_writer_attr(&w, "bridged-to", hr->uuid);
+			}
+
+			switch_xml_writer_close(&w, "hold");
+		}
+		switch_xml_writer_close(&w, "hold-record");
+	}
+
+	for (caller_profile = switch_channel_get_caller_profile(channel); caller_profile; caller_profile = caller_profile->next) {
+		switch_xml_writer_open(&w, "callflow");
+
+		if (!zstr(caller_profile->dialplan)) {
+			switch_xml_writer_attr(&w, "dialplan", caller_profile->dialplan);
+		}
+
+		if (!zstr(caller_profile->uuid_str)) {
+			switch_xml_writer_attr(&w, "unique-id", caller_profile->uuid_str);
+		}
+
+		if (!zstr(caller_profile->clone_of)) {
+			switch_xml_writer_attr(&w, "clone-of", caller_profile->clone_of);
+		}
+
+		if (!zstr(caller_profile->profile_index)) {
+			switch_xml_writer_attr(&w, "profile_index", caller_profile->profile_index);
+		}
+
+		if (caller_profile->caller_extension) {
+			switch_ivr_write_xml_extension(&w, caller_profile, SWITCH_FALSE);
+		}
+
+		switch_xml_writer_open(&w, "caller_profile");
+		switch_ivr_write_xml_profile_data(&w, caller_profile);
+
+		if (caller_profile->origination_caller_profile) {
+			switch_ivr_write_xml_profiles(&w, "origination", "origination_caller_profile", caller_profile->origination_caller_profile);
+		}
+
+		if (caller_profile->originator_caller_profile) {
+			switch_ivr_write_xml_profiles(&w, "originator", "originator_caller_profile", caller_profile->originator_caller_profile);
+		}
+
+		if (caller_profile->originatee_caller_profile) {
+			switch_ivr_write_xml_profiles(&w, "originatee", "originatee_caller_profile", caller_profile->originatee_caller_profile);
+		}
+		switch_xml_writer_close(&w, "caller_profile");
+
+		if (caller_profile->times) {
+			switch_ivr_write_xml_times(&w, caller_profile->times);
+		}
+
+		switch_xml_writer_close(&w, "callflow");
+	}
+
+	switch_xml_writer_close(&w, "cdr");
+
+	*xml_text = switch_xml_writer_finish(&w);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void switch_ivr_write_json_profile_data(switch_json_writer_t *w, switch_caller_profile_t *caller_profile)
+{
+	switch_json_writer_string(w, "username", caller_profile->username);
+	switch_json_writer_string(w, "dialplan", caller_profile->dialplan);
+	switch_json_writer_string(w, "caller_id_name", caller_profile->caller_id_name);
+	switch_json_writer_string(w, "ani", caller_profile->ani);
+	switch_json_writer_string(w, "aniii", caller_profile->aniii);
+	switch_json_writer_string(w, "caller_id_number", caller_profile->caller_id_number);
+	switch_json_writer_string(w, "network_addr", caller_profile->network_addr);
+	switch_json_writer_string(w, "rdnis", caller_profile->rdnis);
+	switch_json_writer_string(w, "destination_number", caller_profile->destination_number);
+	switch_json_writer_string(w, "uuid", caller_profile->uuid);
+	switch_json_writer_string(w, "source", caller_profile->source);
+	switch_json_writer_string(w, "context", caller_profile->context);
+	switch_json_writer_string(w, "chan_name", caller_profile->chan_name);
+}
+
+static void switch_ivr_write_json_call_stats(switch_json_writer_t *w, switch_core_session_t *session, switch_media_type_t type)
+{
+	const char *name = (type == SWITCH_MEDIA_TYPE_VIDEO) ? "video" : "audio";
+	switch_rtp_stats_t *stats = switch_core_media_get_stats(session, type, NULL);
+
+	if (!stats) return;
+
+	switch_json_writer_begin(w, name, '{');
+
+	stats->inbound.std_deviation = sqrt(stats->inbound.variance);
+
+	switch_json_writer_begin(w, "inbound", '{');
+	switch_json_writer_number(w, "raw_bytes", stats->inbound.raw_bytes);
+	switch_json_writer_number(w, "media_bytes", stats->inbound.media_bytes);
+	switch_json_writer_number(w, "packet_count", stats->inbound.packet_count);
+	switch_json_writer_number(w, "media_packet_count", stats->inbound.media_packet_count);
+	switch_json_writer_number(w, "skip_packet_count", stats->inbound.skip_packet_count);
+	switch_json_writer_number(w, "jitter_packet_count", stats->inbound.jb_packet_count);
+	switch_json_writer_number(w, "dtmf_packet_count", stats->inbound.dtmf_packet_count);
+	switch_json_writer_number(w, "cng_packet_count", stats->inbound.cng_packet_count);
+	switch_json_writer_number(w, "flush_packet_count", stats->inbound.flush_packet_count);
+	switch_json_writer_number(w, "largest_jb_size", stats->inbound.largest_jb_size);
+	switch_json_writer_number(w, "jitter_min_variance", stats->inbound.min_variance);
+	switch_json_writer_number(w, "jitter_max_variance", stats->inbound.max_variance);
+	switch_json_writer_number(w, "jitter_loss_rate", stats->inbound.lossrate);
+	switch_json_writer_number(w, "jitter_burst_rate", stats->inbound.burstrate);
+	switch_json_writer_number(w, "mean_interval", stats->inbound.mean_interval);
+	switch_json_writer_number(w, "flaw_total", stats->inbound.flaws);
+	switch_json_writer_number(w, "quality_percentage", stats->inbound.R);
+	switch_json_writer_number(w, "mos", stats->inbound.mos);
+
+	if (stats->inbound.error_log) {
+		switch_error_period_t *ep;
+
+		switch_json_writer_begin(w, "errorLog", '[');
+		for (ep = stats->inbound.error_log; ep; ep = ep->next) {
+
+			if (!(ep->start && ep->stop)) continue;
+
+			switch_json_writer_begin(w, NULL, '{');
+			switch_json_writer_number(w, "start", ep->start);
+			switch_json_writer_number(w, "stop", ep->stop);
+			switch_json_writer_number(w, "flaws", ep->flaws);
+			switch_json_writer_number(w, "consecutiveFlaws", ep->consecutive_flaws);
+			switch_json_writer_number(w, "durationMS", (ep->stop - ep->start) / 1000);
+			switch_json_writer_end(w, '}');
+		}
+		switch_json_writer_end(w, ']');
+	}
+	switch_json_writer_end(w, '}');
+
+	switch_json_writer_begin(w, "outbound", '{');
+	switch_json_writer_number(w, "raw_bytes", stats->outbound.raw_bytes);
+	switch_json_writer_number(w, "media_bytes", stats->outbound.media_bytes);
+	switch_json_writer_number(w, "packet_count", stats->outbound.packet_count);
+	switch_json_writer_number(w, "media_packet_count", stats->outbound.media_packet_count);
+	switch_json_writer_number(w, "skip_packet_count", stats->outbound.skip_packet_count);
+	switch_json_writer_number(w, "dtmf_packet_count", stats->outbound.dtmf_packet_count);
+	switch_json_writer_number(w, "cng_packet_count", stats->outbound.cng_packet_count);
+	switch_json_writer_number(w, "rtcp_packet_count", stats->rtcp.packet_count);
+	switch_json_writer_number(w, "rtcp_octet_count", stats->rtcp.octet_count);
+	switch_json_writer_end(w, '}');
+
+	switch_json_writer_end(w, '}');
+}
+
+static void switch_ivr_write_json_chan_vars(switch_json_writer_t *w, switch_channel_t *channel, switch_bool_t urlencode)
+{
+	switch_event_header_t *hi = switch_channel_variable_first(channel);
+	char *buf = NULL;
+	switch_size_t size = 0;
+
+	if (!hi)
+		return;
+
+	for (; hi; hi = hi->next) {
+		if (!zstr(hi->name) && !zstr(hi->value)) {
+			if (urlencode) {
+				switch_size_t dlen = strlen(hi->value) * 3;
+
+				switch_url_encode(hi->value, switch_ivr_cdr_scratch(&buf, &size, dlen), dlen);
+				switch_json_writer_string(w, hi->name, buf);
+			} else {
+				switch_json_writer_string(w, hi->name, hi->value);
+			}
+		}
+	}
+	switch_channel_variable_last(channel);
+
+	switch_safe_free(buf);
+}
+
+static void switch_ivr_write_json_extension_apps(switch_json_writer_t *w, switch_caller_extension_t *ext)
+{
+	switch_caller_application_t *ap;
+
+	switch_json_writer_begin(w, "applications", '[');
+	for (ap = ext->applications; ap; ap = ap->next) {
+		switch_json_writer_begin(w, NULL, '{');
+		if (ap == ext->current_application) {
+			switch_json_writer_string(w, "last_executed", "true");
+		}
+		switch_json_writer_string(w, "app_name", ap->application_name);
+		switch_json_writer_string(w, "app_data", switch_str_nil(ap->application_data));
+		switch_json_writer_end(w, '}');
+	}
+	switch_json_writer_end(w, ']');
+}
+
+static void switch_ivr_write_json_profiles(switch_json_writer_t *w, const char *name, const char *list, switch_caller_profile_t *cp)
+{
+	switch_json_writer_begin(w, name, '{');
+	switch_json_writer_begin(w, list, '[');
+
+	for (; cp; cp = cp->next) {
+		switch_json_writer_begin(w, NULL, '{');
+		switch_ivr_write_json_profile_data(w, cp);
+		switch_json_writer_end(w, '}');
+	}
+
+	switch_json_writer_end(w, ']');
+	switch_json_writer_end(w, '}');
+}
+
+SWITCH_DECLARE(switch_status_t) switch_ivr_generate_json_cdr_text(switch_core_session_t *session, char **json_text, switch_bool_t urlencode)
+{
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	switch_caller_profile_t *caller_profile;
+	switch_app_log_t *app_log;
+	switch_json_writer_t w;
+	char tmp[512], *f;
+
+	switch_json_writer_init(&w, CDR_TEXT_BUFSIZE);
+
+	switch_json_writer_begin(&w, NULL, '{');
+	switch_json_writer_string(&w, "core-uuid", switch_core_get_uuid());
+	switch_json_writer_string(&w, "switchname", switch_core_get_switchname());
+
+	switch_json_writer_begin(&w, "channel_data", '{');
+	switch_json_writer_string(&w, "state", switch_channel_state_name(switch_channel_get_state(channel)));
+	switch_json_writer_string(&w, "direction", switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND ? "outbound" : "inbound");
+
+	switch_snprintf(tmp, sizeof(tmp), "%d", switch_channel_get_state(channel));
+	switch_json_writer_string(&w, "state_number", tmp);
+
+	if ((f = switch_channel_get_flag_string(channel))) {
+		switch_json_writer_string(&w, "flags", f);
+		free(f);
+	}
+
+	if ((f = switch_channel_get_cap_string(channel))) {
+		switch_json_writer_string(&w, "caps", f);
+		free(f);
+	}
+	switch_json_writer_end(&w, '}');
+
+	switch_json_writer_begin(&w, "callStats", '{');
+	switch_ivr_write_json_call_stats(&w, session, SWITCH_MEDIA_TYPE_AUDIO);
+	switch_ivr_write_json_call_stats(&w, session, SWITCH_MEDIA_TYPE_VIDEO);
+	switch_json_writer_end(&w, '}');
+
+	switch_json_writer_begin(&w, "variables", '{');
+	switch_ivr_write_json_chan_vars(&w, channel, urlencode);
+	switch_json_writer_end(&w, '}');
+
+	if ((app_log = switch_core_session_get_app_log(session))) {
+		switch_app_log_t *ap;
+
+		switch_json_writer_begin(&w, "app_log", '{');
+		switch_json_writer_begin(&w, "applications", '[');
+		for (ap = app_log; ap; ap = ap->next) {
+			switch_json_writer_begin(&w, NULL, '{');
+			switch_json_writer_string(&w, "app_name", ap->app);
+			switch_json_writer_string(&w, "app_data", ap->arg);
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, ap->stamp);
+			switch_json_writer_string(&w, "app_stamp", tmp);
+			switch_json_writer_end(&w, '}');
+		}
+		switch_json_writer_end(&w, ']');
+		switch_json_writer_end(&w, '}');
+	}
+
+	switch_json_writer_begin(&w, "callflow", '[');
+
+	for (caller_profile = switch_channel_get_caller_profile(channel); caller_profile; caller_profile = caller_profile->next) {
+		switch_json_writer_begin(&w, NULL, '{');
+
+		if (!zstr(caller_profile->dialplan)) {
+			switch_json_writer_string(&w, "dialplan", caller_profile->dialplan);
+		}
+
+		if (!zstr(caller_profile->profile_index)) {
+			switch_json_writer_string(&w, "profile_index", caller_profile->profile_index);
+		}
+
+		if (caller_profile->caller_extension) {
+			switch_caller_extension_t *ext = caller_profile->caller_extension;
+
+			switch_json_writer_begin(&w, "extension", '{');
+			switch_json_writer_string(&w, "name", ext->extension_name);
+			switch_json_writer_string(&w, "number", ext->extension_number);
+			switch_ivr_write_json_extension_apps(&w, ext);
+
+			if (ext->current_application) {
+				switch_json_writer_string(&w, "current_app", ext->current_application->application_name);
+			}
+
+			if (ext->children) {
+				switch_caller_profile_t *cp = NULL;
+
+				switch_json_writer_begin(&w, "sub_extensions", '[');
+				for (cp = ext->children; cp; cp = cp->next) {
+
+					if (!cp->caller_extension) {
+						continue;
+					}
+
+					switch_json_writer_begin(&w, NULL, '{');
+					switch_json_writer_string(&w, "name", cp->caller_extension->extension_name);
+					switch_json_writer_string(&w, "number", cp->caller_extension->extension_number);
+					switch_json_writer_string(&w, "dialplan", cp->dialplan);
+
+					if (cp->caller_extension->current_application) {
+						switch_json_writer_string(&w, "current_app", cp->caller_extension->current_application->application_name);
+					}
+
+					switch_ivr_write_json_extension_apps(&w, cp->caller_extension);
+					switch_json_writer_end(&w, '}');
+				}
+				switch_json_writer_end(&w, ']');
+			}
+			switch_json_writer_end(&w, '}');
+		}
+
+		switch_json_writer_begin(&w, "caller_profile", '{');
+		switch_ivr_write_json_profile_data(&w, caller_profile);
+
+		if (caller_profile->originator_caller_profile) {
+			switch_ivr_write_json_profiles(&w, "originator", "originator_caller_profiles", caller_profile->originator_caller_profile);
+		}
+
+		if (caller_profile->originatee_caller_profile) {
+			switch_ivr_write_json_profiles(&w, "originatee", "originatee_caller_profiles", caller_profile->originatee_caller_profile);
+		}
+		switch_json_writer_end(&w, '}');
+
+		if (caller_profile->times) {
+			switch_channel_timetable_t *times = caller_profile->times;
+
+			switch_json_writer_begin(&w, "times", '{');
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->created);
+			switch_json_writer_string(&w, "created_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->profile_created);
+			switch_json_writer_string(&w, "profile_created_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->progress);
+			switch_json_writer_string(&w, "progress_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->progress_media);
+			switch_json_writer_string(&w, "progress_media_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->answered);
+			switch_json_writer_string(&w, "answered_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->bridged);
+			switch_json_writer_string(&w, "bridged_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->last_hold);
+			switch_json_writer_string(&w, "last_hold_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->hold_accum);
+			switch_json_writer_string(&w, "hold_accum_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->hungup);
+			switch_json_writer_string(&w, "hangup_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->resurrected);
+			switch_json_writer_string(&w, "resurrect_time", tmp);
+
+			switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_TIME_T_FMT, times->transferred);
+			switch_json_writer_string(&w, "transfer_time", tmp);
+
+			switch_json_writer_end(&w, '}');
+		}
+
+		switch_json_writer_end(&w, '}');
+	}
+
+	switch_json_writer_end(&w, ']');
+	switch_json_writer_end(&w, '}');
+
+	*json_text = switch_json_writer_finish(&w);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+
 SWITCH_DECLARE(void) switch_ivr_park_session(switch_core_session_t *session)
 {
 	switch_channel_t *channel = switch_core_session_get_channel(session);
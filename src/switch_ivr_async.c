@@ -1152,6 +1152,14 @@ struct record_helper {
 	switch_mutex_t *buffer_mutex;
 	int thread_ready;
 	uint8_t thread_needs_transfer;
+	struct record_writer *writer;
+	uint8_t writer_queued;
+	uint8_t writer_busy;
+	uint32_t writer_channels;
+	uint32_t writer_min_bytes;
+	uint32_t dropped_frames;
+	uint8_t writer_error;
+	uint8_t shared_writer;
 	uint32_t writes;
 	uint32_t vwrites;
 	const char *completion_cause;
@@ -1233,6 +1241,10 @@ static void send_record_stop_event(switch_channel_t *channel, switch_codec_imple
 		switch_channel_set_variable_printf(channel, "record_completion_cause", "%s", rh->completion_cause);
 	}
 
+	if (rh->shared_writer) {
+		switch_channel_set_variable_printf(channel, "record_dropped_frames", "%u", rh->dropped_frames);
+	}
+
 	if (switch_event_create(&event, SWITCH_EVENT_RECORD_STOP) == SWITCH_STATUS_SUCCESS) {
 		switch_channel_event_set_data(channel, event);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Record-File-Path", rh->file);
@@ -1240,6 +1252,9 @@ static void send_record_stop_event(switch_channel_t *channel, switch_codec_imple
 		if (!zstr(rh->completion_cause)) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Record-Completion-Cause", rh->completion_cause);
 		}
+		if (rh->shared_writer) {
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Record-Dropped-Frames", "%u", rh->dropped_frames);
+		}
 		switch_event_fire(&event);
 		switch_event_safe_destroy(rh->variables);
 	}
@@ -1326,6 +1341,208 @@ static void *SWITCH_THREAD_FUNC recording_thread(switch_thread_t *thread, void *
 	return NULL;
 }
 
+/* Largest single write issued by the shared recording writers */
+#define RECORD_WRITER_CHUNK (1024 * 64)
+/* Number of packets buffered before the shared writers flush a recording */
+#define RECORD_WRITER_PACKETS 8
+
+typedef struct record_writer {
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	switch_queue_t *queue;
+	uint32_t count;
+	uint8_t *data;
+} record_writer_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	record_writer_t *writers;
+	uint32_t writer_count;
+	uint32_t buffer_size;
+	int running;
+} RECORD_WRITERS;
+
+static switch_size_t record_writer_drain(struct record_helper *rh, uint8_t *data, switch_size_t min_bytes)
+{
+	switch_size_t bytes, samples, frame_bytes = rh->writer_channels * 2;
+
+	switch_mutex_lock(rh->buffer_mutex);
+	bytes = switch_buffer_inuse(rh->thread_buffer);
+
+	if (!bytes || bytes < min_bytes) {
+		switch_mutex_unlock(rh->buffer_mutex);
+		return 0;
+	}
+
+	if (bytes > RECORD_WRITER_CHUNK) {
+		bytes = RECORD_WRITER_CHUNK;
+	}
+
+	bytes -= bytes % frame_bytes;
+	bytes = switch_buffer_read(rh->thread_buffer, data, bytes);
+	switch_mutex_unlock(rh->buffer_mutex);
+
+	if ((samples = bytes / frame_bytes) && switch_core_file_write(rh->fh, data, &samples) != SWITCH_STATUS_SUCCESS) {
+		rh->writer_error = 1;
+	}
+
+	return bytes;
+}
+
+static void *SWITCH_THREAD_FUNC record_writer_thread(switch_thread_t *thread, void *obj)
+{
+	record_writer_t *writer = (record_writer_t *) obj;
+	void *pop;
+
+	while (switch_queue_pop(writer->queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		struct record_helper *rh = (struct record_helper *) pop;
+
+		/* a queued recording is not freed before it is popped, see record_writer_detach */
+		switch_mutex_lock(writer->mutex);
+		rh->writer_queued = 0;
+		if (!rh->writer) {
+			switch_thread_cond_broadcast(writer->cond);
+			switch_mutex_unlock(writer->mutex);
+			continue;
+		}
+		rh->writer_busy = 1;
+		switch_mutex_unlock(writer->mutex);
+
+		while (!rh->writer_error && record_writer_drain(rh, writer->data, rh->writer_min_bytes));
+
+		switch_mutex_lock(writer->mutex);
+		rh->writer_busy = 0;
+		switch_thread_cond_broadcast(writer->cond);
+		switch_mutex_unlock(writer->mutex);
+	}
+
+	return NULL;
+}
+
+void switch_ivr_record_writer_init(switch_memory_pool_t *pool)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	uint32_t i;
+
+	memset(&RECORD_WRITERS, 0, sizeof(RECORD_WRITERS));
+
+	if (!runtime.record_writer_threads) {
+		return;
+	}
+
+	RECORD_WRITERS.writer_count = runtime.record_writer_threads;
+	RECORD_WRITERS.buffer_size = runtime.record_writer_buffer_size ? runtime.record_writer_buffer_size : 1024 * 512;
+	RECORD_WRITERS.writers = switch_core_alloc(pool, sizeof(record_writer_t) * RECORD_WRITERS.writer_count);
+	switch_mutex_init(&RECORD_WRITERS.mutex, SWITCH_MUTEX_NESTED, pool);
+	RECORD_WRITERS.running = 1;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	for (i = 0; i < RECORD_WRITERS.writer_count; i++) {
+		record_writer_t *writer = &RECORD_WRITERS.writers[i];
+
+		writer->data = switch_core_alloc(pool, RECORD_WRITER_CHUNK);
+		switch_mutex_init(&writer->mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_thread_cond_create(&writer->cond, pool);
+		switch_queue_create(&writer->queue, SWITCH_CORE_QUEUE_LEN, pool);
+		switch_thread_create(&writer->thread, thd_attr, record_writer_thread, writer, pool);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Started %u shared recording writer thread(s)\n", RECORD_WRITERS.writer_count);
+}
+
+void switch_ivr_record_writer_shutdown(void)
+{
+	switch_status_t st;
+	uint32_t i;
+
+	if (!RECORD_WRITERS.running) {
+		return;
+	}
+
+	RECORD_WRITERS.running = 0;
+
+	for (i = 0; i < RECORD_WRITERS.writer_count; i++) {
+		switch_queue_push(RECORD_WRITERS.writers[i].queue, NULL);
+	}
+
+	for (i = 0; i < RECORD_WRITERS.writer_count; i++) {
+		switch_thread_join(&st, RECORD_WRITERS.writers[i].thread);
+	}
+}
+
+static switch_bool_t record_writer_attach(struct record_helper *rh, int channels)
+{
+	record_writer_t *writer = NULL;
+	uint32_t i, min_bytes;
+
+	if (!RECORD_WRITERS.running) {
+		return SWITCH_FALSE;
+	}
+
+	/* pick the least loaded writer, each recording stays on one writer so its writes are sequential */
+	switch_mutex_lock(RECORD_WRITERS.mutex);
+	for (i = 0; i < RECORD_WRITERS.writer_count; i++) {
+		if (!writer || RECORD_WRITERS.writers[i].count < writer->count) {
+			writer = &RECORD_WRITERS.writers[i];
+		}
+	}
+	writer->count++;
+	switch_mutex_unlock(RECORD_WRITERS.mutex);
+
+	min_bytes = rh->read_impl.samples_per_packet * 2 * channels * RECORD_WRITER_PACKETS;
+
+	if (!min_bytes || min_bytes > RECORD_WRITER_CHUNK) {
+		min_bytes = RECORD_WRITER_CHUNK;
+	}
+
+	rh->writer_channels = channels;
+	rh->writer_min_bytes = min_bytes;
+	rh->shared_writer = 1;
+
+	switch_mutex_init(&rh->buffer_mutex, SWITCH_MUTEX_NESTED, rh->helper_pool);
+	switch_buffer_create_dynamic(&rh->thread_buffer, 1024 * 64, 1024 * 64, RECORD_WRITERS.buffer_size);
+
+	rh->writer = writer;
+
+	return SWITCH_TRUE;
+}
+
+/* called from the media thread once the buffer holds enough audio for a flush */
+static void record_writer_queue(struct record_helper *rh)
+{
+	record_writer_t *writer = rh->writer;
+
+	switch_mutex_lock(writer->mutex);
+	if (!rh->writer_queued && switch_queue_trypush(writer->queue, rh) == SWITCH_STATUS_SUCCESS) {
+		rh->writer_queued = 1;
+	}
+	switch_mutex_unlock(writer->mutex);
+}
+
+static void record_writer_detach(struct record_helper *rh)
+{
+	record_writer_t *writer = rh->writer;
+
+	if (!writer) {
+		return;
+	}
+
+	/* wait until the writer is neither writing this recording nor holding it in its queue */
+	switch_mutex_lock(writer->mutex);
+	rh->writer = NULL;
+	while (rh->writer_queued || rh->writer_busy) {
+		switch_thread_cond_wait(writer->cond, writer->mutex);
+	}
+	switch_mutex_unlock(writer->mutex);
+
+	switch_mutex_lock(RECORD_WRITERS.mutex);
+	writer->count--;
+	switch_mutex_unlock(RECORD_WRITERS.mutex);
+}
+
 static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, switch_abc_type_t type)
 {
 	switch_core_session_t *session = switch_core_media_bug_get_session(bug);
@@ -1394,7 +1611,10 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 			/* Required for potential record_transfer */
 			rh->bug = bug;
 			
-			if (!rh->native && rh->fh && (zstr(var) || switch_true(var))) {
+			if (!rh->native && rh->fh && (zstr(var) || switch_true(var)) && !switch_core_file_has_video(rh->fh, SWITCH_TRUE) &&
+				record_writer_attach(rh, switch_core_media_bug_test_flag(bug, SMBF_STEREO) ? 2 : rh->read_impl.number_of_channels)) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Using shared recording writer for file %s\n", rh->file);
+			} else if (!rh->native && rh->fh && (zstr(var) || switch_true(var))) {
 				switch_threadattr_t *thd_attr = NULL;
 				int sanity = 200;
 
@@ -1538,6 +1758,22 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 					switch_thread_join(&st, rh->thread);
 				}
 
+				if (rh->writer) {
+					uint8_t *wdata = malloc(RECORD_WRITER_CHUNK);
+
+					switch_assert(wdata);
+					record_writer_detach(rh);
+
+					while (!rh->writer_error && record_writer_drain(rh, wdata, 0));
+
+					free(wdata);
+				}
+
+				if (rh->writer_error) {
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error writing %s\n", rh->file);
+					set_completion_cause(rh, "uri-failure");
+				}
+
 				if (rh->thread_buffer) {
 					switch_buffer_destroy(&rh->thread_buffer);
 				}
@@ -1659,11 +1895,23 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 				} else {
 					len = (switch_size_t) frame.datalen / 2 / frame.channels;
 
-					if (rh->thread_buffer) {
+					if (rh->thread_buffer && !rh->writer_error) {
+						switch_size_t wrote, inuse;
+
 						switch_mutex_lock(rh->buffer_mutex);
-						switch_buffer_write(rh->thread_buffer, mask ? null_data : data, frame.datalen);
+						wrote = switch_buffer_write(rh->thread_buffer, mask ? null_data : data, frame.datalen);
+						inuse = switch_buffer_inuse(rh->thread_buffer);
 						switch_mutex_unlock(rh->buffer_mutex);
-					} else if (switch_core_file_write(rh->fh, mask ? null_data : data, &len) != SWITCH_STATUS_SUCCESS) {
+
+						if (rh->writer && !rh->writer_queued && inuse >= rh->writer_min_bytes) {
+							record_writer_queue(rh);
+						}
+
+						if (!wrote && !rh->dropped_frames++) {
+							switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+											  "Recording writer is falling behind on %s, dropping audio\n", rh->file);
+						}
+					} else if (rh->writer_error || switch_core_file_write(rh->fh, mask ? null_data : data, &len) != SWITCH_STATUS_SUCCESS) {
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error writing %s\n", rh->file);
 						/* File write failed */
 						set_completion_cause(rh, "uri-failure");
@@ -2816,6 +3064,8 @@ static switch_status_t record_helper_destroy(struct record_helper **rh, switch_c
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Destroying a record helper of another session!\n");
 	}
 
+	record_writer_detach(*rh);
+
 	if ((*rh)->native) {
 		switch_core_file_close(&(*rh)->in_fh);
 		switch_core_file_close(&(*rh)->out_fh);
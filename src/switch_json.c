@@ -28,6 +28,561 @@ SWITCH_DECLARE(const char *)cJSON_GetObjectCstr(const cJSON *object, const char
 	   return cj->valuestring;
 }
 
+static void switch_json_writer_need(switch_json_writer_t *w, switch_size_t need)
+{
+	if (w->len + need + 1 > w->max) {
+		while (w->len + need + 1 > w->max) {
+			w->max *= 2;
+		}
+		w->buf = (char *) switch_must_realloc(w->buf, w->max);
+	}
+}
+
+static void switch_json_writer_putc(switch_json_writer_t *w, char c)
+{
+	switch_json_writer_need(w, 1);
+	w->buf[w->len++] = c;
+}
+
+/* escapes the same way cJSON_PrintUnformatted() does */
+static void switch_json_writer_quote(switch_json_writer_t *w, const char *str)
+{
+	const unsigned char *p;
+	switch_size_t need = 2;
+
+	for (p = (const unsigned char *) str; *p; p++) {
+		if (*p > 31 && *p != '"' && *p != '\\') {
+			need++;
+		} else {
+			need += 6;
+		}
+	}
+
+	switch_json_writer_need(w, need);
+	w->buf[w->len++] = '"';
+
+	for (p = (const unsigned char *) str; *p; p++) {
+		if (*p > 31 && *p != '"' && *p != '\\') {
+			w->buf[w->len++] = *p;
+			continue;
+		}
+
+		w->buf[w->len++] = '\\';
+
+		switch (*p) {
+		case '\\':
+			w->buf[w->len++] = '\\';
+			break;
+		case '"':
+			w->buf[w->len++] = '"';
+			break;
+		case '\b':
+			w->buf[w->len++] = 'b';
+			break;
+		case '\f':
+			w->buf[w->len++] = 'f';
+			break;
+		case '\n':
+			w->buf[w->len++] = 'n';
+			break;
+		case '\r':
+			w->buf[w->len++] = 'r';
+			break;
+		case '\t':
+			w->buf[w->len++] = 't';
+			break;
+		default:
+			w->len += sprintf(w->buf + w->len, "u%04x", *p);
+			break;
+		}
+	}
+
+	w->buf[w->len++] = '"';
+}
+
+static void switch_json_writer_key(switch_json_writer_t *w, const char *key)
+{
+	if (w->need_comma) {
+		switch_json_writer_putc(w, ',');
+	}
+
+	if (key) {
+		switch_json_writer_quote(w, key);
+		switch_json_writer_putc(w, ':');
+	}
+
+	w->need_comma = SWITCH_TRUE;
+}
+
+SWITCH_DECLARE(void) switch_json_writer_begin(switch_json_writer_t *w, const char *key, char c)
+{
+	switch_json_writer_key(w, key);
+	switch_json_writer_putc(w, c);
+	w->need_comma = SWITCH_FALSE;
+}
+
+SWITCH_DECLARE(void) switch_json_writer_end(switch_json_writer_t *w, char c)
+{
+	switch_json_writer_putc(w, c);
+	w->need_comma = SWITCH_TRUE;
+}
+
+/* cJSON_CreateString(NULL) fails and the member is dropped, so is it here */
+SWITCH_DECLARE(void) switch_json_writer_string(switch_json_writer_t *w, const char *key, const char *val)
+{
+	if (!val) {
+		return;
+	}
+
+	switch_json_writer_key(w, key);
+	switch_json_writer_quote(w, val);
+}
+
+SWITCH_DECLARE(void) switch_json_writer_number(switch_json_writer_t *w, const char *key, double d)
+{
+	char num[26];
+	double test;
+	int len;
+
+	if ((d * 0) != 0) {
+		len = sprintf(num, "null");
+	} else {
+		len = sprintf(num, "%1.15g", d);
+		if (sscanf(num, "%lg", &test) != 1 || test != d) {
+			len = sprintf(num, "%1.17g", d);
+		}
+	}
+
+	switch_json_writer_key(w, key);
+	switch_json_writer_need(w, len);
+	memcpy(w->buf + w->len, num, len);
+	w->len += len;
+}
+
+
+SWITCH_DECLARE(void) switch_json_writer_init(switch_json_writer_t *w, switch_size_t size)
+{
+	memset(w, 0, sizeof(*w));
+	w->max = size > 64 ? size : 64;
+	w->buf = (char *) switch_must_malloc(w->max);
+}
+
+SWITCH_DECLARE(char *) switch_json_writer_finish(switch_json_writer_t *w)
+{
+	char *s;
+
+	w->buf[w->len] = '\0';
+	s = (char *) switch_must_realloc(w->buf, w->len + 1);
+	memset(w, 0, sizeof(*w));
+
+	return s;
+}
+
+SWITCH_DECLARE(void) switch_json_writer_destroy(switch_json_writer_t *w)
+{
+	switch_safe_free(w->buf);
+	memset(w, 0, sizeof(*w));
+}
+
+/* same as CJSON_NESTING_LIMIT */
+#define JSON_NESTING_LIMIT 1000
+
+typedef struct {
+	switch_json_member_callback_t callback;
+	void *user_data;
+	int depth;
+} json_scan_t;
+
+static char *json_skip_ws(char *p)
+{
+	while (*p && (unsigned char) *p <= 32) p++;
+	return p;
+}
+
+static unsigned json_hex4(const char *p)
+{
+	unsigned h = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		h <<= 4;
+		if (p[i] >= '0' && p[i] <= '9') {
+			h += p[i] - '0';
+		} else if (p[i] >= 'A' && p[i] <= 'F') {
+			h += 10 + p[i] - 'A';
+		} else if (p[i] >= 'a' && p[i] <= 'f') {
+			h += 10 + p[i] - 'a';
+		} else {
+			/* cJSON reads a bad digit as a zero code point */
+			return 0;
+		}
+	}
+
+	return h;
+}
+
+/* \uXXXX (and a following low surrogate) at r to utf-8 at *w, returns the input length or 0 */
+static int json_utf16_to_utf8(const char *r, const char *end, char **w)
+{
+	unsigned first, codepoint;
+	int len = 6, n, i;
+	unsigned char mark = 0;
+
+	if (end - r < 6) {
+		return 0;
+	}
+
+	first = json_hex4(r + 2);
+
+	if (first >= 0xDC00 && first <= 0xDFFF) {
+		return 0;
+	}
+
+	if (first >= 0xD800 && first <= 0xDBFF) {
+		unsigned second;
+
+		if (end - r < 12 || r[6] != '\\' || r[7] != 'u') {
+			return 0;
+		}
+
+		second = json_hex4(r + 8);
+		if (second < 0xDC00 || second > 0xDFFF) {
+			return 0;
+		}
+
+		codepoint = 0x10000 + (((first & 0x3FF) << 10) | (second & 0x3FF));
+		len = 12;
+	} else {
+		codepoint = first;
+	}
+
+	if (codepoint < 0x80) {
+		n = 1;
+	} else if (codepoint < 0x800) {
+		n = 2;
+		mark = 0xC0;
+	} else if (codepoint < 0x10000) {
+		n = 3;
+		mark = 0xE0;
+	} else {
+		n = 4;
+		mark = 0xF0;
+	}
+
+	for (i = n - 1; i > 0; i--) {
+		(*w)[i] = (char) ((codepoint | 0x80) & 0xBF);
+		codepoint >>= 6;
+	}
+	(*w)[0] = (char) (n > 1 ? ((codepoint | mark) & 0xFF) : (codepoint & 0x7F));
+	*w += n;
+
+	return len;
+}
+
+/* Unescapes the string starting at the quote at *pp in place, the result never grows
+   past the escaped text. Like cJSON the closing quote is found first, skipping any
+   escaped character, then the escapes before it are decoded. Runs without escapes
+   are found with strcspn() and memchr(), which libc vectorizes. */
+static switch_bool_t json_scan_string(char **pp, char **out)
+{
+	char *start = *pp + 1, *end = start, *r, *w, *bs;
+
+	for (;;) {
+		end += strcspn(end, "\"\\");
+
+		if (*end == '"') {
+			break;
+		}
+
+		if (*end != '\\' || !end[1]) {
+			return SWITCH_FALSE;
+		}
+
+		end += 2;
+	}
+
+	r = w = start;
+
+	/* a \u escape may swallow half of an escaped pair, so r can step past end like it does in cJSON */
+	while (r < end && (bs = memchr(r, '\\', end - r))) {
+		if (w != r) {
+			memmove(w, r, bs - r);
+		}
+		w += bs - r;
+		r = bs;
+
+		switch (r[1]) {
+		case 'b':
+			*w++ = '\b';
+			break;
+		case 'f':
+			*w++ = '\f';
+			break;
+		case 'n':
+			*w++ = '\n';
+			break;
+		case 'r':
+			*w++ = '\r';
+			break;
+		case 't':
+			*w++ = '\t';
+			break;
+		case '"':
+		case '\\':
+		case '/':
+			*w++ = r[1];
+			break;
+		case 'u':
+			{
+				int len = json_utf16_to_utf8(r, end, &w);
+
+				if (!len) {
+					return SWITCH_FALSE;
+				}
+				r += len;
+				continue;
+			}
+		default:
+			return SWITCH_FALSE;
+		}
+
+		r += 2;
+	}
+
+	if (r < end) {
+		if (w != r) {
+			memmove(w, r, end - r);
+		}
+		w += end - r;
+	}
+	*w = '\0';
+
+	*pp = end + 1;
+	*out = start;
+
+	return SWITCH_TRUE;
+}
+
+static switch_bool_t json_skip_value(json_scan_t *scan, char **pp);
+
+static switch_bool_t json_skip_number(char **pp)
+{
+	char num[64], *end;
+	size_t i;
+
+	for (i = 0; i < sizeof(num) - 1 && (*pp)[i] && strchr("0123456789+-eE.", (*pp)[i]); i++) {
+		num[i] = (*pp)[i];
+	}
+	num[i] = '\0';
+
+	strtod(num, &end);
+	if (end == num) {
+		return SWITCH_FALSE;
+	}
+
+	*pp += end - num;
+
+	return SWITCH_TRUE;
+}
+
+static switch_bool_t json_skip_container(json_scan_t *scan, char **pp, char close)
+{
+	char *p = *pp + 1, *s;
+
+	if (scan->depth >= JSON_NESTING_LIMIT) {
+		return SWITCH_FALSE;
+	}
+	scan->depth++;
+
+	p = json_skip_ws(p);
+	if (*p != close) {
+		for (;;) {
+			p = json_skip_ws(p);
+
+			if (close == '}') {
+				if (*p != '"' || !json_scan_string(&p, &s)) {
+					return SWITCH_FALSE;
+				}
+				p = json_skip_ws(p);
+				if (*p++ != ':') {
+					return SWITCH_FALSE;
+				}
+				p = json_skip_ws(p);
+			}
+
+			if (!json_skip_value(scan, &p)) {
+				return SWITCH_FALSE;
+			}
+
+			p = json_skip_ws(p);
+			if (*p != ',') {
+				break;
+			}
+			p++;
+		}
+
+		if (*p != close) {
+			return SWITCH_FALSE;
+		}
+	}
+
+	scan->depth--;
+	*pp = p + 1;
+
+	return SWITCH_TRUE;
+}
+
+static switch_bool_t json_skip_value(json_scan_t *scan, char **pp)
+{
+	char *p = *pp, *s;
+
+	if (!strncmp(p, "null", 4) || !strncmp(p, "true", 4)) {
+		*pp += 4;
+		return SWITCH_TRUE;
+	}
+
+	if (!strncmp(p, "false", 5)) {
+		*pp += 5;
+		return SWITCH_TRUE;
+	}
+
+	switch (*p) {
+	case '"':
+		return json_scan_string(pp, &s);
+	case '[':
+		return json_skip_container(scan, pp, ']');
+	case '{':
+		return json_skip_container(scan, pp, '}');
+	case '-':
+		return json_skip_number(pp);
+	default:
+		if (*p >= '0' && *p <= '9') {
+			return json_skip_number(pp);
+		}
+	}
+
+	return SWITCH_FALSE;
+}
+
+/* an array member, strings are reported and anything else skipped */
+static switch_bool_t json_scan_array(json_scan_t *scan, char **pp, const char *name)
+{
+	char *p = json_skip_ws(*pp + 1), *value;
+
+	scan->depth++;
+
+	if (*p != ']') {
+		for (;;) {
+			p = json_skip_ws(p);
+
+			if (*p == '"') {
+				if (!json_scan_string(&p, &value)) {
+					return SWITCH_FALSE;
+				}
+				scan->callback(name, value, SWITCH_TRUE, scan->user_data);
+			} else if (!json_skip_value(scan, &p)) {
+				return SWITCH_FALSE;
+			}
+
+			p = json_skip_ws(p);
+			if (*p != ',') {
+				break;
+			}
+			p++;
+		}
+
+		if (*p != ']') {
+			return SWITCH_FALSE;
+		}
+	}
+
+	scan->depth--;
+	*pp = p + 1;
+
+	return SWITCH_TRUE;
+}
+
+SWITCH_DECLARE(cJSON_bool) switch_json_parse_members(const char *json, switch_json_member_callback_t callback, void *user_data)
+{
+	json_scan_t scan = { 0 };
+	char *dup, *p, *name, *value;
+	cJSON_bool status = SWITCH_FALSE;
+
+	if (!json) {
+		return SWITCH_FALSE;
+	}
+
+	scan.callback = callback;
+	scan.user_data = user_data;
+
+	/* one copy of the text holds every unescaped name and value */
+	dup = p = strdup(json);
+	switch_assert(dup);
+
+	if (strlen(p) > 4 && !strncmp(p, "\xEF\xBB\xBF", 3)) {
+		p += 3;
+	}
+
+	p = json_skip_ws(p);
+
+	if (*p != '{') {
+		/* valid json that isn't an object has no members */
+		if (json_skip_value(&scan, &p)) {
+			status = SWITCH_TRUE;
+		}
+		goto end;
+	}
+
+	scan.depth = 1;
+	p = json_skip_ws(p + 1);
+
+	if (*p != '}') {
+		for (;;) {
+			p = json_skip_ws(p);
+
+			if (*p != '"' || !json_scan_string(&p, &name)) {
+				goto end;
+			}
+
+			p = json_skip_ws(p);
+			if (*p++ != ':') {
+				goto end;
+			}
+			p = json_skip_ws(p);
+
+			if (*p == '"') {
+				if (!json_scan_string(&p, &value)) {
+					goto end;
+				}
+				callback(name, value, SWITCH_FALSE, user_data);
+			} else if (*p == '[') {
+				if (!json_scan_array(&scan, &p, name)) {
+					goto end;
+				}
+			} else if (!json_skip_value(&scan, &p)) {
+				goto end;
+			}
+
+			p = json_skip_ws(p);
+			if (*p != ',') {
+				break;
+			}
+			p++;
+		}
+
+		if (*p != '}') {
+			goto end;
+		}
+	}
+
+	status = SWITCH_TRUE;
+
+  end:
+	free(dup);
+
+	return status;
+}
+
 /* For Emacs:
  * Local Variables:
  * mode:c
@@ -98,11 +98,23 @@ struct switch_loadable_module_container {
 	switch_hash_t *limit_hash;
 	switch_hash_t *database_hash;
 	switch_hash_t *secondary_recover_hash;
+	switch_hash_t *codec_list_cache;
+	uint32_t codec_list_cache_size;
+	uint32_t codec_list_cache_gen;
 	switch_mutex_t *mutex;
 	switch_memory_pool_t *pool;
 };
 
+#define CODEC_LIST_CACHE_MAX 512
+
+typedef struct {
+	int count;
+	const switch_codec_implementation_t *array[SWITCH_MAX_CODECS + 1];
+	char *fmtp[SWITCH_MAX_CODECS + 1];
+} codec_list_cache_entry_t;
+
 static struct switch_loadable_module_container loadable_modules;
+static void codec_list_cache_flush(void);
 static switch_status_t do_shutdown(switch_loadable_module_t *module, switch_bool_t shutdown, switch_bool_t unload, switch_bool_t fail_if_busy,
 								   const char **err);
 static switch_status_t switch_loadable_module_load_module_ex(const char *dir, const char *fname, switch_bool_t runtime, switch_bool_t global, const char **err, switch_loadable_module_type_t type, switch_hash_t *event_hash);
@@ -260,6 +272,8 @@ static switch_status_t switch_loadable_module_process(char *key, switch_loadable
 						switch_core_hash_insert(loadable_modules.codec_hash, impl->iananame, (const void *) node);
 					}
 
+					codec_list_cache_flush();
+
 					if (switch_event_create(&event, SWITCH_EVENT_MODULE_LOAD) == SWITCH_STATUS_SUCCESS) {
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "type", "codec");
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "name", ptr->interface_name);
@@ -1210,6 +1224,9 @@ static switch_status_t switch_loadable_module_unprocess(switch_loadable_module_t
 							}
 						}
 					}
+
+					codec_list_cache_flush();
+
 					if (switch_event_create(&event, SWITCH_EVENT_MODULE_UNLOAD) == SWITCH_STATUS_SUCCESS) {
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "type", "codec");
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "name", ptr->interface_name);
@@ -2165,6 +2182,7 @@ SWITCH_DECLARE(switch_status_t) switch_loadable_module_init(switch_bool_t autolo
 	switch_core_hash_init_nocase(&loadable_modules.database_hash);
 	switch_core_hash_init_nocase(&loadable_modules.dialplan_hash);
 	switch_core_hash_init(&loadable_modules.secondary_recover_hash);
+	switch_core_hash_init(&loadable_modules.codec_list_cache);
 	switch_mutex_init(&loadable_modules.mutex, SWITCH_MUTEX_NESTED, loadable_modules.pool);
 
 	if (!autoload) return SWITCH_STATUS_SUCCESS;
@@ -2498,6 +2516,7 @@ SWITCH_DECLARE(void) switch_loadable_module_shutdown(void)
 	switch_core_hash_destroy(&loadable_modules.module_hash);
 	switch_core_hash_destroy(&loadable_modules.endpoint_hash);
 	switch_core_hash_destroy(&loadable_modules.codec_hash);
+	switch_core_hash_destroy(&loadable_modules.codec_list_cache);
 	switch_core_hash_destroy(&loadable_modules.timer_hash);
 	switch_core_hash_destroy(&loadable_modules.application_hash);
 	switch_core_hash_destroy(&loadable_modules.chat_application_hash);
@@ -2835,7 +2854,53 @@ SWITCH_DECLARE(char *) switch_parse_codec_buf(char *buf, uint32_t *interval, uin
 	return name;
 }
 
-SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_implementation_t **array, char fmtp_array[SWITCH_MAX_CODECS][MAX_FMTP_LEN], int arraylen, char **prefs, int preflen)
+static void codec_list_cache_destroy(void *ptr)
+{
+	codec_list_cache_entry_t *entry = (codec_list_cache_entry_t *) ptr;
+	int x;
+
+	for (x = 0; x < SWITCH_MAX_CODECS + 1; x++) {
+		switch_safe_free(entry->fmtp[x]);
+	}
+
+	free(entry);
+}
+
+/* implementation pointers go stale with the module that provides them, call with loadable_modules.mutex held */
+static void codec_list_cache_flush(void)
+{
+	switch_core_hash_destroy(&loadable_modules.codec_list_cache);
+	switch_core_hash_init(&loadable_modules.codec_list_cache);
+	loadable_modules.codec_list_cache_size = 0;
+	loadable_modules.codec_list_cache_gen++;
+}
+
+static switch_bool_t codec_list_cache_key(char *key, switch_size_t keylen, int arraylen, char **prefs, int preflen)
+{
+	switch_size_t len;
+	int x;
+
+	len = switch_snprintf(key, keylen, "%d", arraylen);
+
+	for (x = 0; x < preflen; x++) {
+		switch_size_t plen = strlen(prefs[x]);
+
+		if (len + plen + 2 > keylen) {
+			return SWITCH_FALSE;
+		}
+
+		key[len++] = ',';
+		memcpy(key + len, prefs[x], plen);
+		len += plen;
+	}
+
+	key[len] = '\0';
+
+	return SWITCH_TRUE;
+}
+
+static int get_codecs_sorted(const switch_codec_implementation_t **array, char fmtp_array[SWITCH_MAX_CODECS][MAX_FMTP_LEN], uint8_t *fmtp_set,
+							 int arraylen, char **prefs, int preflen)
 {
 	int x, i = 0, j = 0;
 	switch_codec_interface_t *codec_interface;
@@ -2917,6 +2982,7 @@ SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_
 
 				if (!zstr(fmtp)) {
 					switch_set_string(fmtp_array[i], fmtp);
+					fmtp_set[i] = 1;
 				}
 				array[i++] = imp;
 				goto found;
@@ -2972,6 +3038,75 @@ SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_
 	return i;
 }
 
+SWITCH_DECLARE(int) switch_loadable_module_get_codecs_sorted(const switch_codec_implementation_t **array, char fmtp_array[SWITCH_MAX_CODECS][MAX_FMTP_LEN], int arraylen, char **prefs, int preflen)
+{
+	char key[1024];
+	uint8_t fmtp_set[SWITCH_MAX_CODECS + 1] = { 0 };
+	codec_list_cache_entry_t *entry;
+	switch_bool_t cacheable;
+	uint32_t gen;
+	int x, i;
+
+	/* the same handful of codec strings is resolved on every call setup, remember the answers */
+	cacheable = arraylen <= SWITCH_MAX_CODECS && codec_list_cache_key(key, sizeof(key), arraylen, prefs, preflen);
+
+	switch_mutex_lock(loadable_modules.mutex);
+	gen = loadable_modules.codec_list_cache_gen;
+
+	if (cacheable && (entry = (codec_list_cache_entry_t *) switch_core_hash_find(loadable_modules.codec_list_cache, key))) {
+		for (x = 0; x < entry->count; x++) {
+			array[x] = entry->array[x];
+		}
+
+		for (x = 0; x < SWITCH_MAX_CODECS && x <= entry->count; x++) {
+			if (entry->fmtp[x]) {
+				switch_set_string(fmtp_array[x], entry->fmtp[x]);
+			}
+		}
+
+		/* the entry may be flushed as soon as the lock is released */
+		i = entry->count;
+		switch_mutex_unlock(loadable_modules.mutex);
+		return i;
+	}
+	switch_mutex_unlock(loadable_modules.mutex);
+
+	i = get_codecs_sorted(array, fmtp_array, fmtp_set, arraylen, prefs, preflen);
+
+	if (!cacheable || i > SWITCH_MAX_CODECS) {
+		return i;
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	entry->count = i;
+
+	for (x = 0; x < i; x++) {
+		entry->array[x] = array[x];
+	}
+
+	for (x = 0; x < SWITCH_MAX_CODECS + 1; x++) {
+		if (fmtp_set[x]) {
+			entry->fmtp[x] = strdup(fmtp_array[x]);
+		}
+	}
+
+	switch_mutex_lock(loadable_modules.mutex);
+	/* a codec module came or went while we were looking, the answer may already be stale */
+	if (gen != loadable_modules.codec_list_cache_gen || switch_core_hash_find(loadable_modules.codec_list_cache, key)) {
+		codec_list_cache_destroy(entry);
+	} else {
+		if (loadable_modules.codec_list_cache_size >= CODEC_LIST_CACHE_MAX) {
+			codec_list_cache_flush();
+		}
+
+		switch_core_hash_insert_destructor(loadable_modules.codec_list_cache, key, entry, codec_list_cache_destroy);
+		loadable_modules.codec_list_cache_size++;
+	}
+	switch_mutex_unlock(loadable_modules.mutex);
+
+	return i;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_api_execute(const char *cmd, const char *arg, switch_core_session_t *session, switch_stream_handle_t *stream)
 {
 	switch_api_interface_t *api;
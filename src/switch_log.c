@@ -32,6 +32,9 @@
 
 #include <switch.h>
 #include "private/switch_core_pvt.h"
+#ifndef WIN32
+#include <pthread.h>
+#endif
 
 static const char *LEVELS[] = {
 	"DISABLE",
@@ -59,9 +62,6 @@ static switch_memory_pool_t *LOG_POOL = NULL;
 static switch_log_binding_t *BINDINGS = NULL;
 static switch_mutex_t *BINDLOCK = NULL;
 static switch_queue_t *LOG_QUEUE = NULL;
-#ifdef SWITCH_LOG_RECYCLE
-static switch_queue_t *LOG_RECYCLE_QUEUE = NULL;
-#endif
 static int8_t THREAD_RUNNING = 0;
 static uint8_t MAX_LEVEL = 0;
 static int mods_loaded = 0;
@@ -223,34 +223,115 @@ SWITCH_DECLARE(cJSON *) switch_log_node_to_json(const switch_log_node_t *node, i
 	return json;
 }
 
-static switch_log_node_t *switch_log_node_alloc()
+/*
+ * Log nodes carry their text inline so the common log line costs one node from
+ * the cache and no malloc.  Lines that don't fit spill their strings to the heap.
+ * Nodes released by the logger thread go back to a capped free list.
+ */
+
+#define LOG_NODE_BUFLEN 1024
+#define LOG_NODE_CACHE_MAX 1024
+
+/* switch_log_node_t must stay the first member, loggers only ever see the node */
+typedef struct log_slab_node_s {
+	switch_log_node_t node;
+	struct log_slab_node_s *next;
+	char buf[LOG_NODE_BUFLEN];
+} log_slab_node_t;
+
+#define log_node_inline(_slab, _p) ((_p) >= (_slab)->buf && (_p) < (_slab)->buf + sizeof((_slab)->buf))
+
+static struct {
+	switch_mutex_t *mutex;
+	log_slab_node_t *head;
+	uint32_t count;
+	switch_atomic_t dropped;
+	uint32_t dropped_reported;
+#ifndef WIN32
+	pthread_key_t date_key;
+	int date_key_ok;
+#endif
+} LOG_CACHE;
+
+typedef struct log_date_cache_s {
+	int64_t sec;
+	char date[32];
+} log_date_cache_t;
+
+static log_slab_node_t *log_slab_alloc(void)
 {
-	switch_log_node_t *node = NULL;
-#ifdef SWITCH_LOG_RECYCLE
-	void *pop = NULL;
+	log_slab_node_t *slab = NULL;
 
-	if (switch_queue_trypop(LOG_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS) {
-		node = (switch_log_node_t *) pop;
+	if (LOG_CACHE.mutex) {
+		switch_mutex_lock(LOG_CACHE.mutex);
+		if ((slab = LOG_CACHE.head)) {
+			LOG_CACHE.head = slab->next;
+			LOG_CACHE.count--;
+		}
+		switch_mutex_unlock(LOG_CACHE.mutex);
+	}
+
+	if (!slab) {
+		slab = malloc(sizeof(*slab));
+		switch_assert(slab);
+	}
+
+	memset(&slab->node, 0, sizeof(slab->node));
+	slab->next = NULL;
+
+	return slab;
+}
+
+static void log_slab_release(log_slab_node_t *slab)
+{
+	if (LOG_CACHE.mutex) {
+		switch_mutex_lock(LOG_CACHE.mutex);
+		if (LOG_CACHE.count < LOG_NODE_CACHE_MAX) {
+			slab->next = LOG_CACHE.head;
+			LOG_CACHE.head = slab;
+			LOG_CACHE.count++;
+			slab = NULL;
+		}
+		switch_mutex_unlock(LOG_CACHE.mutex);
+	}
+
+	if (slab) {
+		free(slab);
+	}
+}
+
+/* copies str into the unused tail of the node buffer, or the heap when it doesn't fit */
+static char *log_slab_strdup(log_slab_node_t *slab, switch_size_t *used, const char *str)
+{
+	switch_size_t len = strlen(str) + 1;
+	char *p;
+
+	if (*used + len <= sizeof(slab->buf)) {
+		p = slab->buf + *used;
+		*used += len;
+		memcpy(p, str, len);
 	} else {
-#endif
-		node = malloc(sizeof(*node));
-		switch_assert(node);
-#ifdef SWITCH_LOG_RECYCLE
+		p = strdup(str);
+		switch_assert(p);
 	}
-#endif
-	return node;
+
+	return p;
 }
 
 SWITCH_DECLARE(switch_log_node_t *) switch_log_node_dup(const switch_log_node_t *node)
 {
-	switch_log_node_t *newnode = switch_log_node_alloc();
+	log_slab_node_t *slab = log_slab_alloc();
+	switch_log_node_t *newnode = &slab->node;
+	switch_size_t used = 0;
 
 	*newnode = *node;
 	newnode->content = NULL;
+	newnode->data = NULL;
+	newnode->userdata = NULL;
+	newnode->tags = NULL;
 
 	if (node->data) {
-		newnode->data = strdup(node->data);
-		switch_assert(newnode->data);
+		newnode->data = log_slab_strdup(slab, &used, node->data);
 
 		// content is a pointer inside data; need to calculate the new pointer
 		if (node->content && node->content >= node->data) {
@@ -259,8 +340,7 @@ SWITCH_DECLARE(switch_log_node_t *) switch_log_node_dup(const switch_log_node_t
 	}
 
 	if (node->userdata) {
-		newnode->userdata = strdup(node->userdata);
-		switch_assert(newnode->userdata);
+		newnode->userdata = log_slab_strdup(slab, &used, node->userdata);
 	}
 
 	if (node->tags) {
@@ -281,22 +361,65 @@ SWITCH_DECLARE(void) switch_log_node_free(switch_log_node_t **pnode)
 	node = *pnode;
 
 	if (node) {
-		switch_safe_free(node->userdata);
-		switch_safe_free(node->data);
+		log_slab_node_t *slab = (log_slab_node_t *) node;
+
+		if (node->userdata && !log_node_inline(slab, node->userdata)) {
+			free(node->userdata);
+		}
+		if (node->data && !log_node_inline(slab, node->data)) {
+			free(node->data);
+		}
 		if (node->tags) {
 			switch_event_destroy(&node->tags);
 		}
-#ifdef SWITCH_LOG_RECYCLE
-		if (switch_queue_trypush(LOG_RECYCLE_QUEUE, node) != SWITCH_STATUS_SUCCESS) {
-			free(node);
-		}
-#else
-		free(node);
-#endif
+		log_slab_release(slab);
 	}
 	*pnode = NULL;
 }
 
+SWITCH_DECLARE(uint32_t) switch_log_get_dropped(void)
+{
+	return switch_atomic_read(&LOG_CACHE.dropped);
+}
+
+#ifndef WIN32
+static void log_date_cache_destroy(void *ptr)
+{
+	free(ptr);
+}
+#endif
+
+/* "YYYY-MM-DD hh:mm:ss.uuuuuu", the part up to the seconds is rendered once per second per thread */
+static void log_format_date(switch_time_t now, char *buf, switch_size_t len)
+{
+	switch_time_exp_t tm;
+#ifndef WIN32
+	log_date_cache_t *cache = NULL;
+
+	if (LOG_CACHE.date_key_ok && !(cache = pthread_getspecific(LOG_CACHE.date_key))) {
+		if ((cache = calloc(1, sizeof(*cache)))) {
+			cache->sec = -1;
+			pthread_setspecific(LOG_CACHE.date_key, cache);
+		}
+	}
+
+	if (cache) {
+		if (cache->sec != now / 1000000) {
+			switch_time_exp_lt(&tm, now);
+			switch_snprintf(cache->date, sizeof(cache->date), "%0.4d-%0.2d-%0.2d %0.2d:%0.2d:%0.2d",
+							tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+			cache->sec = now / 1000000;
+		}
+		switch_snprintf(buf, len, "%s.%0.6d", cache->date, (int) (now % 1000000));
+		return;
+	}
+#endif
+
+	switch_time_exp_lt(&tm, now);
+	switch_snprintf(buf, len, "%0.4d-%0.2d-%0.2d %0.2d:%0.2d:%0.2d.%0.6d",
+					tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_usec);
+}
+
 SWITCH_DECLARE(const char *) switch_log_level2str(switch_log_level_t level)
 {
 	if (level > SWITCH_LOG_DEBUG) {
@@ -413,6 +536,16 @@ SWITCH_DECLARE(switch_status_t) switch_log_unbind_logger(switch_log_function_t f
 		}
 		last = ptr;
 	}
+
+	if (status == SWITCH_STATUS_SUCCESS) {
+		/* let lines nobody listens to anymore be skipped before they are formatted */
+		MAX_LEVEL = 0;
+		for (ptr = BINDINGS; ptr; ptr = ptr->next) {
+			if ((uint8_t) ptr->level > MAX_LEVEL) {
+				MAX_LEVEL = ptr->level;
+			}
+		}
+	}
 	switch_mutex_unlock(BINDLOCK);
 
 	return status;
@@ -487,6 +620,13 @@ static void *SWITCH_THREAD_FUNC log_thread(switch_thread_t *t, void *obj)
 
 		switch_log_node_free(&node);
 
+		if (switch_atomic_read(&LOG_CACHE.dropped) != LOG_CACHE.dropped_reported && switch_queue_size(LOG_QUEUE) < SWITCH_CORE_QUEUE_LEN / 2) {
+			uint32_t dropped = switch_atomic_read(&LOG_CACHE.dropped);
+
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Log queue overflow, %u line%s dropped (%u total)\n",
+							  dropped - LOG_CACHE.dropped_reported, dropped - LOG_CACHE.dropped_reported == 1 ? "" : "s", dropped);
+			LOG_CACHE.dropped_reported = dropped;
+		}
 	}
 
 	THREAD_RUNNING = 0;
@@ -509,21 +649,18 @@ SWITCH_DECLARE(void) switch_log_vprintf(switch_text_channel_t channel, const cha
 										const char *userdata, switch_log_level_t level, const char *fmt, va_list ap)
 {
 	char *data = NULL;
-	char *new_fmt = NULL;
 	int ret = 0;
 	FILE *handle;
 	const char *filep = (file ? switch_cut_path(file) : "");
 	const char *funcp = (func ? func : "");
 	char *content = NULL;
 	switch_time_t now = switch_micro_time_now();
-	uint32_t len;
-#ifdef SWITCH_FUNC_IN_LOG
-	const char *extra_fmt = "%s [%s] %s:%d %s()%c%s";
-#else
-	const char *extra_fmt = "%s [%s] %s:%d%c%s";
-#endif
 	switch_log_level_t limit_level = runtime.hard_log_level;
 	switch_log_level_t special_level = SWITCH_LOG_UNINIT;
+	switch_bool_t to_console, to_mods;
+	log_slab_node_t *slab = NULL;
+	switch_size_t used = 0, prefix = 0;
+	va_list ap2;
 
 	if (limit_level == SWITCH_LOG_DISABLE) {
 		return;
@@ -553,48 +690,61 @@ SWITCH_DECLARE(void) switch_log_vprintf(switch_text_channel_t channel, const cha
 
 	handle = switch_core_data_channel(channel);
 
-	if (channel != SWITCH_CHANNEL_ID_LOG_CLEAN) {
-		char date[80] = "";
-		//switch_size_t retsize;
-		switch_time_exp_t tm;
+	to_console = (console_mods_loaded == 0 || !do_mods) && handle;
+	to_mods = do_mods && level <= MAX_LEVEL;
 
-		switch_time_exp_lt(&tm, now);
-		switch_snprintf(date, sizeof(date), "%0.4d-%0.2d-%0.2d %0.2d:%0.2d:%0.2d.%0.6d",
-						tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_usec);
+	/* nothing would print or receive this line, don't render it */
+	if (channel != SWITCH_CHANNEL_ID_EVENT && !to_console && !to_mods) {
+		return;
+	}
 
-		//switch_strftime_nocheck(date, &retsize, sizeof(date), "%Y-%m-%d %T", &tm);
+	slab = log_slab_alloc();
 
+	if (channel != SWITCH_CHANNEL_ID_LOG_CLEAN) {
+		char date[80] = "";
+
+		log_format_date(now, date, sizeof(date));
 #ifdef SWITCH_FUNC_IN_LOG
-		len = (uint32_t) (strlen(extra_fmt) + strlen(date) + strlen(filep) + 32 + strlen(funcp) + strlen(fmt));
+		ret = switch_snprintf(slab->buf, sizeof(slab->buf) - 1, "%s [%s] %s:%d %s()", date, switch_log_level2str(level), filep, line, funcp);
 #else
-		len = (uint32_t) (strlen(extra_fmt) + strlen(date) + strlen(filep) + 32 + strlen(fmt));
+		ret = switch_snprintf(slab->buf, sizeof(slab->buf) - 1, "%s [%s] %s:%d", date, switch_log_level2str(level), filep, line);
 #endif
-		new_fmt = malloc(len + 1);
-		switch_assert(new_fmt);
-#ifdef SWITCH_FUNC_IN_LOG
-		switch_snprintf(new_fmt, len, extra_fmt, date, switch_log_level2str(level), filep, line, funcp, 128, fmt);
+		prefix = used = (switch_size_t) ret < sizeof(slab->buf) - 1 ? (switch_size_t) ret : sizeof(slab->buf) - 2;
+		slab->buf[used++] = ' ';
+	}
+
+#ifdef _MSC_VER
+	ap2 = ap;
 #else
-		switch_snprintf(new_fmt, len, extra_fmt, date, switch_log_level2str(level), filep, line, 128, fmt);
+	va_copy(ap2, ap);
 #endif
 
-		fmt = new_fmt;
-	}
-
-	ret = switch_vasprintf(&data, fmt, ap);
+	ret = vsnprintf(slab->buf + used, sizeof(slab->buf) - used, fmt, ap);
 
-	if (ret == -1) {
+	if (ret < 0) {
+		va_end(ap2);
 		fprintf(stderr, "Memory Error\n");
 		goto end;
 	}
 
-	if (channel == SWITCH_CHANNEL_ID_LOG_CLEAN) {
-		content = data;
+	if ((switch_size_t) ret < sizeof(slab->buf) - used) {
+		data = slab->buf;
+		used += ret + 1;
 	} else {
-		if ((content = strchr(data, 128))) {
-			*content = ' ';
-		}
+		/* too long for the node, render it again on the heap */
+		data = malloc(used + ret + 1);
+		switch_assert(data);
+		memcpy(data, slab->buf, used);
+		vsnprintf(data + used, ret + 1, fmt, ap2);
+		/* the node buffer is free again for the uuid */
+		used = 0;
 	}
 
+	va_end(ap2);
+
+	/* content starts at the space that separates it from the prefix */
+	content = data + prefix;
+
 	if (channel == SWITCH_CHANNEL_ID_EVENT) {
 		switch_event_t *event;
 		if (switch_event_running() == SWITCH_STATUS_SUCCESS && switch_event_create(&event, SWITCH_EVENT_LOG) == SWITCH_STATUS_SUCCESS) {
@@ -607,52 +757,49 @@ SWITCH_DECLARE(void) switch_log_vprintf(switch_text_channel_t channel, const cha
 				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "User-Data", userdata);
 			}
 			switch_event_fire(&event);
-			data = NULL;
 		}
 
 		goto end;
 	}
 
-	if (console_mods_loaded == 0 || !do_mods) {
-		if (handle) {
-			int aok = 1;
+	if (to_console) {
+		int aok = 1;
 #ifndef WIN32
 
-			fd_set can_write;
-			int fd;
-			struct timeval to;
-
-			fd = fileno(handle);
-			memset(&to, 0, sizeof(to));
-			FD_ZERO(&can_write);
-			FD_SET(fd, &can_write);
-			to.tv_sec = 0;
-			to.tv_usec = 100000;
-			if (select(fd + 1, NULL, &can_write, NULL, &to) > 0) {
-				aok = FD_ISSET(fd, &can_write);
-			} else {
-				aok = 0;
-			}
+		fd_set can_write;
+		int fd;
+		struct timeval to;
+
+		fd = fileno(handle);
+		memset(&to, 0, sizeof(to));
+		FD_ZERO(&can_write);
+		FD_SET(fd, &can_write);
+		to.tv_sec = 0;
+		to.tv_usec = 100000;
+		if (select(fd + 1, NULL, &can_write, NULL, &to) > 0) {
+			aok = FD_ISSET(fd, &can_write);
+		} else {
+			aok = 0;
+		}
 #endif
-			if (aok) {
-				if (COLORIZE) {
+		if (aok) {
+			if (COLORIZE) {
 
 #ifdef WIN32
-					SetConsoleTextAttribute(hStdout, COLORS[level]);
-					WriteFile(hStdout, data, (DWORD) strlen(data), NULL, NULL);
-					SetConsoleTextAttribute(hStdout, wOldColorAttrs);
+				SetConsoleTextAttribute(hStdout, COLORS[level]);
+				WriteFile(hStdout, data, (DWORD) strlen(data), NULL, NULL);
+				SetConsoleTextAttribute(hStdout, wOldColorAttrs);
 #else
-					fprintf(handle, "%s%s%s", COLORS[level], data, SWITCH_SEQ_DEFAULT_COLOR);
+				fprintf(handle, "%s%s%s", COLORS[level], data, SWITCH_SEQ_DEFAULT_COLOR);
 #endif
-				} else {
-					fprintf(handle, "%s", data);
-				}
+			} else {
+				fprintf(handle, "%s", data);
 			}
 		}
 	}
 
-	if (do_mods && level <= MAX_LEVEL) {
-		switch_log_node_t *node = switch_log_node_alloc();
+	if (to_mods) {
+		switch_log_node_t *node = &slab->node;
 
 		node->data = data;
 		data = NULL;
@@ -667,23 +814,31 @@ SWITCH_DECLARE(void) switch_log_vprintf(switch_text_channel_t channel, const cha
 		node->tags = NULL;
 		if (channel == SWITCH_CHANNEL_ID_SESSION) {
 			switch_core_session_t *session = (switch_core_session_t *) userdata;
-			node->userdata = userdata ? strdup(switch_core_session_get_uuid(session)) : NULL;
+			node->userdata = userdata ? log_slab_strdup(slab, &used, switch_core_session_get_uuid(session)) : NULL;
 			if (session) {
 				switch_channel_get_log_tags(switch_core_session_get_channel(session), &node->tags);
 			}
 		} else {
-			node->userdata = !zstr(userdata) ? strdup(userdata) : NULL;
+			node->userdata = !zstr(userdata) ? log_slab_strdup(slab, &used, userdata) : NULL;
 		}
 
+		slab = NULL;
+
 		if (switch_queue_trypush(LOG_QUEUE, node) != SWITCH_STATUS_SUCCESS) {
+			switch_atomic_inc(&LOG_CACHE.dropped);
 			switch_log_node_free(&node);
 		}
 	}
 
   end:
 
-	switch_safe_free(data);
-	switch_safe_free(new_fmt);
+	if (data && (!slab || data != slab->buf)) {
+		free(data);
+	}
+
+	if (slab) {
+		log_slab_release(slab);
+	}
 
 }
 
@@ -698,8 +853,12 @@ SWITCH_DECLARE(switch_status_t) switch_log_init(switch_memory_pool_t *pool, swit
 	switch_threadattr_create(&thd_attr, LOG_POOL);
 
 	switch_queue_create(&LOG_QUEUE, SWITCH_CORE_QUEUE_LEN, LOG_POOL);
-#ifdef SWITCH_LOG_RECYCLE
-	switch_queue_create(&LOG_RECYCLE_QUEUE, SWITCH_CORE_QUEUE_LEN, LOG_POOL);
+	switch_mutex_init(&LOG_CACHE.mutex, SWITCH_MUTEX_NESTED, LOG_POOL);
+#ifndef WIN32
+	/* the key outlives a core restart, threads may still hold a date cache */
+	if (!LOG_CACHE.date_key_ok && !pthread_key_create(&LOG_CACHE.date_key, log_date_cache_destroy)) {
+		LOG_CACHE.date_key_ok = 1;
+	}
 #endif
 	switch_mutex_init(&BINDLOCK, SWITCH_MUTEX_NESTED, LOG_POOL);
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
@@ -727,18 +886,29 @@ SWITCH_DECLARE(switch_status_t) switch_log_init(switch_memory_pool_t *pool, swit
 
 SWITCH_DECLARE(void) switch_core_memory_reclaim_logger(void)
 {
-#ifdef SWITCH_LOG_RECYCLE
-	void *pop;
-	int size = switch_queue_size(LOG_RECYCLE_QUEUE);
-	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_CONSOLE, "Returning %d recycled log node(s) %d bytes\n", size,
-					  (int) sizeof(switch_log_node_t) * size);
-	while (switch_queue_trypop(LOG_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS) {
-		switch_log_node_free(&pop);
+	log_slab_node_t *list, *slab;
+	uint32_t count;
+
+	if (!LOG_CACHE.mutex) {
+		return;
 	}
-#else
-	return;
-#endif
 
+	switch_mutex_lock(LOG_CACHE.mutex);
+	list = LOG_CACHE.head;
+	count = LOG_CACHE.count;
+	LOG_CACHE.head = NULL;
+	LOG_CACHE.count = 0;
+	switch_mutex_unlock(LOG_CACHE.mutex);
+
+	while ((slab = list)) {
+		list = slab->next;
+		free(slab);
+	}
+
+	if (count && THREAD_RUNNING) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %u cached log node(s) %u bytes\n", count,
+						  count * (uint32_t) sizeof(log_slab_node_t));
+	}
 }
 
 SWITCH_DECLARE(switch_status_t) switch_log_shutdown(void)
@@ -754,6 +924,8 @@ SWITCH_DECLARE(switch_status_t) switch_log_shutdown(void)
 	switch_thread_join(&st, thread);
 
 	switch_core_memory_reclaim_logger();
+	/* the pool is going away with the mutex, late lines fall back to malloc */
+	LOG_CACHE.mutex = NULL;
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -154,9 +154,8 @@ static switch_status_t switch_g711u_encode(switch_codec_t *codec,
 	dbuf = decoded_data;
 	ebuf = encoded_data;
 
-	for (i = 0; i < decoded_data_len / sizeof(short); i++) {
-		ebuf[i] = linear_to_ulaw(dbuf[i]);
-	}
+	i = decoded_data_len / sizeof(short);
+	switch_sln_to_ulaw(dbuf, ebuf, i);
 
 	*encoded_data_len = i;
 
@@ -172,7 +171,6 @@ static switch_status_t switch_g711u_decode(switch_codec_t *codec,
 {
 	short *dbuf;
 	unsigned char *ebuf;
-	uint32_t i;
 
 	dbuf = decoded_data;
 	ebuf = encoded_data;
@@ -181,11 +179,9 @@ static switch_status_t switch_g711u_decode(switch_codec_t *codec,
 		memset(dbuf, 0, codec->implementation->decoded_bytes_per_packet);
 		*decoded_data_len = codec->implementation->decoded_bytes_per_packet;
 	} else {
-		for (i = 0; i < encoded_data_len; i++) {
-			dbuf[i] = ulaw_to_linear(ebuf[i]);
-		}
+		switch_ulaw_to_sln(ebuf, dbuf, encoded_data_len);
 
-		*decoded_data_len = i * 2;
+		*decoded_data_len = encoded_data_len * 2;
 	}
 
 	return SWITCH_STATUS_SUCCESS;
@@ -225,9 +221,8 @@ static switch_status_t switch_g711a_encode(switch_codec_t *codec,
 	dbuf = decoded_data;
 	ebuf = encoded_data;
 
-	for (i = 0; i < decoded_data_len / sizeof(short); i++) {
-		ebuf[i] = linear_to_alaw(dbuf[i]);
-	}
+	i = decoded_data_len / sizeof(short);
+	switch_sln_to_alaw(dbuf, ebuf, i);
 
 	*encoded_data_len = i;
 
@@ -243,7 +238,6 @@ static switch_status_t switch_g711a_decode(switch_codec_t *codec,
 {
 	short *dbuf;
 	unsigned char *ebuf;
-	uint32_t i;
 
 	dbuf = decoded_data;
 	ebuf = encoded_data;
@@ -252,11 +246,9 @@ static switch_status_t switch_g711a_decode(switch_codec_t *codec,
 		memset(dbuf, 0, codec->implementation->decoded_bytes_per_packet);
 		*decoded_data_len = codec->implementation->decoded_bytes_per_packet;
 	} else {
-		for (i = 0; i < encoded_data_len; i++) {
-			dbuf[i] = alaw_to_linear(ebuf[i]);
-		}
+		switch_alaw_to_sln(ebuf, dbuf, encoded_data_len);
 
-		*decoded_data_len = i * 2;
+		*decoded_data_len = encoded_data_len * 2;
 	}
 
 	return SWITCH_STATUS_SUCCESS;
@@ -32,10 +32,27 @@
 
 #include <switch.h>
 #include <switch_resample.h>
+#include "private/switch_core_pvt.h"
 #ifndef WIN32
 #include <switch_private.h>
 #endif
 #include <speex/speex_resampler.h>
+#include <g711.h>
+
+/* Vector kernels for the per frame PCM helpers, picked at runtime from what the cpu supports.
+   Each kernel handles whole blocks and returns how far it got so the scalar loop finishes the tail. */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SWITCH_PCM_SSE2 1
+#include <emmintrin.h>
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define SWITCH_PCM_AVX2 1
+#define PCM_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define SWITCH_PCM_NEON 1
+#include <arm_neon.h>
+#endif
 
 #define NORMFACT (float)0x8000
 #define MAXSAMPLE (float)0x7FFF
@@ -52,10 +69,15 @@
 
 #define resample_buffer(a, b, c) a > b ? ((a / 1000) / 2) * c : ((b / 1000) / 2) * c
 
-SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
-															   uint32_t from_rate, uint32_t to_rate,
-															   uint32_t to_size,
-															   int quality, uint32_t channels, const char *file, const char *func, int line)
+static switch_status_t polyphase_create(switch_audio_resampler_t *resampler, uint32_t from_rate, uint32_t to_rate, switch_resample_tier_t tier);
+static uint32_t polyphase_process(switch_audio_resampler_t *resampler, int16_t *src, uint32_t srclen);
+static void polyphase_destroy(switch_audio_resampler_t *resampler);
+
+/* speex quality used by each tier when its ratio has no shared filter bank */
+static const int resample_tier_speex_quality[] = { SWITCH_RESAMPLE_QUALITY, 2, 5, 8 };
+
+static switch_status_t resample_create(switch_audio_resampler_t **new_resampler, uint32_t from_rate, uint32_t to_rate, uint32_t to_size,
+									   switch_resample_tier_t tier, int quality, uint32_t channels)
 {
 	int err = 0;
 	switch_audio_resampler_t *resampler;
@@ -65,11 +87,15 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 
 	if (!channels) channels = 1;
 
-	resampler->resampler = speex_resampler_init(channels, from_rate, to_rate, quality, &err);
+	resampler->channels = channels;
+
+	if (tier == SWITCH_RESAMPLE_TIER_SPEEX || polyphase_create(resampler, from_rate, to_rate, tier) != SWITCH_STATUS_SUCCESS) {
+		resampler->resampler = speex_resampler_init(channels, from_rate, to_rate, quality, &err);
 
-	if (!resampler->resampler) {
-		free(resampler);
-		return SWITCH_STATUS_GENERR;
+		if (!resampler->resampler) {
+			free(resampler);
+			return SWITCH_STATUS_GENERR;
+		}
 	}
 
 	*new_resampler = resampler;
@@ -79,7 +105,6 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 	resampler->to_rate = to_rate;
 	resampler->factor = (lto_rate / lfrom_rate);
 	resampler->rfactor = (lfrom_rate / lto_rate);
-	resampler->channels = channels;
 
 	//resampler->to_size = resample_buffer(to_rate, from_rate, (uint32_t) to_size);
 
@@ -90,9 +115,60 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static switch_resample_engine_t resample_engine = SWITCH_RESAMPLE_ENGINE_SPEEX;
+
+SWITCH_DECLARE(void) switch_resample_set_engine(switch_resample_engine_t engine)
+{
+	resample_engine = engine;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
+															   uint32_t from_rate, uint32_t to_rate,
+															   uint32_t to_size,
+															   int quality, uint32_t channels, const char *file, const char *func, int line)
+{
+	switch_resample_tier_t tier = SWITCH_RESAMPLE_TIER_SPEEX;
+
+	/* callers that don't ask for a tier keep speex unless switch.conf opts them in */
+	if (resample_engine == SWITCH_RESAMPLE_ENGINE_POLYPHASE) {
+		if (quality <= 3) {
+			tier = SWITCH_RESAMPLE_TIER_CONFERENCE;
+		} else if (quality <= 6) {
+			tier = SWITCH_RESAMPLE_TIER_ASR;
+		} else {
+			tier = SWITCH_RESAMPLE_TIER_RECORDING;
+		}
+	}
+
+	return resample_create(new_resampler, from_rate, to_rate, to_size, tier, quality, channels);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_resample_perform_create_tier(switch_audio_resampler_t **new_resampler,
+																	uint32_t from_rate, uint32_t to_rate, uint32_t to_size,
+																	switch_resample_tier_t tier, uint32_t channels, const char *file, const char *func, int line)
+{
+	if (tier > SWITCH_RESAMPLE_TIER_RECORDING) {
+		tier = SWITCH_RESAMPLE_TIER_SPEEX;
+	}
+
+	return resample_create(new_resampler, from_rate, to_rate, to_size, resample_engine == SWITCH_RESAMPLE_ENGINE_SPEEX ? SWITCH_RESAMPLE_TIER_SPEEX : tier,
+						   resample_tier_speex_quality[tier], channels);
+}
+
+SWITCH_DECLARE(const char *) switch_resample_engine_name(switch_audio_resampler_t *resampler)
+{
+	return resampler->polyphase ? "polyphase" : "speex";
+}
+
 SWITCH_DECLARE(uint32_t) switch_resample_process(switch_audio_resampler_t *resampler, int16_t *src, uint32_t srclen)
 {
-	int to_size = switch_resample_calc_buffer_size(resampler->to_rate, resampler->from_rate, srclen) / 2;
+	int to_size;
+
+	if (resampler->polyphase) {
+		return polyphase_process(resampler, src, srclen);
+	}
+
+	to_size = switch_resample_calc_buffer_size(resampler->to_rate, resampler->from_rate, srclen) / 2;
 
 	if (to_size > resampler->to_size) {
 		resampler->to_size = to_size;
@@ -112,6 +188,9 @@ SWITCH_DECLARE(void) switch_resample_destroy(switch_audio_resampler_t **resample
 		if ((*resampler)->resampler) {
 			speex_resampler_destroy((*resampler)->resampler);
 		}
+		if ((*resampler)->polyphase) {
+			polyphase_destroy(*resampler);
+		}
 		free((*resampler)->to);
 		free(*resampler);
 		*resampler = NULL;
@@ -194,6 +273,1147 @@ SWITCH_DECLARE(void) switch_swap_linear(int16_t *buf, int len)
 	}
 }
 
+static switch_simd_level_t pcm_simd_cpu = SWITCH_SIMD_NONE;
+static switch_simd_level_t pcm_simd = SWITCH_SIMD_NONE;
+static int pcm_simd_ready = 0;
+
+#if defined(SWITCH_PCM_SSE2) || defined(SWITCH_PCM_NEON)
+/* lane j of a silence block starts 6 * j generator steps ahead: state = state * mul[j] + inc[j] */
+static const uint16_t pcm_lcg_jump_mul[8] = { 1, 27193, 16561, 45417, 64097, 59801, 23825, 49865 };
+static const uint16_t pcm_lcg_jump_inc[8] = { 0, 6762, 57348, 41806, 49864, 18674, 35916, 53078 };
+#endif
+
+static switch_simd_level_t pcm_simd_init(void)
+{
+	switch_simd_level_t level = SWITCH_SIMD_NONE;
+
+#if defined(SWITCH_PCM_SSE2)
+	level = SWITCH_SIMD_SSE2;
+#if defined(SWITCH_PCM_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		level = SWITCH_SIMD_AVX2;
+	}
+#endif
+#elif defined(SWITCH_PCM_NEON)
+	level = SWITCH_SIMD_NEON;
+#endif
+
+	pcm_simd_cpu = level;
+	if (!pcm_simd_ready) {
+		pcm_simd = level;
+		pcm_simd_ready = 1;
+	}
+
+	return pcm_simd;
+}
+
+static inline switch_simd_level_t pcm_simd_get(void)
+{
+	return pcm_simd_ready ? pcm_simd : pcm_simd_init();
+}
+
+SWITCH_DECLARE(switch_simd_level_t) switch_pcm_simd_level(void)
+{
+	return pcm_simd_get();
+}
+
+SWITCH_DECLARE(switch_simd_level_t) switch_pcm_simd_set_level(switch_simd_level_t level)
+{
+	pcm_simd_get();
+
+	if (level > pcm_simd_cpu || (level != SWITCH_SIMD_NONE && pcm_simd_cpu == SWITCH_SIMD_NEON)) {
+		level = pcm_simd_cpu;
+	}
+
+	pcm_simd = level;
+
+	return pcm_simd;
+}
+
+SWITCH_DECLARE(const char *) switch_pcm_simd_name(switch_simd_level_t level)
+{
+	switch (level) {
+	case SWITCH_SIMD_SSE2:
+		return "sse2";
+	case SWITCH_SIMD_AVX2:
+		return "avx2";
+	case SWITCH_SIMD_NEON:
+		return "neon";
+	default:
+		return "none";
+	}
+}
+
+#ifdef SWITCH_PCM_SSE2
+/* pick a where mask is set, b elsewhere */
+static inline __m128i pcm_blend_sse2(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* G.711 segment of an unsigned magnitude, top_bit(mag | 0xFF) - 7, read from the exponent of its float
+   conversion, along with the 2 ^ (13 - seg) multiplier whose high product is mag >> (seg + 3) */
+static inline void pcm_segment_sse2(__m128i mag, __m128i *seg, __m128i *step)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i w = _mm_or_si128(mag, _mm_set1_epi16(0xFF));
+	__m128i lo = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero))), 23);
+	__m128i hi = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(w, zero))), 23);
+	const __m128i top = _mm_set1_epi32(274);
+
+	*seg = _mm_sub_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(127 + 7));
+	lo = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(top, lo), 23)));
+	hi = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(top, hi), 23)));
+	*step = _mm_packs_epi32(lo, hi);
+}
+
+/* per lane shifts by 0-7 built from the bits of count */
+static inline __m128i pcm_sllv_epi16_sse2(__m128i v, __m128i count)
+{
+	const __m128i one = _mm_set1_epi16(1), two = _mm_set1_epi16(2), four = _mm_set1_epi16(4);
+
+	v = pcm_blend_sse2(_mm_cmpeq_epi16(_mm_and_si128(count, one), one), _mm_slli_epi16(v, 1), v);
+	v = pcm_blend_sse2(_mm_cmpeq_epi16(_mm_and_si128(count, two), two), _mm_slli_epi16(v, 2), v);
+	return pcm_blend_sse2(_mm_cmpeq_epi16(_mm_and_si128(count, four), four), _mm_slli_epi16(v, 4), v);
+}
+
+/* (int32_t) (sample * rate) for 4 lanes, same double math as the scalar loop */
+static inline __m128i pcm_scale_epi32_sse2(__m128i v, __m128d rate)
+{
+	__m128i lo = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(v), rate));
+	__m128i hi = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), rate));
+
+	return _mm_unpacklo_epi64(lo, hi);
+}
+
+static uint32_t pcm_merge_sse2(int16_t *data, const int16_t *other, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (data + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (other + i));
+		_mm_storeu_si128((__m128i *) (data + i), _mm_adds_epi16(a, b));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_unmerge_sse2(int16_t *data, const int16_t *other, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (data + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (other + i));
+		_mm_storeu_si128((__m128i *) (data + i), _mm_sub_epi16(a, b));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_volume_sse2(int16_t *data, uint32_t len, double rate)
+{
+	const __m128d r = _mm_set1_pd(rate);
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *) (data + i));
+		__m128i lo = pcm_scale_epi32_sse2(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16), r);
+		__m128i hi = pcm_scale_epi32_sse2(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16), r);
+		_mm_storeu_si128((__m128i *) (data + i), _mm_packs_epi32(lo, hi));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_downmix_stereo_sse2(int16_t *data, uint32_t frames)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	uint32_t i;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		__m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (data + i * 2)), ones);
+		__m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (data + i * 2 + 8)), ones);
+		_mm_storeu_si128((__m128i *) (data + i), _mm_packs_epi32(a, b));
+	}
+
+	return i;
+}
+
+/* expands from the top down so it can run in place, returns the frames left at the bottom */
+static uint32_t pcm_upmix_mono_sse2(int16_t *data, uint32_t frames)
+{
+	uint32_t i = frames;
+
+	while (i >= 8) {
+		__m128i v;
+
+		i -= 8;
+		v = _mm_loadu_si128((const __m128i *) (data + i));
+		_mm_storeu_si128((__m128i *) (data + i * 2), _mm_unpacklo_epi16(v, v));
+		_mm_storeu_si128((__m128i *) (data + i * 2 + 8), _mm_unpackhi_epi16(v, v));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_silence_sse2(int16_t *data, uint32_t samples, uint32_t channels, int divisor, int16_t *rnd)
+{
+	const __m128i mul = _mm_set1_epi16(31821);
+	const __m128i inc = _mm_set1_epi16(13849);
+	const __m128i jump_mul = _mm_loadu_si128((const __m128i *) pcm_lcg_jump_mul);
+	const __m128i jump_inc = _mm_loadu_si128((const __m128i *) pcm_lcg_jump_inc);
+	const __m128 div = _mm_set1_ps((float) divisor);
+	int16_t out[8];
+	uint32_t i, j, x;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i r = _mm_add_epi16(_mm_mullo_epi16(_mm_set1_epi16(*rnd), jump_mul), jump_inc);
+		__m128i sum = _mm_setzero_si128();
+		__m128i lo, hi, s;
+
+		for (x = 0; x < 6; x++) {
+			r = _mm_add_epi16(_mm_mullo_epi16(r, mul), inc);
+			sum = _mm_add_epi16(sum, r);
+		}
+
+		*rnd = (int16_t) _mm_extract_epi16(r, 7);
+
+		/* float division truncates to the same quotient as the integer one for 16 bit dividends */
+		lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(sum, sum), 16)), div));
+		hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(sum, sum), 16)), div));
+		s = _mm_packs_epi32(lo, hi);
+
+		if (channels == 1) {
+			_mm_storeu_si128((__m128i *) (data + i), s);
+		} else {
+			_mm_storeu_si128((__m128i *) out, s);
+			for (x = 0; x < 8; x++) {
+				for (j = 0; j < channels; j++) {
+					data[(i + x) * channels + j] = out[x];
+				}
+			}
+		}
+	}
+
+	return i;
+}
+
+static uint32_t pcm_ulaw_encode_sse2(const int16_t *data, uint8_t *out, uint32_t len)
+{
+	const __m128i bias = _mm_set1_epi16(ULAW_BIAS);
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (data + i));
+		__m128i sign = _mm_srai_epi16(x, 15);
+		__m128i mag = _mm_add_epi16(_mm_sub_epi16(_mm_xor_si128(x, sign), sign), bias);
+		__m128i seg, step, code;
+
+		pcm_segment_sse2(mag, &seg, &step);
+		code = _mm_and_si128(_mm_mulhi_epu16(mag, step), _mm_set1_epi16(0x0F));
+		code = _mm_or_si128(_mm_slli_epi16(seg, 4), code);
+		code = pcm_blend_sse2(_mm_cmpgt_epi16(seg, _mm_set1_epi16(7)), _mm_set1_epi16(0x7F), code);
+		code = _mm_xor_si128(code, _mm_xor_si128(_mm_set1_epi16(0xFF), _mm_and_si128(sign, _mm_set1_epi16(0x80))));
+		_mm_storel_epi64((__m128i *) (out + i), _mm_packus_epi16(code, code));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_ulaw_decode_sse2(const uint8_t *data, int16_t *out, uint32_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi16(ULAW_BIAS);
+	const __m128i sign = _mm_set1_epi16(0x80);
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i u = _mm_xor_si128(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (data + i)), zero), _mm_set1_epi16(0xFF));
+		__m128i seg = _mm_srli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x70)), 4);
+		__m128i t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x0F)), 3), bias);
+
+		t = _mm_sub_epi16(pcm_sllv_epi16_sse2(t, seg), bias);
+		t = pcm_blend_sse2(_mm_cmpeq_epi16(_mm_and_si128(u, sign), sign), _mm_sub_epi16(zero, t), t);
+		_mm_storeu_si128((__m128i *) (out + i), t);
+	}
+
+	return i;
+}
+
+static uint32_t pcm_alaw_encode_sse2(const int16_t *data, uint8_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (data + i));
+		__m128i sign = _mm_srai_epi16(x, 15);
+		__m128i lin = _mm_sub_epi16(_mm_xor_si128(x, sign), _mm_and_si128(sign, _mm_set1_epi16(7)));
+		__m128i seg, step, code;
+
+		pcm_segment_sse2(lin, &seg, &step);
+		/* segment 0 shifts by 4 like segment 1 */
+		step = _mm_min_epi16(step, _mm_set1_epi16(1 << 12));
+		code = _mm_and_si128(_mm_mulhi_epu16(lin, step), _mm_set1_epi16(0x0F));
+		code = _mm_or_si128(_mm_slli_epi16(seg, 4), code);
+		/* a tiny step below zero encodes as the sign alone */
+		code = _mm_andnot_si128(_mm_srai_epi16(lin, 15), code);
+		code = _mm_xor_si128(code, _mm_xor_si128(_mm_set1_epi16(ALAW_AMI_MASK | 0x80), _mm_and_si128(sign, _mm_set1_epi16(0x80))));
+		_mm_storel_epi64((__m128i *) (out + i), _mm_packus_epi16(code, code));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_alaw_decode_sse2(const uint8_t *data, int16_t *out, uint32_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i sign = _mm_set1_epi16(0x80);
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i a = _mm_xor_si128(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (data + i)), zero), _mm_set1_epi16(ALAW_AMI_MASK));
+		__m128i v = _mm_slli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x0F)), 4);
+		__m128i seg = _mm_srli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x70)), 4);
+		__m128i high = pcm_sllv_epi16_sse2(_mm_add_epi16(v, _mm_set1_epi16(0x108)), _mm_sub_epi16(seg, one));
+
+		v = pcm_blend_sse2(_mm_cmpeq_epi16(seg, zero), _mm_add_epi16(v, _mm_set1_epi16(8)), high);
+		v = pcm_blend_sse2(_mm_cmpeq_epi16(_mm_and_si128(a, sign), sign), v, _mm_sub_epi16(zero, v));
+		_mm_storeu_si128((__m128i *) (out + i), v);
+	}
+
+	return i;
+}
+#endif
+
+#ifdef SWITCH_PCM_AVX2
+static inline PCM_AVX2 __m256i pcm_scale_epi32_avx2(__m256i v, __m256d rate)
+{
+	__m128i lo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), rate));
+	__m128i hi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), rate));
+
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+static PCM_AVX2 uint32_t pcm_merge_avx2(int16_t *data, const int16_t *other, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (data + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (other + i));
+		_mm256_storeu_si256((__m256i *) (data + i), _mm256_adds_epi16(a, b));
+	}
+
+	return i;
+}
+
+static PCM_AVX2 uint32_t pcm_unmerge_avx2(int16_t *data, const int16_t *other, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (data + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (other + i));
+		_mm256_storeu_si256((__m256i *) (data + i), _mm256_sub_epi16(a, b));
+	}
+
+	return i;
+}
+
+static PCM_AVX2 uint32_t pcm_volume_avx2(int16_t *data, uint32_t len, double rate)
+{
+	const __m256d r = _mm256_set1_pd(rate);
+	uint32_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m256i s = _mm256_loadu_si256((const __m256i *) (data + i));
+		__m256i lo = pcm_scale_epi32_avx2(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)), r);
+		__m256i hi = pcm_scale_epi32_avx2(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)), r);
+		/* packs works per 128 bit lane, put the quarters back in order */
+		_mm256_storeu_si256((__m256i *) (data + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+	}
+
+	return i;
+}
+
+static PCM_AVX2 uint32_t pcm_downmix_stereo_avx2(int16_t *data, uint32_t frames)
+{
+	const __m256i ones = _mm256_set1_epi16(1);
+	uint32_t i;
+
+	for (i = 0; i + 16 <= frames; i += 16) {
+		__m256i a = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (data + i * 2)), ones);
+		__m256i b = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (data + i * 2 + 16)), ones);
+		_mm256_storeu_si256((__m256i *) (data + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+	}
+
+	return i;
+}
+#endif
+
+#ifdef SWITCH_PCM_NEON
+static uint32_t pcm_merge_neon(int16_t *data, const int16_t *other, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		vst1q_s16(data + i, vqaddq_s16(vld1q_s16(data + i), vld1q_s16(other + i)));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_unmerge_neon(int16_t *data, const int16_t *other, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		vst1q_s16(data + i, vsubq_s16(vld1q_s16(data + i), vld1q_s16(other + i)));
+	}
+
+	return i;
+}
+
+static inline int32x2_t pcm_scale_s32_neon(int32x2_t v, float64x2_t rate)
+{
+	return vmovn_s64(vcvtq_s64_f64(vmulq_f64(vcvtq_f64_s64(vmovl_s32(v)), rate)));
+}
+
+static uint32_t pcm_volume_neon(int16_t *data, uint32_t len, double rate)
+{
+	const float64x2_t r = vdupq_n_f64(rate);
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		int16x8_t s = vld1q_s16(data + i);
+		int32x4_t lo = vmovl_s16(vget_low_s16(s));
+		int32x4_t hi = vmovl_s16(vget_high_s16(s));
+
+		lo = vcombine_s32(pcm_scale_s32_neon(vget_low_s32(lo), r), pcm_scale_s32_neon(vget_high_s32(lo), r));
+		hi = vcombine_s32(pcm_scale_s32_neon(vget_low_s32(hi), r), pcm_scale_s32_neon(vget_high_s32(hi), r));
+		vst1q_s16(data + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_downmix_stereo_neon(int16_t *data, uint32_t frames)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		int16x8x2_t v = vld2q_s16(data + i * 2);
+		vst1q_s16(data + i, vqaddq_s16(v.val[0], v.val[1]));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_upmix_mono_neon(int16_t *data, uint32_t frames)
+{
+	uint32_t i = frames;
+
+	while (i >= 8) {
+		int16x8x2_t v;
+
+		i -= 8;
+		v.val[0] = v.val[1] = vld1q_s16(data + i);
+		vst2q_s16(data + i * 2, v);
+	}
+
+	return i;
+}
+
+static uint32_t pcm_silence_neon(int16_t *data, uint32_t samples, uint32_t channels, int divisor, int16_t *rnd)
+{
+	const int16x8_t mul = vdupq_n_s16(31821);
+	const int16x8_t inc = vdupq_n_s16(13849);
+	const int16x8_t jump_mul = vreinterpretq_s16_u16(vld1q_u16(pcm_lcg_jump_mul));
+	const int16x8_t jump_inc = vreinterpretq_s16_u16(vld1q_u16(pcm_lcg_jump_inc));
+	const float32x4_t div = vdupq_n_f32((float) divisor);
+	int16_t out[8];
+	uint32_t i, j, x;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t r = vaddq_s16(vmulq_s16(vdupq_n_s16(*rnd), jump_mul), jump_inc);
+		int16x8_t sum = vdupq_n_s16(0);
+		int32x4_t lo, hi;
+		int16x8_t s;
+
+		for (x = 0; x < 6; x++) {
+			r = vaddq_s16(vmulq_s16(r, mul), inc);
+			sum = vaddq_s16(sum, r);
+		}
+
+		*rnd = vgetq_lane_s16(r, 7);
+
+		lo = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(sum))), div));
+		hi = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(sum))), div));
+		s = vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi));
+
+		if (channels == 1) {
+			vst1q_s16(data + i, s);
+		} else {
+			vst1q_s16(out, s);
+			for (x = 0; x < 8; x++) {
+				for (j = 0; j < channels; j++) {
+					data[(i + x) * channels + j] = out[x];
+				}
+			}
+		}
+	}
+
+	return i;
+}
+
+static uint32_t pcm_ulaw_encode_neon(const int16_t *data, uint8_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		int16x8_t x = vld1q_s16(data + i);
+		int16x8_t sign = vshrq_n_s16(x, 15);
+		uint16x8_t mag = vaddq_u16(vreinterpretq_u16_s16(vabsq_s16(x)), vdupq_n_u16(ULAW_BIAS));
+		int16x8_t seg = vsubq_s16(vdupq_n_s16(8), vreinterpretq_s16_u16(vclzq_u16(vorrq_u16(mag, vdupq_n_u16(0xFF)))));
+		uint16x8_t code = vandq_u16(vshlq_u16(mag, vnegq_s16(vaddq_s16(seg, vdupq_n_s16(3)))), vdupq_n_u16(0x0F));
+
+		code = vorrq_u16(vreinterpretq_u16_s16(vshlq_n_s16(seg, 4)), code);
+		code = vbslq_u16(vceqq_s16(seg, vdupq_n_s16(8)), vdupq_n_u16(0x7F), code);
+		code = veorq_u16(code, veorq_u16(vdupq_n_u16(0xFF), vandq_u16(vreinterpretq_u16_s16(sign), vdupq_n_u16(0x80))));
+		vst1_u8(out + i, vmovn_u16(code));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_ulaw_decode_neon(const uint8_t *data, int16_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		uint16x8_t u = veorq_u16(vmovl_u8(vld1_u8(data + i)), vdupq_n_u16(0xFF));
+		int16x8_t seg = vreinterpretq_s16_u16(vshrq_n_u16(vandq_u16(u, vdupq_n_u16(0x70)), 4));
+		uint16x8_t t = vaddq_u16(vshlq_n_u16(vandq_u16(u, vdupq_n_u16(0x0F)), 3), vdupq_n_u16(ULAW_BIAS));
+		int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vshlq_u16(t, seg)), vdupq_n_s16(ULAW_BIAS));
+
+		vst1q_s16(out + i, vbslq_s16(vtstq_u16(u, vdupq_n_u16(0x80)), vnegq_s16(v), v));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_alaw_encode_neon(const int16_t *data, uint8_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		int16x8_t x = vld1q_s16(data + i);
+		int16x8_t sign = vshrq_n_s16(x, 15);
+		int16x8_t lin = vsubq_s16(veorq_s16(x, sign), vandq_s16(sign, vdupq_n_s16(7)));
+		int16x8_t seg = vsubq_s16(vdupq_n_s16(8), vclzq_s16(vorrq_s16(lin, vdupq_n_s16(0xFF))));
+		int16x8_t shift = vaddq_s16(vmaxq_s16(seg, vdupq_n_s16(1)), vdupq_n_s16(3));
+		int16x8_t code = vandq_s16(vshlq_s16(lin, vnegq_s16(shift)), vdupq_n_s16(0x0F));
+
+		code = vorrq_s16(vshlq_n_s16(seg, 4), code);
+		/* a tiny step below zero encodes as the sign alone */
+		code = vbicq_s16(code, vshrq_n_s16(lin, 15));
+		code = veorq_s16(code, veorq_s16(vdupq_n_s16(ALAW_AMI_MASK | 0x80), vandq_s16(sign, vdupq_n_s16(0x80))));
+		vst1_u8(out + i, vmovn_u16(vreinterpretq_u16_s16(code)));
+	}
+
+	return i;
+}
+
+static uint32_t pcm_alaw_decode_neon(const uint8_t *data, int16_t *out, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		uint16x8_t a = veorq_u16(vmovl_u8(vld1_u8(data + i)), vdupq_n_u16(ALAW_AMI_MASK));
+		uint16x8_t v = vshlq_n_u16(vandq_u16(a, vdupq_n_u16(0x0F)), 4);
+		uint16x8_t seg = vshrq_n_u16(vandq_u16(a, vdupq_n_u16(0x70)), 4);
+		uint16x8_t high = vshlq_u16(vaddq_u16(v, vdupq_n_u16(0x108)), vsubq_s16(vreinterpretq_s16_u16(seg), vdupq_n_s16(1)));
+		int16x8_t r;
+
+		v = vbslq_u16(vceqq_u16(seg, vdupq_n_u16(0)), vaddq_u16(v, vdupq_n_u16(8)), high);
+		r = vreinterpretq_s16_u16(v);
+		vst1q_s16(out + i, vbslq_s16(vtstq_u16(a, vdupq_n_u16(0x80)), r, vnegq_s16(r)));
+	}
+
+	return i;
+}
+#endif
+
+static uint32_t pcm_merge_simd(int16_t *data, const int16_t *other, uint32_t len)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_AVX2
+	case SWITCH_SIMD_AVX2:
+		return pcm_merge_avx2(data, other, len);
+#endif
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_SSE2:
+		return pcm_merge_sse2(data, other, len);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_merge_neon(data, other, len);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static uint32_t pcm_unmerge_simd(int16_t *data, const int16_t *other, uint32_t len)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_AVX2
+	case SWITCH_SIMD_AVX2:
+		return pcm_unmerge_avx2(data, other, len);
+#endif
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_SSE2:
+		return pcm_unmerge_sse2(data, other, len);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_unmerge_neon(data, other, len);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static uint32_t pcm_volume_simd(int16_t *data, uint32_t len, double rate)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_AVX2
+	case SWITCH_SIMD_AVX2:
+		return pcm_volume_avx2(data, len, rate);
+#endif
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_SSE2:
+		return pcm_volume_sse2(data, len, rate);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_volume_neon(data, len, rate);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static uint32_t pcm_downmix_stereo_simd(int16_t *data, uint32_t frames)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_AVX2
+	case SWITCH_SIMD_AVX2:
+		return pcm_downmix_stereo_avx2(data, frames);
+#endif
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_SSE2:
+		return pcm_downmix_stereo_sse2(data, frames);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_downmix_stereo_neon(data, frames);
+#endif
+	default:
+		return 0;
+	}
+}
+
+/* the remaining kernels are shuffle or compare bound and gain nothing from 256 bit registers */
+static uint32_t pcm_upmix_mono_simd(int16_t *data, uint32_t frames)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_AVX2:
+	case SWITCH_SIMD_SSE2:
+		return pcm_upmix_mono_sse2(data, frames);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_upmix_mono_neon(data, frames);
+#endif
+	default:
+		return frames;
+	}
+}
+
+static uint32_t pcm_silence_simd(int16_t *data, uint32_t samples, uint32_t channels, int divisor, int16_t *rnd)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_AVX2:
+	case SWITCH_SIMD_SSE2:
+		return pcm_silence_sse2(data, samples, channels, divisor, rnd);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_silence_neon(data, samples, channels, divisor, rnd);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static uint32_t pcm_ulaw_encode_simd(const int16_t *data, uint8_t *out, uint32_t len)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_AVX2:
+	case SWITCH_SIMD_SSE2:
+		return pcm_ulaw_encode_sse2(data, out, len);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_ulaw_encode_neon(data, out, len);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static uint32_t pcm_ulaw_decode_simd(const uint8_t *data, int16_t *out, uint32_t len)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_AVX2:
+	case SWITCH_SIMD_SSE2:
+		return pcm_ulaw_decode_sse2(data, out, len);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_ulaw_decode_neon(data, out, len);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static uint32_t pcm_alaw_encode_simd(const int16_t *data, uint8_t *out, uint32_t len)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_AVX2:
+	case SWITCH_SIMD_SSE2:
+		return pcm_alaw_encode_sse2(data, out, len);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_alaw_encode_neon(data, out, len);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static uint32_t pcm_alaw_decode_simd(const uint8_t *data, int16_t *out, uint32_t len)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_AVX2:
+	case SWITCH_SIMD_SSE2:
+		return pcm_alaw_decode_sse2(data, out, len);
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_alaw_decode_neon(data, out, len);
+#endif
+	default:
+		return 0;
+	}
+}
+
+/* Shared polyphase filter banks.  A bank holds the windowed sinc for one reduced up/down ratio and tier,
+   split into its phases.  It is built on first use and never changes afterwards, so every resampler with
+   that ratio reads the same coefficients without locking and only keeps its own sample history. */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* largest bank (phases * taps) worth sharing, rarer ratios stay on speex */
+#define RESAMPLE_MAX_COEFFS 65536
+
+typedef struct resample_bank_s {
+	uint32_t up;
+	uint32_t down;
+	switch_resample_tier_t tier;
+	/* taps per phase, padded to a multiple of 8, oldest sample first */
+	uint32_t taps;
+	float *coeffs;
+	struct resample_bank_s *next;
+} resample_bank_t;
+
+typedef struct {
+	const resample_bank_t *bank;
+	/* position of the next output in 1/up input steps from the start of the current input */
+	uint64_t time;
+	/* per channel, taps - 1 samples of history followed by the current input */
+	float *buf;
+	uint32_t buf_len;
+} resample_polyphase_t;
+
+static const struct {
+	/* taps per phase when upsampling, scaled by down/up when decimating */
+	uint32_t taps;
+	/* passband edge as a fraction of the lower nyquist */
+	double rolloff;
+	/* kaiser window shape, higher trades transition width for stopband */
+	double beta;
+} resample_tiers[] = {
+	{ 0, 0, 0 },
+	{ 16, 0.85, 6.0 },
+	{ 24, 0.90, 7.5 },
+	{ 48, 0.95, 9.5 }
+};
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	resample_bank_t *banks;
+} RESAMPLE_BANKS;
+
+typedef float (*pcm_dot_func_t)(const float *a, const float *b, uint32_t len);
+
+/* len is always a multiple of 8 */
+static float pcm_dot_c(const float *a, const float *b, uint32_t len)
+{
+	float sum = 0;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+#ifdef SWITCH_PCM_SSE2
+static float pcm_dot_sse2(const float *a, const float *b, uint32_t len)
+{
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	uint32_t i;
+
+	for (i = 0; i < len; i += 8) {
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+
+	s0 = _mm_add_ps(s0, s1);
+	s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+	s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+
+	return _mm_cvtss_f32(s0);
+}
+#endif
+
+#ifdef SWITCH_PCM_AVX2
+static PCM_AVX2 float pcm_dot_avx2(const float *a, const float *b, uint32_t len)
+{
+	__m256 acc = _mm256_setzero_ps();
+	__m128 s;
+	uint32_t i;
+
+	for (i = 0; i < len; i += 8) {
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+
+	s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+
+	return _mm_cvtss_f32(s);
+}
+#endif
+
+#ifdef SWITCH_PCM_NEON
+static float pcm_dot_neon(const float *a, const float *b, uint32_t len)
+{
+	float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+	uint32_t i;
+
+	for (i = 0; i < len; i += 8) {
+		s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+		s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+
+	return vaddvq_f32(vaddq_f32(s0, s1));
+}
+#endif
+
+static pcm_dot_func_t pcm_dot_get(void)
+{
+	switch (pcm_simd_get()) {
+#ifdef SWITCH_PCM_AVX2
+	case SWITCH_SIMD_AVX2:
+		return pcm_dot_avx2;
+#endif
+#ifdef SWITCH_PCM_SSE2
+	case SWITCH_SIMD_SSE2:
+		return pcm_dot_sse2;
+#endif
+#ifdef SWITCH_PCM_NEON
+	case SWITCH_SIMD_NEON:
+		return pcm_dot_neon;
+#endif
+	default:
+		return pcm_dot_c;
+	}
+}
+
+static double resample_bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	int k;
+
+	for (k = 1; k < 64; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12) break;
+	}
+
+	return sum;
+}
+
+static resample_bank_t *resample_bank_build(uint32_t up, uint32_t down, switch_resample_tier_t tier)
+{
+	uint32_t span = up > down ? up : down;
+	uint32_t taps = (resample_tiers[tier].taps * span + up - 1) / up;
+	uint32_t padded = (taps + 7) & ~7U;
+	uint32_t len = taps * up, i, p;
+	double cutoff = resample_tiers[tier].rolloff * 0.5 / span;
+	double beta = resample_tiers[tier].beta, center = (len - 1) / 2.0, sum = 0;
+	double *h;
+	resample_bank_t *bank;
+
+	if ((uint64_t) padded * up > RESAMPLE_MAX_COEFFS) {
+		return NULL;
+	}
+
+	switch_zmalloc(h, len * sizeof(double));
+
+	for (i = 0; i < len; i++) {
+		double x = i - center, r = 2.0 * i / (len - 1) - 1.0;
+
+		h[i] = (x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x)) *
+			resample_bessel_i0(beta * sqrt(1 - r * r)) / resample_bessel_i0(beta);
+		sum += h[i];
+	}
+
+	bank = switch_core_alloc(RESAMPLE_BANKS.pool, sizeof(*bank));
+	bank->up = up;
+	bank->down = down;
+	bank->tier = tier;
+	bank->taps = padded;
+	bank->coeffs = switch_core_alloc(RESAMPLE_BANKS.pool, padded * up * sizeof(float));
+
+	/* phase p weighs input sample i0 - k with h[k * up + p], stored reversed behind the zero padding */
+	for (p = 0; p < up; p++) {
+		float *c = bank->coeffs + p * padded + (padded - taps);
+
+		for (i = 0; i < taps; i++) {
+			c[i] = (float) (h[(taps - 1 - i) * up + p] * up / sum);
+		}
+	}
+
+	free(h);
+
+	return bank;
+}
+
+static uint32_t resample_gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+static const resample_bank_t *resample_bank_get(uint32_t from_rate, uint32_t to_rate, switch_resample_tier_t tier)
+{
+	resample_bank_t *bank = NULL;
+	uint32_t g, up, down;
+
+	if (!RESAMPLE_BANKS.mutex || !from_rate || !to_rate || from_rate == to_rate) {
+		return NULL;
+	}
+
+	g = resample_gcd(from_rate, to_rate);
+	up = to_rate / g;
+	down = from_rate / g;
+
+	switch_mutex_lock(RESAMPLE_BANKS.mutex);
+
+	for (bank = RESAMPLE_BANKS.banks; bank; bank = bank->next) {
+		if (bank->up == up && bank->down == down && bank->tier == tier) {
+			break;
+		}
+	}
+
+	if (!bank && (bank = resample_bank_build(up, down, tier))) {
+		bank->next = RESAMPLE_BANKS.banks;
+		RESAMPLE_BANKS.banks = bank;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Built %u/%u resample bank for tier %d, %u phases of %u taps\n",
+						  up, down, tier, up, bank->taps);
+	}
+
+	switch_mutex_unlock(RESAMPLE_BANKS.mutex);
+
+	return bank;
+}
+
+void switch_resample_bank_init(switch_memory_pool_t *pool)
+{
+	memset(&RESAMPLE_BANKS, 0, sizeof(RESAMPLE_BANKS));
+	RESAMPLE_BANKS.pool = pool;
+	switch_mutex_init(&RESAMPLE_BANKS.mutex, SWITCH_MUTEX_NESTED, pool);
+}
+
+void switch_resample_bank_shutdown(void)
+{
+	switch_mutex_t *mutex = RESAMPLE_BANKS.mutex;
+
+	if (!mutex) return;
+
+	/* banks live in the core pool, resamplers still holding one stay valid until it is destroyed */
+	switch_mutex_lock(mutex);
+	RESAMPLE_BANKS.banks = NULL;
+	RESAMPLE_BANKS.mutex = NULL;
+	switch_mutex_unlock(mutex);
+}
+
+static switch_status_t polyphase_create(switch_audio_resampler_t *resampler, uint32_t from_rate, uint32_t to_rate, switch_resample_tier_t tier)
+{
+	const resample_bank_t *bank = resample_bank_get(from_rate, to_rate, tier);
+	resample_polyphase_t *pp;
+
+	if (!bank) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_zmalloc(pp, sizeof(*pp));
+	pp->bank = bank;
+	resampler->polyphase = pp;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static uint32_t polyphase_process(switch_audio_resampler_t *resampler, int16_t *src, uint32_t srclen)
+{
+	resample_polyphase_t *pp = (resample_polyphase_t *) resampler->polyphase;
+	const resample_bank_t *bank = pp->bank;
+	uint32_t channels = resampler->channels, hist = bank->taps - 1;
+	uint32_t max_out = (uint32_t) (((uint64_t) srclen * bank->up) / bank->down) + 1;
+	uint64_t end = (uint64_t) srclen * bank->up, t = pp->time;
+	pcm_dot_func_t dot = pcm_dot_get();
+	uint32_t out = 0, ch, i;
+
+	if (max_out > resampler->to_size) {
+		resampler->to_size = max_out;
+		resampler->to = realloc(resampler->to, resampler->to_size * sizeof(int16_t) * channels);
+		switch_assert(resampler->to);
+	}
+
+	if (hist + srclen > pp->buf_len) {
+		uint32_t buf_len = hist + srclen;
+		float *buf;
+
+		switch_zmalloc(buf, buf_len * channels * sizeof(float));
+
+		if (pp->buf) {
+			for (ch = 0; ch < channels; ch++) {
+				memcpy(buf + ch * buf_len, pp->buf + ch * pp->buf_len, hist * sizeof(float));
+			}
+			free(pp->buf);
+		}
+
+		pp->buf = buf;
+		pp->buf_len = buf_len;
+	}
+
+	for (ch = 0; ch < channels; ch++) {
+		float *buf = pp->buf + ch * pp->buf_len;
+
+		for (i = 0; i < srclen; i++) {
+			buf[hist + i] = (float) src[i * channels + ch];
+		}
+
+		out = 0;
+
+		/* the window for an output ends at its newest input sample, t / up */
+		for (t = pp->time; t < end; t += bank->down) {
+			float y = dot(bank->coeffs + (t % bank->up) * bank->taps, buf + t / bank->up, bank->taps);
+			int32_t z = (int32_t) (y >= 0 ? y + 0.5f : y - 0.5f);
+
+			switch_normalize_to_16bit(z);
+			resampler->to[out++ * channels + ch] = (int16_t) z;
+		}
+
+		memmove(buf, buf + srclen, hist * sizeof(float));
+	}
+
+	pp->time = t - end;
+	resampler->to_len = out;
+
+	return out;
+}
+
+static void polyphase_destroy(switch_audio_resampler_t *resampler)
+{
+	resample_polyphase_t *pp = (resample_polyphase_t *) resampler->polyphase;
+
+	switch_safe_free(pp->buf);
+	free(pp);
+	resampler->polyphase = NULL;
+}
+
+SWITCH_DECLARE(void) switch_sln_to_ulaw(const int16_t *data, uint8_t *out, uint32_t samples)
+{
+	uint32_t i;
+
+	for (i = pcm_ulaw_encode_simd(data, out, samples); i < samples; i++) {
+		out[i] = linear_to_ulaw(data[i]);
+	}
+}
+
+SWITCH_DECLARE(void) switch_ulaw_to_sln(const uint8_t *data, int16_t *out, uint32_t samples)
+{
+	uint32_t i;
+
+	for (i = pcm_ulaw_decode_simd(data, out, samples); i < samples; i++) {
+		out[i] = ulaw_to_linear(data[i]);
+	}
+}
+
+SWITCH_DECLARE(void) switch_sln_to_alaw(const int16_t *data, uint8_t *out, uint32_t samples)
+{
+	uint32_t i;
+
+	for (i = pcm_alaw_encode_simd(data, out, samples); i < samples; i++) {
+		out[i] = linear_to_alaw(data[i]);
+	}
+}
+
+SWITCH_DECLARE(void) switch_alaw_to_sln(const uint8_t *data, int16_t *out, uint32_t samples)
+{
+	uint32_t i;
+
+	for (i = pcm_alaw_decode_simd(data, out, samples); i < samples; i++) {
+		out[i] = alaw_to_linear(data[i]);
+	}
+}
+
 
 SWITCH_DECLARE(void) switch_generate_sln_silence(int16_t *data, uint32_t samples, uint32_t channels, uint32_t divisor)
 {
@@ -211,7 +1431,10 @@ SWITCH_DECLARE(void) switch_generate_sln_silence(int16_t *data, uint32_t samples
 		return;
 	}
 
-	for (i = 0; i < samples; i++, sum_rnd = 0) {
+	i = pcm_silence_simd(data, samples, channels, (int) divisor, &rnd2);
+	data += i * channels;
+
+	for (; i < samples; i++, sum_rnd = 0) {
 		for (x = 0; x < 6; x++) {
 			rnd2 = rnd2 * 31821U + 13849U;
 			sum_rnd += rnd2;
@@ -241,7 +1464,7 @@ SWITCH_DECLARE(uint32_t) switch_merge_sln(int16_t *data, uint32_t samples, int16
 		x = samples;
 	}
 
-	for (i = 0; i < x * channels; i++) {
+	for (i = pcm_merge_simd(data, other_data, x * channels); i < x * channels; i++) {
 		z = data[i] + other_data[i];
 		switch_normalize_to_16bit(z);
 		data[i] = (int16_t) z;
@@ -264,7 +1487,7 @@ SWITCH_DECLARE(uint32_t) switch_unmerge_sln(int16_t *data, uint32_t samples, int
 		x = samples;
 	}
 
-	for (i = 0; i < x * channels; i++) {
+	for (i = pcm_unmerge_simd(data, other_data, x * channels); i < x * channels; i++) {
 		data[i] -= other_data[i];
 	}
 
@@ -280,7 +1503,9 @@ SWITCH_DECLARE(void) switch_mux_channels(int16_t *data, switch_size_t samples, u
 
 	if (orig_channels > channels) {
 		if (channels == 1) {
-			for (i = 0; i < samples; i++) {
+			i = orig_channels == 2 ? pcm_downmix_stereo_simd(data, (uint32_t) samples) : 0;
+
+			for (; i < samples; i++) {
 				int32_t z = 0;
 				for (j = 0; j < orig_channels; j++) {
 					z += (int16_t) data[i * orig_channels + j];
@@ -306,6 +1531,14 @@ SWITCH_DECLARE(void) switch_mux_channels(int16_t *data, switch_size_t samples, u
 				data[mark_buf++] = (int16_t) z_right;
 			}
 		} 
+	} else if (orig_channels == 1 && channels == 2) {
+		/* duplicate from the top down so every sample is read before it is overwritten */
+		i = pcm_upmix_mono_simd(data, (uint32_t) samples);
+
+		while (i > 0) {
+			i--;
+			data[i * 2 + 1] = data[i * 2] = data[i];
+		}
 	} else if (orig_channels < channels) {
 
 		/* interesting problem... take a give buffer and double up every sample in the buffer without using any other buffer.....
@@ -385,7 +1618,7 @@ SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t s
 		uint32_t x;
 		int16_t *fp = data;
 
-		for (x = 0; x < samples; x++) {
+		for (x = pcm_volume_simd(fp, samples, newrate); x < samples; x++) {
 			tmp = (int32_t) (fp[x] * newrate);
 			switch_normalize_to_16bit(tmp);
 			fp[x] = (int16_t) tmp;
@@ -424,7 +1657,7 @@ SWITCH_DECLARE(void) switch_change_sln_volume(int16_t *data, uint32_t samples, i
 		uint32_t x;
 		int16_t *fp = data;
 
-		for (x = 0; x < samples; x++) {
+		for (x = pcm_volume_simd(fp, samples, newrate); x < samples; x++) {
 			tmp = (int32_t) (fp[x] * newrate);
 			switch_normalize_to_16bit(tmp);
 			fp[x] = (int16_t) tmp;
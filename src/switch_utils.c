@@ -41,6 +41,7 @@
 #endif
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
 #else
  /* process.h is required for _getpid() */
 #include <process.h>
@@ -65,11 +66,17 @@ struct switch_network_node {
 	char *str;
 	switch_network_port_range_t port_range;
 	struct switch_network_node *next;
+	/* other IPv4 /32 nodes for the same address, in list order */
+	struct switch_network_node *host_next;
 };
 typedef struct switch_network_node switch_network_node_t;
 
 struct switch_network_list {
 	struct switch_network_node *node_head;
+	/* IPv4 /32 nodes (e.g. one per directory user cidr) live in this open addressed table instead of node_head */
+	struct switch_network_node **host_table;
+	uint32_t host_size;
+	uint32_t host_count;
 	switch_bool_t default_type;
 	switch_memory_pool_t *pool;
 	char *name;
@@ -98,16 +105,345 @@ SWITCH_DECLARE(char *) switch_print_host(switch_sockaddr_t *addr, char *buf, swi
 	return buf;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_frame_alloc(switch_frame_t **frame, switch_size_t size)
+/* Frame memory cache
+ *
+ * Duplicated frames (switch_frame_dup, switch_frame_alloc and the per-member
+ * switch_frame_buffer_t queues) draw their headers and payload buffers from a
+ * small set of size classes.  Each thread keeps a short free list per class so
+ * the common dup/free cycle of a video frame never touches malloc or a lock;
+ * overflow and refill go through a shared depot under a mutex.
+ */
+
+#define FRAME_POOL_CLASSES 5
+#define FRAME_POOL_HEADER 0
+#define FRAME_POOL_THREAD_MAX 32
+#define FRAME_POOL_DEPOT_MAX 1024
+#define FRAME_POOL_MAGIC 0x46524d50
+
+typedef struct frame_pool_block_s {
+	struct frame_pool_block_s *next;
+} frame_pool_block_t;
+
+/* switch_frame_t must stay the first member, callers only ever see the frame */
+typedef struct frame_pool_frame_s {
+	switch_frame_t frame;
+	uint32_t magic;
+	void *buf;
+	int hdr_cls;
+	int buf_cls;
+} frame_pool_frame_t;
+
+typedef struct frame_pool_cache_s {
+	frame_pool_block_t *head[FRAME_POOL_CLASSES];
+	uint32_t count[FRAME_POOL_CLASSES];
+} frame_pool_cache_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	int ready;
+	frame_pool_block_t *depot[FRAME_POOL_CLASSES];
+	uint32_t depot_count[FRAME_POOL_CLASSES];
+	switch_atomic_t allocated[FRAME_POOL_CLASSES];
+	switch_atomic_t in_use[FRAME_POOL_CLASSES];
+	uint32_t high_water[FRAME_POOL_CLASSES];
+} FRAME_POOL;
+
+#ifndef WIN32
+/* created once for the life of the process, a restart of the core reuses it */
+static pthread_key_t frame_pool_key;
+static int frame_pool_key_ready = 0;
+#endif
+
+static const switch_size_t frame_pool_size[FRAME_POOL_CLASSES] = {
+	sizeof(frame_pool_frame_t), 512, 2048, 8192, SWITCH_RTP_MAX_BUF_LEN
+};
+
+static int frame_pool_class(switch_size_t size)
 {
-	switch_frame_t *new_frame;
+	int i;
+
+	for (i = FRAME_POOL_HEADER + 1; i < FRAME_POOL_CLASSES; i++) {
+		if (size <= frame_pool_size[i]) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void frame_pool_release_blocks(frame_pool_block_t *list, int cls)
+{
+	frame_pool_block_t *bp;
+
+	while ((bp = list)) {
+		list = bp->next;
+		free(bp);
+		switch_atomic_dec(&FRAME_POOL.allocated[cls]);
+	}
+}
+
+/* hand 'count' blocks from the front of 'list' to the depot, caller holds no locks */
+static void frame_pool_depot_put(int cls, frame_pool_block_t *list, uint32_t count)
+{
+	frame_pool_block_t *tail = list, *excess = NULL;
+
+	while (tail->next) {
+		tail = tail->next;
+	}
+
+	switch_mutex_lock(FRAME_POOL.mutex);
+	if (FRAME_POOL.depot_count[cls] + count <= FRAME_POOL_DEPOT_MAX) {
+		tail->next = FRAME_POOL.depot[cls];
+		FRAME_POOL.depot[cls] = list;
+		FRAME_POOL.depot_count[cls] += count;
+	} else {
+		excess = list;
+	}
+	switch_mutex_unlock(FRAME_POOL.mutex);
+
+	if (excess) {
+		frame_pool_release_blocks(excess, cls);
+	}
+}
+
+#ifndef WIN32
+static frame_pool_cache_t *frame_pool_cache(void)
+{
+	frame_pool_cache_t *cache;
+
+	if (!(cache = pthread_getspecific(frame_pool_key))) {
+		switch_zmalloc(cache, sizeof(*cache));
+		pthread_setspecific(frame_pool_key, cache);
+	}
+
+	return cache;
+}
+
+static void frame_pool_cache_destroy(void *ptr)
+{
+	frame_pool_cache_t *cache = (frame_pool_cache_t *) ptr;
+	int i;
+
+	for (i = 0; i < FRAME_POOL_CLASSES; i++) {
+		if (cache->head[i]) {
+			if (FRAME_POOL.ready) {
+				frame_pool_depot_put(i, cache->head[i], cache->count[i]);
+			} else {
+				frame_pool_release_blocks(cache->head[i], i);
+			}
+		}
+	}
+
+	free(cache);
+}
+#endif
 
-	switch_zmalloc(new_frame, sizeof(*new_frame));
+static void *frame_pool_get(int cls)
+{
+	frame_pool_block_t *bp = NULL;
+	uint32_t in_use;
+
+	if (cls < 0 || !FRAME_POOL.ready) {
+		return NULL;
+	}
+
+#ifndef WIN32
+	{
+		frame_pool_cache_t *cache = frame_pool_cache();
+
+		if (!cache->head[cls]) {
+			/* refill half a cache worth from the depot in one lock round trip */
+			switch_mutex_lock(FRAME_POOL.mutex);
+			while (FRAME_POOL.depot[cls] && cache->count[cls] < FRAME_POOL_THREAD_MAX / 2) {
+				bp = FRAME_POOL.depot[cls];
+				FRAME_POOL.depot[cls] = bp->next;
+				FRAME_POOL.depot_count[cls]--;
+				bp->next = cache->head[cls];
+				cache->head[cls] = bp;
+				cache->count[cls]++;
+			}
+			switch_mutex_unlock(FRAME_POOL.mutex);
+		}
+
+		if ((bp = cache->head[cls])) {
+			cache->head[cls] = bp->next;
+			cache->count[cls]--;
+		}
+	}
+#else
+	switch_mutex_lock(FRAME_POOL.mutex);
+	if ((bp = FRAME_POOL.depot[cls])) {
+		FRAME_POOL.depot[cls] = bp->next;
+		FRAME_POOL.depot_count[cls]--;
+	}
+	switch_mutex_unlock(FRAME_POOL.mutex);
+#endif
+
+	if (!bp) {
+		bp = malloc(frame_pool_size[cls]);
+		switch_assert(bp);
+		switch_atomic_inc(&FRAME_POOL.allocated[cls]);
+	}
+
+	switch_atomic_inc(&FRAME_POOL.in_use[cls]);
+	in_use = switch_atomic_read(&FRAME_POOL.in_use[cls]);
+
+	if (in_use > FRAME_POOL.high_water[cls]) {
+		FRAME_POOL.high_water[cls] = in_use;
+	}
+
+	return bp;
+}
+
+static void frame_pool_put(int cls, void *ptr)
+{
+	frame_pool_block_t *bp = (frame_pool_block_t *) ptr;
+
+	if (!ptr) {
+		return;
+	}
+
+	if (cls < 0) {
+		free(ptr);
+		return;
+	}
+
+	switch_atomic_dec(&FRAME_POOL.in_use[cls]);
+
+	if (!FRAME_POOL.ready) {
+		free(bp);
+		switch_atomic_dec(&FRAME_POOL.allocated[cls]);
+		return;
+	}
+
+#ifndef WIN32
+	{
+		frame_pool_cache_t *cache = frame_pool_cache();
+
+		bp->next = cache->head[cls];
+		cache->head[cls] = bp;
+
+		if (++cache->count[cls] > FRAME_POOL_THREAD_MAX) {
+			/* keep the hot half, spill the rest to the depot */
+			frame_pool_block_t *np = cache->head[cls], *spill;
+			uint32_t keep = FRAME_POOL_THREAD_MAX / 2, i;
+
+			for (i = 1; i < keep; i++) {
+				np = np->next;
+			}
+
+			spill = np->next;
+			np->next = NULL;
+			frame_pool_depot_put(cls, spill, cache->count[cls] - keep);
+			cache->count[cls] = keep;
+		}
+	}
+#else
+	frame_pool_depot_put(cls, bp, 1);
+#endif
+}
+
+void switch_frame_pool_init(switch_memory_pool_t *pool)
+{
+	memset(&FRAME_POOL, 0, sizeof(FRAME_POOL));
+	switch_mutex_init(&FRAME_POOL.mutex, SWITCH_MUTEX_NESTED, pool);
+#ifndef WIN32
+	if (!frame_pool_key_ready) {
+		if (pthread_key_create(&frame_pool_key, frame_pool_cache_destroy)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Frame pool disabled, no thread key available\n");
+			return;
+		}
+		frame_pool_key_ready = 1;
+	}
+#endif
+	FRAME_POOL.ready = 1;
+}
+
+void switch_frame_pool_shutdown(void)
+{
+	int i;
+
+	if (!FRAME_POOL.ready) {
+		return;
+	}
+
+#ifndef WIN32
+	{
+		frame_pool_cache_t *cache = pthread_getspecific(frame_pool_key);
+
+		if (cache) {
+			pthread_setspecific(frame_pool_key, NULL);
+			frame_pool_cache_destroy(cache);
+		}
+	}
+#endif
+
+	switch_mutex_lock(FRAME_POOL.mutex);
+	FRAME_POOL.ready = 0;
+
+	for (i = 0; i < FRAME_POOL_CLASSES; i++) {
+		uint32_t in_use = switch_atomic_read(&FRAME_POOL.in_use[i]);
+
+		frame_pool_release_blocks(FRAME_POOL.depot[i], i);
+		FRAME_POOL.depot[i] = NULL;
+		FRAME_POOL.depot_count[i] = 0;
+
+		if (in_use) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Frame pool: %u %" SWITCH_SIZE_T_FMT " byte block%s still in use at shutdown (high water %u)\n",
+							  in_use, frame_pool_size[i], in_use == 1 ? "" : "s", FRAME_POOL.high_water[i]);
+		}
+	}
+
+	switch_mutex_unlock(FRAME_POOL.mutex);
+}
+
+SWITCH_DECLARE(int) switch_frame_pool_stats(switch_frame_pool_stats_t *stats, int max)
+{
+	int i;
+
+	for (i = 0; i < FRAME_POOL_CLASSES && i < max; i++) {
+		stats[i].size = frame_pool_size[i];
+		stats[i].allocated = switch_atomic_read(&FRAME_POOL.allocated[i]);
+		stats[i].in_use = switch_atomic_read(&FRAME_POOL.in_use[i]);
+		stats[i].high_water = FRAME_POOL.high_water[i];
+		stats[i].cached = FRAME_POOL.depot_count[i];
+	}
+
+	return i;
+}
+
+static switch_frame_t *frame_pool_new_frame(switch_size_t size)
+{
+	frame_pool_frame_t *pf;
+
+	if ((pf = frame_pool_get(FRAME_POOL_HEADER))) {
+		memset(pf, 0, sizeof(*pf));
+		pf->hdr_cls = FRAME_POOL_HEADER;
+	} else {
+		switch_zmalloc(pf, sizeof(*pf));
+		pf->hdr_cls = -1;
+	}
+
+	pf->magic = FRAME_POOL_MAGIC;
+	pf->buf_cls = frame_pool_class(size);
+
+	if (!(pf->buf = frame_pool_get(pf->buf_cls))) {
+		pf->buf_cls = -1;
+		pf->buf = malloc(size);
+		switch_assert(pf->buf);
+	}
+
+	return &pf->frame;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_frame_alloc(switch_frame_t **frame, switch_size_t size)
+{
+	switch_frame_t *new_frame = frame_pool_new_frame(size);
 
 	switch_set_flag(new_frame, SFF_DYNAMIC);
+	switch_set_flag(new_frame, SFF_POOLED);
 	new_frame->buflen = (uint32_t)size;
-	new_frame->data = malloc(size);
-	switch_assert(new_frame->data);
+	new_frame->data = ((frame_pool_frame_t *) new_frame)->buf;
 
 	*frame = new_frame;
 
@@ -118,12 +454,16 @@ SWITCH_DECLARE(switch_status_t) switch_frame_alloc(switch_frame_t **frame, switc
 typedef struct switch_frame_node_s {
 	switch_frame_t *frame;
 	int inuse;
-	struct switch_frame_node_s *prev;
+	int pooled;
 	struct switch_frame_node_s *next;
+	struct switch_frame_node_s *all_next;
 } switch_frame_node_t;
 
 struct switch_frame_buffer_s {
-	switch_frame_node_t *head;
+	/* free nodes, [0] for data frames, [1] for frames carrying a packet */
+	switch_frame_node_t *head[2];
+	/* every node ever created, so destroy can hand the buffers back */
+	switch_frame_node_t *all;
 	switch_memory_pool_t *pool;
 	switch_queue_t *queue;
 	switch_mutex_t *mutex;
@@ -133,42 +473,37 @@ struct switch_frame_buffer_s {
 static switch_frame_t *find_free_frame(switch_frame_buffer_t *fb, switch_frame_t *orig)
 {
 	switch_frame_node_t *np;
-	int x = 0;
+	int which = orig->packet ? 1 : 0;
+	int cls = frame_pool_class(SWITCH_RTP_MAX_BUF_LEN);
 
 	switch_mutex_lock(fb->mutex);
 
-	for (np = fb->head; np; np = np->next) {
-		x++;
-
-		if (!np->inuse && ((orig->packet && np->frame->packet) || (!orig->packet && !np->frame->packet))) {
-
-			if (np == fb->head) {
-				fb->head = np->next;
-			} else if (np->prev) {
-				np->prev->next = np->next;
-			}
-
-			if (np->next) {
-				np->next->prev = np->prev;
-			}
-
-			fb->total--;
-			np->prev = np->next = NULL;
-			break;
-		}
-	}
+	if ((np = fb->head[which])) {
+		fb->head[which] = np->next;
+		fb->total--;
+		np->next = NULL;
+	} else {
+		void *buf;
 
-	if (!np) {
 		np = switch_core_alloc(fb->pool, sizeof(*np));
 		np->frame = switch_core_alloc(fb->pool, sizeof(*np->frame));
 
+		if ((buf = frame_pool_get(cls))) {
+			np->pooled = 1;
+		} else {
+			buf = switch_core_alloc(fb->pool, SWITCH_RTP_MAX_BUF_LEN);
+		}
+
 		if (orig->packet) {
-			np->frame->packet = switch_core_alloc(fb->pool, SWITCH_RTP_MAX_BUF_LEN);
+			np->frame->packet = buf;
 		} else {
 			np->frame->packet = NULL;
-			np->frame->data = switch_core_alloc(fb->pool, SWITCH_RTP_MAX_BUF_LEN);
+			np->frame->data = buf;
 			np->frame->buflen = SWITCH_RTP_MAX_BUF_LEN;
 		}
+
+		np->all_next = fb->all;
+		fb->all = np;
 	}
 
 	np->frame->samples = orig->samples;
@@ -179,7 +514,8 @@ static switch_frame_t *find_free_frame(switch_frame_buffer_t *fb, switch_frame_t
 	np->frame->seq = orig->seq;
 	np->frame->ssrc = orig->ssrc;
 	np->frame->m = orig->m;
-	np->frame->flags = orig->flags;
+	/* a frame buffer node is not a pool frame even when orig is */
+	np->frame->flags = orig->flags & ~SFF_POOLED;
 	np->frame->codec = orig->codec;
 	np->frame->pmap = orig->pmap;
 	np->frame->img = NULL;
@@ -213,6 +549,7 @@ SWITCH_DECLARE(switch_status_t) switch_frame_buffer_free(switch_frame_buffer_t *
 {
 	switch_frame_t *old_frame;
 	switch_frame_node_t *node;
+	int which;
 
 	switch_mutex_lock(fb->mutex);
 
@@ -225,17 +562,11 @@ SWITCH_DECLARE(switch_status_t) switch_frame_buffer_free(switch_frame_buffer_t *
 
 	fb->total++;
 
-	if (fb->head) {
-		fb->head->prev = node;
-	}
-
-	node->next = fb->head;
-	node->prev = NULL;
-	fb->head = node;
+	which = node->frame->packet ? 1 : 0;
+	node->next = fb->head[which];
+	fb->head[which] = node;
 
 	switch_assert(node->next != node);
-	switch_assert(node->prev != node);
-
 
 	switch_mutex_unlock(fb->mutex);
 
@@ -288,8 +619,18 @@ SWITCH_DECLARE(switch_status_t) switch_frame_buffer_destroy(switch_frame_buffer_
 {
 	switch_frame_buffer_t *fb = *fbP;
 	switch_memory_pool_t *pool;
+	switch_frame_node_t *np;
+	int cls = frame_pool_class(SWITCH_RTP_MAX_BUF_LEN);
+
 	*fbP = NULL;
 	pool = fb->pool;
+
+	for (np = fb->all; np; np = np->all_next) {
+		if (np->pooled) {
+			frame_pool_put(cls, np->frame->packet ? np->frame->packet : np->frame->data);
+		}
+	}
+
 	switch_core_destroy_memory_pool(&pool);
 
 	return SWITCH_STATUS_SUCCESS;
@@ -323,21 +664,19 @@ SWITCH_DECLARE(switch_status_t) switch_frame_dup(switch_frame_t *orig, switch_fr
 
 	switch_assert(orig->buflen);
 
-	new_frame = malloc(sizeof(*new_frame));
-	switch_assert(new_frame);
+	new_frame = frame_pool_new_frame(orig->packet ? SWITCH_RTP_MAX_BUF_LEN : orig->buflen);
 
 	*new_frame = *orig;
 	switch_set_flag(new_frame, SFF_DYNAMIC);
+	switch_set_flag(new_frame, SFF_POOLED);
 
 	if (orig->packet) {
-		new_frame->packet = malloc(SWITCH_RTP_MAX_BUF_LEN);
-		switch_assert(new_frame->packet);
+		new_frame->packet = ((frame_pool_frame_t *) new_frame)->buf;
 		memcpy(new_frame->packet, orig->packet, orig->packetlen);
 		new_frame->data = ((unsigned char *)new_frame->packet) + 12;
 	} else {
 		new_frame->packet = NULL;
-		new_frame->data = malloc(new_frame->buflen);
-		switch_assert(new_frame->data);
+		new_frame->data = ((frame_pool_frame_t *) new_frame)->buf;
 		memcpy(new_frame->data, orig->data, orig->datalen);
 	}
 
@@ -358,6 +697,8 @@ SWITCH_DECLARE(switch_status_t) switch_frame_dup(switch_frame_t *orig, switch_fr
 SWITCH_DECLARE(switch_status_t) switch_frame_free(switch_frame_t **frame)
 {
 	switch_frame_t * f;
+	frame_pool_frame_t *pf;
+	void *buf;
 
 	if (!frame) {
 		return SWITCH_STATUS_FALSE;
@@ -375,13 +716,29 @@ SWITCH_DECLARE(switch_status_t) switch_frame_free(switch_frame_t **frame)
 		switch_img_free(&(f->img));
 	}
 
-	if (f->packet) {
-		switch_safe_free(f->packet);
-	} else {
-		switch_safe_free(f->data);
+	/* SFF_DYNAMIC frames malloc'ed outside the pool are freed the old way.  Only frame_pool_new_frame()
+	   frames carry SFF_POOLED, copies into other frames strip it, so the header read below stays in bounds. */
+	if (!switch_test_flag(f, SFF_POOLED) || ((frame_pool_frame_t *) f)->magic != FRAME_POOL_MAGIC) {
+		if (f->packet) {
+			switch_safe_free(f->packet);
+		} else {
+			switch_safe_free(f->data);
+		}
+		free(f);
+		return SWITCH_STATUS_SUCCESS;
 	}
 
-	free(f);
+	pf = (frame_pool_frame_t *) f;
+	buf = f->packet ? f->packet : f->data;
+
+	/* callers may have swapped in a buffer of their own, the pool one still goes back */
+	if (buf != pf->buf) {
+		switch_safe_free(buf);
+	}
+
+	pf->magic = 0;
+	frame_pool_put(pf->buf_cls, pf->buf);
+	frame_pool_put(pf->hdr_cls, pf);
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -538,12 +895,84 @@ SWITCH_DECLARE(switch_bool_t) is_port_in_node(int port, switch_network_node_t *n
 	return SWITCH_TRUE;
 }
 
+static switch_network_node_t **network_list_host_slot(switch_network_list_t *list, uint32_t ip)
+{
+	uint32_t mask = list->host_size - 1;
+	uint32_t i = (ip * 2654435761U) & mask;
+
+	while (list->host_table[i] && list->host_table[i]->ip.v4 != ip) {
+		i = (i + 1) & mask;
+	}
+
+	return &list->host_table[i];
+}
+
+static void network_list_add_host(switch_network_list_t *list, switch_network_node_t *node)
+{
+	switch_network_node_t **slot;
+
+	if ((list->host_count + 1) * 2 > list->host_size) {
+		switch_network_node_t **old_table = list->host_table;
+		uint32_t old_size = list->host_size, i;
+
+		/* the old table stays in the list pool, growth is geometric so that's bounded */
+		list->host_size = old_size ? old_size * 2 : 64;
+		list->host_table = switch_core_alloc(list->pool, sizeof(*list->host_table) * list->host_size);
+
+		for (i = 0; i < old_size; i++) {
+			if (old_table[i]) {
+				*network_list_host_slot(list, old_table[i]->ip.v4) = old_table[i];
+			}
+		}
+	}
+
+	slot = network_list_host_slot(list, node->ip.v4);
+
+	if (!*slot) {
+		list->host_count++;
+	}
+
+	/* newest first, the same order a walk of node_head would see them in */
+	node->host_next = *slot;
+	*slot = node;
+}
+
+static void network_list_add_node(switch_network_list_t *list, switch_network_node_t *node)
+{
+	if (node->family == AF_INET && node->bits == 32) {
+		network_list_add_host(list, node);
+	} else {
+		node->next = list->node_head;
+		list->node_head = node;
+	}
+}
+
 SWITCH_DECLARE(switch_bool_t) switch_network_list_validate_ip_port_token(switch_network_list_t *list, uint32_t ip, int port, const char **token)
 {
 	switch_network_node_t *node;
 	switch_bool_t ok = list->default_type;
 	uint32_t bits = 0;
 
+	/* an exact host match outranks any shorter prefix, so check those first */
+	if (list->host_count) {
+		switch_bool_t found = SWITCH_FALSE;
+
+		for (node = *network_list_host_slot(list, ip); node; node = node->host_next) {
+			if (is_port_in_node(port, node)) {
+				ok = node->ok ? SWITCH_TRUE : SWITCH_FALSE;
+				found = SWITCH_TRUE;
+
+				if (token) {
+					*token = node->token;
+				}
+			}
+		}
+
+		if (found) {
+			return ok;
+		}
+	}
+
 	for (node = list->node_head; node; node = node->next) {
 		if (node->family == AF_INET6) continue; /* want AF_INET */
 		if (node->bits >= bits && switch_test_subnet(ip, node->ip.v4, node->mask.v4) && is_port_in_node(port, node)) {
@@ -656,8 +1085,7 @@ SWITCH_DECLARE(switch_status_t) switch_network_list_perform_add_cidr_token(switc
 		node->token = switch_core_strdup(list->pool, token);
 	}
 
-	node->next = list->node_head;
-	list->node_head = node;
+	network_list_add_node(list, node);
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Adding %s %s(%s) [%s] to list %s\n",
 					  cidr_str, ports ? ports : "", ok ? "allow" : "deny", switch_str_nil(token), list->name);
@@ -703,28 +1131,49 @@ SWITCH_DECLARE(switch_status_t) switch_network_list_add_host_port_mask(switch_ne
 {
 	ip_t ip, mask;
 	switch_network_node_t *node;
+	int family = strchr(host, ':') ? AF_INET6 : AF_INET;
+	int i;
 
-	switch_inet_pton(AF_INET, host, &ip);
-	switch_inet_pton(AF_INET, mask_str, &mask);
+	if (switch_inet_pton(family, host, &ip) != 1 || switch_inet_pton(family, mask_str, &mask) != 1) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Adding %s:%s (%s) to list %s\n",
+						  host, mask_str, ok ? "allow" : "deny", list->name);
+		return SWITCH_STATUS_GENERR;
+	}
 
 	node = switch_core_alloc(list->pool, sizeof(*node));
 
-	node->ip.v4 = ntohl(ip.v4);
-	node->mask.v4 = ntohl(mask.v4);
 	node->ok = ok;
+	node->family = family;
 	if(port) {
 		memcpy(&node->port_range, port, sizeof(switch_network_port_range_t));
 	}
 
-	/* http://graphics.stanford.edu/~seander/bithacks.html */
-	mask.v4 = mask.v4 - ((mask.v4 >> 1) & 0x55555555);
-	mask.v4 = (mask.v4 & 0x33333333) + ((mask.v4 >> 2) & 0x33333333);
-	node->bits = (((mask.v4 + (mask.v4 >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+	if (family == AF_INET6) {
+		/* kept in network order, as switch_parse_cidr leaves them */
+		node->ip = ip;
+		node->mask = mask;
+
+		for (i = 0; i < 16; i++) {
+			uint8_t byte = mask.v6.s6_addr[i];
+
+			for (; byte; byte &= byte - 1) {
+				node->bits++;
+			}
+		}
+	} else {
+		node->ip.v4 = ntohl(ip.v4);
+		node->mask.v4 = ntohl(mask.v4);
+
+		/* http://graphics.stanford.edu/~seander/bithacks.html */
+		mask.v4 = mask.v4 - ((mask.v4 >> 1) & 0x55555555);
+		mask.v4 = (mask.v4 & 0x33333333) + ((mask.v4 >> 2) & 0x33333333);
+		node->bits = (((mask.v4 + (mask.v4 >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+	}
 
 	node->str = switch_core_sprintf(list->pool, "%s:%s", host, mask_str);
 
-	node->next = list->node_head;
-	list->node_head = node;
+	/* a /32 host joins the other exact entries so their relative order is kept */
+	network_list_add_node(list, node);
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -1810,21 +2259,487 @@ static int get_netmask(struct sockaddr_in *me, int *mask)
 #endif
 
 
-SWITCH_DECLARE(switch_status_t) switch_resolve_host(const char *host, char *buf, size_t buflen)
+/* Host lookup cache: getaddrinfo() holds the calling thread for as long as the resolver takes and outbound
+   routing resolves the same carrier and PBX names over and over. getaddrinfo() does not report the record TTL,
+   answers are kept for the configured one. Modules that talk DNS themselves keep their records here too, with
+   the TTL the record carried. Entries sit on a list in use order so the least recently used one is dropped
+   when the cache is full. */
+
+#define DNS_CACHE_PREFETCH_HITS 10	/* hits since the last lookup that make a name worth refreshing before it expires */
+#define DNS_CACHE_SHUTDOWN_WAIT 5000000	/* how long shutdown waits for background refreshes, usec */
+
+typedef struct dns_cache_entry_s {
+	char *key;
+	char *answer;
+	switch_bool_t found;
+	time_t expires;
+	uint8_t refreshing;
+	uint32_t hits;
+	uint32_t recent_hits;
+	uint32_t lookups;
+	uint32_t failures;
+	switch_time_t last_usec;
+	switch_time_t max_usec;
+	switch_time_t total_usec;
+	struct dns_cache_entry_s *prev;
+	struct dns_cache_entry_s *next;
+} dns_cache_entry_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	dns_cache_entry_t *head;
+	dns_cache_entry_t *tail;
+	switch_dns_resolver_func_t resolver;
+	uint32_t ttl;
+	uint32_t negative_ttl;
+	uint32_t stale_ttl;
+	uint32_t max_entries;
+	uint32_t count;
+	uint32_t refreshing;
+	uint8_t running;
+} dns_cache;
+
+static switch_status_t dns_cache_getaddrinfo(const char *host, int family, char *buf, size_t buflen, switch_time_t *usec)
+{
+	struct addrinfo hints, *ai;
+	switch_time_t started = switch_time_now();
+	switch_dns_resolver_func_t resolver = dns_cache.resolver;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	int err;
+
+	if (resolver) {
+		status = resolver(host, family, buf, buflen);
+	} else {
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = family;
+
+		if (!(err = getaddrinfo(host, 0, family == AF_UNSPEC ? 0 : &hints, &ai))) {
+			get_addr(buf, buflen, ai->ai_addr, sizeof(struct sockaddr_storage));
+			freeaddrinfo(ai);
+			status = SWITCH_STATUS_SUCCESS;
+		}
+	}
+
+	if (usec) {
+		*usec = switch_time_now() - started;
+	}
+
+	return status;
+}
+
+/* the list helpers are called with dns_cache.mutex held */
+static void dns_cache_unlink(dns_cache_entry_t *entry)
 {
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		dns_cache.head = entry->next;
+	}
 
-	struct addrinfo *ai;
-	int err;
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		dns_cache.tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+static void dns_cache_append(dns_cache_entry_t *entry)
+{
+	entry->next = NULL;
+	if ((entry->prev = dns_cache.tail)) {
+		entry->prev->next = entry;
+	} else {
+		dns_cache.head = entry;
+	}
+	dns_cache.tail = entry;
+}
 
-	if ((err = getaddrinfo(host, 0, 0, &ai))) {
+static void dns_cache_touch(dns_cache_entry_t *entry)
+{
+	if (dns_cache.tail != entry) {
+		dns_cache_unlink(entry);
+		dns_cache_append(entry);
+	}
+}
+
+static void dns_cache_drop(dns_cache_entry_t *entry)
+{
+	dns_cache_unlink(entry);
+	switch_core_hash_delete(dns_cache.hash, entry->key);
+	dns_cache.count--;
+
+	switch_safe_free(entry->answer);
+	switch_safe_free(entry->key);
+	free(entry);
+}
+
+static dns_cache_entry_t *dns_cache_entry(const char *key)
+{
+	dns_cache_entry_t *entry;
+
+	if (!dns_cache.hash) {
+		return NULL;
+	}
+
+	if ((entry = switch_core_hash_find(dns_cache.hash, key))) {
+		return entry;
+	}
+
+	if (dns_cache.max_entries && dns_cache.count >= dns_cache.max_entries && dns_cache.head) {
+		dns_cache_drop(dns_cache.head);
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	entry->key = strdup(key);
+	switch_core_hash_insert(dns_cache.hash, key, entry);
+	dns_cache_append(entry);
+	dns_cache.count++;
+
+	return entry;
+}
+
+/* call with dns_cache.mutex held */
+static void dns_cache_store(const char *key, switch_status_t status, const char *addr, switch_time_t usec)
+{
+	dns_cache_entry_t *entry;
+	time_t now = switch_epoch_time_now(NULL);
+
+	if (!(entry = dns_cache_entry(key))) {
+		return;
+	}
+
+	dns_cache_touch(entry);
+	entry->refreshing = 0;
+	entry->recent_hits = 0;
+	entry->lookups++;
+	entry->last_usec = usec;
+	entry->total_usec += usec;
+
+	if (usec > entry->max_usec) {
+		entry->max_usec = usec;
+	}
+
+	if (status == SWITCH_STATUS_SUCCESS) {
+		switch_safe_free(entry->answer);
+		entry->answer = strdup(addr);
+		entry->found = SWITCH_TRUE;
+		entry->expires = now + dns_cache.ttl;
+	} else {
+		entry->failures++;
+
+		/* a failed refresh keeps serving the old answer until its stale window is over */
+		if (!entry->found || now >= entry->expires + (time_t) dns_cache.stale_ttl) {
+			entry->found = SWITCH_FALSE;
+			switch_safe_free(entry->answer);
+			entry->expires = now + dns_cache.negative_ttl;
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC dns_cache_refresh(switch_thread_t *thread, void *obj)
+{
+	char *key = (char *) obj;
+	char *host = strchr(key, '|') + 1;
+	char buf[80] = "";
+	switch_time_t usec = 0;
+	switch_status_t status;
+
+	status = dns_cache_getaddrinfo(host, atoi(key), buf, sizeof(buf), &usec);
+
+	switch_mutex_lock(dns_cache.mutex);
+	dns_cache_store(key, status, buf, usec);
+	dns_cache.refreshing--;
+	switch_mutex_unlock(dns_cache.mutex);
+
+	free(key);
+
+	return NULL;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_resolve_host_family(const char *host, int family, char *buf, size_t buflen)
+{
+	char key[300];
+	dns_cache_entry_t *entry;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	switch_bool_t cached = SWITCH_FALSE, refresh = SWITCH_FALSE;
+	switch_time_t usec = 0;
+	time_t now;
+
+	if (zstr(host)) {
 		return SWITCH_STATUS_FALSE;
 	}
 
-	get_addr(buf, buflen, ai->ai_addr, sizeof(struct sockaddr_storage));
+	if (!dns_cache.mutex || !dns_cache.ttl || strlen(host) > 255) {
+		return dns_cache_getaddrinfo(host, family, buf, buflen, NULL);
+	}
 
-	freeaddrinfo(ai);
+	switch_snprintf(key, sizeof(key), "%d|%s", family, host);
+	now = switch_epoch_time_now(NULL);
 
-	return SWITCH_STATUS_SUCCESS;
+	switch_mutex_lock(dns_cache.mutex);
+	if (dns_cache.hash && (entry = switch_core_hash_find(dns_cache.hash, key)) &&
+		(now < entry->expires || (entry->found && now < entry->expires + (time_t) dns_cache.stale_ttl))) {
+		cached = SWITCH_TRUE;
+		entry->hits++;
+		entry->recent_hits++;
+		dns_cache_touch(entry);
+
+		if (entry->found) {
+			switch_copy_string(buf, entry->answer, buflen);
+			status = SWITCH_STATUS_SUCCESS;
+		}
+
+		/* serve a stale answer while it is looked up again, and look up busy names shortly before they expire */
+		if (!entry->refreshing && dns_cache.running) {
+			if (now >= entry->expires) {
+				refresh = SWITCH_TRUE;
+			} else if (entry->found && entry->recent_hits >= DNS_CACHE_PREFETCH_HITS && entry->expires - now <= (time_t) (dns_cache.ttl / 10) + 1) {
+				refresh = SWITCH_TRUE;
+			}
+		}
+
+		if (refresh) {
+			entry->refreshing = 1;
+			dns_cache.refreshing++;
+		}
+	}
+	switch_mutex_unlock(dns_cache.mutex);
+
+	if (refresh) {
+		switch_thread_data_t *td;
+
+		switch_zmalloc(td, sizeof(*td));
+		td->alloc = 1;
+		td->func = dns_cache_refresh;
+		td->obj = strdup(key);
+
+		if (switch_thread_pool_launch_thread(&td) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_lock(dns_cache.mutex);
+			if (dns_cache.hash && (entry = switch_core_hash_find(dns_cache.hash, key))) {
+				entry->refreshing = 0;
+			}
+			dns_cache.refreshing--;
+			switch_mutex_unlock(dns_cache.mutex);
+		}
+	}
+
+	if (cached) {
+		return status;
+	}
+
+	status = dns_cache_getaddrinfo(host, family, buf, buflen, &usec);
+
+	switch_mutex_lock(dns_cache.mutex);
+	dns_cache_store(key, status, buf, usec);
+	switch_mutex_unlock(dns_cache.mutex);
+
+	return status;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_resolve_host(const char *host, char *buf, size_t buflen)
+{
+	return switch_resolve_host_family(host, AF_UNSPEC, buf, buflen);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_dns_cache_get_record(const char *type, const char *name, char **answer)
+{
+	dns_cache_entry_t *entry;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	char *key;
+
+	*answer = NULL;
+
+	if (zstr(type) || zstr(name) || !dns_cache.mutex || !dns_cache.ttl) {
+		return status;
+	}
+
+	key = switch_mprintf("%s|%s", type, name);
+
+	switch_mutex_lock(dns_cache.mutex);
+	if (dns_cache.hash && (entry = switch_core_hash_find(dns_cache.hash, key)) && switch_epoch_time_now(NULL) < entry->expires) {
+		entry->hits++;
+		dns_cache_touch(entry);
+
+		if (entry->found) {
+			*answer = strdup(entry->answer);
+			status = SWITCH_STATUS_SUCCESS;
+		} else {
+			status = SWITCH_STATUS_NOTFOUND;
+		}
+	}
+	switch_mutex_unlock(dns_cache.mutex);
+
+	free(key);
+
+	return status;
+}
+
+SWITCH_DECLARE(void) switch_dns_cache_put_record(const char *type, const char *name, const char *answer, uint32_t ttl, switch_time_t usec)
+{
+	dns_cache_entry_t *entry;
+	char *key;
+
+	if (zstr(type) || zstr(name) || !dns_cache.mutex || !dns_cache.ttl) {
+		return;
+	}
+
+	key = switch_mprintf("%s|%s", type, name);
+
+	switch_mutex_lock(dns_cache.mutex);
+	if ((entry = dns_cache_entry(key))) {
+		dns_cache_touch(entry);
+		entry->lookups++;
+		entry->last_usec = usec;
+		entry->total_usec += usec;
+
+		if (usec > entry->max_usec) {
+			entry->max_usec = usec;
+		}
+
+		switch_safe_free(entry->answer);
+
+		if (answer) {
+			entry->answer = strdup(answer);
+			entry->found = SWITCH_TRUE;
+			entry->expires = switch_epoch_time_now(NULL) + (ttl < dns_cache.ttl ? ttl : dns_cache.ttl);
+		} else {
+			entry->failures++;
+			entry->found = SWITCH_FALSE;
+			entry->expires = switch_epoch_time_now(NULL) + dns_cache.negative_ttl;
+		}
+	}
+	switch_mutex_unlock(dns_cache.mutex);
+
+	free(key);
+}
+
+SWITCH_DECLARE(void) switch_dns_cache_set(uint32_t ttl, uint32_t negative_ttl, uint32_t stale_ttl, uint32_t max_entries)
+{
+	if (!dns_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(dns_cache.mutex);
+	dns_cache.ttl = ttl;
+	dns_cache.negative_ttl = negative_ttl;
+	dns_cache.stale_ttl = stale_ttl;
+	dns_cache.max_entries = max_entries;
+
+	while (dns_cache.max_entries && dns_cache.count > dns_cache.max_entries && dns_cache.head) {
+		dns_cache_drop(dns_cache.head);
+	}
+	switch_mutex_unlock(dns_cache.mutex);
+
+	if (!ttl) {
+		switch_dns_cache_flush(NULL);
+	}
+}
+
+SWITCH_DECLARE(void) switch_dns_cache_set_resolver(switch_dns_resolver_func_t resolver)
+{
+	dns_cache.resolver = resolver;
+}
+
+SWITCH_DECLARE(uint32_t) switch_dns_cache_flush(const char *host)
+{
+	dns_cache_entry_t *entry, *next;
+	uint32_t deleted = 0;
+
+	if (!dns_cache.mutex) {
+		return 0;
+	}
+
+	switch_mutex_lock(dns_cache.mutex);
+	for (entry = dns_cache.head; entry; entry = next) {
+		const char *name = strchr(entry->key, '|');
+
+		next = entry->next;
+
+		if (!zstr(host) && (!name || strcasecmp(name + 1, host))) {
+			continue;
+		}
+
+		dns_cache_drop(entry);
+		deleted++;
+	}
+	switch_mutex_unlock(dns_cache.mutex);
+
+	return deleted;
+}
+
+SWITCH_DECLARE(void) switch_dns_cache_stats(switch_stream_handle_t *stream)
+{
+	dns_cache_entry_t *entry;
+	time_t now = switch_epoch_time_now(NULL);
+
+	if (!dns_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(dns_cache.mutex);
+	stream->write_function(stream, "ttl: %u negative-ttl: %u stale-ttl: %u entries: %u/%u refreshing: %u\n",
+						   dns_cache.ttl, dns_cache.negative_ttl, dns_cache.stale_ttl, dns_cache.count, dns_cache.max_entries, dns_cache.refreshing);
+
+	stream->write_function(stream, "%-40s %-6s %-40s %8s %8s %8s %8s %8s %8s %8s\n",
+						   "host", "type", "answer", "expires", "hits", "lookups", "failed", "last-ms", "avg-ms", "max-ms");
+
+	/* most recently used first */
+	for (entry = dns_cache.tail; entry; entry = entry->prev) {
+		const char *host = strchr(entry->key, '|') + 1;
+		char type[16];
+
+		if (isdigit((unsigned char) *entry->key)) {
+			int family = atoi(entry->key);
+			switch_copy_string(type, family == AF_INET ? "ipv4" : family == AF_INET6 ? "ipv6" : "any", sizeof(type));
+		} else {
+			switch_copy_string(type, entry->key, sizeof(type));
+			if (strchr(type, '|')) {
+				*strchr(type, '|') = '\0';
+			}
+		}
+
+		stream->write_function(stream, "%-40s %-6s %-40s %8ld %8u %8u %8u %8.1f %8.1f %8.1f\n",
+							   host, type, entry->found ? entry->answer : "(not found)", (long) (entry->expires - now),
+							   entry->hits, entry->lookups, entry->failures, (double) entry->last_usec / 1000,
+							   entry->lookups ? (double) entry->total_usec / entry->lookups / 1000 : 0.0, (double) entry->max_usec / 1000);
+	}
+	switch_mutex_unlock(dns_cache.mutex);
+}
+
+void switch_dns_cache_init(switch_memory_pool_t *pool)
+{
+	memset(&dns_cache, 0, sizeof(dns_cache));
+	switch_mutex_init(&dns_cache.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init_nocase(&dns_cache.hash);
+	dns_cache.max_entries = 10000;
+	dns_cache.running = 1;
+}
+
+void switch_dns_cache_shutdown(void)
+{
+	switch_time_t started = switch_time_now();
+
+	if (!dns_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(dns_cache.mutex);
+	dns_cache.running = 0;
+	dns_cache.ttl = 0;
+	switch_mutex_unlock(dns_cache.mutex);
+
+	while (dns_cache.refreshing && switch_time_now() - started < DNS_CACHE_SHUTDOWN_WAIT) {
+		switch_yield(100000);
+	}
+
+	switch_dns_cache_flush(NULL);
+
+	switch_mutex_lock(dns_cache.mutex);
+	switch_core_hash_destroy(&dns_cache.hash);
+	switch_mutex_unlock(dns_cache.mutex);
 }
 
 
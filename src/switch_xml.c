@@ -199,6 +199,7 @@ static void preprocess_env_set(char *keyval)
 
 static int preprocess(const char *cwd, const char *file, FILE *write_fd, int rlevel);
 
+typedef struct xml_index_s xml_index_t;
 typedef struct switch_xml_root *switch_xml_root_t;
 struct switch_xml_root {		/* additional data for the root tag */
 	struct switch_xml xml;		/* is a super-struct built on top of switch_xml struct */
@@ -214,6 +215,7 @@ struct switch_xml_root {		/* additional data for the root tag */
 	char ***pi;					/* processing instructions */
 	short standalone;			/* non-zero if <?xml standalone="yes"?> */
 	char err[SWITCH_XML_ERRL];	/* error string */
+	xml_index_t *index;			/* lookup index, built when installed as the main root */
 };
 
 char *SWITCH_XML_NIL[] = { NULL };	/* empty, null terminated array of strings */
@@ -1718,6 +1720,652 @@ SWITCH_DECLARE(switch_xml_t) switch_xml_parse_file(const char *file)
 	return xml;
 }
 
+/* Lookup index for the main root
+ *
+ * Built once in switch_xml_set_root() and freed with the root, so every
+ * reloadxml swaps in a complete index together with the tree it describes.
+ * Readers holding an older root keep using that root's index.
+ *
+ * Keys live in one case insensitive hash:
+ *   c/<parent>/<tag>/<name>  first <tag name="..."> under the root or a section
+ *   d/<domain>               per domain search layout
+ *   i/<domain>/<ip>          first user with that ip attribute
+ *   n/<domain>/<id>          first user with that id or number-alias
+ * Users are searched group by group and then in the domain itself, the
+ * index records the first (tag, position) hit so results match the linear
+ * walk in find_user_in_tag() exactly.
+ */
+
+#define XML_INDEX_NONE 0x7fffffff
+#define XML_INDEX_KEY_MAX 512
+
+typedef struct xml_index_user_s {
+	switch_xml_t node;
+	int tag;
+	int pos;
+} xml_index_user_t;
+
+typedef struct xml_index_domain_s {
+	/* group <users> tags first, the domain's own users last */
+	int ntags;
+	int ngroup_tags;
+	switch_bool_t has_groups;
+	switch_xml_t *group;
+	/* per tag, the first user whose type attribute isn't "pointer"; find_child_multi() matches those on any lookup */
+	xml_index_user_t *wild;
+	int first_wild_tag;
+} xml_index_domain_t;
+
+struct xml_index_s {
+	switch_memory_pool_t *pool;
+	switch_hash_t *hash;
+	uint32_t domains;
+	uint32_t users;
+};
+
+static void xml_index_add(xml_index_t *idx, const char *key, void *val)
+{
+	if (strlen(key) < XML_INDEX_KEY_MAX - 1 && !switch_core_hash_find(idx->hash, key)) {
+		switch_core_hash_insert(idx->hash, key, val);
+	}
+}
+
+static void xml_index_add_user(xml_index_t *idx, char kind, switch_xml_t domain, const char *value, switch_xml_t user, int tag, int pos)
+{
+	char key[XML_INDEX_KEY_MAX];
+	xml_index_user_t *entry;
+
+	if (zstr(value) || strlen(value) > XML_INDEX_KEY_MAX - 32) {
+		return;
+	}
+
+	switch_snprintf(key, sizeof(key), "%c/%p/%s", kind, (void *) domain, value);
+
+	if (!switch_core_hash_find(idx->hash, key)) {
+		entry = switch_core_alloc(idx->pool, sizeof(*entry));
+		entry->node = user;
+		entry->tag = tag;
+		entry->pos = pos;
+		switch_core_hash_insert(idx->hash, key, entry);
+	}
+}
+
+static void xml_index_users(xml_index_t *idx, xml_index_domain_t *dom, switch_xml_t domain, switch_xml_t tag, int t)
+{
+	switch_xml_t user;
+	int pos = 0;
+
+	for (user = switch_xml_child(tag, "user"); user; user = user->next, pos++) {
+		const char *type = switch_xml_attr(user, "type");
+
+		if (type && strcasecmp(type, "pointer") && !dom->wild[t].node) {
+			dom->wild[t].node = user;
+			dom->wild[t].tag = t;
+			dom->wild[t].pos = pos;
+
+			if (dom->first_wild_tag == XML_INDEX_NONE) {
+				dom->first_wild_tag = t;
+			}
+		}
+
+		xml_index_add_user(idx, 'i', domain, switch_xml_attr(user, "ip"), user, t, pos);
+		xml_index_add_user(idx, 'n', domain, switch_xml_attr(user, "id"), user, t, pos);
+		xml_index_add_user(idx, 'n', domain, switch_xml_attr(user, "number-alias"), user, t, pos);
+		idx->users++;
+	}
+}
+
+static void xml_index_domain(xml_index_t *idx, switch_xml_t domain)
+{
+	xml_index_domain_t *dom;
+	switch_xml_t groups, group, users;
+	char key[64];
+	int t = 0;
+
+	dom = switch_core_alloc(idx->pool, sizeof(*dom));
+	dom->first_wild_tag = XML_INDEX_NONE;
+
+	if ((groups = switch_xml_child(domain, "groups"))) {
+		dom->has_groups = SWITCH_TRUE;
+
+		for (group = switch_xml_child(groups, "group"); group; group = group->next) {
+			if (switch_xml_child(group, "users")) {
+				dom->ngroup_tags++;
+			}
+		}
+	}
+
+	dom->ntags = dom->ngroup_tags + 1;
+	dom->group = switch_core_alloc(idx->pool, sizeof(switch_xml_t) * dom->ntags);
+	dom->wild = switch_core_alloc(idx->pool, sizeof(xml_index_user_t) * dom->ntags);
+
+	for (group = groups ? switch_xml_child(groups, "group") : NULL; group; group = group->next) {
+		if ((users = switch_xml_child(group, "users"))) {
+			dom->group[t] = group;
+			xml_index_users(idx, dom, domain, users, t++);
+		}
+	}
+
+	if (!(users = switch_xml_child(domain, "users"))) {
+		users = domain;
+	}
+
+	xml_index_users(idx, dom, domain, users, t);
+
+	switch_snprintf(key, sizeof(key), "d/%p", (void *) domain);
+	xml_index_add(idx, key, dom);
+	idx->domains++;
+}
+
+static void xml_index_children(xml_index_t *idx, switch_xml_t parent)
+{
+	switch_xml_t tag, child;
+	char key[XML_INDEX_KEY_MAX];
+
+	for (tag = parent->child; tag; tag = tag->sibling) {
+		for (child = tag; child; child = child->next) {
+			const char *name = switch_xml_attr(child, "name");
+
+			if (name) {
+				switch_snprintf(key, sizeof(key), "c/%p/%s/%s", (void *) parent, child->name, name);
+				xml_index_add(idx, key, child);
+			}
+		}
+	}
+}
+
+static xml_index_t *xml_index_build(switch_xml_t root)
+{
+	xml_index_t *idx;
+	switch_memory_pool_t *pool = NULL;
+	switch_xml_t section, domain;
+	switch_time_t start = switch_time_now();
+
+	switch_core_new_memory_pool(&pool);
+	idx = switch_core_alloc(pool, sizeof(*idx));
+	idx->pool = pool;
+	switch_core_hash_init_nocase(&idx->hash);
+
+	xml_index_children(idx, root);
+
+	for (section = switch_xml_child(root, "section"); section; section = section->next) {
+		const char *name = switch_xml_attr(section, "name");
+
+		xml_index_children(idx, section);
+
+		if (name && !strcasecmp(name, "directory")) {
+			for (domain = switch_xml_child(section, "domain"); domain; domain = domain->next) {
+				xml_index_domain(idx, domain);
+			}
+		}
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Indexed %u domain%s and %u user%s in %" SWITCH_TIME_T_FMT "ms\n",
+					  idx->domains, idx->domains == 1 ? "" : "s", idx->users, idx->users == 1 ? "" : "s", (switch_time_now() - start) / 1000);
+
+	return idx;
+}
+
+static void xml_index_destroy(xml_index_t **idxP)
+{
+	xml_index_t *idx = *idxP;
+	switch_memory_pool_t *pool;
+
+	if (!idx) {
+		return;
+	}
+
+	*idxP = NULL;
+	pool = idx->pool;
+	switch_core_hash_destroy(&idx->hash);
+	switch_core_destroy_memory_pool(&pool);
+}
+
+/* the index of the installed root that node belongs to, if any */
+static xml_index_t *xml_index_get(switch_xml_t node)
+{
+	switch_xml_t root;
+
+	for (root = node; root && root->parent; root = root->parent);
+
+	if (root && switch_test_flag(root, SWITCH_XML_ROOT)) {
+		return ((switch_xml_root_t) root)->index;
+	}
+
+	return NULL;
+}
+
+/* switch_xml_find_child() for the root and section levels, answered from the index when possible */
+static switch_xml_t xml_index_find_child(switch_xml_t node, const char *childname, const char *attrname, const char *value)
+{
+	xml_index_t *idx;
+	char key[XML_INDEX_KEY_MAX];
+	switch_xml_t found;
+
+	if (node && childname && attrname && value && !strcasecmp(attrname, "name") &&
+		(!node->parent || (!node->parent->parent && !strcmp(node->name, "section"))) &&
+		strlen(childname) + strlen(value) < XML_INDEX_KEY_MAX - 32 && (idx = xml_index_get(node))) {
+
+		switch_snprintf(key, sizeof(key), "c/%p/%s/%s", (void *) node, childname, value);
+
+		if (!(found = switch_core_hash_find(idx->hash, key))) {
+			return NULL;
+		}
+
+		/* the hash ignores case, the tag name must not */
+		if (!strcmp(found->name, childname)) {
+			return found;
+		}
+	}
+
+	return switch_xml_find_child(node, childname, attrname, value);
+}
+
+static xml_index_user_t *xml_index_pick(xml_index_user_t *a, xml_index_user_t *b)
+{
+	if (!a || !a->node) return b && b->node ? b : NULL;
+	if (!b || !b->node) return a;
+	return a->pos <= b->pos ? a : b;
+}
+
+/*
+ * Same answer as running find_user_in_tag() over the domain's groups and then the domain.
+ * Returns SWITCH_STATUS_IGNORE when the lookup can't be served from the index.
+ */
+static switch_status_t xml_index_find_user(switch_xml_t domain, const char *ip, const char *user_name, const char *key,
+										   switch_event_t *params, switch_bool_t groups_only, switch_xml_t *user, switch_xml_t *ingroup)
+{
+	xml_index_t *idx;
+	xml_index_domain_t *dom;
+	xml_index_user_t *by_ip = NULL, *by_name = NULL, *hit = NULL;
+	char hkey[XML_INDEX_KEY_MAX];
+	int t, limit;
+
+	if (!domain || !(idx = xml_index_get(domain))) {
+		return SWITCH_STATUS_IGNORE;
+	}
+
+	/* only the default "!pointer" user type and the id key are indexed */
+	if (params && switch_event_get_header(params, "user_type")) {
+		return SWITCH_STATUS_IGNORE;
+	}
+
+	if (user_name && (!key || strcasecmp(key, "id"))) {
+		return SWITCH_STATUS_IGNORE;
+	}
+
+	/* empty values are never indexed, neither are oversized ones */
+	if ((ip && (!*ip || strlen(ip) > XML_INDEX_KEY_MAX - 32)) || (user_name && (!*user_name || strlen(user_name) > XML_INDEX_KEY_MAX - 32))) {
+		return SWITCH_STATUS_IGNORE;
+	}
+
+	switch_snprintf(hkey, sizeof(hkey), "d/%p", (void *) domain);
+
+	if (!(dom = switch_core_hash_find(idx->hash, hkey))) {
+		return SWITCH_STATUS_IGNORE;
+	}
+
+	*user = NULL;
+
+	if (!ip && !user_name) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (ip) {
+		switch_snprintf(hkey, sizeof(hkey), "i/%p/%s", (void *) domain, ip);
+		by_ip = switch_core_hash_find(idx->hash, hkey);
+	}
+
+	if (user_name) {
+		switch_snprintf(hkey, sizeof(hkey), "n/%p/%s", (void *) domain, user_name);
+		by_name = switch_core_hash_find(idx->hash, hkey);
+	}
+
+	/* the first tag with any candidate is where the linear walk stops */
+	t = dom->first_wild_tag;
+	if (by_ip && by_ip->tag < t) t = by_ip->tag;
+	if (by_name && by_name->tag < t) t = by_name->tag;
+
+	/* locate_user_in_domain only looks at the domain's own users when it has no groups */
+	limit = groups_only && dom->has_groups ? dom->ngroup_tags : dom->ntags;
+
+	if (t >= limit) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (ip) {
+		hit = xml_index_pick(by_ip && by_ip->tag == t ? by_ip : NULL, &dom->wild[t]);
+	}
+
+	if (!hit && user_name) {
+		hit = xml_index_pick(by_name && by_name->tag == t ? by_name : NULL, &dom->wild[t]);
+	}
+
+	if (!hit) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	*user = hit->node;
+
+	if (ingroup && dom->group[t]) {
+		*ingroup = dom->group[t];
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Binding result cache: answers from the search bindings are kept per section so bursts of
+   identical lookups (the same user registering, the same destination dialed) hit the backend once. */
+
+#define XML_BCACHE_WAIT_MAX 10000000	/* how long followers wait on an in-flight fetch, usec */
+
+typedef struct xml_bcache_conf_s {
+	uint32_t ttl;
+	uint32_t negative_ttl;
+	char *key_template;
+} xml_bcache_conf_t;
+
+typedef struct xml_bcache_entry_s {
+	char *text;				/* serialized answer, NULL for a cached "not found" */
+	switch_time_t expires;
+	uint8_t pending;		/* a fetch for this key is running */
+	uint8_t flushed;		/* flushed while pending, drop the answer */
+} xml_bcache_entry_t;
+
+static switch_mutex_t *BCACHE_MUTEX = NULL;
+static switch_thread_cond_t *BCACHE_COND = NULL;
+static switch_hash_t *BCACHE_CONF_HASH = NULL;
+static switch_hash_t *BCACHE_HASH = NULL;
+static uint32_t BCACHE_COUNT = 0;
+static uint32_t BCACHE_MAX = 10000;
+
+static void xml_bcache_entry_free(xml_bcache_entry_t *entry)
+{
+	switch_safe_free(entry->text);
+	free(entry);
+}
+
+SWITCH_DECLARE(void) switch_xml_binding_cache_set_max(uint32_t max_entries)
+{
+	BCACHE_MAX = max_entries;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_xml_binding_cache_set(const char *section, uint32_t ttl, uint32_t negative_ttl, const char *key_template)
+{
+	xml_bcache_conf_t *conf, *old;
+
+	if (zstr(section) || !BCACHE_MUTEX) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(BCACHE_MUTEX);
+
+	if ((old = switch_core_hash_find(BCACHE_CONF_HASH, section))) {
+		switch_core_hash_delete(BCACHE_CONF_HASH, section);
+		switch_safe_free(old->key_template);
+		free(old);
+	}
+
+	if (ttl || negative_ttl) {
+		switch_zmalloc(conf, sizeof(*conf));
+		conf->ttl = ttl;
+		conf->negative_ttl = negative_ttl;
+		conf->key_template = zstr(key_template) ? NULL : strdup(key_template);
+		switch_core_hash_insert(BCACHE_CONF_HASH, section, conf);
+	}
+
+	switch_mutex_unlock(BCACHE_MUTEX);
+
+	switch_xml_binding_cache_flush(section, NULL);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+typedef struct xml_bcache_sweep_s {
+	const char *prefix;
+	size_t prefix_len;
+	const char *value;
+	switch_time_t now;
+	uint32_t deleted;
+} xml_bcache_sweep_t;
+
+/* true when value is one of the |-separated fields of a cache key, or the value of a name=value field */
+static switch_bool_t xml_bcache_key_has(const char *key, const char *value)
+{
+	size_t len = strlen(value);
+	const char *p = key, *eq, *end;
+
+	while ((p = strchr(p, '|'))) {
+		p++;
+		if (!strncmp(p, value, len) && (p[len] == '|' || p[len] == '\0')) {
+			return SWITCH_TRUE;
+		}
+
+		end = strchr(p, '|');
+		if ((eq = strchr(p, '=')) && (!end || eq < end) && !strncmp(eq + 1, value, len) && (eq[len + 1] == '|' || eq[len + 1] == '\0')) {
+			return SWITCH_TRUE;
+		}
+	}
+
+	return SWITCH_FALSE;
+}
+
+/* deletes entries matching the prefix, or only expired ones when now is set;
+   entries with a fetch in flight are marked so their answer is dropped instead */
+static switch_bool_t xml_bcache_sweep_callback(const void *key, const void *val, void *pData)
+{
+	xml_bcache_entry_t *entry = (xml_bcache_entry_t *) val;
+	xml_bcache_sweep_t *sweep = (xml_bcache_sweep_t *) pData;
+
+	if (sweep->prefix && strncasecmp((const char *) key, sweep->prefix, sweep->prefix_len)) {
+		return SWITCH_FALSE;
+	}
+
+	if (sweep->value && !xml_bcache_key_has(key, sweep->value)) {
+		return SWITCH_FALSE;
+	}
+
+	if (entry->pending) {
+		if (!sweep->now) {
+			entry->flushed = 1;
+		}
+		return SWITCH_FALSE;
+	}
+
+	if (sweep->now && entry->expires > sweep->now) {
+		return SWITCH_FALSE;
+	}
+
+	xml_bcache_entry_free(entry);
+	sweep->deleted++;
+
+	return SWITCH_TRUE;
+}
+
+SWITCH_DECLARE(uint32_t) switch_xml_binding_cache_flush(const char *section, const char *key)
+{
+	xml_bcache_sweep_t sweep = { 0 };
+	char *prefix = NULL;
+
+	if (!BCACHE_MUTEX) {
+		return 0;
+	}
+
+	if (!zstr(section)) {
+		prefix = switch_mprintf("%s|", section);
+		sweep.prefix = prefix;
+		sweep.prefix_len = strlen(prefix);
+	}
+
+	if (!zstr(key)) {
+		sweep.value = key;
+	}
+
+	switch_mutex_lock(BCACHE_MUTEX);
+	switch_core_hash_delete_multi(BCACHE_HASH, xml_bcache_sweep_callback, &sweep);
+	BCACHE_COUNT -= sweep.deleted;
+	switch_mutex_unlock(BCACHE_MUTEX);
+
+	switch_safe_free(prefix);
+
+	return sweep.deleted;
+}
+
+/* request params that tell one user's answer from another's */
+static const char *xml_bcache_id_params[] = { "user", "domain", "ip", "sip_auth_username", "sip_auth_realm", NULL };
+
+static char *xml_bcache_key(const char *section, const char *tag_name, const char *key_name, const char *key_value, switch_event_t *params,
+							uint32_t *ttl, uint32_t *negative_ttl)
+{
+	xml_bcache_conf_t *conf;
+	switch_stream_handle_t stream = { 0 };
+	switch_event_header_t *hp;
+	char *tpl = NULL, *expanded = NULL;
+	int i;
+
+	if (!BCACHE_MUTEX || zstr(section)) {
+		return NULL;
+	}
+
+	switch_mutex_lock(BCACHE_MUTEX);
+	if ((conf = switch_core_hash_find(BCACHE_CONF_HASH, section))) {
+		*ttl = conf->ttl;
+		*negative_ttl = conf->negative_ttl;
+		if (conf->key_template) {
+			tpl = strdup(conf->key_template);
+		}
+	}
+	switch_mutex_unlock(BCACHE_MUTEX);
+
+	if (!conf) {
+		return NULL;
+	}
+
+	SWITCH_STANDARD_STREAM(stream);
+	stream.write_function(&stream, "%s|%s|%s|%s", section, switch_str_nil(tag_name), switch_str_nil(key_name), switch_str_nil(key_value));
+
+	if (tpl) {
+		if (params && (expanded = switch_event_expand_headers(params, tpl)) == tpl) {
+			expanded = NULL;
+		}
+
+		stream.write_function(&stream, "|%s", expanded ? expanded : tpl);
+
+		/* a template must never let two users share one answer */
+		for (i = 0; params && xml_bcache_id_params[i]; i++) {
+			const char *val = switch_event_get_header(params, xml_bcache_id_params[i]);
+			stream.write_function(&stream, "|%s=%s", xml_bcache_id_params[i], switch_str_nil(val));
+		}
+	} else if (params) {
+		/* everything that is asked, except the event stamps that change on every request */
+		for (hp = params->headers; hp; hp = hp->next) {
+			if (!strncasecmp(hp->name, "Event-Date-", 11) || !strncasecmp(hp->name, "Event-Calling-", 14) ||
+				!strcasecmp(hp->name, "Event-Sequence")) {
+				continue;
+			}
+
+			stream.write_function(&stream, "|%s=%s", hp->name, hp->value);
+		}
+	}
+
+	switch_safe_free(expanded);
+	switch_safe_free(tpl);
+
+	return (char *) stream.data;
+}
+
+/* Returns SWITCH_STATUS_SUCCESS with a private copy in *xml (NULL for a cached "not found") on a hit.
+   On a miss the caller becomes the only one fetching the key and must call xml_bcache_store(). */
+static switch_status_t xml_bcache_lookup(const char *key, switch_xml_t *xml)
+{
+	xml_bcache_entry_t *entry;
+	switch_time_t started = switch_micro_time_now();
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	*xml = NULL;
+
+	switch_mutex_lock(BCACHE_MUTEX);
+
+	for (;;) {
+		switch_time_t now = switch_micro_time_now();
+
+		if (!(entry = switch_core_hash_find(BCACHE_HASH, key))) {
+			switch_zmalloc(entry, sizeof(*entry));
+			entry->pending = 1;
+			switch_core_hash_insert(BCACHE_HASH, key, entry);
+			BCACHE_COUNT++;
+			break;
+		}
+
+		if (entry->pending) {
+			if (now - started > XML_BCACHE_WAIT_MAX) {
+				/* the fetch is stuck, ask the bindings ourselves without caching the answer */
+				status = SWITCH_STATUS_TIMEOUT;
+				break;
+			}
+			switch_thread_cond_timedwait(BCACHE_COND, BCACHE_MUTEX, 100000);
+			continue;
+		}
+
+		if (entry->expires > now) {
+			if (entry->text) {
+				*xml = switch_xml_parse_str_dynamic(strdup(entry->text), SWITCH_FALSE);
+			}
+			status = SWITCH_STATUS_SUCCESS;
+			break;
+		}
+
+		entry->pending = 1;
+		break;
+	}
+
+	switch_mutex_unlock(BCACHE_MUTEX);
+
+	return status;
+}
+
+static void xml_bcache_store(const char *key, switch_xml_t xml, switch_bool_t not_found, uint32_t ttl, uint32_t negative_ttl)
+{
+	xml_bcache_entry_t *entry;
+	switch_time_t now = switch_micro_time_now();
+	char *text = NULL;
+	uint32_t secs = xml ? ttl : not_found ? negative_ttl : 0;
+
+	if (xml && secs) {
+		text = switch_xml_toxml(xml, SWITCH_FALSE);
+	}
+
+	switch_mutex_lock(BCACHE_MUTEX);
+
+	if ((entry = switch_core_hash_find(BCACHE_HASH, key))) {
+		entry->pending = 0;
+
+		if (!secs || entry->flushed || (xml && !text)) {
+			switch_core_hash_delete(BCACHE_HASH, key);
+			xml_bcache_entry_free(entry);
+			BCACHE_COUNT--;
+		} else {
+			switch_safe_free(entry->text);
+			entry->text = text;
+			text = NULL;
+			entry->expires = now + (switch_time_t) secs * 1000000;
+
+			if (BCACHE_MAX && BCACHE_COUNT > BCACHE_MAX) {
+				xml_bcache_sweep_t sweep = { 0 };
+
+				sweep.now = now;
+				switch_core_hash_delete_multi(BCACHE_HASH, xml_bcache_sweep_callback, &sweep);
+				BCACHE_COUNT -= sweep.deleted;
+			}
+		}
+	}
+
+	switch_thread_cond_broadcast(BCACHE_COND);
+	switch_mutex_unlock(BCACHE_MUTEX);
+
+	switch_safe_free(text);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 												  const char *tag_name,
 												  const char *key_name,
@@ -1730,6 +2378,22 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 	switch_xml_binding_t *binding;
 	uint8_t loops = 0;
 	switch_xml_section_t sections = BINDINGS ? switch_xml_parse_section_string(section) : 0;
+	char *cache_key = NULL;
+	uint32_t ttl = 0, negative_ttl = 0;
+	switch_bool_t not_found = SWITCH_FALSE;
+
+	if (BINDINGS && (cache_key = xml_bcache_key(section, tag_name, key_name, key_value, params, &ttl, &negative_ttl))) {
+		switch_status_t cstatus = xml_bcache_lookup(cache_key, &xml);
+
+		if (cstatus == SWITCH_STATUS_SUCCESS) {
+			switch_safe_free(cache_key);
+			goto search;
+		}
+
+		if (cstatus != SWITCH_STATUS_FALSE) {
+			switch_safe_free(cache_key);
+		}
+	}
 
 	switch_thread_rwlock_rdlock(B_RWLOCK);
 
@@ -1752,6 +2416,7 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 						if (aname && !strcasecmp(aname, "not found")) {
 							switch_xml_free(xml);
 							xml = NULL;
+							not_found = SWITCH_TRUE;
 							continue;
 						}
 					}
@@ -1761,11 +2426,20 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error[%s]\n", err);
 				switch_xml_free(xml);
 				xml = NULL;
+				/* a broken answer is not a real "not found", don't cache it */
+				negative_ttl = 0;
 			}
 		}
 	}
 	switch_thread_rwlock_unlock(B_RWLOCK);
 
+	if (cache_key) {
+		xml_bcache_store(cache_key, xml, not_found, ttl, negative_ttl);
+		free(cache_key);
+	}
+
+ search:
+
 	for (;;) {
 		if (!xml) {
 			if (!(xml = switch_xml_root())) {
@@ -1775,7 +2449,7 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 			}
 		}
 
-		if ((conf = switch_xml_find_child(xml, "section", "name", section)) && (tag = switch_xml_find_child(conf, tag_name, key_name, key_value))) {
+		if ((conf = xml_index_find_child(xml, "section", "name", section)) && (tag = xml_index_find_child(conf, tag_name, key_name, key_value))) {
 			if (clone) {
 				char *x = switch_xml_toxml(tag, SWITCH_FALSE);
 				switch_assert(x);
@@ -1908,6 +2582,12 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user_in_domain(const char *use
 	switch_xml_t group = NULL, groups = NULL, users = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 
+	if ((status = xml_index_find_user(domain, NULL, user_name, "id", NULL, SWITCH_TRUE, user, ingroup)) != SWITCH_STATUS_IGNORE) {
+		return status;
+	}
+
+	status = SWITCH_STATUS_FALSE;
+
 	if ((groups = switch_xml_child(domain, "groups"))) {
 		for (group = switch_xml_child(groups, "group"); group; group = group->next) {
 			if ((users = switch_xml_child(group, "users"))) {
@@ -2201,6 +2881,10 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user(const char *key,
 		goto end;
 	}
 
+	if ((status = xml_index_find_user(*domain, ip, user_name, key, params, SWITCH_FALSE, user, ingroup)) != SWITCH_STATUS_IGNORE) {
+		goto end;
+	}
+
 	status = SWITCH_STATUS_FALSE;
 
 	if ((groups = switch_xml_child(*domain, "groups"))) {
@@ -2292,6 +2976,11 @@ SWITCH_DECLARE(switch_status_t) switch_xml_set_root(switch_xml_t new_main)
 {
 	switch_xml_t old_root = NULL;
 
+	/* index the new tree before anyone can see it */
+	if (new_main && !new_main->parent && !((switch_xml_root_t) new_main)->index) {
+		((switch_xml_root_t) new_main)->index = xml_index_build(new_main);
+	}
+
 	switch_mutex_lock(REFLOCK);
 
 	old_root = MAIN_XML_ROOT;
@@ -2400,6 +3089,7 @@ SWITCH_DECLARE(switch_status_t) switch_xml_reload(const char **err)
 
 	if ((xml_root = switch_xml_open_root(1, err))) {
 		switch_xml_free(xml_root);
+		switch_xml_binding_cache_flush(NULL, NULL);
 		return SWITCH_STATUS_SUCCESS;
 	}
 
@@ -2419,6 +3109,11 @@ SWITCH_DECLARE(switch_status_t) switch_xml_init(switch_memory_pool_t *pool, cons
 	switch_core_hash_init(&CACHE_HASH);
 	switch_core_hash_init(&CACHE_EXPIRES_HASH);
 
+	switch_mutex_init(&BCACHE_MUTEX, SWITCH_MUTEX_NESTED, XML_MEMORY_POOL);
+	switch_thread_cond_create(&BCACHE_COND, XML_MEMORY_POOL);
+	switch_core_hash_init_nocase(&BCACHE_CONF_HASH);
+	switch_core_hash_init(&BCACHE_HASH);
+
 	switch_thread_rwlock_create(&B_RWLOCK, XML_MEMORY_POOL);
 
 	assert(pool != NULL);
@@ -2454,6 +3149,27 @@ SWITCH_DECLARE(switch_status_t) switch_xml_destroy(void)
 	switch_core_hash_destroy(&CACHE_HASH);
 	switch_core_hash_destroy(&CACHE_EXPIRES_HASH);
 
+	if (BCACHE_MUTEX) {
+		switch_hash_index_t *hi;
+
+		switch_xml_binding_cache_flush(NULL, NULL);
+
+		switch_mutex_lock(BCACHE_MUTEX);
+		for (hi = switch_core_hash_first(BCACHE_CONF_HASH); hi; hi = switch_core_hash_next(&hi)) {
+			void *val;
+			xml_bcache_conf_t *conf;
+
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			conf = (xml_bcache_conf_t *) val;
+			switch_safe_free(conf->key_template);
+			free(conf);
+		}
+		switch_core_hash_destroy(&BCACHE_CONF_HASH);
+		switch_core_hash_destroy(&BCACHE_HASH);
+		switch_mutex_unlock(BCACHE_MUTEX);
+		BCACHE_MUTEX = NULL;
+	}
+
 	return status;
 }
 
@@ -2772,6 +3488,138 @@ SWITCH_DECLARE(char *) switch_xml_toxml_buf_ex(switch_xml_t xml, char *buf, swit
 	return (char *) switch_must_realloc(s, len + 1);
 }
 
+/* grows the writer buffer by doubling so long documents don't realloc per tag */
+static void switch_xml_writer_need(switch_xml_writer_t *writer, switch_size_t need)
+{
+	if (writer->len + need + 1 > writer->max) {
+		while (writer->len + need + 1 > writer->max) {
+			writer->max *= 2;
+		}
+		writer->buf = (char *) switch_must_realloc(writer->buf, writer->max);
+	}
+}
+
+static void switch_xml_writer_puts(switch_xml_writer_t *writer, const char *s, switch_size_t len)
+{
+	switch_xml_writer_need(writer, len);
+	memcpy(writer->buf + writer->len, s, len);
+	writer->len += len;
+}
+
+static void switch_xml_writer_encode(switch_xml_writer_t *writer, const char *s, short a)
+{
+	if (!(s && *s)) {
+		return;
+	}
+
+	switch_xml_writer_need(writer, strlen(s) + 16);
+	switch_xml_ampencode(s, 0, &writer->buf, &writer->len, &writer->max, a, writer->use_utf8_encoding);
+}
+
+/* the same ">" toxml_r prints once it knows the tag has content */
+static void switch_xml_writer_end_tag(switch_xml_writer_t *writer)
+{
+	if (writer->tag_open) {
+		switch_xml_writer_puts(writer, ">", 1);
+		writer->tag_open = SWITCH_FALSE;
+	}
+}
+
+static void switch_xml_writer_indent(switch_xml_writer_t *writer)
+{
+	uint32_t i;
+
+	switch_xml_writer_need(writer, strlen(XML_INDENT) * writer->depth);
+	for (i = 0; i < writer->depth; i++) {
+		switch_xml_writer_puts(writer, XML_INDENT, strlen(XML_INDENT));
+	}
+}
+
+SWITCH_DECLARE(void) switch_xml_writer_init(switch_xml_writer_t *writer, switch_size_t size, switch_bool_t prn_header, switch_bool_t use_utf8_encoding)
+{
+	memset(writer, 0, sizeof(*writer));
+	writer->max = size > SWITCH_XML_BUFSIZE ? size : SWITCH_XML_BUFSIZE;
+	writer->buf = (char *) switch_must_malloc(writer->max);
+	writer->use_utf8_encoding = use_utf8_encoding;
+
+	if (prn_header) {
+		switch_xml_writer_puts(writer, "<?xml version=\"1.0\"?>\n", 22);
+	}
+}
+
+SWITCH_DECLARE(void) switch_xml_writer_open(switch_xml_writer_t *writer, const char *name)
+{
+	switch_xml_writer_end_tag(writer);
+
+	if (writer->len && writer->buf[writer->len - 1] == '>') {
+		switch_xml_writer_puts(writer, "\n", 1);
+	}
+	switch_xml_writer_indent(writer);
+	switch_xml_writer_puts(writer, "<", 1);
+	switch_xml_writer_puts(writer, name, strlen(name));
+
+	writer->depth++;
+	writer->tag_open = SWITCH_TRUE;
+}
+
+SWITCH_DECLARE(void) switch_xml_writer_attr(switch_xml_writer_t *writer, const char *name, const char *value)
+{
+	switch_assert(writer->tag_open);
+
+	switch_xml_writer_puts(writer, " ", 1);
+	switch_xml_writer_puts(writer, name, strlen(name));
+	switch_xml_writer_puts(writer, "=\"", 2);
+	switch_xml_writer_encode(writer, value, 1);
+	switch_xml_writer_puts(writer, "\"", 1);
+}
+
+SWITCH_DECLARE(void) switch_xml_writer_text(switch_xml_writer_t *writer, const char *txt)
+{
+	switch_xml_writer_end_tag(writer);
+	switch_xml_writer_encode(writer, txt, 0);
+}
+
+SWITCH_DECLARE(void) switch_xml_writer_close(switch_xml_writer_t *writer, const char *name)
+{
+	switch_xml_writer_end_tag(writer);
+
+	if (writer->depth > 0) {
+		writer->depth--;
+	}
+
+	if (writer->buf[writer->len - 1] == '\n') {
+		switch_xml_writer_indent(writer);
+	}
+	switch_xml_writer_puts(writer, "</", 2);
+	switch_xml_writer_puts(writer, name, strlen(name));
+	switch_xml_writer_puts(writer, ">\n", 2);
+}
+
+SWITCH_DECLARE(void) switch_xml_writer_element(switch_xml_writer_t *writer, const char *name, const char *txt)
+{
+	switch_xml_writer_open(writer, name);
+	switch_xml_writer_text(writer, txt);
+	switch_xml_writer_close(writer, name);
+}
+
+SWITCH_DECLARE(char *) switch_xml_writer_finish(switch_xml_writer_t *writer)
+{
+	char *s;
+
+	switch_xml_writer_need(writer, 0);
+	writer->buf[writer->len] = '\0';
+	s = (char *) switch_must_realloc(writer->buf, writer->len + 1);
+	memset(writer, 0, sizeof(*writer));
+
+	return s;
+}
+
+SWITCH_DECLARE(void) switch_xml_writer_destroy(switch_xml_writer_t *writer)
+{
+	switch_safe_free(writer->buf);
+	memset(writer, 0, sizeof(*writer));
+}
+
 /* free the memory allocated for the switch_xml structure */
 SWITCH_DECLARE(void) switch_xml_free(switch_xml_t xml)
 {
@@ -2841,6 +3689,7 @@ SWITCH_DECLARE(void) switch_xml_free(switch_xml_t xml)
 			free(root->m);		/* malloced xml data */
 		if (root->u)
 			free(root->u);		/* utf8 conversion */
+		xml_index_destroy(&root->index);
 	}
 
 	switch_xml_free_attr(xml->attr);	/* tag attributes */
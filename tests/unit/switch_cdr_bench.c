@@ -0,0 +1,121 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2019, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_cdr_bench.c -- times the tree and streamed CDR generators, not part of make check
+ *
+ */
+#include <switch.h>
+#include <stdlib.h>
+
+#include <test/switch_test.h>
+
+#define CDR_LOOPS 1000
+#define CDR_VARS 200
+
+FST_CORE_BEGIN("./conf")
+{
+	FST_SUITE_BEGIN(switch_cdr_bench)
+	{
+		FST_SETUP_BEGIN()
+		{
+			fst_requires_module("mod_loopback");
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+		}
+		FST_TEARDOWN_END()
+
+		FST_SESSION_BEGIN(cdr_generate)
+		{
+			switch_xml_t xml_cdr = NULL;
+			cJSON *json_cdr = NULL;
+			char *text = NULL;
+			switch_time_t start;
+			char name[32];
+			int i;
+
+			/* a call with a long variable list and a few app log entries */
+			for (i = 0; i < CDR_VARS; i++) {
+				switch_snprintf(name, sizeof(name), "cdr_bench_%d", i);
+				switch_channel_set_variable(fst_channel, name, "some value with <markup> & \"quotes\"");
+			}
+
+			for (i = 0; i < 10; i++) {
+				switch_core_session_execute_application(fst_session, "log", "DEBUG cdr bench");
+			}
+
+			start = switch_time_now();
+			for (i = 0; i < CDR_LOOPS; i++) {
+				fst_requires(switch_ivr_generate_xml_cdr(fst_session, &xml_cdr) == SWITCH_STATUS_SUCCESS);
+				text = switch_xml_toxml(xml_cdr, SWITCH_TRUE);
+				switch_xml_free(xml_cdr);
+				xml_cdr = NULL;
+				switch_safe_free(text);
+			}
+			printf("xml cdr tree: %.1fus per cdr\n", (double) (switch_time_now() - start) / CDR_LOOPS);
+
+			start = switch_time_now();
+			for (i = 0; i < CDR_LOOPS; i++) {
+				fst_requires(switch_ivr_generate_xml_cdr_text(fst_session, &text, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+				switch_safe_free(text);
+			}
+			printf("xml cdr streamed: %.1fus per cdr\n", (double) (switch_time_now() - start) / CDR_LOOPS);
+
+			start = switch_time_now();
+			for (i = 0; i < CDR_LOOPS; i++) {
+				fst_requires(switch_ivr_generate_json_cdr(fst_session, &json_cdr, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+				text = cJSON_PrintUnformatted(json_cdr);
+				cJSON_Delete(json_cdr);
+				json_cdr = NULL;
+				switch_safe_free(text);
+			}
+			printf("json cdr tree: %.1fus per cdr\n", (double) (switch_time_now() - start) / CDR_LOOPS);
+
+			start = switch_time_now();
+			for (i = 0; i < CDR_LOOPS; i++) {
+				fst_requires(switch_ivr_generate_json_cdr_text(fst_session, &text, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+				switch_safe_free(text);
+			}
+			printf("json cdr streamed: %.1fus per cdr\n", (double) (switch_time_now() - start) / CDR_LOOPS);
+		}
+		FST_SESSION_END()
+	}
+	FST_SUITE_END()
+}
+FST_CORE_END()
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -38,6 +38,67 @@
 #include <openssl/ssl.h>
 #endif
 
+static switch_log_node_t *captured[2];
+static int captured_count = 0;
+
+static switch_status_t capture_logger(const switch_log_node_t *node, switch_log_level_t level)
+{
+	if (node->content && strstr(node->content, "log-node-test") && captured_count < 2) {
+		captured[captured_count++] = switch_log_node_dup(node);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static int resolver_calls = 0;
+static int resolver_released = 0;
+
+static void test_resolver(switch_channel_t *channel, void *user_data)
+{
+	resolver_calls++;
+	switch_channel_set_variable(channel, "lazy_one", (const char *) user_data);
+	switch_channel_add_variable_var_check(channel, "lazy_two", "a", SWITCH_FALSE, SWITCH_STACK_PUSH);
+	switch_channel_add_variable_var_check(channel, "lazy_two", "b", SWITCH_FALSE, SWITCH_STACK_PUSH);
+}
+
+static void test_resolver_release(void *user_data)
+{
+	resolver_released++;
+}
+
+/* reads "<name><number>" from the pool_stats line starting with prefix */
+static uint32_t pool_stat(const char *prefix, const char *name)
+{
+	switch_stream_handle_t stream = { 0 };
+	const char *p;
+	uint32_t val = 0;
+
+	SWITCH_STANDARD_STREAM(stream);
+	switch_core_pool_stats(&stream);
+
+	if ((p = strstr((char *) stream.data, prefix)) && (p = strstr(p, name))) {
+		val = (uint32_t) atol(p + strlen(name));
+	}
+
+	switch_safe_free(stream.data);
+
+	return val;
+}
+
+static switch_bool_t pool_stat_wait(const char *name, uint32_t min)
+{
+	int i;
+
+	for (i = 0; i < 500; i++) {
+		if (pool_stat("Pool cache:", name) >= min) {
+			return SWITCH_TRUE;
+		}
+		switch_yield(10000);
+	}
+
+	return SWITCH_FALSE;
+}
+
 FST_CORE_BEGIN("./conf")
 {
 	FST_SUITE_BEGIN(switch_core)
@@ -239,6 +300,120 @@ FST_CORE_BEGIN("./conf")
 			fst_check_int_equals(switch_safe_atoll(0, 3), 3);
 		}
 		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_log_node)
+		{
+			char long_line[3000];
+			int i;
+
+			memset(long_line, 'x', sizeof(long_line) - 1);
+			long_line[sizeof(long_line) - 1] = '\0';
+
+			switch_log_bind_logger(capture_logger, SWITCH_LOG_DEBUG, SWITCH_FALSE);
+			switch_log_printf(SWITCH_CHANNEL_ID_LOG, __FILE__, __SWITCH_FUNC__, __LINE__, "some-uuid", SWITCH_LOG_WARNING, "log-node-test short\n");
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "log-node-test %s\n", long_line);
+
+			for (i = 0; i < 100 && captured_count < 2; i++) {
+				switch_yield(10000);
+			}
+
+			switch_log_unbind_logger(capture_logger);
+			fst_requires(captured_count == 2);
+
+			/* content keeps the leading space after the date/level/file prefix */
+			fst_check_string_equals(captured[0]->content, " log-node-test short\n");
+			fst_check(captured[0]->content > captured[0]->data);
+			fst_check_string_equals(captured[0]->userdata, "some-uuid");
+			fst_check(strlen(captured[1]->content) == strlen(" log-node-test \n") + strlen(long_line));
+
+			switch_log_node_free(&captured[0]);
+			switch_log_node_free(&captured[1]);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_pool_stats)
+		{
+			switch_memory_pool_t *pools[8] = { 0 };
+			char site[64];
+			uint32_t reused, trimmed;
+			int i, line = 0;
+
+			switch_core_memory_pool_cache_set(100, 64, 1);
+
+			for (i = 0; i < 8; i++) {
+				switch_core_new_memory_pool(&pools[i]); line = __LINE__;
+				switch_core_alloc(pools[i], 1000);
+			}
+
+			for (i = 0; i < 8; i++) {
+				switch_core_destroy_memory_pool(&pools[i]);
+			}
+
+			/* after the grace period the pool thread parks them in the depot */
+			fst_requires(pool_stat_wait("depot:", 8));
+
+			reused = pool_stat("Pool cache:", "reused:");
+			for (i = 0; i < 8; i++) {
+				switch_core_new_memory_pool(&pools[i]);
+			}
+			fst_check(pool_stat("Pool cache:", "reused:") >= reused + 8);
+
+			/* pools are accounted against the file:line that created them */
+			switch_snprintf(site, sizeof(site), "Pool 'switch_core.c:%d'", line);
+			fst_check(pool_stat(site, "created:") >= 8);
+			fst_check(pool_stat(site, "max_bytes:") >= 1000);
+
+			for (i = 0; i < 8; i++) {
+				switch_core_destroy_memory_pool(&pools[i]);
+			}
+			fst_requires(pool_stat_wait("depot:", 8));
+
+			/* nothing takes them this time, so a trim interval later they go back to the OS */
+			trimmed = pool_stat("Pool cache:", "trimmed:");
+			fst_check(pool_stat_wait("trimmed:", trimmed + 8));
+
+			switch_core_memory_pool_cache_set(0, 0, 0);
+
+			/* with the cache off pools are neither accounted nor attached */
+			switch_core_new_memory_pool(&pools[0]); line = __LINE__;
+			switch_core_alloc(pools[0], 1000);
+			switch_snprintf(site, sizeof(site), "Pool 'switch_core.c:%d'", line);
+			fst_check(pool_stat(site, "created:") == 0);
+			switch_core_destroy_memory_pool(&pools[0]);
+		}
+		FST_TEST_END()
+
+		FST_SESSION_BEGIN(test_variable_resolver)
+		{
+			switch_channel_t *channel = switch_core_session_get_channel(fst_session);
+			switch_event_t *vars = NULL;
+
+			resolver_calls = resolver_released = 0;
+			fst_check(switch_channel_set_variable_resolver(channel, "lazy_", test_resolver, test_resolver_release, "one") == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_channel_set_variable_resolver(channel, "lazy_", test_resolver, test_resolver_release, "one") == SWITCH_STATUS_FALSE);
+
+			/* other variables don't trigger it */
+			switch_channel_set_variable(channel, "eager", "yes");
+			fst_check_string_equals(switch_channel_get_variable(channel, "eager"), "yes");
+			fst_check(resolver_calls == 0);
+
+			fst_check_string_equals(switch_channel_get_variable(channel, "lazy_one"), "one");
+			fst_check_string_equals(switch_channel_get_variable_dup(channel, "lazy_two", SWITCH_FALSE, 1), "b");
+			fst_check(resolver_calls == 1);
+			fst_check(resolver_released == 1);
+
+			/* a second resolver is materialized by listing the variables */
+			fst_check(switch_channel_set_variable_resolver(channel, "lazy_", test_resolver, test_resolver_release, "two") == SWITCH_STATUS_SUCCESS);
+			switch_channel_get_variables(channel, &vars);
+			fst_requires(vars);
+			fst_check_string_equals(switch_event_get_header(vars, "lazy_one"), "two");
+			switch_event_destroy(&vars);
+			fst_check(resolver_calls == 2);
+
+			/* left pending, the channel resolves or releases it on the way down */
+			fst_check(switch_channel_set_variable_resolver(channel, "lazy_", test_resolver, test_resolver_release, "three") == SWITCH_STATUS_SUCCESS);
+		}
+		FST_SESSION_END()
 	}
 	FST_SUITE_END()
 }
@@ -127,6 +127,33 @@ FST_CORE_BEGIN("./conf")
 
 		}
 		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_switch_loadable_module_get_codecs_sorted_cached)
+		{
+			const switch_codec_implementation_t *first[SWITCH_MAX_CODECS] = { 0 };
+			const switch_codec_implementation_t *second[SWITCH_MAX_CODECS] = { 0 };
+			char first_fmtp[SWITCH_MAX_CODECS][MAX_FMTP_LEN] = {{ 0 }};
+			char second_fmtp[SWITCH_MAX_CODECS][MAX_FMTP_LEN] = {{ 0 }};
+			char codec_string[] = "OPUS~useinbandfec=1,PCMU@20i,PCMA";
+			char *prefs[SWITCH_MAX_CODECS] = { 0 };
+			int num_prefs, a, b, x;
+
+			num_prefs = switch_separate_string(codec_string, ',', prefs, SWITCH_MAX_CODECS);
+
+			/* the second call is answered from the cache and has to look exactly like the first */
+			a = switch_loadable_module_get_codecs_sorted(first, first_fmtp, SWITCH_MAX_CODECS, prefs, num_prefs);
+			b = switch_loadable_module_get_codecs_sorted(second, second_fmtp, SWITCH_MAX_CODECS, prefs, num_prefs);
+			fst_check(a == 3);
+			fst_check(a == b);
+
+			for (x = 0; x < a && x < b; x++) {
+				fst_check(first[x] == second[x]);
+				fst_check_string_equals(first_fmtp[x], second_fmtp[x]);
+			}
+
+			fst_check_string_equals(second_fmtp[0], "useinbandfec=1");
+		}
+		FST_TEST_END()
 	}
 	FST_SUITE_END()
 }
@@ -0,0 +1,122 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2019, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_core_media_bug.c -- tests media bugs on the frame path
+ *
+ */
+#include <switch.h>
+#include <stdlib.h>
+
+#include <test/switch_test.h>
+
+#define BENCH_FRAMES 50000
+
+static switch_bool_t bench_bug_callback(switch_media_bug_t *bug, void *user_data, switch_abc_type_t type)
+{
+	uint32_t *hits = (uint32_t *) user_data;
+
+	if (type == SWITCH_ABC_TYPE_WRITE_REPLACE) {
+		(*hits)++;
+	}
+
+	return SWITCH_TRUE;
+}
+
+static double write_frames(switch_core_session_t *session, int loops)
+{
+	switch_codec_implementation_t write_impl = { 0 };
+	switch_frame_t frame = { 0 };
+	int16_t data[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
+	switch_time_t start, elapsed;
+	int x;
+
+	switch_core_session_get_write_impl(session, &write_impl);
+
+	frame.codec = switch_core_session_get_write_codec(session);
+	frame.data = data;
+	frame.datalen = write_impl.decoded_bytes_per_packet;
+	frame.samples = write_impl.samples_per_packet;
+	frame.rate = write_impl.actual_samples_per_second;
+	frame.channels = write_impl.number_of_channels;
+
+	start = switch_time_now();
+	for (x = 0; x < loops; x++) {
+		switch_core_session_write_frame(session, &frame, SWITCH_IO_FLAG_NONE, 0);
+	}
+	elapsed = switch_time_now() - start;
+
+	return elapsed ? loops / (elapsed / 1000000.0) : 0;
+}
+
+FST_CORE_BEGIN("./conf")
+{
+	FST_SUITE_BEGIN(switch_core_media_bug)
+	{
+		FST_SETUP_BEGIN()
+		{
+		}
+		FST_SETUP_END()
+
+		FST_TEARDOWN_BEGIN()
+		{
+		}
+		FST_TEARDOWN_END()
+
+		FST_SESSION_BEGIN(frame_path_benchmark)
+		{
+			int counts[] = { 0, 1, 5 };
+			int i;
+
+			/* drop the recording the test harness attaches so the 0 bug run has no bugs at all */
+			switch_ivr_stop_record_session(fst_session, "all");
+
+			for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); i++) {
+				switch_media_bug_t *bugs[5] = { 0 };
+				uint32_t hits = 0;
+				double rate;
+				int x;
+
+				for (x = 0; x < counts[i]; x++) {
+					fst_requires(switch_core_media_bug_add(fst_session, "bench", NULL, bench_bug_callback, &hits, 0,
+														   SMBF_WRITE_REPLACE | SMBF_NO_PAUSE, &bugs[x]) == SWITCH_STATUS_SUCCESS);
+				}
+
+				rate = write_frames(fst_session, BENCH_FRAMES);
+				fst_check(hits == (uint32_t) (BENCH_FRAMES * counts[i]));
+				printf("write_frame with %d media bug(s): %.0f frames per second\n", counts[i], rate);
+
+				for (x = 0; x < counts[i]; x++) {
+					fst_check(switch_core_media_bug_remove(fst_session, &bugs[x]) == SWITCH_STATUS_SUCCESS);
+				}
+
+				fst_check(switch_core_media_bug_count(fst_session, "bench") == 0);
+			}
+		}
+		FST_SESSION_END()
+	}
+	FST_SUITE_END()
+}
+FST_CORE_END()
@@ -104,6 +104,49 @@ FST_TEST_BEGIN(benchmark)
 }
 FST_TEST_END()
 
+FST_TEST_BEGIN(json)
+{
+  switch_event_t *event = NULL, *parsed = NULL;
+  cJSON *cj = NULL;
+  char *str = NULL, *ref = NULL;
+
+  fst_requires(switch_event_create(&event, SWITCH_EVENT_CUSTOM) == SWITCH_STATUS_SUCCESS);
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "quote\"d", "tab\there \\ \x01 caf\xc3\xa9");
+  switch_event_add_header_string(event, SWITCH_STACK_PUSH, "list", "one");
+  switch_event_add_header_string(event, SWITCH_STACK_PUSH, "list", "two");
+  switch_event_add_body(event, "line1\nline2");
+
+  /* the writer must produce the same text as the cJSON tree it replaced */
+  fst_check(switch_event_serialize_json(event, &str) == SWITCH_STATUS_SUCCESS);
+  fst_check(switch_event_serialize_json_obj(event, &cj) == SWITCH_STATUS_SUCCESS);
+  ref = cJSON_PrintUnformatted(cj);
+  fst_check_string_equals(str, ref);
+
+  fst_check(switch_event_create_json(&parsed, str) == SWITCH_STATUS_SUCCESS);
+  fst_check(parsed->event_id == SWITCH_EVENT_CUSTOM);
+  fst_check_string_equals(switch_event_get_header(parsed, "quote\"d"), "tab\there \\ \x01 caf\xc3\xa9");
+  fst_check_string_equals(switch_event_get_header_idx(parsed, "list", 1), "two");
+  fst_check_string_equals(parsed->body, "line1\nline2");
+  switch_event_destroy(&parsed);
+
+  fst_check(switch_event_create_json(&parsed, "{\"a\":\"\\u00e9\\ud83d\\ude00\\/\",\"n\":1,\"o\":{\"x\":\"y\"},\"l\":[\"s\",2,null]}") == SWITCH_STATUS_SUCCESS);
+  fst_check_string_equals(switch_event_get_header(parsed, "a"), "\xc3\xa9\xf0\x9f\x98\x80/");
+  fst_check(switch_event_get_header(parsed, "n") == NULL);
+  fst_check(switch_event_get_header(parsed, "o") == NULL);
+  fst_check_string_equals(switch_event_get_header_idx(parsed, "l", 0), "s");
+  switch_event_destroy(&parsed);
+
+  fst_check(switch_event_create_json(&parsed, "{\"a\":\"b\",}") == SWITCH_STATUS_FALSE);
+  fst_check(switch_event_create_json(&parsed, "{\"a\":\"\\ude00\"}") == SWITCH_STATUS_FALSE);
+  fst_check(switch_event_create_json(&parsed, "{\"a\":\"unterminated}") == SWITCH_STATUS_FALSE);
+
+  cJSON_Delete(cj);
+  free(ref);
+  free(str);
+  switch_event_destroy(&event);
+}
+FST_TEST_END()
+
 FST_SUITE_END()
 
 FST_MINCORE_END()
@@ -812,6 +812,45 @@ FST_CORE_BEGIN("./conf")
 			switch_dial_handle_list_destroy(&dl);
 		}
 		FST_SESSION_END()
+
+		FST_SESSION_BEGIN(generate_cdr_text)
+		{
+			switch_xml_t xml_cdr = NULL;
+			cJSON *json_cdr = NULL;
+			char *tree_text, *text = NULL;
+
+			switch_channel_set_variable(fst_channel, "cdr_plain", "value");
+			switch_channel_set_variable(fst_channel, "cdr_special", "<a href=\"x\">&amp;</a>\n\t\"quoted\"\\");
+			switch_channel_set_variable(fst_channel, "cdr_utf8", "Voulez-Vous Parler Fran\xc3\xa7" "ais");
+			switch_channel_add_variable_var_check(fst_channel, "cdr_array", "one", SWITCH_FALSE, SWITCH_STACK_PUSH);
+			switch_channel_add_variable_var_check(fst_channel, "cdr_array", "two", SWITCH_FALSE, SWITCH_STACK_PUSH);
+			switch_core_session_execute_application(fst_session, "log", "INFO streamed <cdr> & \"app_log\"");
+
+			fst_requires(switch_ivr_generate_xml_cdr(fst_session, &xml_cdr) == SWITCH_STATUS_SUCCESS);
+			tree_text = switch_xml_toxml(xml_cdr, SWITCH_TRUE);
+			fst_requires(switch_ivr_generate_xml_cdr_text(fst_session, &text, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(text, tree_text);
+			switch_xml_free(xml_cdr);
+			switch_safe_free(tree_text);
+			switch_safe_free(text);
+
+			fst_requires(switch_ivr_generate_json_cdr(fst_session, &json_cdr, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+			tree_text = cJSON_PrintUnformatted(json_cdr);
+			fst_requires(switch_ivr_generate_json_cdr_text(fst_session, &text, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(text, tree_text);
+			cJSON_Delete(json_cdr);
+			switch_safe_free(tree_text);
+			switch_safe_free(text);
+
+			fst_requires(switch_ivr_generate_json_cdr(fst_session, &json_cdr, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS);
+			tree_text = cJSON_PrintUnformatted(json_cdr);
+			fst_requires(switch_ivr_generate_json_cdr_text(fst_session, &text, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(text, tree_text);
+			cJSON_Delete(json_cdr);
+			switch_safe_free(tree_text);
+			switch_safe_free(text);
+		}
+		FST_SESSION_END()
 	}
 	FST_SUITE_END()
 }
@@ -0,0 +1,406 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2019, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_resample.c -- tests the resampler and the vector PCM helpers
+ *
+ */
+#include <switch.h>
+#include <g711.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <test/switch_test.h>
+
+#define PCM_SAMPLES 4096
+#define BENCH_LOOPS 2000
+
+static const switch_simd_level_t levels[] = { SWITCH_SIMD_SSE2, SWITCH_SIMD_AVX2, SWITCH_SIMD_NEON };
+
+static int16_t a[PCM_SAMPLES * 2], b[PCM_SAMPLES * 2], want[PCM_SAMPLES * 2], got[PCM_SAMPLES * 2];
+
+static void fill_random(void)
+{
+	int i;
+
+	for (i = 0; i < PCM_SAMPLES * 2; i++) {
+		a[i] = (int16_t) (rand() & 0xFFFF);
+		b[i] = (int16_t) (rand() & 0xFFFF);
+	}
+}
+
+/* a copy of the scalar generator from a known seed */
+static int16_t silence_sample(int16_t *rnd, uint32_t divisor)
+{
+	int sum_rnd = 0;
+	int x;
+
+	for (x = 0; x < 6; x++) {
+		*rnd = *rnd * 31821U + 13849U;
+		sum_rnd += *rnd;
+	}
+
+	return (int16_t) ((int16_t) sum_rnd / (int) divisor);
+}
+
+/* the seed is time based, so find the one that produced the first samples and replay the whole buffer */
+static switch_bool_t silence_matches(const int16_t *data, uint32_t samples, uint32_t channels, uint32_t divisor)
+{
+	uint32_t seed, i, j;
+
+	for (seed = 0; seed < 0x10000; seed++) {
+		int16_t rnd = (int16_t) seed;
+
+		for (i = 0; i < samples; i++) {
+			int16_t s = silence_sample(&rnd, divisor);
+
+			for (j = 0; j < channels; j++) {
+				if (data[i * channels + j] != s) break;
+			}
+
+			if (j < channels) break;
+		}
+
+		if (i == samples) return SWITCH_TRUE;
+	}
+
+	return SWITCH_FALSE;
+}
+
+static double samples_per_ns(switch_time_t start, uint32_t samples)
+{
+	switch_time_t elapsed = switch_time_now() - start;
+
+	return elapsed ? (double) samples * BENCH_LOOPS / (elapsed * 1000.0) : 0;
+}
+
+/* least squares fit of a tone at a known frequency, everything left over counts as noise */
+static double tone_snr(const int16_t *data, uint32_t samples, double freq, uint32_t rate)
+{
+	double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0, det, fa, fb, sig = 0, err = 0;
+	uint32_t i, skip = rate / 10;
+
+	for (i = skip; i < samples; i++) {
+		double s = sin(2 * M_PI * freq * i / rate), c = cos(2 * M_PI * freq * i / rate);
+
+		ss += s * s;
+		cc += c * c;
+		sc += s * c;
+		ys += data[i] * s;
+		yc += data[i] * c;
+	}
+
+	det = ss * cc - sc * sc;
+	fa = (ys * cc - yc * sc) / det;
+	fb = (yc * ss - ys * sc) / det;
+
+	for (i = skip; i < samples; i++) {
+		double fit = fa * sin(2 * M_PI * freq * i / rate) + fb * cos(2 * M_PI * freq * i / rate);
+
+		sig += fit * fit;
+		err += (data[i] - fit) * (data[i] - fit);
+	}
+
+	return err ? 10 * log10(sig / err) : 200;
+}
+
+/* resample two seconds of a 1khz tone in 20ms frames, returns the output length */
+static uint32_t resample_tone(uint32_t from, uint32_t to, switch_resample_tier_t tier, int16_t *out, double *ns_per_sample, const char **engine)
+{
+	switch_audio_resampler_t *resampler = NULL;
+	uint32_t samples = from * 2, frame = from / 50, i, len = 0;
+	int16_t *in = malloc(samples * sizeof(int16_t));
+	switch_time_t start;
+
+	for (i = 0; i < samples; i++) {
+		in[i] = (int16_t) (16000 * sin(2 * M_PI * 1000 * i / from));
+	}
+
+	switch_resample_create_tier(&resampler, from, to, frame, tier, 1);
+	*engine = switch_resample_engine_name(resampler);
+
+	start = switch_time_now();
+	for (i = 0; i + frame <= samples; i += frame) {
+		switch_resample_process(resampler, in + i, frame);
+		memcpy(out + len, resampler->to, resampler->to_len * sizeof(int16_t));
+		len += resampler->to_len;
+	}
+	*ns_per_sample = (switch_time_now() - start) * 1000.0 / samples;
+
+	switch_resample_destroy(&resampler);
+	free(in);
+
+	return len;
+}
+
+FST_MINCORE_BEGIN("./conf")
+
+FST_SUITE_BEGIN(switch_resample)
+
+FST_SETUP_BEGIN()
+{
+}
+FST_SETUP_END()
+
+FST_TEARDOWN_BEGIN()
+{
+	/* asking for more than the cpu has restores the best level it supports */
+	switch_pcm_simd_set_level(SWITCH_SIMD_NEON);
+}
+FST_TEARDOWN_END()
+
+FST_TEST_BEGIN(g711_bit_exact)
+{
+	static int16_t linear[0x10000], decoded[256];
+	static uint8_t encoded[0x10000], codes[256];
+	uint32_t i, l;
+
+	for (i = 0; i < 0x10000; i++) {
+		linear[i] = (int16_t) i;
+	}
+
+	for (i = 0; i < 256; i++) {
+		codes[i] = (uint8_t) i;
+	}
+
+	for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		if (switch_pcm_simd_set_level(levels[l]) != levels[l]) continue;
+
+		/* odd length so the scalar tail runs too */
+		switch_sln_to_ulaw(linear, encoded, 0xFFFF);
+		for (i = 0; i < 0xFFFF && encoded[i] == linear_to_ulaw(linear[i]); i++);
+		fst_check(i == 0xFFFF);
+
+		switch_sln_to_alaw(linear, encoded, 0xFFFF);
+		for (i = 0; i < 0xFFFF && encoded[i] == linear_to_alaw(linear[i]); i++);
+		fst_check(i == 0xFFFF);
+
+		switch_ulaw_to_sln(codes, decoded, 256);
+		for (i = 0; i < 256 && decoded[i] == ulaw_to_linear(codes[i]); i++);
+		fst_check(i == 256);
+
+		switch_alaw_to_sln(codes, decoded, 256);
+		for (i = 0; i < 256 && decoded[i] == alaw_to_linear(codes[i]); i++);
+		fst_check(i == 256);
+	}
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(pcm_bit_exact)
+{
+	uint32_t l, n;
+	int32_t vol;
+
+	srand(1234);
+
+	for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		if (switch_pcm_simd_set_level(levels[l]) != levels[l]) continue;
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "checking %s\n", switch_pcm_simd_name(levels[l]));
+
+		for (n = 1; n < PCM_SAMPLES; n += 331) {
+			fill_random();
+
+			switch_pcm_simd_set_level(SWITCH_SIMD_NONE);
+			memcpy(want, a, sizeof(a));
+			switch_merge_sln(want, n, b, n, 2);
+			switch_pcm_simd_set_level(levels[l]);
+			memcpy(got, a, sizeof(a));
+			switch_merge_sln(got, n, b, n, 2);
+			fst_check(!memcmp(want, got, sizeof(got)));
+
+			switch_pcm_simd_set_level(SWITCH_SIMD_NONE);
+			memcpy(want, a, sizeof(a));
+			switch_unmerge_sln(want, n, b, n, 1);
+			switch_pcm_simd_set_level(levels[l]);
+			memcpy(got, a, sizeof(a));
+			switch_unmerge_sln(got, n, b, n, 1);
+			fst_check(!memcmp(want, got, sizeof(got)));
+
+			for (vol = -SWITCH_GRANULAR_VOLUME_MAX; vol <= SWITCH_GRANULAR_VOLUME_MAX; vol++) {
+				switch_pcm_simd_set_level(SWITCH_SIMD_NONE);
+				memcpy(want, a, sizeof(a));
+				switch_change_sln_volume_granular(want, n, vol);
+				switch_pcm_simd_set_level(levels[l]);
+				memcpy(got, a, sizeof(a));
+				switch_change_sln_volume_granular(got, n, vol);
+				fst_check(!memcmp(want, got, sizeof(got)));
+			}
+
+			for (vol = -4; vol <= 4; vol++) {
+				switch_pcm_simd_set_level(SWITCH_SIMD_NONE);
+				memcpy(want, a, sizeof(a));
+				switch_change_sln_volume(want, n, vol);
+				switch_pcm_simd_set_level(levels[l]);
+				memcpy(got, a, sizeof(a));
+				switch_change_sln_volume(got, n, vol);
+				fst_check(!memcmp(want, got, sizeof(got)));
+			}
+
+			switch_pcm_simd_set_level(SWITCH_SIMD_NONE);
+			memcpy(want, a, sizeof(a));
+			switch_mux_channels(want, n, 2, 1);
+			switch_pcm_simd_set_level(levels[l]);
+			memcpy(got, a, sizeof(a));
+			switch_mux_channels(got, n, 2, 1);
+			fst_check(!memcmp(want, got, sizeof(got)));
+
+			switch_pcm_simd_set_level(SWITCH_SIMD_NONE);
+			memcpy(want, a, sizeof(a));
+			switch_mux_channels(want, n, 1, 2);
+			switch_pcm_simd_set_level(levels[l]);
+			memcpy(got, a, sizeof(a));
+			switch_mux_channels(got, n, 1, 2);
+			fst_check(!memcmp(want, got, sizeof(got)));
+
+			switch_generate_sln_silence(got, n, 1, 1);
+			fst_check(silence_matches(got, n, 1, 1));
+			switch_generate_sln_silence(got, n, 2, 400);
+			fst_check(silence_matches(got, n, 2, 400));
+		}
+	}
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(tiers_default_to_speex)
+{
+	switch_audio_resampler_t *resampler = NULL;
+
+	fst_requires(switch_resample_create_tier(&resampler, 8000, 16000, 160, SWITCH_RESAMPLE_TIER_CONFERENCE, 1) == SWITCH_STATUS_SUCCESS);
+	fst_check_string_equals(switch_resample_engine_name(resampler), "speex");
+	switch_resample_destroy(&resampler);
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(polyphase_vs_speex)
+{
+	static const uint32_t rates[][2] = { { 8000, 16000 }, { 16000, 8000 }, { 8000, 48000 }, { 48000, 8000 }, { 16000, 48000 }, { 44100, 48000 } };
+	static const switch_resample_tier_t tiers[] = { SWITCH_RESAMPLE_TIER_SPEEX, SWITCH_RESAMPLE_TIER_CONFERENCE,
+													SWITCH_RESAMPLE_TIER_ASR, SWITCH_RESAMPLE_TIER_RECORDING };
+	int16_t *out = malloc(48000 * 3 * sizeof(int16_t));
+	uint32_t r, t;
+
+	switch_resample_set_engine(SWITCH_RESAMPLE_ENGINE_TIERED);
+
+	for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+		for (t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+			const char *engine = NULL;
+			double ns, snr;
+			uint32_t len = resample_tone(rates[r][0], rates[r][1], tiers[t], out, &ns, &engine);
+
+			snr = tone_snr(out, len, 1000, rates[r][1]);
+			printf("%u -> %u tier %d (%s): %.1f dB snr, %.1f ns per input sample\n", rates[r][0], rates[r][1], tiers[t], engine, snr, ns);
+
+			if (tiers[t] != SWITCH_RESAMPLE_TIER_SPEEX) {
+				/* whole frames of the common ratios come out at exactly the new rate */
+				fst_check_string_equals(engine, "polyphase");
+				fst_check(len == rates[r][1] * 2);
+				fst_check(snr > 70);
+			}
+		}
+	}
+
+	switch_resample_set_engine(SWITCH_RESAMPLE_ENGINE_SPEEX);
+	free(out);
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(legacy_create_keeps_speex)
+{
+	switch_audio_resampler_t *resampler = NULL;
+
+	/* tiered only moves the callers that ask for a tier */
+	switch_resample_set_engine(SWITCH_RESAMPLE_ENGINE_TIERED);
+	fst_requires(switch_resample_create(&resampler, 8000, 16000, 160, SWITCH_RESAMPLE_QUALITY, 1) == SWITCH_STATUS_SUCCESS);
+	fst_check_string_equals(switch_resample_engine_name(resampler), "speex");
+	switch_resample_destroy(&resampler);
+	switch_resample_set_engine(SWITCH_RESAMPLE_ENGINE_SPEEX);
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(benchmark)
+{
+	static uint8_t encoded[PCM_SAMPLES];
+	switch_simd_level_t all[] = { SWITCH_SIMD_NONE, SWITCH_SIMD_SSE2, SWITCH_SIMD_AVX2, SWITCH_SIMD_NEON };
+	switch_time_t start;
+	uint32_t l;
+	int x;
+
+	fill_random();
+
+	for (l = 0; l < sizeof(all) / sizeof(all[0]); l++) {
+		const char *name = switch_pcm_simd_name(all[l]);
+
+		if (switch_pcm_simd_set_level(all[l]) != all[l]) continue;
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_merge_sln(a, PCM_SAMPLES, b, PCM_SAMPLES, 1);
+		printf("%s merge: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES));
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_change_sln_volume_granular(a, PCM_SAMPLES, -3);
+		printf("%s volume: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES));
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_mux_channels(b, PCM_SAMPLES / 2, 2, 1);
+		printf("%s stereo to mono: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES / 2));
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_generate_sln_silence(a, PCM_SAMPLES, 1, 400);
+		printf("%s comfort noise: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES));
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_sln_to_ulaw(a, encoded, PCM_SAMPLES);
+		printf("%s ulaw encode: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES));
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_ulaw_to_sln(encoded, a, PCM_SAMPLES);
+		printf("%s ulaw decode: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES));
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_sln_to_alaw(a, encoded, PCM_SAMPLES);
+		printf("%s alaw encode: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES));
+
+		start = switch_time_now();
+		for (x = 0; x < BENCH_LOOPS; x++) switch_alaw_to_sln(encoded, a, PCM_SAMPLES);
+		printf("%s alaw decode: %.3f samples/ns\n", name, samples_per_ns(start, PCM_SAMPLES));
+	}
+}
+FST_TEST_END()
+
+FST_SUITE_END()
+
+FST_MINCORE_END()
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -32,6 +32,23 @@
 #include <switch.h>
 #include <test/switch_test.h>
 
+static int stub_lookups = 0;
+static int stub_generation = 0;
+
+/* stands in for getaddrinfo() under the dns cache, <letter>.example resolves to 192.0.2.<n> */
+static switch_status_t stub_resolver(const char *host, int family, char *buf, size_t buflen)
+{
+    stub_lookups++;
+
+    if (strlen(host) != 9 || strcmp(host + 1, ".example")) {
+        return SWITCH_STATUS_FALSE;
+    }
+
+    switch_snprintf(buf, buflen, "192.0.2.%d", host[0] - 'a' + 1 + stub_generation * 100);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
 FST_MINCORE_BEGIN("./conf")
 
 FST_SUITE_BEGIN(switch_hash)
@@ -80,6 +97,215 @@ FST_TEST_BEGIN(b64)
 }
 FST_TEST_END()
 
+FST_TEST_BEGIN(frame_pool)
+{
+    switch_frame_pool_stats_t before[8], after[8];
+    switch_frame_t orig = { 0 };
+    switch_frame_t *clones[64];
+    unsigned char packet[1500] = { 0 };
+    int i, j, n;
+
+    orig.packet = packet;
+    orig.packetlen = sizeof(packet);
+    orig.data = packet + 12;
+    orig.datalen = sizeof(packet) - 12;
+    orig.buflen = sizeof(packet);
+    packet[12] = 0x5a;
+
+    /* warm the cache so later rounds should be served without malloc */
+    for (i = 0; i < 64; i++) switch_frame_dup(&orig, &clones[i]);
+    for (i = 0; i < 64; i++) switch_frame_free(&clones[i]);
+
+    n = switch_frame_pool_stats(before, 8);
+    fst_check(n > 1);
+
+    for (j = 0; j < 100; j++) {
+        for (i = 0; i < 64; i++) {
+            fst_check(switch_frame_dup(&orig, &clones[i]) == SWITCH_STATUS_SUCCESS);
+            fst_check(((unsigned char *)clones[i]->data)[0] == 0x5a);
+        }
+        for (i = 0; i < 64; i++) {
+            switch_frame_free(&clones[i]);
+            fst_check(clones[i] == NULL);
+        }
+    }
+
+    fst_check(switch_frame_pool_stats(after, 8) == n);
+
+    for (i = 0; i < n; i++) {
+        fst_check(after[i].in_use == before[i].in_use);
+        fst_check(after[i].allocated == before[i].allocated);
+    }
+
+    /* the first class holds the frame headers */
+    fst_check(after[0].high_water >= 64);
+
+    /* a caller swapping in its own buffer still hands the pool buffer back */
+    fst_check(switch_frame_alloc(&clones[0], 160) == SWITCH_STATUS_SUCCESS);
+    clones[0]->data = malloc(160);
+    switch_frame_free(&clones[0]);
+
+    /* SFF_DYNAMIC frames built by hand are not mistaken for pool frames */
+    clones[0] = calloc(1, sizeof(switch_frame_t));
+    clones[0]->data = malloc(160);
+    switch_set_flag(clones[0], SFF_DYNAMIC);
+    fst_check(switch_frame_free(&clones[0]) == SWITCH_STATUS_SUCCESS);
+
+    /* copies of a pool frame into a frame buffer don't inherit SFF_POOLED */
+    {
+        switch_frame_buffer_t *fb = NULL;
+        switch_frame_t *copy = NULL;
+
+        fst_check(switch_frame_dup(&orig, &clones[0]) == SWITCH_STATUS_SUCCESS);
+        fst_check(switch_test_flag(clones[0], SFF_POOLED));
+        fst_check(switch_frame_buffer_create(&fb, 0) == SWITCH_STATUS_SUCCESS);
+        fst_check(switch_frame_buffer_dup(fb, clones[0], &copy) == SWITCH_STATUS_SUCCESS);
+        fst_check(!switch_test_flag(copy, SFF_POOLED));
+        switch_frame_buffer_free(fb, &copy);
+        switch_frame_buffer_destroy(&fb);
+        switch_frame_free(&clones[0]);
+    }
+
+    switch_frame_pool_stats(after, 8);
+
+    for (i = 0; i < n; i++) {
+        fst_check(after[i].in_use == before[i].in_use);
+    }
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(network_list_host_order)
+{
+    switch_memory_pool_t *pool = NULL;
+    switch_network_list_t *list = NULL;
+    uint32_t ip = ntohl(inet_addr("10.0.0.1"));
+
+    switch_core_new_memory_pool(&pool);
+    fst_requires(switch_network_list_create(&list, "test", SWITCH_FALSE, pool) == SWITCH_STATUS_SUCCESS);
+
+    /* among exact entries the first one added decides, whichever call added it */
+    switch_network_list_add_host_mask(list, "10.0.0.1", "255.255.255.255", SWITCH_TRUE);
+    switch_network_list_add_cidr(list, "10.0.0.1/32", SWITCH_FALSE);
+    switch_network_list_add_cidr(list, "10.0.0.0/8", SWITCH_FALSE);
+    fst_check(switch_network_list_validate_ip_token(list, ip, NULL) == SWITCH_TRUE);
+    fst_check(switch_network_list_validate_ip_token(list, ntohl(inet_addr("10.0.0.2")), NULL) == SWITCH_FALSE);
+
+    switch_core_destroy_memory_pool(&pool);
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(network_list_host_mask_ipv6)
+{
+    switch_memory_pool_t *pool = NULL;
+    switch_network_list_t *list = NULL;
+    ip_t ip;
+
+    switch_core_new_memory_pool(&pool);
+    fst_requires(switch_network_list_create(&list, "test", SWITCH_FALSE, pool) == SWITCH_STATUS_SUCCESS);
+
+    /* the family comes from the address, so a v6 host/mask matches v6 peers */
+    fst_check(switch_network_list_add_host_mask(list, "2001:db8::", "ffff:ffff::", SWITCH_TRUE) == SWITCH_STATUS_SUCCESS);
+    fst_check(switch_network_list_add_host_mask(list, "2001:db8::", "bogus", SWITCH_TRUE) == SWITCH_STATUS_GENERR);
+
+    switch_inet_pton(AF_INET6, "2001:db8::1", &ip);
+    fst_check(switch_network_list_validate_ip6_token(list, ip, NULL) == SWITCH_TRUE);
+    switch_inet_pton(AF_INET6, "2001:db9::1", &ip);
+    fst_check(switch_network_list_validate_ip6_token(list, ip, NULL) == SWITCH_FALSE);
+
+    /* and it is never taken for a v4 entry */
+    fst_check(switch_network_list_validate_ip_token(list, 0, NULL) == SWITCH_FALSE);
+
+    switch_core_destroy_memory_pool(&pool);
+}
+FST_TEST_END()
+
+FST_TEST_BEGIN(dns_cache)
+{
+    char buf[80] = "";
+    char *answer = NULL;
+    switch_stream_handle_t stream = { 0 };
+    int i;
+
+    switch_dns_cache_set_resolver(stub_resolver);
+    switch_dns_cache_set(60, 5, 30, 100);
+
+    /* the second lookup is answered from the cache */
+    stub_lookups = 0;
+    fst_check(switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf)) == SWITCH_STATUS_SUCCESS);
+    fst_check_string_equals(buf, "192.0.2.1");
+    fst_check(switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf)) == SWITCH_STATUS_SUCCESS);
+    fst_check_string_equals(buf, "192.0.2.1");
+    fst_check(stub_lookups == 1);
+
+    /* a name that does not resolve is remembered too */
+    fst_check(switch_resolve_host("no-such-host.invalid", buf, sizeof(buf)) == SWITCH_STATUS_FALSE);
+    fst_check(switch_resolve_host("no-such-host.invalid", buf, sizeof(buf)) == SWITCH_STATUS_FALSE);
+    fst_check(stub_lookups == 2);
+
+    SWITCH_STANDARD_STREAM(stream);
+    switch_dns_cache_stats(&stream);
+    fst_check(strstr((char *) stream.data, "a.example") != NULL);
+    fst_check(strstr((char *) stream.data, "(not found)") != NULL);
+    switch_safe_free(stream.data);
+
+    fst_check(switch_dns_cache_flush("a.example") == 1);
+    fst_check(switch_dns_cache_flush(NULL) == 1);
+
+    /* a full cache drops the least recently used name */
+    switch_dns_cache_set(60, 5, 30, 2);
+    stub_lookups = 0;
+    switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf));
+    switch_resolve_host_family("b.example", AF_INET, buf, sizeof(buf));
+    switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf));
+    switch_resolve_host_family("c.example", AF_INET, buf, sizeof(buf));
+    fst_check(stub_lookups == 3);
+    switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf));
+    fst_check(stub_lookups == 3);
+    switch_resolve_host_family("b.example", AF_INET, buf, sizeof(buf));
+    fst_check(stub_lookups == 4);
+    switch_dns_cache_flush(NULL);
+
+    /* an expired answer is served while it is looked up again in the background */
+    switch_dns_cache_set(1, 5, 30, 100);
+    stub_lookups = 0;
+    fst_check(switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf)) == SWITCH_STATUS_SUCCESS);
+    stub_generation = 1;
+    switch_sleep(2100000);
+    fst_check(switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf)) == SWITCH_STATUS_SUCCESS);
+    fst_check_string_equals(buf, "192.0.2.1");
+
+    for (i = 0; i < 50 && stub_lookups < 2; i++) {
+        switch_sleep(20000);
+    }
+
+    fst_check(switch_resolve_host_family("a.example", AF_INET, buf, sizeof(buf)) == SWITCH_STATUS_SUCCESS);
+    fst_check_string_equals(buf, "192.0.2.101");
+    fst_check(stub_lookups == 2);
+    stub_generation = 0;
+    switch_dns_cache_flush(NULL);
+
+    /* records a module resolved itself */
+    switch_dns_cache_set(60, 5, 30, 100);
+    fst_check(switch_dns_cache_get_record("naptr", "4.3.2.1.e164.arpa", &answer) == SWITCH_STATUS_FALSE);
+    switch_dns_cache_put_record("naptr", "4.3.2.1.e164.arpa", "100 10 \"u\" \"E2U+sip\" \"!^.*$!sip:1234@example.com!\" .", 300, 0);
+    switch_dns_cache_put_record("naptr", "5.3.2.1.e164.arpa", NULL, 300, 0);
+    fst_check(switch_dns_cache_get_record("naptr", "4.3.2.1.e164.arpa", &answer) == SWITCH_STATUS_SUCCESS);
+    fst_check(answer && strstr(answer, "E2U+sip") != NULL);
+    switch_safe_free(answer);
+    fst_check(switch_dns_cache_get_record("naptr", "5.3.2.1.e164.arpa", &answer) == SWITCH_STATUS_NOTFOUND);
+    fst_check(answer == NULL);
+    fst_check(switch_dns_cache_flush(NULL) == 2);
+
+    switch_dns_cache_set_resolver(NULL);
+
+    /* the system resolver still sits behind it */
+    fst_check(switch_resolve_host_family("localhost", AF_INET, buf, sizeof(buf)) == SWITCH_STATUS_SUCCESS);
+    fst_check_string_equals(buf, "127.0.0.1");
+
+    switch_dns_cache_set(0, 0, 0, 0);
+}
+FST_TEST_END()
+
 
 FST_SUITE_END()
 
@@ -34,6 +34,36 @@
 
 #include <test/switch_test.h>
 
+static int binding_calls = 0;
+
+static switch_xml_t counting_binding(const char *section, const char *tag_name, const char *key_name, const char *key_value,
+									 switch_event_t *params, void *user_data)
+{
+	const char *text = "<document type=\"freeswitch/xml\"><section name=\"directory\">"
+		"<domain name=\"cached.com\"><user id=\"1000\"/></domain></section></document>";
+	const char *not_found = "<document type=\"freeswitch/xml\"><section name=\"result\"><result status=\"not found\"/></section></document>";
+
+	const char *user = params ? switch_event_get_header(params, "user") : NULL;
+
+	binding_calls++;
+
+	if (user && !strcmp(switch_str_nil(key_value), "cached.com")) {
+		char *user_text = switch_mprintf("<document type=\"freeswitch/xml\"><section name=\"directory\">"
+										 "<domain name=\"cached.com\"><user id=\"%s\"><params><param name=\"password\" value=\"%s-secret\"/>"
+										 "</params></user></domain></section></document>", user, user);
+		switch_xml_t xml = switch_xml_parse_str_dup(user_text);
+
+		switch_safe_free(user_text);
+		return xml;
+	}
+
+	if (!strcmp(switch_str_nil(key_value), "cached.com")) {
+		return switch_xml_parse_str_dup((char *)text);
+	}
+
+	return switch_xml_parse_str_dup((char *)not_found);
+}
+
 FST_MINCORE_BEGIN("./conf")
 {
 	FST_SUITE_BEGIN(switch_xml)
@@ -117,6 +147,127 @@ FST_MINCORE_BEGIN("./conf")
 			free(xml_string);
 		}
 		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_directory_index)
+		{
+			const char *text =
+				"<document type=\"freeswitch/xml\"><section name=\"directory\">"
+				"<domain name=\"example.com\"><groups>"
+				"<group name=\"sales\"><users><user id=\"1000\" number-alias=\"2000\"/><user id=\"1001\" ip=\"10.0.0.1\"/>"
+				"<user id=\"1002\" type=\"pointer\"/></users></group>"
+				"<group name=\"support\"><users><user id=\"1002\"/></users></group>"
+				"</groups><users><user id=\"1003\"/></users></domain>"
+				"<domain name=\"other.com\"><user id=\"1000\"/></domain>"
+				"</section></document>";
+			const char *names[] = { "1000", "2000", "1001", "1002", "1003", "9999", NULL };
+			switch_xml_t plain, plain_domain, x_root, x_domain, x_user, x_group, p_user, p_group;
+			const char *err = NULL;
+			int i;
+
+			fst_requires((plain = switch_xml_parse_str_dup((char *)text)));
+			switch_xml_set_root(switch_xml_parse_str_dup((char *)text));
+
+			fst_check(switch_xml_locate_user("id", "2000", "example.com", NULL, &x_root, &x_domain, &x_user, &x_group, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(x_user, "id"), "1000");
+			fst_check_string_equals(switch_xml_attr(x_group, "name"), "sales");
+
+			/* users outside any group are only searched by switch_xml_locate_user */
+			fst_check(switch_xml_locate_user_in_domain("1003", x_domain, &x_user, NULL) == SWITCH_STATUS_FALSE);
+			switch_xml_free(x_root);
+
+			fst_check(switch_xml_locate_user("id", "nobody", "example.com", "10.0.0.1", &x_root, &x_domain, &x_user, &x_group, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(x_user, "id"), "1001");
+			switch_xml_free(x_root);
+
+			fst_check(switch_xml_locate_user("id", "1000", "other.com", NULL, &x_root, &x_domain, &x_user, &x_group, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check(x_group == NULL);
+			fst_check_string_equals(switch_xml_attr(x_domain, "name"), "other.com");
+			switch_xml_free(x_root);
+
+			/* the indexed answers must match a walk of an identical tree that isn't installed */
+			plain_domain = switch_xml_find_child(switch_xml_find_child(plain, "section", "name", "directory"), "domain", "name", "example.com");
+			fst_requires(plain_domain);
+			fst_requires(switch_xml_locate_domain("example.com", NULL, &x_root, &x_domain) == SWITCH_STATUS_SUCCESS);
+
+			for (i = 0; names[i]; i++) {
+				switch_status_t a, b;
+
+				x_user = x_group = p_user = p_group = NULL;
+				a = switch_xml_locate_user_in_domain(names[i], x_domain, &x_user, &x_group);
+				b = switch_xml_locate_user_in_domain(names[i], plain_domain, &p_user, &p_group);
+				fst_check(a == b);
+
+				if (a == SWITCH_STATUS_SUCCESS && b == SWITCH_STATUS_SUCCESS) {
+					fst_check_string_equals(switch_xml_attr(x_user, "id"), switch_xml_attr(p_user, "id"));
+					fst_check_string_equals(switch_xml_attr(x_group, "name"), switch_xml_attr(p_group, "name"));
+				}
+			}
+
+			switch_xml_free(x_root);
+			switch_xml_free(plain);
+			switch_xml_reload(&err);
+		}
+		FST_TEST_END()
+
+		FST_TEST_BEGIN(test_binding_cache)
+		{
+			switch_xml_binding_t *binding = NULL;
+			switch_xml_t x_root, x_domain, x_user;
+
+			fst_requires(switch_xml_bind_search_function_ret(counting_binding, SWITCH_XML_SECTION_DIRECTORY, NULL, &binding) == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_xml_binding_cache_set("directory", 60, 60, NULL) == SWITCH_STATUS_SUCCESS);
+
+			binding_calls = 0;
+			fst_check(switch_xml_locate_domain("cached.com", NULL, &x_root, &x_domain) == SWITCH_STATUS_SUCCESS);
+			switch_xml_free(x_root);
+			fst_check(switch_xml_locate_domain("cached.com", NULL, &x_root, &x_domain) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(x_domain, "name"), "cached.com");
+			switch_xml_free(x_root);
+			fst_check(binding_calls == 1);
+
+			/* "not found" is remembered too */
+			fst_check(switch_xml_locate_domain("missing.com", NULL, &x_root, &x_domain) == SWITCH_STATUS_FALSE);
+			fst_check(switch_xml_locate_domain("missing.com", NULL, &x_root, &x_domain) == SWITCH_STATUS_FALSE);
+			fst_check(binding_calls == 2);
+
+			fst_check(switch_xml_binding_cache_flush("directory", "cached.com") == 1);
+			fst_check(switch_xml_locate_domain("cached.com", NULL, &x_root, &x_domain) == SWITCH_STATUS_SUCCESS);
+			switch_xml_free(x_root);
+			fst_check(binding_calls == 3);
+
+			/* users of one domain never share an answer, with or without a key template */
+			fst_check(switch_xml_locate_user("id", "alice", "cached.com", NULL, &x_root, &x_domain, &x_user, NULL, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(x_user, "id"), "alice");
+			switch_xml_free(x_root);
+			fst_check(switch_xml_locate_user("id", "bob", "cached.com", NULL, &x_root, &x_domain, &x_user, NULL, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(x_user, "id"), "bob");
+			fst_check_string_equals(switch_xml_attr(switch_xml_find_child(switch_xml_child(x_user, "params"), "param", "name", "password"), "value"), "bob-secret");
+			switch_xml_free(x_root);
+			fst_check(binding_calls == 5);
+			fst_check(switch_xml_locate_user("id", "alice", "cached.com", NULL, &x_root, &x_domain, &x_user, NULL, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(switch_xml_find_child(switch_xml_child(x_user, "params"), "param", "name", "password"), "value"), "alice-secret");
+			switch_xml_free(x_root);
+			fst_check(binding_calls == 5);
+
+			fst_check(switch_xml_binding_cache_set("directory", 60, 60, "${action}") == SWITCH_STATUS_SUCCESS);
+			fst_check(switch_xml_locate_user("id", "alice", "cached.com", NULL, &x_root, &x_domain, &x_user, NULL, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(x_user, "id"), "alice");
+			switch_xml_free(x_root);
+			fst_check(switch_xml_locate_user("id", "bob", "cached.com", NULL, &x_root, &x_domain, &x_user, NULL, NULL) == SWITCH_STATUS_SUCCESS);
+			fst_check_string_equals(switch_xml_attr(x_user, "id"), "bob");
+			switch_xml_free(x_root);
+			fst_check(binding_calls == 7);
+			fst_check(switch_xml_binding_cache_flush("directory", "bob") == 1);
+
+			switch_xml_binding_cache_set("directory", 0, 0, NULL);
+			binding_calls = 0;
+			fst_check(switch_xml_locate_domain("cached.com", NULL, &x_root, &x_domain) == SWITCH_STATUS_SUCCESS);
+			switch_xml_free(x_root);
+			fst_check(binding_calls == 1);
+
+			switch_xml_unbind_search_function(&binding);
+		}
+		FST_TEST_END()
 	}
 	FST_SUITE_END()
 }